@@ -1,13 +1,396 @@
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <ctype.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define UNSTR_INDEX_MMAP
+#endif
 
 #include "unstring.h"
 
+#if defined(__GNUC__)
+#define UNSTRING_TLS				__thread
+#elif defined(_MSC_VER)
+#define UNSTRING_TLS				__declspec(thread)
+#else
+#define UNSTRING_TLS				_Thread_local
+#endif
+
+#ifdef UNSTRING_ENABLE_STATS
+#define UNSTR_STATS_ADD(member, n)	(unstr_stats_local.member += (n))
+#define UNSTR_STATS_HEAP(n)			unstr_stats_heap((long)(n))
+static UNSTRING_TLS unstr_stats_t unstr_stats_local;
+static void unstr_stats_heap(long n);
+#else
+#define UNSTR_STATS_ADD(member, n)	((void)0)
+#define UNSTR_STATS_HEAP(n)			((void)0)
+#endif
+
+#ifdef UNSTRING_ENABLE_TRACE
+#if !defined(__GNUC__)
+/* 計測の終了にcleanup属性、ヒストグラムに__builtin_clzllを使う */
+#error "UNSTRING_ENABLE_TRACE requires GCC or Clang"
+#endif
+#include <time.h>
+typedef struct unstr_trace_scope_st {
+	unstr_trace_id_t id;
+	size_t bytes;
+	struct timespec start;
+} unstr_trace_scope_t;
+/* 関数を抜ける時にunstr_trace_leaveが呼ばれるので、途中のreturnも計測できる */
+#define UNSTR_TRACE(id, n)			\
+	unstr_trace_scope_t unstr_trace_scope __attribute__((cleanup(unstr_trace_leave))) = unstr_trace_enter((id), (n))
+#define UNSTR_TRACE_BYTES(n)		(unstr_trace_scope.bytes = (n))
+static UNSTRING_TLS unstr_trace_stat_t unstr_trace_local[UNSTR_TRACE_MAX];
+static UNSTRING_TLS unstr_trace_hook_t unstr_trace_hook;
+static UNSTRING_TLS void *unstr_trace_hook_arg;
+static UNSTRING_TLS unstr_bool_t unstr_trace_busy;
+static unstr_trace_scope_t unstr_trace_enter(unstr_trace_id_t id, size_t bytes);
+static void unstr_trace_leave(unstr_trace_scope_t *scope);
+static size_t unstr_trace_bucket(unsigned long long nsec);
+#else
+#define UNSTR_TRACE(id, n)			((void)0)
+#define UNSTR_TRACE_BYTES(n)		((void)0)
+#endif
+
+#ifdef UNSTRING_ENABLE_CACHE
+/* 32, 64, 128, 256, 512, 1024バイトのバッファを再利用する。
+ * スレッド毎に保持するので、スレッドを終了する前にunstr_cache_releaseを呼ぶこと
+ */
+#define UNSTRING_CACHE_MIN_SHIFT	(5)
+#define UNSTRING_CACHE_CLASSES		(6)
+#ifndef UNSTRING_CACHE_DEPTH
+#define UNSTRING_CACHE_DEPTH		(64)	/* 1種類当たりの最大保持数 */
+#endif
+typedef struct unstr_cache_st {
+	unstr_t *header[UNSTRING_CACHE_DEPTH];
+	size_t header_count;
+	void *buffer[UNSTRING_CACHE_CLASSES][UNSTRING_CACHE_DEPTH];
+	size_t buffer_count[UNSTRING_CACHE_CLASSES];
+} unstr_cache_t;
+static UNSTRING_TLS unstr_cache_t unstr_cache_local;
+#endif
+
+#ifdef UNSTRING_ENABLE_COW
+/* バッファの直前に置く参照数。データの16バイト境界を保つ大きさにする */
+#if defined(__GNUC__)
+typedef size_t unstr_refs_t;
+#define UNSTR_REFS_INIT(p)			(*(p) = 1)
+#define UNSTR_REFS_LOAD(p)			__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define UNSTR_REFS_ADD(p)			((void)__atomic_add_fetch((p), 1, __ATOMIC_RELAXED))
+#define UNSTR_REFS_SUB(p)			__atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+typedef volatile long unstr_refs_t;
+#define UNSTR_REFS_INIT(p)			(*(p) = 1)
+#define UNSTR_REFS_LOAD(p)			((size_t)*(p))
+#define UNSTR_REFS_ADD(p)			((void)_InterlockedIncrement(p))
+#define UNSTR_REFS_SUB(p)			((size_t)_InterlockedDecrement(p))
+#else
+#include <stdatomic.h>
+typedef atomic_size_t unstr_refs_t;
+#define UNSTR_REFS_INIT(p)			atomic_init((p), 1)
+#define UNSTR_REFS_LOAD(p)			atomic_load(p)
+#define UNSTR_REFS_ADD(p)			((void)atomic_fetch_add((p), 1))
+#define UNSTR_REFS_SUB(p)			(atomic_fetch_sub((p), 1) - 1)
+#endif
+typedef union unstr_shared_un {
+	unstr_refs_t refs;
+	char align[16];
+} unstr_shared_t;
+#define UNSTR_SHARED_SIZE			(sizeof(unstr_shared_t))
+#define UNSTR_SHARED(p)				((unstr_shared_t *)((p) - UNSTR_SHARED_SIZE))
+#define UNSTR_DETACH(str, keep)		unstr_buffer_detach((str), (keep))
+/* 他の文字列のバッファの一部を指す部分文字列。自身の領域を持たないのでheapは0 */
+typedef struct unstr_slice_st {
+	unstr_t str;
+	char *base;					/* 参照しているバッファの先頭 */
+	size_t heap;				/* 参照しているバッファのサイズ */
+} unstr_slice_t;
+#define UNSTR_IS_SLICE(s)			(((s)->heap == 0) && ((s)->data != NULL))
+/* unstr_explode_tokensの要素。全要素で1つのバッファを共有する */
+typedef unstr_slice_t unstr_token_t;
+#else
+#define UNSTR_SHARED_SIZE			(0)
+#define UNSTR_DETACH(str, keep)		((void)0)
+#define UNSTR_IS_SLICE(s)			(0)
+typedef unstr_t unstr_token_t;
+#endif
+
+#define UNSTR_NOT_FOUND				UNSTRING_NPOS
+/* 2進数で表したsize_tと符号が入る長さ */
+#define UNSTR_INT_DIGITS			((sizeof(size_t) * 8) + 1)
+#define UNSTR_DIGITS_LOWER			"0123456789abcdefghijklmnopqrstuvwxyz"
+#define UNSTR_DIGITS_UPPER			"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+
+/* クイックサーチの検索文字列と移動量表 */
+typedef struct unstr_search_st {
+	const unsigned char *x;
+	size_t m;
+	size_t table[256];
+} unstr_search_t;
+
+/* unstr_sscanfのフォーマットを分解したもの */
+struct unstr_sscanf_plan_st {
+	unstr_search_t head;		/* 先頭の読み飛ばす文字列 */
+	size_t count;				/* 区切り文字列の数(最大の取得数) */
+	unstr_search_t *sep;		/* 区切り文字列。xがNULLなら残り全てを取得 */
+};
+
+/* unstr_regex_tの記号。バイト値の後ろに文字列の終端と先頭を表す記号を置く */
+#define UNSTR_REGEX_EOT				(256)
+#define UNSTR_REGEX_BOT				(257)
+#define UNSTR_REGEX_SYMBOLS			(258)
+#define UNSTR_REGEX_SET_WORDS		((UNSTR_REGEX_SYMBOLS + 31) / 32)
+#define UNSTR_REGEX_HAS(set, c)		(((set)[(c) >> 5] >> ((c) & 31)) & 1u)
+#define UNSTR_REGEX_ADD(set, c)		((set)[(c) >> 5] |= (1u << ((c) & 31)))
+#define UNSTR_REGEX_MAX_NFA			(10000)	/* NFAの最大状態数 */
+#define UNSTR_REGEX_MAX_REPEAT		(1000)	/* {m,n}の最大値 */
+#define UNSTR_REGEX_MAX_DEPTH		(1000)	/* 括弧の最大の深さ */
+#ifndef UNSTRING_REGEX_CACHE_STATES
+#define UNSTRING_REGEX_CACHE_STATES	(1024)	/* 超えるとDFAを作り直す */
+#endif
+
+typedef enum {
+	UNSTR_REGEX_NODE_SET = 0,	/* 記号の集合に一致する1記号 */
+	UNSTR_REGEX_NODE_EMPTY,		/* 空文字列 */
+	UNSTR_REGEX_NODE_CONCAT,	/* left, rightの連結 */
+	UNSTR_REGEX_NODE_ALT,		/* leftかright */
+	UNSTR_REGEX_NODE_REPEAT		/* leftのmin回以上max回以下の繰り返し。maxが負なら上限無し */
+} unstr_regex_node_type_t;
+
+/* 正規表現の構文木の節 */
+typedef struct unstr_regex_node_st {
+	unstr_regex_node_type_t type;
+	int left;
+	int right;
+	int min;
+	int max;
+	unsigned int set[UNSTR_REGEX_SET_WORDS];
+} unstr_regex_node_t;
+
+typedef struct unstr_regex_parser_st {
+	const unsigned char *p;		/* 次に読む位置 */
+	unstr_regex_node_t *nodes;
+	size_t count;
+	size_t size;
+	size_t depth;
+	unstr_bool_t error;
+} unstr_regex_parser_t;
+
+typedef enum {
+	UNSTR_REGEX_STATE_SET = 0,	/* setに含まれる記号でoutへ進む */
+	UNSTR_REGEX_STATE_SPLIT,	/* 何も読まずにoutとout1へ進む */
+	UNSTR_REGEX_STATE_MATCH		/* 一致 */
+} unstr_regex_state_type_t;
+
+/* Thompson法で作るNFAの状態 */
+typedef struct unstr_regex_state_st {
+	unstr_regex_state_type_t type;
+	int out;
+	int out1;
+	unsigned int set[UNSTR_REGEX_SET_WORDS];
+} unstr_regex_state_t;
+
+typedef struct unstr_regex_nfa_st {
+	unstr_regex_state_t *states;
+	size_t count;
+	size_t size;
+	int start;
+	int match;
+} unstr_regex_nfa_t;
+
+/* 遅延構築するDFAの状態。キーは[一致済み][NFA状態..., -1][NFA状態..., -1]... */
+typedef struct unstr_regex_dstate_st {
+	size_t key;					/* keys内の位置 */
+	size_t len;					/* キーの長さ */
+	unsigned char match;		/* この位置で一致が終わる */
+	unsigned char dead;			/* これ以上一致しない */
+	unsigned char idle;			/* 検索開始直後と同じで、途中まで一致しているものが無い */
+} unstr_regex_dstate_t;
+
+typedef struct unstr_regex_dfa_st {
+	const unstr_regex_nfa_t *nfa;
+	unstr_bool_t unanchored;	/* 各位置から一致を始める */
+	unstr_bool_t accel;			/* idleの状態で先頭の固定文字列を読み飛ばす */
+	unstr_regex_dstate_t *states;
+	int *trans;					/* 状態×記号の種類の遷移先。負なら未作成 */
+	size_t count;
+	size_t size;
+	int *keys;
+	size_t keys_len;
+	size_t keys_size;
+	int *hash;					/* 状態番号+1。0は空き */
+	size_t hash_size;
+	int *init;					/* 検索開始直後の状態のキー */
+	size_t init_len;
+} unstr_regex_dfa_t;
+
+/* コンパイルした正規表現 */
+struct unstr_regex_st {
+	unstr_regex_nfa_t fwd;		/* 前から読むNFA */
+	unstr_regex_nfa_t rev;		/* 後ろから読むNFA */
+	unstr_regex_dfa_t search;	/* 一致の終わりを探す */
+	unstr_regex_dfa_t anchored;	/* 先頭から一致させる */
+	unstr_regex_dfa_t reverse;	/* 一致の終わりから始まりを探す */
+	unsigned short classes[UNSTR_REGEX_SYMBOLS];	/* 記号の種類 */
+	int rep[UNSTR_REGEX_SYMBOLS];	/* 種類毎の代表の記号 */
+	size_t nclass;
+	unstr_search_t prefix;		/* 一致の先頭に必ずある固定文字列 */
+	char *prefix_data;
+	unsigned int *mark;			/* 以下はDFAを作る時の作業領域 */
+	size_t mark_count;
+	unsigned int gen;
+	int *stack;
+	int *key;
+};
+
+/* unstr_compact_tの本体。長さの直後に内容と終端を置き、容量は持たない */
+struct unstr_compact_st {
+	unsigned int length;
+	char data[4];
+};
+#define UNSTR_COMPACT_MAX_LENGTH	((size_t)(unsigned int)-1)
+#define UNSTR_COMPACT_SIZE(len)		(offsetof(unstr_compact_t, data) + (len) + 1)
+
+/* unstr_index_tのファイルの見出し。メモリ上でも同じ並びで先頭に置く */
+#define UNSTR_INDEX_MAGIC			"UNSTRIDX"
+#define UNSTR_INDEX_ORDER			(0x01020304u)	/* バイト順の確認用 */
+#define UNSTR_INDEX_WORD			((unsigned int)(sizeof(int) | (sizeof(size_t) << 8)))
+#define UNSTR_INDEX_BLOCK			(32)	/* 区間最小値のブロックの大きさ */
+#define UNSTR_INDEX_SECTIONS		(5)
+#define UNSTR_INDEX_ALIGN(n)		(((n) + 7) & ~(size_t)7)
+typedef struct unstr_index_header_st {
+	char magic[8];
+	unsigned int order;
+	unsigned int word;			/* intとsize_tの大きさ */
+	size_t length;				/* 文字列長 */
+	size_t size;				/* 索引全体の大きさ */
+} unstr_index_header_t;
+
+/* 接尾辞配列の索引。全ての配列はblockの中を指す */
+struct unstr_index_st {
+	const char *text;			/* 複製した文字列('\0'で終わる) */
+	size_t length;
+	const int *sa;				/* 接尾辞配列 */
+	const int *lcp;				/* lcp[i]はsa[i - 1]とsa[i]の共通接頭辞の長さ */
+	const int *sa_table;		/* saのブロック毎の最小値のスパーステーブル */
+	const int *lcp_table;		/* lcpのブロック毎の最小値のスパーステーブル */
+	size_t blocks;				/* ブロック数 */
+	char *block;				/* 見出しから始まる索引全体 */
+	size_t size;
+	unstr_bool_t mapped;		/* blockをmmapした場合はUNSTRING_TRUE */
+};
+
+/* 16進数とBASE64の変換処理。書き込んだ長さか、不正な入力ならUNSTR_NOT_FOUNDを返す */
+typedef size_t (*unstr_codec_func_t)(char *dst, const unsigned char *src, size_t len);
+#define UNSTR_BASE64_CHARS			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+
 static void *unstr_malloc(size_t size);
 static void *unstr_realloc(void *p, size_t size, size_t len);
+static unstr_t *unstr_header_new(void);
+static void unstr_header_free(unstr_t *str);
+static char *unstr_buffer_new(size_t *heap);
+static void unstr_buffer_free(char *p, size_t heap);
+static char *unstr_buffer_resize(char *p, size_t heap, size_t *size, size_t len);
+#ifdef UNSTRING_ENABLE_COW
+static void unstr_buffer_detach(unstr_t *str, size_t keep);
+#endif
 static unstr_bool_t unstr_check_heap_size(const unstr_t *str, size_t size);
+static FILE *unstr_file_open(const unstr_t *filename, const char *mode);
+static void unstr_search_init(unstr_search_t *s, const char *x, size_t m);
+static size_t unstr_search_exec(const unstr_search_t *s, const char *y, size_t n, size_t offset);
+static size_t unstr_search_count(const unstr_search_t *s, const char *y, size_t n);
+static size_t unstr_count_byte(const unsigned char *p, size_t len, unsigned char c);
+static void unstr_search_init_case(unstr_search_t *s, const char *x, size_t m);
+static size_t unstr_search_exec_case(const unstr_search_t *s, const char *y, size_t n, size_t offset);
+static int unstr_memcasecmp(const unsigned char *s1, const unsigned char *s2, size_t len);
+static void unstr_convert_case(char *p, size_t len, char from, int diff);
+#if defined(__SSE2__)
+static unsigned int unstr_bit_count(unsigned int bits);
+#endif
+#if defined(__SSE2__)
+static __m128i unstr_reverse_block(__m128i v);
+#endif
+static void unstr_reverse_copy(char *dst, const char *src, size_t len);
+static void unstr_reverse_swap(char *p, size_t len);
+#if defined(__SSE2__)
+static size_t unstr_utf8_check_block(const unsigned char *p, size_t len);
+#endif
+static size_t unstr_utf8_check(const unsigned char *p, size_t len);
+static size_t unstr_utf8_count(const unsigned char *p, size_t len);
+static size_t unstr_utf8_seek(const unsigned char *p, size_t len, size_t index);
+static size_t unstr_format_int(char *end, int num, size_t physics, const char *digits);
+static unstr_t *unstr_file_read(unstr_t *str, FILE *fp);
+static void unstr_replace_exec(unstr_t *str, const char *data, size_t len, const unstr_search_t *s, const unstr_t *replace);
+static unstr_bool_t unstr_strtok_next(const unstr_t *str, const char *delim, size_t *index, size_t *start, size_t *len);
+static void unstr_batch_item(unstr_t *const *list, const unstr_view_t *views, size_t i, unstr_view_t *item);
+static size_t unstr_strpos_each(unstr_t *const *list, const unstr_view_t *views, size_t len, const unstr_t *search, int *result);
+static size_t unstr_substr_count_each(unstr_t *const *list, const unstr_view_t *views, size_t len, const unstr_t *search, size_t *result);
+static size_t unstr_strcmp_each(unstr_t *const *list, const unstr_view_t *views, size_t len, const unstr_t *s2, int *result);
+static unstr_bool_t unstr_replace_each(unstr_t **dst, unstr_t *const *list, const unstr_view_t *views, size_t len, const unstr_t *search, const unstr_t *replace);
+static size_t unstr_sscanf_vexec(const unstr_sscanf_plan_t *plan, const unstr_t *data, va_list list);
+static unstr_bool_t unstr_sscanf_next(const unstr_sscanf_plan_t *plan, const unstr_t *data, size_t *i, size_t *pos, unstr_view_t *view);
+static int unstr_regex_node(unstr_regex_parser_t *ps, unstr_regex_node_type_t type, int left, int right);
+static int unstr_regex_parse_alt(unstr_regex_parser_t *ps);
+static int unstr_regex_parse_concat(unstr_regex_parser_t *ps);
+static int unstr_regex_parse_repeat(unstr_regex_parser_t *ps);
+static int unstr_regex_parse_atom(unstr_regex_parser_t *ps);
+static unstr_bool_t unstr_regex_parse_bracket(unstr_regex_parser_t *ps, unsigned int *set);
+static int unstr_regex_parse_escape(unstr_regex_parser_t *ps, unsigned int *set);
+static unstr_bool_t unstr_regex_parse_number(unstr_regex_parser_t *ps, int *num);
+static unstr_bool_t unstr_regex_add_ctype(unsigned int *set, const char *name, size_t len, unstr_bool_t negate);
+static int unstr_regex_add_state(unstr_regex_nfa_t *nfa, unstr_regex_state_type_t type, int out, int out1, const unsigned int *set);
+static int unstr_regex_emit(unstr_regex_nfa_t *nfa, const unstr_regex_node_t *nodes, int n, int next, unstr_bool_t reverse);
+static unstr_bool_t unstr_regex_prefix(const unstr_regex_node_t *nodes, int n, char *buf, size_t *len);
+static int unstr_regex_compare_int(const void *a, const void *b);
+static void unstr_regex_next_gen(unstr_regex_t *re);
+static void unstr_regex_closure(unstr_regex_t *re, const unstr_regex_nfa_t *nfa, int s, size_t *len);
+static int unstr_regex_intern(unstr_regex_t *re, unstr_regex_dfa_t *dfa, size_t len, unstr_bool_t *flushed);
+static int unstr_regex_start(unstr_regex_t *re, unstr_regex_dfa_t *dfa);
+static int unstr_regex_step(unstr_regex_t *re, unstr_regex_dfa_t *dfa, int si, int cls);
+static int unstr_regex_anchor(unstr_regex_t *re, unstr_regex_dfa_t *dfa, int s, int sym);
+static size_t unstr_regex_forward(unstr_regex_t *re, unstr_regex_dfa_t *dfa, const unsigned char *t, size_t n, size_t pos);
+static size_t unstr_regex_backward(unstr_regex_t *re, const unsigned char *t, size_t n, size_t end, size_t pos);
+static size_t unstr_regex_exec(unstr_regex_t *re, const unstr_t *str, size_t offset, unstr_view_t *match);
+static void unstr_regex_dfa_free(unstr_regex_dfa_t *dfa);
+static unstr_bool_t unstr_codec_into(unstr_t *dst, const unstr_t *src, size_t size, unstr_codec_func_t func);
+#if defined(__SSE2__)
+static __m128i unstr_hex_chars(__m128i v);
+static __m128i unstr_hex_values(__m128i v);
+static __m128i unstr_base64_chars(__m128i v);
+static __m128i unstr_base64_values(__m128i v);
+#endif
+static int unstr_hex_value(unsigned char c);
+static int unstr_base64_value(unsigned char c);
+static size_t unstr_hex_encode(char *dst, const unsigned char *src, size_t len);
+static size_t unstr_hex_decode(char *dst, const unsigned char *src, size_t len);
+static size_t unstr_base64_encode_exec(char *dst, const unsigned char *src, size_t len);
+static size_t unstr_base64_decode_exec(char *dst, const unsigned char *src, size_t len);
+static size_t unstr_index_layout(size_t length, size_t *offset);
+static unstr_bool_t unstr_index_attach(unstr_index_t *idx, char *block, size_t size);
+static size_t unstr_index_log2(size_t x);
+static size_t unstr_index_levels(size_t blocks);
+static unstr_bool_t unstr_sais(const int *s, int *sa, int n, int upper);
+static unstr_bool_t unstr_sais_induce(const int *s, int *sa, int n, int upper, const unsigned char *ls, const int *sum_l, const int *sum_s, const int *lms, int m);
+static unstr_bool_t unstr_index_lcp(unstr_index_t *idx, int *s);
+static void unstr_index_build_table(const unstr_index_t *idx, const int *arr, int *table);
+static unstr_bool_t unstr_index_check(const int *arr, size_t n, size_t upper);
+static int unstr_index_min(const unstr_index_t *idx, const int *arr, const int *table, size_t begin, size_t end);
+static size_t unstr_index_range(const unstr_index_t *idx, const unstr_t *search, size_t *end);
+static int unstr_index_compare_size(const void *a, const void *b);
 
 /**
  * @brief		メモリを確保し領域をしるしで埋める。
@@ -17,6 +400,7 @@ static unstr_bool_t unstr_check_heap_size(const unstr_t *str, size_t size);
 static void *unstr_malloc(size_t size)
 {
 	void *p = malloc(size);
+	UNSTR_STATS_ADD(alloc_count, 1);
 	if(p == NULL){
 		/* 領域の確保に失敗した場合、perrorを呼び出す。 */
 		perror("unstr_malloc:");
@@ -35,6 +419,11 @@ static void *unstr_malloc(size_t size)
  */
 static void *unstr_realloc(void *p, size_t size, size_t len)
 {
+	if(p == NULL){
+		UNSTR_STATS_ADD(alloc_count, 1);
+	} else {
+		UNSTR_STATS_ADD(realloc_count, 1);
+	}
 	p = realloc(p, size);
 	if(p == NULL){
 		/* 領域の確保に失敗した場合、perrorを呼び出す。 */
@@ -49,986 +438,6103 @@ static void *unstr_realloc(void *p, size_t size, size_t len)
 }
 
 /**
- * @brief		文字列を拡張する際に領域の確保が必要か計算する
- * @param[in]	str		計算を行う文字列
- * @param[in]	size	拡張する文字列の長さ
- * @return		判定結果
- * @return		UNSTRING_TRUE	必要
- * @return		UNSTRING_FALSE	不要
- */
-static unstr_bool_t unstr_check_heap_size(const unstr_t *str, size_t size)
-{
-	return (((str->length + size) >= str->heap) ? UNSTRING_TRUE : UNSTRING_FALSE);
-}
-
-/**
- * @brief		文字列のバッファを拡張する
- * @param[in]	str		拡張対象
- * @param[in]	size	増加させる量
- * @return		無し
- * @public
+ * @brief		unstr_t本体を確保する
+ * @return		空のunstr_t
+ * @par			詳細:
+ * UNSTRING_ENABLE_CACHEを定義した場合は、このスレッドで開放したものを再利用する。
  */
-unstr_t *unstr_alloc(unstr_t *str, size_t size)
+static unstr_t *unstr_header_new(void)
 {
+	unstr_t *str = 0;
+#ifdef UNSTRING_ENABLE_CACHE
+	if(unstr_cache_local.header_count != 0){
+		UNSTR_STATS_ADD(alloc_count, 1);
+		UNSTR_STATS_ADD(cache_hit, 1);
+		str = unstr_cache_local.header[--unstr_cache_local.header_count];
+	}
+#endif
 	if(str == NULL){
-		str = unstr_malloc(sizeof(unstr_t));
-		str->length = 0;
-		str->heap = 0;
-		str->data = NULL;
+		str = (unstr_t *)unstr_malloc(sizeof(unstr_t));
 	}
-	/* 頻繁に確保すると良くないらしいので大まかに確保して
-	 * 確保する回数を減らす。
-	 */
-	str->heap += size + (str->heap >> 1);
-	str->data = unstr_realloc(str->data, str->heap, str->length);
+	str->length = 0;
+	str->heap = 0;
+	str->data = NULL;
 	return str;
 }
 
 /**
- * @brief		引数で渡された文字列をunstr_tで初期化する
- * @param[in]	str		文字列
- * @return		unstr_tに変換された文字列
- * @public
+ * @brief		unstr_t本体を開放する
+ * @param[in]	str		開放するunstr_t。バッファは開放済みであること
+ * @return		無し
  */
-unstr_t *unstr_init(const char *str)
+static void unstr_header_free(unstr_t *str)
 {
-	size_t size = 0;
-	unstr_t *data = 0;
-	if(str == NULL) return NULL;
-	size = strlen(str);
-	data = unstr_alloc(NULL, size + 1);
-	memcpy(data->data, str, size);
-	data->data[size] = '\0';
-	data->length = size;
-	return data;
+#ifdef UNSTRING_ENABLE_CACHE
+	if(unstr_cache_local.header_count < UNSTRING_CACHE_DEPTH){
+		unstr_cache_local.header[unstr_cache_local.header_count++] = str;
+		return;
+	}
+#endif
+	free(str);
 }
 
 /**
- * @brief		文字列の領域だけ確保して初期化する。
- * @param[in]	size	確保するunstr_t型のバッファサイズ
- * @return		空のunstr_t型
- * @public
+ * @brief			文字列のバッファを新しく確保する
+ * @param[in,out]	heap	確保するサイズ。再利用する場合は実際に使えるサイズに切り上げる
+ * @return			確保した領域へのポインタ
+ * @par				詳細:
+ * UNSTRING_ENABLE_CACHEを定義した場合、1024バイト以下はサイズ毎に再利用する。
+ * UNSTRING_ENABLE_COWを定義した場合、領域の直前に参照数を置く。
  */
-unstr_t *unstr_init_memory(size_t size)
+static char *unstr_buffer_new(size_t *heap)
 {
-	unstr_t *data = 0;
-	if(size == 0) return NULL;
-	data = unstr_alloc(NULL, size);
-	/* 長さ0の文字列扱い */
-	data->data[0] = '\0';
-	data->length = 0;
-	return data;
+	char *p = 0;
+#ifdef UNSTRING_ENABLE_CACHE
+	size_t c = 0;
+	while((c < UNSTRING_CACHE_CLASSES) && (((size_t)1 << (c + UNSTRING_CACHE_MIN_SHIFT)) < *heap)){
+		c++;
+	}
+	if(c < UNSTRING_CACHE_CLASSES){
+		/* 同じ大きさに揃えておくと開放時に同じ種類へ戻せる */
+		*heap = (size_t)1 << (c + UNSTRING_CACHE_MIN_SHIFT);
+		if(unstr_cache_local.buffer_count[c] != 0){
+			UNSTR_STATS_ADD(alloc_count, 1);
+			UNSTR_STATS_ADD(cache_hit, 1);
+			p = (char *)unstr_cache_local.buffer[c][--unstr_cache_local.buffer_count[c]];
+			memset(p + UNSTR_SHARED_SIZE, UNSTRING_MEMORY_STAMP, *heap);
+		}
+	}
+#endif
+	if(p == NULL){
+		p = (char *)unstr_realloc(NULL, *heap + UNSTR_SHARED_SIZE, 0);
+		if(p == NULL){
+			return NULL;
+		}
+	}
+	UNSTR_STATS_HEAP(*heap);
+#ifdef UNSTRING_ENABLE_COW
+	UNSTR_REFS_INIT(&(((unstr_shared_t *)p)->refs));
+#endif
+	return p + UNSTR_SHARED_SIZE;
 }
 
 /**
- * @brief		文字列(unstr_t)を開放する
- * @param[in]	str		開放するunstr_t型
+ * @brief		文字列のバッファを開放する
+ * @param[in]	p		開放する領域
+ * @param[in]	heap	領域のサイズ
  * @return		無し
- * @public
+ * @par			詳細:
+ * 共有している場合は参照数を減らすだけで、最後の参照の時に開放する。
+ * 別のスレッドで確保した領域も、このスレッドの保持数に空きがあれば再利用する。
  */
-void unstr_free_func(unstr_t *str)
+static void unstr_buffer_free(char *p, size_t heap)
 {
-	if(str != NULL){
-		free(str->data);
-		str->data = NULL;
-		str->length = 0;
-		str->heap = 0;
+#ifdef UNSTRING_ENABLE_CACHE
+	size_t c = UNSTRING_CACHE_CLASSES;
+#endif
+	if(p == NULL){
+		return;
 	}
-	free(str);
+#ifdef UNSTRING_ENABLE_COW
+	/* 参照が1つなら他のスレッドが増やすことはないので、不可分操作を省ける */
+	if((UNSTR_REFS_LOAD(&(UNSTR_SHARED(p)->refs)) != 1)
+	&& (UNSTR_REFS_SUB(&(UNSTR_SHARED(p)->refs)) != 0)){
+		return;
+	}
+#endif
+	UNSTR_STATS_HEAP(-(long)heap);
+	p -= UNSTR_SHARED_SIZE;
+#ifdef UNSTRING_ENABLE_CACHE
+	/* heap以下で最大の種類に入れる。最大の種類の倍以上ある領域は保持し続けると
+	 * 小さな確保に大きな領域を渡すことになるので、再利用せずに開放する
+	 */
+	if(heap >= ((size_t)1 << (UNSTRING_CACHE_CLASSES + UNSTRING_CACHE_MIN_SHIFT))){
+		c = 0;
+	}
+	while((c > 0) && (((size_t)1 << (c - 1 + UNSTRING_CACHE_MIN_SHIFT)) > heap)){
+		c--;
+	}
+	if((c > 0) && (unstr_cache_local.buffer_count[c - 1] < UNSTRING_CACHE_DEPTH)){
+		unstr_cache_local.buffer[c - 1][unstr_cache_local.buffer_count[c - 1]++] = p;
+		return;
+	}
+#endif
+	free(p);
 }
 
 /**
- * @brief		引数で渡された文字列を開放する
- * @param[in]	size	開放する文字列(unstr_t)の数
- * @param[in]	...		開放する文字列(unstr_t)
- * @return		無し
- * @public
+ * @brief			文字列のバッファを拡張する
+ * @param[in]		p		拡張する領域
+ * @param[in]		heap	領域のサイズ
+ * @param[in,out]	size	新しいサイズ。新しく確保した場合は切り上げることがある
+ * @param[in]		len		使用している長さ
+ * @return			拡張した領域へのポインタ
+ * @par				詳細:
+ * 共有している場合は新しく確保してlenバイトと終端をコピーし、元の参照を手放す。
  */
-void unstr_delete(size_t size, ...)
+static char *unstr_buffer_resize(char *p, size_t heap, size_t *size, size_t len)
 {
-	unstr_t *str = 0;
-	va_list list;
-	va_start(list, size);
-	while(size--){
-		str = va_arg(list, unstr_t *);
-		unstr_free(str);
+	char *ret = 0;
+#ifdef UNSTRING_ENABLE_COW
+	if(UNSTR_REFS_LOAD(&(UNSTR_SHARED(p)->refs)) != 1){
+		ret = unstr_buffer_new(size);
+		if(ret != NULL){
+			memcpy(ret, p, len);
+			ret[len] = '\0';
+			unstr_buffer_free(p, heap);
+		}
+		return ret;
 	}
-	va_end(list);
+#endif
+	ret = (char *)unstr_realloc(p - UNSTR_SHARED_SIZE, *size + UNSTR_SHARED_SIZE, len + UNSTR_SHARED_SIZE);
+	if(ret == NULL){
+		return NULL;
+	}
+	UNSTR_STATS_HEAP(*size - heap);
+	return ret + UNSTR_SHARED_SIZE;
 }
 
+#ifdef UNSTRING_ENABLE_COW
 /**
- * @brief			空文字列で初期化する。領域は開放しない。
- * @param[in,out]	str		初期化する文字列
+ * @brief			共有しているバッファを書き込む前に切り離す
+ * @param[in,out]	str		対象文字列
+ * @param[in]		keep	新しいバッファに残す長さ
  * @return			無し
- * @public
+ * @par				詳細:
+ * 共有していない場合は何もしない。keepより後ろの内容は残らない。
+ * 部分文字列は常に切り離し、長さに合わせたバッファを持つ通常の文字列にする。
  */
-void unstr_zero(unstr_t *str)
+static void unstr_buffer_detach(unstr_t *str, size_t keep)
 {
-	if(str != NULL){
-		if(str->data != NULL){
-			str->data[0] = '\0';
+	char *p = 0;
+	char *base = 0;
+	size_t base_heap = 0;
+	size_t heap = 0;
+	if((str == NULL) || (str->data == NULL)){
+		return;
+	}
+	if(UNSTR_IS_SLICE(str)){
+		base = ((unstr_slice_t *)str)->base;
+		base_heap = ((unstr_slice_t *)str)->heap;
+		heap = str->length + 1;
+	} else {
+		if(UNSTR_REFS_LOAD(&(UNSTR_SHARED(str->data)->refs)) == 1){
+			return;
 		}
-		str->length = 0;
+		base = str->data;
+		base_heap = str->heap;
+		heap = str->heap;
 	}
+	p = unstr_buffer_new(&heap);
+	if(p == NULL){
+		return;
+	}
+	if(keep > str->length){
+		keep = str->length;
+	}
+	memcpy(p, str->data, keep);
+	p[keep] = '\0';
+	unstr_buffer_free(base, base_heap);
+	str->data = p;
+	str->heap = heap;
 }
+#endif
 
 /**
- * @brief		文字列用の領域が確保されていることを確認する。
- * @param[in]	str		対象文字列
- * @return		確認結果
- * @return		UNSTRING_TRUE	確保済み
- * @return		UNSTRING_FALSE	確保なし
- * @public
+ * @brief		文字列を拡張する際に領域の確保が必要か計算する
+ * @param[in]	str		計算を行う文字列
+ * @param[in]	size	拡張する文字列の長さ
+ * @return		判定結果
+ * @return		UNSTRING_TRUE	必要
+ * @return		UNSTRING_FALSE	不要
  */
-unstr_bool_t unstr_isset(const unstr_t *str)
+static unstr_bool_t unstr_check_heap_size(const unstr_t *str, size_t size)
 {
-	unstr_bool_t ret = UNSTRING_FALSE;
-	if((str != NULL) && (str->data != NULL)){
-		ret = UNSTRING_TRUE;
-	} else {
-		ret = UNSTRING_FALSE;
-	}
-	return ret;
+	return (((str->length + size) >= str->heap) ? UNSTRING_TRUE : UNSTRING_FALSE);
 }
 
 /**
- * @brief		文字列が空またはNULLであるか確認する。
- * @param[in]	str		対象文字列
- * @return		確認結果
- * @return		UNSTRING_TRUE	空
- * @return		UNSTRING_FALSE	空ではない
- * @public
+ * @brief		ファイルを開く
+ * @param[in]	filename	ファイルパス
+ * @param[in]	mode		fopenのモード
+ * @return		ファイルポインタ。失敗した場合はNULL
+ * @par			詳細:
+ * 部分文字列は'\0'で終わっていないので、終端を付けた複製で開く。
  */
-unstr_bool_t unstr_empty(const unstr_t *str)
+static FILE *unstr_file_open(const unstr_t *filename, const char *mode)
 {
-	unstr_bool_t ret = UNSTRING_FALSE;
-	if((str == NULL) || (str->data == NULL) || (str->length <= 0)){
-		ret = UNSTRING_TRUE;
-	} else {
-		ret = UNSTRING_FALSE;
+	FILE *fp = 0;
+	unstr_t *path = 0;
+	if(unstr_empty(filename) || (mode == NULL)){
+		return NULL;
 	}
-	return ret;
+	if(filename->data[filename->length] == '\0'){
+		return fopen(filename->data, mode);
+	}
+	path = unstr_init_memory(filename->length + 2);
+	unstr_write(path, filename->data, 0, filename->length);
+	fp = fopen(path->data, mode);
+	unstr_free(path);
+	return fp;
 }
 
 /**
- * @brief			unstr_t型にバイナリをコピーする
- * @param[in,out]	us		コピー先
- * @param[in]		s		コピー元
- * @param[in]		offset	コピー先の開始位置
- * @param[in]		len		コピーする長さ
- * @return			コピー結果
- * @return			UNSTRING_TRUE	成功
- * @return			UNSTRING_FALSE	失敗
- * @public
- * @par				詳細:
- * lenが0だった場合は失敗にしない。
+ * @brief		クイックサーチの移動量表を作成する
+ * @param[out]	s		格納先
+ * @param[in]	x		検索文字列。sが使われている間は開放しないこと
+ * @param[in]	m		検索文字列の長さ
+ * @return		無し
+ * @par			詳細:
+ * 1バイトの検索文字列はmemchrなどで探すので、移動量表は作らない。
  */
-unstr_bool_t unstr_write(unstr_t *us, const char *bin, size_t offset, size_t len)
+static void unstr_search_init(unstr_search_t *s, const char *x, size_t m)
 {
-	size_t size = len + offset;
-	if(!unstr_isset(us) || (bin == NULL)){
-		return UNSTRING_FALSE;
+	size_t i = 0;
+	s->x = (const unsigned char *)x;
+	s->m = m;
+	if(m == 1){
+		return;
 	}
-	if(unstr_check_heap_size(us, size + 1)){
-		unstr_alloc(us, size + 1);
+	for(i = 0; i < 256; i++){
+		s->table[i] = m + 1;
+	}
+	for(i = 0; i < m; i++){
+		s->table[s->x[i]] = m - i;
 	}
-	memcpy(&(us->data[offset]), bin, len);
-	us->length = size;
-	us->data[us->length] = '\0';
-	return UNSTRING_TRUE;
 }
 
 /**
- * @brief		文字列の長さを返す
- * @param[in]	str		対象文字列
- * @return		文字列の長さ
- * @public
+ * @brief		クイックサーチで検索する
+ * @param[in]	s		unstr_search_initで作成した移動量表
+ * @param[in]	y		対象文字列
+ * @param[in]	n		対象文字列の長さ
+ * @param[in]	offset	検索開始位置
+ * @return		発見した位置。見つからない場合はUNSTR_NOT_FOUND
+ * @par			詳細:
+ * yの終端より後ろは読まないので、'\0'で終わっていなくても良い。
+ * 検索文字列が長さ0の場合はoffsetを返す。
  */
-size_t unstr_strlen(const unstr_t *str)
+static size_t unstr_search_exec(const unstr_search_t *s, const char *y, size_t n, size_t offset)
 {
-	return unstr_isset(str) ? str->length : 0;
+	const unsigned char *t = (const unsigned char *)y;
+	const unsigned char *p = 0;
+	size_t m = s->m;
+	size_t i = offset;
+	if((offset > n) || (m > (n - offset))){
+		return UNSTR_NOT_FOUND;
+	}
+	if(m == 1){
+		p = (const unsigned char *)memchr(t + offset, s->x[0], n - offset);
+		return (p == NULL) ? UNSTR_NOT_FOUND : (size_t)(p - t);
+	}
+	while(i <= (n - m)){
+		if(memcmp(s->x, t + i, m) == 0){
+			return i;
+		}
+		if((i + m) >= n){
+			break;
+		}
+		i += s->table[t[i + m]];
+	}
+	return UNSTR_NOT_FOUND;
 }
 
 /**
- * @brief		文字列のコピーを返す。
- * @param[in]	str		コピー元
- * @return		コピーした文字列
- * @public
+ * @brief		検索文字列の出現数を数える
+ * @param[in]	s		unstr_search_initで作成した移動量表
+ * @param[in]	y		対象文字列
+ * @param[in]	n		対象文字列の長さ
+ * @return		出現数。重なって出現したものも数える
  */
-unstr_t *unstr_copy(const unstr_t *str)
+static size_t unstr_search_count(const unstr_search_t *s, const char *y, size_t n)
 {
-	unstr_t *data = 0;
-	if(unstr_isset(str)){
-		data = unstr_init_memory(str->length + 2);
-		unstr_strcat(data, str);
+	size_t count = 0;
+	size_t pos = 0;
+	if(s->m == 1){
+		return unstr_count_byte((const unsigned char *)y, n, s->x[0]);
 	}
-	return data;
+	while((pos = unstr_search_exec(s, y, n, pos)) != UNSTR_NOT_FOUND){
+		count++;
+		pos++;
+	}
+	return count;
 }
 
 /**
- * @brief			文字列をコピーする。
- * @param[in,out]	s1		コピー先
- * @param[in]		s2		コピー元
- * @return			コピー結果
- * @return			UNSTRING_TRUE	成功
- * @return			UNSTRING_FALSE	失敗
- * @public
- * @par				詳細:
- * s2に空文字列だった場合、s1が空文字列になります。
+ * @brief		1バイトの出現数を数える
+ * @param[in]	p		対象領域
+ * @param[in]	len		対象領域の長さ
+ * @param[in]	c		数えるバイト
+ * @return		出現数
+ * @par			詳細:
+ * SSE2が使える場合は16バイトずつ比較して一致をバイト毎のカウンタに溜め、
+ * 溢れる前(255回毎)にまとめて足す。
  */
-unstr_bool_t unstr_strcpy(unstr_t *s1, const unstr_t *s2)
+static size_t unstr_count_byte(const unsigned char *p, size_t len, unsigned char c)
 {
-	if(!unstr_isset(s2)){
-		return UNSTRING_FALSE;
+	size_t count = 0;
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i target = _mm_set1_epi8((char)c);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc;
+	__m128i sum;
+	size_t j = 0;
+	while((i + 16) <= len){
+		acc = _mm_setzero_si128();
+		/* 一致したバイトは-1なので、引くとカウンタが1増える */
+		for(j = 0; (j < 255) && ((i + 16) <= len); j++, i += 16){
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), target));
+		}
+		sum = _mm_sad_epu8(acc, zero);
+		count += (size_t)_mm_cvtsi128_si32(sum) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
 	}
-	return unstr_write(s1, s2->data, 0, s2->length);
+#endif
+	for(; i < len; i++){
+		count += (p[i] == c);
+	}
+	return count;
 }
 
+/* ASCIIの大文字を小文字にする。それ以外はそのまま */
+#define UNSTR_FOLD(c)				((unsigned char)((c) + (((unsigned int)((unsigned char)(c) - 'A') < 26u) ? 0x20 : 0)))
+
 /**
- * @brief			unstr_t文字列にchar文字列をコピーする。
- * @param[in,out]	s1		コピー先
- * @param[in]		s2		コピー元
- * @return			コピー結果
- * @return			UNSTRING_TRUE	成功
- * @return			UNSTRING_FALSE	失敗
- * @public
+ * @brief		大文字小文字を区別せずにメモリを比較する
+ * @param[in]	s1		比較対象1
+ * @param[in]	s2		比較対象2
+ * @param[in]	len		比較する長さ
+ * @return		比較結果。memcmpと同じ
  */
-unstr_bool_t unstr_strcpy_char(unstr_t *s1, const char *s2)
+static int unstr_memcasecmp(const unsigned char *s1, const unsigned char *s2, size_t len)
 {
-	unstr_bool_t ret = UNSTRING_FALSE;
-	unstr_t *str = 0;
-	if(s2 != NULL){
-		str = unstr_init(s2);
-		ret = unstr_strcpy(s1, str);
-		unstr_free(str);
+	size_t i = 0;
+	int diff = 0;
+#if defined(__SSE2__)
+	const __m128i lo = _mm_set1_epi8('A' - 1);
+	const __m128i hi = _mm_set1_epi8('Z' + 1);
+	const __m128i d = _mm_set1_epi8(0x20);
+	__m128i a;
+	__m128i b;
+	/* 16バイトずつ小文字にして比較し、違いがあればその先は1バイトずつ調べる */
+	for(; (i + 16) <= len; i += 16){
+		a = _mm_loadu_si128((const __m128i *)(s1 + i));
+		b = _mm_loadu_si128((const __m128i *)(s2 + i));
+		a = _mm_add_epi8(a, _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi8(a, lo), _mm_cmplt_epi8(a, hi)), d));
+		b = _mm_add_epi8(b, _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi8(b, lo), _mm_cmplt_epi8(b, hi)), d));
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xffff){
+			break;
+		}
 	}
-	return ret;
+#endif
+	for(; i < len; i++){
+		diff = (int)UNSTR_FOLD(s1[i]) - (int)UNSTR_FOLD(s2[i]);
+		if(diff != 0){
+			return diff;
+		}
+	}
+	return 0;
 }
 
 /**
- * @brief			文字列を切り出してコピーする
- * @param[in,out]	s1		コピー先
- * @param[in]		s2		コピー元
- * @param[in]		size	コピーする長さ
- * @return			コピー結果
- * @return			UNSTRING_TRUE	成功
- * @return			UNSTRING_FALSE	失敗
- * @public
+ * @brief		大文字小文字を区別しないクイックサーチの移動量表を作成する
+ * @param[out]	s		格納先
+ * @param[in]	x		検索文字列。sが使われている間は開放しないこと
+ * @param[in]	m		検索文字列の長さ
+ * @return		無し
  */
-unstr_bool_t unstr_substr(unstr_t *s1, const unstr_t *s2, size_t len)
+static void unstr_search_init_case(unstr_search_t *s, const char *x, size_t m)
 {
-	if(!unstr_isset(s1) || unstr_empty(s2)){
-		return UNSTRING_FALSE;
+	size_t i = 0;
+	unsigned char c = 0;
+	s->x = (const unsigned char *)x;
+	s->m = m;
+	for(i = 0; i < 256; i++){
+		s->table[i] = m + 1;
 	}
-	if(s2->length < len){
-		len = s2->length;
+	for(i = 0; i < m; i++){
+		c = UNSTR_FOLD(s->x[i]);
+		s->table[s->x[i]] = m - i;
+		if((c >= 'a') && (c <= 'z')){
+			s->table[c] = m - i;
+			s->table[c - 0x20] = m - i;
+		}
 	}
-	return unstr_write(s1, s2->data, 0, len);
 }
 
 /**
- * @brief		char文字列を切り出してunstr_t文字列に変換する
- * @param[out]	str		コピー先文字列
- * @param[in]	c		対象文字列
- * @param[in]	size	コピーする長さ
- * @return		変換結果
- * @return		UNSTRING_TRUE	成功
- * @return		UNSTRING_FALSE	失敗
- * @public
+ * @brief		大文字小文字を区別せずにクイックサーチで検索する
+ * @param[in]	s		unstr_search_init_caseで作成した移動量表
+ * @param[in]	y		対象文字列
+ * @param[in]	n		対象文字列の長さ
+ * @param[in]	offset	検索開始位置
+ * @return		発見した位置。見つからない場合はUNSTR_NOT_FOUND
  */
-unstr_bool_t unstr_substr_char(unstr_t *str, const char *c, size_t len)
+static size_t unstr_search_exec_case(const unstr_search_t *s, const char *y, size_t n, size_t offset)
 {
-	unstr_t *data = 0;
-	unstr_bool_t ret = UNSTRING_FALSE;
-	if(c != NULL){
-		data = unstr_init(c);
-		ret = unstr_substr(str, data, len);
-		unstr_free(data);
+	const unsigned char *t = (const unsigned char *)y;
+	size_t m = s->m;
+	size_t i = offset;
+	unsigned char first = 0;
+	if((offset > n) || (m > (n - offset))){
+		return UNSTR_NOT_FOUND;
 	}
-	return ret;
+	if(m == 0){
+		return offset;
+	}
+	first = UNSTR_FOLD(s->x[0]);
+	while(i <= (n - m)){
+		if((UNSTR_FOLD(t[i]) == first) && (unstr_memcasecmp(s->x, t + i, m) == 0)){
+			return i;
+		}
+		if((i + m) >= n){
+			break;
+		}
+		i += s->table[t[i + m]];
+	}
+	return UNSTR_NOT_FOUND;
 }
 
 /**
- * @brief			文字列を結合する
- * @param[in,out]	s1		結合先文字列
- * @param[in]		s2		結合文字列
- * @return			変換結果
- * @return			UNSTRING_TRUE	成功
- * @return			UNSTRING_FALSE	失敗
- * @public
+ * @brief			ASCIIの大文字と小文字を変換する
+ * @param[in,out]	p		対象領域
+ * @param[in]		len		対象領域の長さ
+ * @param[in]		from	変換する範囲の先頭('a'または'A')
+ * @param[in]		diff	変換で加える値(-0x20または0x20)
+ * @return			無し
  * @par				詳細:
- * s1に変化が無い場合、UNSTRING_FALSEを返します。
+ * SSE2が使える場合は16バイトずつ変換する。0x80以上のバイトは変換しない。
  */
-unstr_bool_t unstr_strcat(unstr_t *s1, const unstr_t *s2)
+static void unstr_convert_case(char *p, size_t len, char from, int diff)
 {
-	if(!unstr_isset(s1) || unstr_empty(s2)){
-		return UNSTRING_FALSE;
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i lo = _mm_set1_epi8((char)(from - 1));
+	const __m128i hi = _mm_set1_epi8((char)(from + 26));
+	const __m128i d = _mm_set1_epi8((char)diff);
+	__m128i v;
+	__m128i mask;
+	for(; (i + 16) <= len; i += 16){
+		v = _mm_loadu_si128((const __m128i *)(p + i));
+		/* 0x80以上は符号付きで負になるので範囲外になる */
+		mask = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+		v = _mm_add_epi8(v, _mm_and_si128(mask, d));
+		_mm_storeu_si128((__m128i *)(p + i), v);
+	}
+#endif
+	for(; i < len; i++){
+		if(((unsigned char)(p[i] - from)) < 26u){
+			p[i] = (char)(p[i] + diff);
+		}
 	}
-	return unstr_write(s1, s2->data, s1->length, s2->length);
 }
 
+#if defined(__SSE2__)
 /**
- * @brief			unstr_t文字列にchar文字列を結合する
- * @param[in,out]	str		結合先文字列
- * @param[in]		c		結合文字列
- * @return			結合結果
- * @return			UNSTRING_TRUE	成功
- * @return			UNSTRING_FALSE	失敗
- * @public
+ * @brief		立っているビットを数える
+ * @param[in]	bits	対象
+ * @return		1のビットの数
  */
-unstr_bool_t unstr_strcat_char(unstr_t *str, const char *c)
+static unsigned int unstr_bit_count(unsigned int bits)
 {
-	unstr_t *data = 0;
-	unstr_bool_t ret = UNSTRING_FALSE;
-	if(c != NULL){
-		data = unstr_init(c);
-		ret = unstr_strcat(str, data);
-		unstr_free(data);
+#if defined(__GNUC__)
+	return (unsigned int)__builtin_popcount(bits);
+#else
+	unsigned int count = 0;
+	while(bits != 0){
+		bits &= bits - 1;
+		count++;
 	}
-	return ret;
+	return count;
+#endif
 }
+#endif
 
+#if defined(__SSE2__)
 /**
- * @brief		文字列を比較する
- * @param[in]	s1		比較文字列1
- * @param[in]	s2		比較文字列2
- * @return		比較結果
- * @return		0			同じ
- * @return		0x100		エラー
- * @return		上記以外	違う(文字コードの差分)
- * @public
+ * @brief		16バイトを逆順に並べ替える
+ * @param[in]	v		対象
+ * @return		並べ替えた値
  */
-int unstr_strcmp(const unstr_t *s1, const unstr_t *s2)
+static __m128i unstr_reverse_block(__m128i v)
 {
-	int ret = 0x100;
-	if(unstr_isset(s1) && unstr_isset(s2)){
-		if(s1->length == s2->length){
-			ret = memcmp(s1->data, s2->data, s1->length);
-		}
-	}
-	return ret;
+	/* 32bit単位、16bit単位の順に入れ替えてから、16bit内の2バイトを交換する */
+	v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
 }
+#endif
 
 /**
- * @brief		char文字列とunstr_t文字列を比較する
- * @param[in]	s1		比較文字列1
- * @param[in]	s2		比較文字列2
- * @return		比較結果
- * @return		0			同じ
- * @return		0x100		エラー
- * @return		上記以外	違う(文字コードの差分)
- * @public
+ * @brief		バイト列を逆順にコピーする
+ * @param[out]	dst		コピー先(srcと重ならないこと)
+ * @param[in]	src		コピー元
+ * @param[in]	len		コピーする長さ
+ * @return		無し
+ * @par			詳細:
+ * SSE2が使える場合は16バイトずつ反転する。
  */
-int unstr_strcmp_char(const unstr_t *s1, const char *s2)
+static void unstr_reverse_copy(char *dst, const char *src, size_t len)
 {
-	int ret = 0x100;
-	unstr_t *str = 0;
-	if(s2 != NULL){
-		str = unstr_init(s2);
-		ret = unstr_strcmp(s1, str);
-		unstr_free(str);
+	size_t i = 0;
+#if defined(__SSE2__)
+	for(; (i + 16) <= len; i += 16){
+		_mm_storeu_si128((__m128i *)(dst + len - i - 16),
+			unstr_reverse_block(_mm_loadu_si128((const __m128i *)(src + i))));
+	}
+#endif
+	for(; i < len; i++){
+		dst[len - i - 1] = src[i];
 	}
-	return ret;
 }
 
 /**
- * @brief		文字列を検索する
- * @param[in]	s1		比較文字列1
- * @param[in]	s2		比較文字列2
- * @return		比較結果
- * @return		アドレス	発見
- * @return		NULL		エラー
- * @public
+ * @brief			バイト列をその場で逆順にする
+ * @param[in,out]	p		対象領域
+ * @param[in]		len		対象領域の長さ
+ * @return			無し
+ * @par				詳細:
+ * SSE2が使える場合は両端から16バイトずつ読み込み、反転して入れ替える。
+ * 中央に残った32バイト未満は1バイトずつ交換する。
  */
-char* unstr_strstr(const unstr_t *s1, const unstr_t *s2)
+static void unstr_reverse_swap(char *p, size_t len)
 {
-	int pos = unstr_strpos(s1, s2);
-	if(pos >= 0){
-		return s1->data + pos;
+	size_t lo = 0;
+	size_t hi = len;
+	char c = 0;
+#if defined(__SSE2__)
+	__m128i head;
+	__m128i tail;
+	while((lo + 32) <= hi){
+		head = _mm_loadu_si128((const __m128i *)(p + lo));
+		tail = _mm_loadu_si128((const __m128i *)(p + hi - 16));
+		_mm_storeu_si128((__m128i *)(p + lo), unstr_reverse_block(tail));
+		_mm_storeu_si128((__m128i *)(p + hi - 16), unstr_reverse_block(head));
+		lo += 16;
+		hi -= 16;
+	}
+#endif
+	while((lo + 1) < hi){
+		c = p[lo];
+		p[lo++] = p[--hi];
+		p[hi] = c;
 	}
-	return NULL;
 }
 
+#if defined(__SSE2__)
 /**
- * @brief		unstr_t文字列をchar文字列で検索する
- * @param[in]	s1		比較文字列1
- * @param[in]	s2		比較文字列2
- * @return		比較結果
- * @return		アドレス	発見
- * @return		NULL		エラー
- * @public
+ * @brief		UTF-8として正しい16バイト単位の範囲を求める
+ * @param[in]	p		対象領域
+ * @param[in]	len		対象領域の長さ
+ * @return		先頭から正しいと確認できた長さ(16の倍数)
+ * @par			詳細:
+ * 各バイトについて1〜3バイト前の先頭バイトから継続バイトであるべきかを求め、
+ * 実際に継続バイトかどうかと比べる。冗長な表現、サロゲート、U+10FFFFを超える値は
+ * 直前のバイトとの組で判定する。戻り値の位置をまたぐ文字は検査していない。
  */
-char* unstr_strstr_char(const unstr_t *s1, const char *s2)
+static size_t unstr_utf8_check_block(const unsigned char *p, size_t len)
 {
-	char *ret = 0;
-	unstr_t *str = 0;
-	if(s2 != NULL){
-		str = unstr_init(s2);
-		ret = unstr_strstr(s1, str);
-		unstr_free(str);
+	const __m128i zero = _mm_setzero_si128();
+	/* 末尾の1〜3バイトで終わらない先頭バイトを見つける閾値 */
+	const __m128i tail = _mm_set_epi8((char)0xBF, (char)0xDF, (char)0xEF,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	__m128i prev = zero;
+	__m128i cur;
+	__m128i prev1;
+	__m128i prev2;
+	__m128i prev3;
+	__m128i need;
+	__m128i err;
+	size_t i = 0;
+	for(; (i + 16) <= len; i += 16){
+		cur = _mm_loadu_si128((const __m128i *)(p + i));
+		if(_mm_movemask_epi8(cur) == 0){
+			/* ASCIIだけなら前の16バイトが文字の途中で終わっていないかだけ調べる */
+			if((_mm_movemask_epi8(prev) != 0)
+			&& (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(prev, tail), zero)) != 0xFFFF)){
+				break;
+			}
+			prev = cur;
+			continue;
+		}
+		prev1 = _mm_or_si128(_mm_slli_si128(cur, 1), _mm_srli_si128(prev, 15));
+		prev2 = _mm_or_si128(_mm_slli_si128(cur, 2), _mm_srli_si128(prev, 14));
+		prev3 = _mm_or_si128(_mm_slli_si128(cur, 3), _mm_srli_si128(prev, 13));
+		/* 0xC0以上の1バイト後、0xE0以上の2バイト後、0xF0以上の3バイト後は継続バイト */
+		need = _mm_or_si128(_mm_subs_epu8(prev1, _mm_set1_epi8((char)0xBF)),
+			_mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8((char)0xDF)),
+			_mm_subs_epu8(prev3, _mm_set1_epi8((char)0xEF))));
+		/* 継続バイト(符号付きで-64未満)の有無が必要性と一致しなければ不正 */
+		err = _mm_cmpeq_epi8(_mm_cmpeq_epi8(need, zero),
+			_mm_cmplt_epi8(cur, _mm_set1_epi8((char)0xC0)));
+		/* 0xC0, 0xC1, 0xF5以上は現れない */
+		err = _mm_or_si128(err, _mm_cmpeq_epi8(_mm_and_si128(cur, _mm_set1_epi8((char)0xFE)), _mm_set1_epi8((char)0xC0)));
+		err = _mm_or_si128(err, _mm_cmpeq_epi8(_mm_max_epu8(cur, _mm_set1_epi8((char)0xF5)), cur));
+		/* E0の後は0xA0以上、EDの後は0x9F以下、F0の後は0x90以上、F4の後は0x8F以下 */
+		err = _mm_or_si128(err, _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xE0)),
+			_mm_cmpeq_epi8(_mm_min_epu8(cur, _mm_set1_epi8((char)0x9F)), cur)));
+		err = _mm_or_si128(err, _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xED)),
+			_mm_cmpeq_epi8(_mm_max_epu8(cur, _mm_set1_epi8((char)0xA0)), cur)));
+		err = _mm_or_si128(err, _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xF0)),
+			_mm_cmpeq_epi8(_mm_min_epu8(cur, _mm_set1_epi8((char)0x8F)), cur)));
+		err = _mm_or_si128(err, _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char)0xF4)),
+			_mm_cmpeq_epi8(_mm_max_epu8(cur, _mm_set1_epi8((char)0x90)), cur)));
+		if(_mm_movemask_epi8(err) != 0){
+			break;
+		}
+		prev = cur;
 	}
-	return ret;
+	return i;
 }
+#endif
 
 /**
- * @brief		対象文字列を区切り文字で切り、格納先に格納する。
- * @param[in]	str		対象文字列
- * @param[in]	delim	区切り文字列
- * @param[out]	len		配列の長さ
- * @return		unstr_tの配列
- * @public
+ * @brief		UTF-8として不正なバイトを探す
+ * @param[in]	p		対象領域
+ * @param[in]	len		対象領域の長さ
+ * @return		最初の不正な文字の位置。全て正しい場合はUNSTR_NOT_FOUND
+ * @par			詳細:
+ * RFC 3629に従い、冗長な表現、サロゲート、U+10FFFFを超える値を不正とする。
+ * SSE2が使える場合は16バイト単位で調べ、残りと不正な箇所の特定だけを1バイトずつ行う。
  */
-unstr_t **unstr_explode(const unstr_t *str, const char *delim, size_t *len)
+static size_t unstr_utf8_check(const unsigned char *p, size_t len)
 {
-	unstr_t *s = 0;
-	unstr_t **ret = 0;
-	size_t index = 0;
-	size_t size = 0;
-	size_t heap = 0;
-	if(unstr_empty(str)
-	|| (delim == NULL)
-	|| (strlen(delim) == 0)
-	|| (len == NULL)){
-		return NULL;
+	size_t i = 0;
+	size_t j = 0;
+	size_t need = 0;
+	unsigned char c = 0;
+	unsigned char lo = 0;
+	unsigned char hi = 0;
+#if defined(__SSE2__)
+	j = unstr_utf8_check_block(p, len);
+	/* 確認済みの範囲の継続バイト以外は文字の先頭なので、末尾3バイト内の先頭から調べ直す */
+	i = (j < 3) ? 0 : (j - 3);
+	while((i < j) && ((p[i] & 0xC0) == 0x80)){
+		i++;
 	}
-	while((s = unstr_strtok(str, delim, &index)) != NULL){
-		if(size >= heap){
-			heap = ((heap << 1) + 8);
-			ret = unstr_realloc(ret, heap * sizeof(unstr_t *), size * sizeof(unstr_t *));
+#endif
+	while(i < len){
+		c = p[i];
+		if(c < 0x80){
+			i++;
+			continue;
 		}
-		ret[size] = s;
-		size++;
+		/* 2バイト目の範囲で冗長な表現とサロゲートを弾く */
+		lo = 0x80;
+		hi = 0xBF;
+		if((c >= 0xC2) && (c <= 0xDF)){
+			need = 1;
+		} else if((c >= 0xE0) && (c <= 0xEF)){
+			need = 2;
+			if(c == 0xE0){
+				lo = 0xA0;
+			} else if(c == 0xED){
+				hi = 0x9F;
+			}
+		} else if((c >= 0xF0) && (c <= 0xF4)){
+			need = 3;
+			if(c == 0xF0){
+				lo = 0x90;
+			} else if(c == 0xF4){
+				hi = 0x8F;
+			}
+		} else {
+			return i;
+		}
+		if((need > (len - i - 1)) || (p[i + 1] < lo) || (p[i + 1] > hi)){
+			return i;
+		}
+		for(j = 2; j <= need; j++){
+			if((p[i + j] & 0xC0) != 0x80){
+				return i;
+			}
+		}
+		i += need + 1;
 	}
-	*len = size;
-	return ret;
+	return UNSTR_NOT_FOUND;
 }
 
 /**
- * @brief			自動拡張機能付きsprintf。細かいフォーマットには未対応。
- * @param[in,out]	str		格納先
- * @param[in]		format	フォーマット
- * @param[in]		...		可変引数
- * @return			unstr_t文字列
- * @public
+ * @brief		UTF-8の文字数を数える
+ * @param[in]	p		対象領域
+ * @param[in]	len		対象領域の長さ
+ * @return		文字数
  * @par			詳細:
- * formatが空文字列の場合を許容する
+ * 継続バイト(0x80〜0xBF)以外のバイトを数える。不正なバイトも1文字になる。
+ * SSE2が使える場合は16バイトずつ数える。
  */
-unstr_t *unstr_sprintf(unstr_t *str, const char *format, ...)
+static size_t unstr_utf8_count(const unsigned char *p, size_t len)
 {
-	va_list list;
-	unstr_t *unsp = 0;
-	char *sp = 0;
-	int ip = 0;
 	size_t i = 0;
-	if(format == NULL){
-		return NULL;
-	}
-	va_start(list, format);
-	if(unstr_isset(str)){
-		unstr_zero(str);
-	} else {
-		unstr_free(str);
-		str = unstr_init_memory(UNSTRING_HEAP_SIZE);
+	size_t cont = 0;
+#if defined(__SSE2__)
+	/* 符号付きで-64未満が継続バイト */
+	const __m128i limit = _mm_set1_epi8((char)0xC0);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum = zero;
+	__m128i acc;
+	size_t j = 0;
+	unsigned long long lane[2];
+	while((i + 16) <= len){
+		/* 8bitの計数が溢れる前に64bitへ足し込む */
+		acc = zero;
+		for(j = 0; (j < 255) && ((i + 16) <= len); j++, i += 16){
+			acc = _mm_sub_epi8(acc, _mm_cmplt_epi8(_mm_loadu_si128((const __m128i *)(p + i)), limit));
+		}
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(acc, zero));
 	}
-	while((sp = strchr(format, '%')) != NULL){
-		i = sp - format;
-		if(i > 0){
-			unsp = unstr_init_memory(i + 2);
-			unstr_substr_char(unsp, format, i);
-			unstr_strcat(str, unsp);
-			unstr_free(unsp);
-			format += i;
+	_mm_storeu_si128((__m128i *)lane, sum);
+	cont = (size_t)(lane[0] + lane[1]);
+#endif
+	for(; i < len; i++){
+		if((p[i] & 0xC0) == 0x80){
+			cont++;
 		}
-		if((*(format + 1)) == '\0'){
+	}
+	return len - cont;
+}
+
+/**
+ * @brief		UTF-8の文字番号からバイト位置を求める
+ * @param[in]	p		対象領域
+ * @param[in]	len		対象領域の長さ
+ * @param[in]	index	文字番号
+ * @return		バイト位置。indexが文字数と同じ場合はlen、超える場合はUNSTR_NOT_FOUND
+ */
+static size_t unstr_utf8_seek(const unsigned char *p, size_t len, size_t index)
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i limit = _mm_set1_epi8((char)0xC0);
+	size_t n = 0;
+#endif
+	if(index == 0){
+		return 0;
+	}
+#if defined(__SSE2__)
+	/* 目的の文字が含まれない16バイトは文字数だけ数えて飛ばす */
+	for(; (i + 16) <= len; i += 16){
+		n = 16 - unstr_bit_count((unsigned int)_mm_movemask_epi8(
+			_mm_cmplt_epi8(_mm_loadu_si128((const __m128i *)(p + i)), limit)));
+		if(n > index){
 			break;
 		}
-		format++;
-		switch(*format){
-		case 's':
-			sp = va_arg(list, char *);
-			unstr_strcat_char(str, sp);
-			break;
-		case '$':
-			unsp = va_arg(list, unstr_t*);
-			unstr_strcat(str, unsp);
-			break;
-		case 'd':
-			ip = va_arg(list, int);
-			unsp = unstr_itoa(ip, 10);
-			unstr_strcat(str, unsp);
-			unstr_free(unsp);
-			break;
-		case 'x':
-			ip = va_arg(list, int);
-			unsp = unstr_itoa(ip, 16);
-			unstr_strcat(str, unsp);
-			unstr_free(unsp);
-			break;
-		case 'X':
-			ip = va_arg(list, int);
-			unsp = unstr_itoa(ip, 16);
-			for(i = 0; i < unsp->length; i++){
-				unsp->data[i] = toupper(unsp->data[i]);
+		index -= n;
+	}
+#endif
+	for(; i < len; i++){
+		if((p[i] & 0xC0) != 0x80){
+			if(index == 0){
+				return i;
 			}
-			unstr_strcat(str, unsp);
-			unstr_free(unsp);
-			break;
-		case '%':
-			unstr_strcat_char(str, "%");
-			break;
-		default:
-			format--;
-			break;
+			index--;
 		}
-		format++;
 	}
-	unstr_strcat_char(str, format);
-	va_end(list);
+	return (index == 0) ? len : UNSTR_NOT_FOUND;
+}
+
+#ifdef UNSTRING_ENABLE_STATS
+/**
+ * @brief		確保中のバッファ量を更新し、最大値を記録する
+ * @param[in]	n		増減量
+ * @return		無し
+ */
+static void unstr_stats_heap(long n)
+{
+	unstr_stats_local.heap_live += n;
+	if(unstr_stats_local.heap_live > unstr_stats_local.heap_peak){
+		unstr_stats_local.heap_peak = unstr_stats_local.heap_live;
+	}
+}
+#endif
+
+#ifdef UNSTRING_ENABLE_TRACE
+/**
+ * @brief		計測を開始する
+ * @param[in]	id		計測対象の関数
+ * @param[in]	bytes	処理するバイト数
+ * @return		計測状態
+ */
+static unstr_trace_scope_t unstr_trace_enter(unstr_trace_id_t id, size_t bytes)
+{
+	unstr_trace_scope_t scope;
+	scope.id = id;
+	scope.bytes = bytes;
+	clock_gettime(CLOCK_MONOTONIC, &(scope.start));
+	return scope;
+}
+
+/**
+ * @brief		計測を終了し、ヒストグラムとフックに反映する
+ * @param[in]	scope	計測状態
+ * @return		無し
+ * @par			詳細:
+ * フックやunstr_trace_jsonの中から呼ばれた関数は計測しない。
+ */
+static void unstr_trace_leave(unstr_trace_scope_t *scope)
+{
+	struct timespec end;
+	unsigned long long nsec = 0;
+	unstr_trace_stat_t *stat = 0;
+	if(unstr_trace_busy){
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	nsec = ((unsigned long long)(end.tv_sec - scope->start.tv_sec) * 1000000000ULL)
+		+ (unsigned long long)end.tv_nsec - (unsigned long long)scope->start.tv_nsec;
+	stat = &(unstr_trace_local[scope->id]);
+	stat->calls++;
+	stat->bytes += scope->bytes;
+	stat->nsec += nsec;
+	stat->histogram[unstr_trace_bucket(nsec)]++;
+	if(unstr_trace_hook != NULL){
+		unstr_trace_busy = UNSTRING_TRUE;
+		unstr_trace_hook(scope->id, scope->bytes, nsec, unstr_trace_hook_arg);
+		unstr_trace_busy = UNSTRING_FALSE;
+	}
+}
+
+/**
+ * @brief		処理時間からヒストグラムの位置を求める
+ * @param[in]	nsec	処理時間
+ * @return		ヒストグラムの位置
+ */
+static size_t unstr_trace_bucket(unsigned long long nsec)
+{
+	size_t e = 0;
+	if(nsec < 16){
+		return (size_t)nsec;
+	}
+	e = (sizeof(unsigned long long) * 8) - 1 - (size_t)__builtin_clzll(nsec);
+	if(e >= UNSTRING_TRACE_MAX_EXP){
+		return UNSTRING_TRACE_BUCKETS - 1;
+	}
+	return 16 + ((e - 4) << UNSTRING_TRACE_SUB_BITS)
+		+ (size_t)((nsec >> (e - UNSTRING_TRACE_SUB_BITS)) & ((1 << UNSTRING_TRACE_SUB_BITS) - 1));
+}
+#endif
+
+/**
+ * @brief		文字列のバッファを拡張する
+ * @param[in]	str		拡張対象
+ * @param[in]	size	増加させる量
+ * @return		無し
+ * @public
+ */
+unstr_t *unstr_alloc(unstr_t *str, size_t size)
+{
+	size_t heap = 0;
+	UNSTR_TRACE(UNSTR_TRACE_ALLOC, size);
+	if(str == NULL){
+		str = unstr_header_new();
+	}
+	if(UNSTR_IS_SLICE(str)){
+		/* 部分文字列は元のバッファを拡張できないので、先に自身のバッファを持たせる */
+		UNSTR_DETACH(str, str->length);
+	}
+	/* 頻繁に確保すると良くないらしいので大まかに確保して
+	 * 確保する回数を減らす。
+	 */
+	heap = str->heap + size + (str->heap >> 1);
+	if(heap == 0){
+		/* heapが0の文字列は部分文字列と区別できないので、最低1バイト確保する */
+		heap = 1;
+	}
+	if(str->data == NULL){
+		str->data = unstr_buffer_new(&heap);
+	} else {
+		str->data = unstr_buffer_resize(str->data, str->heap, &heap, str->length);
+	}
+	str->heap = heap;
 	return str;
 }
 
 /**
- * @brief			文字列を反転させる。
- * @param[in,out]	str		対象文字列
- * @return			反転結果
- * @return			UNSTRING_TRUE	成功
- * @return			UNSTRING_FALSE	失敗
+ * @brief		引数で渡された文字列をunstr_tで初期化する
+ * @param[in]	str		文字列
+ * @return		unstr_tに変換された文字列
  * @public
  */
-unstr_t *unstr_reverse(const unstr_t *str)
+unstr_t *unstr_init(const char *str)
 {
-	size_t length = 0;
 	size_t size = 0;
-	size_t count = 0;
-	int c = 0;
-	unstr_t *ret = 0;
-	if(unstr_empty(str)) return NULL;
-	ret = unstr_copy(str);
-	length = ret->length - 1;
-	size = ret->length / 2;
-	while(count < size){
-		c = ret->data[count];
-		ret->data[count++] = ret->data[length];
-		ret->data[length--] = c;
+	unstr_t *data = 0;
+	UNSTR_TRACE(UNSTR_TRACE_INIT, 0);
+	if(str == NULL) return NULL;
+	size = strlen(str);
+	UNSTR_TRACE_BYTES(size);
+	data = unstr_alloc(NULL, size + 1);
+	memcpy(data->data, str, size);
+	data->data[size] = '\0';
+	data->length = size;
+	return data;
+}
+
+/**
+ * @brief		文字列の領域だけ確保して初期化する。
+ * @param[in]	size	確保するunstr_t型のバッファサイズ
+ * @return		空のunstr_t型
+ * @public
+ */
+unstr_t *unstr_init_memory(size_t size)
+{
+	unstr_t *data = 0;
+	UNSTR_TRACE(UNSTR_TRACE_INIT_MEMORY, size);
+	if(size == 0) return NULL;
+	data = unstr_alloc(NULL, size);
+	/* 長さ0の文字列扱い */
+	data->data[0] = '\0';
+	data->length = 0;
+	return data;
+}
+
+#if defined(UNSTRING_ENABLE_COW) && defined(__GNUC__) && !defined(__clang__)
+/* UNSTRING_HEADER_ONLYで展開すると、unstr_initの直後の開放で部分文字列の分岐を
+ * unstr_tの大きさの領域への範囲外アクセスと誤検出するので、この関数だけ止める */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#endif
+/**
+ * @brief		文字列(unstr_t)を開放する
+ * @param[in]	str		開放するunstr_t型
+ * @return		無し
+ * @public
+ */
+void unstr_free_func(unstr_t *str)
+{
+	UNSTR_TRACE(UNSTR_TRACE_FREE_FUNC, unstr_strlen(str));
+	if(str != NULL){
+		UNSTR_STATS_ADD(free_count, 1);
+		UNSTR_STATS_ADD(freed_heap, str->heap);
+		UNSTR_STATS_ADD(freed_length, str->length);
+#ifdef UNSTRING_ENABLE_COW
+		if(UNSTR_IS_SLICE(str)){
+			/* 部分文字列は参照を手放すだけで、本体はunstr_tより大きいのでそのまま開放する */
+			unstr_buffer_free(((unstr_slice_t *)str)->base, ((unstr_slice_t *)str)->heap);
+			free(str);
+			return;
+		}
+#endif
+		unstr_buffer_free(str->data, str->heap);
+		str->data = NULL;
+		str->length = 0;
+		str->heap = 0;
+		unstr_header_free(str);
+	}
+}
+#if defined(UNSTRING_ENABLE_COW) && defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/**
+ * @brief		引数で渡された文字列を開放する
+ * @param[in]	size	開放する文字列(unstr_t)の数
+ * @param[in]	...		開放する文字列(unstr_t)
+ * @return		無し
+ * @public
+ */
+void unstr_delete(size_t size, ...)
+{
+	unstr_t *str = 0;
+	va_list list;
+	UNSTR_TRACE(UNSTR_TRACE_DELETE, 0);
+	va_start(list, size);
+	while(size--){
+		str = va_arg(list, unstr_t *);
+		unstr_free(str);
+	}
+	va_end(list);
+}
+
+/**
+ * @brief			配列の全ての文字列を開放する
+ * @param[in,out]	list	開放する文字列(unstr_t)の配列。要素はNULLになる
+ * @param[in]		len		配列の要素数
+ * @return			無し
+ * @public
+ * @par				詳細:
+ * 配列自体は開放しない。unstr_explodeの結果はこの後にfreeで配列を開放する。
+ */
+void unstr_delete_array(unstr_t **list, size_t len)
+{
+	size_t i = 0;
+	UNSTR_TRACE(UNSTR_TRACE_DELETE_ARRAY, len);
+	if(list == NULL){
+		return;
+	}
+	for(i = 0; i < len; i++){
+		unstr_free(list[i]);
+	}
+}
+
+/**
+ * @brief			空文字列で初期化する。領域は開放しない。
+ * @param[in,out]	str		初期化する文字列
+ * @return			無し
+ * @public
+ */
+void unstr_zero(unstr_t *str)
+{
+	if(str != NULL){
+		UNSTR_DETACH(str, 0);
+		if(str->data != NULL){
+			str->data[0] = '\0';
+		}
+		str->length = 0;
+	}
+}
+
+/**
+ * @brief		文字列用の領域が確保されていることを確認する。
+ * @param[in]	str		対象文字列
+ * @return		確認結果
+ * @return		UNSTRING_TRUE	確保済み
+ * @return		UNSTRING_FALSE	確保なし
+ * @public
+ */
+unstr_bool_t unstr_isset(const unstr_t *str)
+{
+	unstr_bool_t ret = UNSTRING_FALSE;
+	if((str != NULL) && (str->data != NULL)){
+		ret = UNSTRING_TRUE;
+	} else {
+		ret = UNSTRING_FALSE;
 	}
 	return ret;
 }
 
 /**
- * @brief		数値から文字列を作成する。
- * @param[in]	num		対象数値
- * @param[in]	physics	基数
- * @return		unstr_t文字列
+ * @brief		文字列が空またはNULLであるか確認する。
+ * @param[in]	str		対象文字列
+ * @return		確認結果
+ * @return		UNSTRING_TRUE	空
+ * @return		UNSTRING_FALSE	空ではない
+ * @public
+ */
+unstr_bool_t unstr_empty(const unstr_t *str)
+{
+	unstr_bool_t ret = UNSTRING_FALSE;
+	if((str == NULL) || (str->data == NULL) || (str->length <= 0)){
+		ret = UNSTRING_TRUE;
+	} else {
+		ret = UNSTRING_FALSE;
+	}
+	return ret;
+}
+
+/**
+ * @brief			unstr_t型にバイナリをコピーする
+ * @param[in,out]	us		コピー先
+ * @param[in]		s		コピー元
+ * @param[in]		offset	コピー先の開始位置
+ * @param[in]		len		コピーする長さ
+ * @return			コピー結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * lenが0だった場合は失敗にしない。
+ */
+unstr_bool_t unstr_write(unstr_t *us, const char *bin, size_t offset, size_t len)
+{
+	size_t size = len + offset;
+	size_t inner = UNSTR_NOT_FOUND;
+#ifdef UNSTRING_ENABLE_COW
+	char *hold_base = 0;
+	size_t hold_heap = 0;
+#endif
+	UNSTR_TRACE(UNSTR_TRACE_WRITE, len);
+	if(!unstr_isset(us) || (bin == NULL)){
+		return UNSTRING_FALSE;
+	}
+#ifdef UNSTRING_ENABLE_COW
+	/* 部分文字列が元のバッファの最後の参照だった場合でもbinを読めるように、書き終わるまで参照を持つ */
+	if(UNSTR_IS_SLICE(us)){
+		hold_base = ((unstr_slice_t *)us)->base;
+		hold_heap = ((unstr_slice_t *)us)->heap;
+		UNSTR_REFS_ADD(&(UNSTR_SHARED(hold_base)->refs));
+	} else if((us->data != NULL) && (bin >= us->data) && (bin < (us->data + us->heap))
+	&& (UNSTR_REFS_LOAD(&(UNSTR_SHARED(us->data)->refs)) != 1)){
+		/* 共有しているバッファは、切り離した後に他のスレッドが最後の参照を開放することがあるので、
+		 * binを読み終わるまで参照を持つ。参照が1つなら自身しか開放しないので不要
+		 */
+		hold_base = us->data;
+		hold_heap = us->heap;
+		UNSTR_REFS_ADD(&(UNSTR_SHARED(hold_base)->refs));
+	}
+#endif
+	UNSTR_DETACH(us, offset);
+	/* binが自身のバッファを指す場合は、拡張で移動しても読めるように位置を覚える */
+	if((bin >= us->data) && (bin < (us->data + us->heap))){
+		inner = (size_t)(bin - us->data);
+	}
+	if(unstr_check_heap_size(us, size + 1)){
+		unstr_alloc(us, size + 1);
+	}
+	if(inner != UNSTR_NOT_FOUND){
+		memmove(&(us->data[offset]), us->data + inner, len);
+	} else {
+		memcpy(&(us->data[offset]), bin, len);
+	}
+	us->length = size;
+	us->data[us->length] = '\0';
+#ifdef UNSTRING_ENABLE_COW
+	if(hold_base != NULL){
+		unstr_buffer_free(hold_base, hold_heap);
+	}
+#endif
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		文字列の長さを返す
+ * @param[in]	str		対象文字列
+ * @return		文字列の長さ
+ * @public
+ */
+size_t unstr_strlen(const unstr_t *str)
+{
+	return unstr_isset(str) ? str->length : 0;
+}
+
+/**
+ * @brief		文字列のコピーを返す。
+ * @param[in]	str		コピー元
+ * @return		コピーした文字列
  * @public
  * @par			詳細:
- * 10進数以外のマイナス値には対応していない。
+ * UNSTRING_ENABLE_COWを定義した場合はバッファを共有し、長さに関わらず定数時間で終わる。
+ * どちらかに書き込む時に、書き込む側がバッファを切り離す。\n
+ * 確保済みの文字列に書き込む場合はunstr_strcpyを使う。
+ */
+unstr_t *unstr_copy(const unstr_t *str)
+{
+	unstr_t *data = 0;
+	UNSTR_TRACE(UNSTR_TRACE_COPY, unstr_strlen(str));
+	if(unstr_isset(str)){
+#ifdef UNSTRING_ENABLE_COW
+		if(UNSTR_IS_SLICE(str)){
+			return unstr_slice(str, 0, str->length);
+		}
+		UNSTR_REFS_ADD(&(UNSTR_SHARED(str->data)->refs));
+		data = unstr_header_new();
+		data->data = str->data;
+		data->length = str->length;
+		data->heap = str->heap;
+#else
+		data = unstr_init_memory(str->length + 2);
+		unstr_strcat(data, str);
+#endif
+	}
+	return data;
+}
+
+/**
+ * @brief			共有しているバッファを切り離し、直接書き込めるようにする
+ * @param[in,out]	str		対象文字列
+ * @return			結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	strが無効
+ * @public
+ * @par				詳細:
+ * str->dataに直接書き込む前に呼ぶ。unstr_t用の関数は内部で切り離すので不要。
+ * UNSTRING_ENABLE_COWを定義しない場合は共有しないので何もしない。
+ */
+unstr_bool_t unstr_detach(unstr_t *str)
+{
+	if(!unstr_isset(str)){
+		return UNSTRING_FALSE;
+	}
+	UNSTR_DETACH(str, str->length);
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		文字列の一部を指す部分文字列を返す
+ * @param[in]	str		元の文字列
+ * @param[in]	start	開始位置
+ * @param[in]	len		長さ。残りより長い場合は末尾まで
+ * @return		部分文字列。startが長さを超える場合はNULL
+ * @public
+ * @par			詳細:
+ * UNSTRING_ENABLE_COWを定義した場合は元のバッファを共有し、参照数で元のバッファを保つ。
+ * 元の文字列を変更・開放しても部分文字列は変わらない。読み取り専用の関数にはそのまま渡せ、
+ * 書き込む関数に渡すと自身のバッファにコピーしてから書き込む。\n
+ * 部分文字列のdataは'\0'で終わっていないので、C文字列として使う場合はunstr_detachを呼ぶ。\n
+ * 定義しない場合は切り出した内容をコピーする。どちらの場合もunstr_freeで開放する。
+ */
+unstr_t *unstr_slice(const unstr_t *str, size_t start, size_t len)
+{
+#ifdef UNSTRING_ENABLE_COW
+	unstr_slice_t *slice = 0;
+#endif
+	unstr_t *data = 0;
+	UNSTR_TRACE(UNSTR_TRACE_SLICE, 0);
+	if(!unstr_isset(str) || (start > str->length)){
+		return NULL;
+	}
+	if(len > (str->length - start)){
+		len = str->length - start;
+	}
+	UNSTR_TRACE_BYTES(len);
+#ifdef UNSTRING_ENABLE_COW
+	/* unstr_compact_refのbaseはNULLで、参照数を持たないので共有できない */
+	if(!UNSTR_IS_SLICE(str) || (((const unstr_slice_t *)str)->base != NULL)){
+		slice = (unstr_slice_t *)unstr_malloc(sizeof(unstr_slice_t));
+		if(slice == NULL){
+			return NULL;
+		}
+		if(UNSTR_IS_SLICE(str)){
+			/* 部分文字列の部分文字列は元のバッファを直接指す */
+			slice->base = ((const unstr_slice_t *)str)->base;
+			slice->heap = ((const unstr_slice_t *)str)->heap;
+		} else {
+			slice->base = str->data;
+			slice->heap = str->heap;
+		}
+		UNSTR_REFS_ADD(&(UNSTR_SHARED(slice->base)->refs));
+		slice->str.data = str->data + start;
+		slice->str.length = len;
+		slice->str.heap = 0;
+		return &(slice->str);
+	}
+#endif
+	data = unstr_init_memory(len + 2);
+	unstr_write(data, str->data + start, 0, len);
+	return data;
+}
+
+/**
+ * @brief		文字列を容量を持たない読み取り専用の文字列にする
+ * @param[in]	str		対象文字列
+ * @return		作成した文字列。長さが32bitを超える場合はNULL
+ * @public
+ * @par			詳細:
+ * 4バイトの長さと内容と終端を長さちょうどの1つの領域に置く。unstr_tの24バイトの
+ * ヘッダと余分に確保する容量が無いので、短い文字列を大量に保持する場合に使う。\n
+ * 変更はできない。読み取り専用の関数にはunstr_compact_refを通して渡す。
+ * unstr_compact_freeで開放する。
+ */
+unstr_compact_t *unstr_compact_init(const unstr_t *str)
+{
+	unstr_compact_t *c = 0;
+	UNSTR_TRACE(UNSTR_TRACE_COMPACT_INIT, unstr_strlen(str));
+	if(!unstr_isset(str) || (str->length > UNSTR_COMPACT_MAX_LENGTH)){
+		return NULL;
+	}
+	c = (unstr_compact_t *)unstr_malloc(UNSTR_COMPACT_SIZE(str->length));
+	if(c == NULL){
+		return NULL;
+	}
+	UNSTR_STATS_HEAP(str->length + 1);
+	c->length = (unsigned int)str->length;
+	memcpy(c->data, str->data, str->length);
+	c->data[str->length] = '\0';
+	return c;
+}
+
+/**
+ * @brief		unstr_compact_initで作成した文字列を開放する
+ * @param[in]	c		開放する文字列
+ * @return		無し
+ * @public
+ */
+void unstr_compact_free(unstr_compact_t *c)
+{
+	UNSTR_TRACE(UNSTR_TRACE_COMPACT_FREE, (c == NULL) ? 0 : c->length);
+	if(c != NULL){
+		UNSTR_STATS_ADD(free_count, 1);
+		UNSTR_STATS_ADD(freed_heap, c->length + 1);
+		UNSTR_STATS_ADD(freed_length, c->length);
+		UNSTR_STATS_HEAP(-(long)(c->length + 1));
+		free(c);
+	}
+}
+
+/**
+ * @brief		unstr_compact_tの長さを返す
+ * @param[in]	c		対象文字列
+ * @return		長さ。cがNULLなら0
+ * @public
+ */
+size_t unstr_compact_strlen(const unstr_compact_t *c)
+{
+	return (c == NULL) ? 0 : c->length;
+}
+
+/**
+ * @brief		unstr_compact_tの内容を返す
+ * @param[in]	c		対象文字列
+ * @return		'\0'で終わる内容。cがNULLならNULL
+ * @public
+ */
+const char *unstr_compact_data(const unstr_compact_t *c)
+{
+	return (c == NULL) ? NULL : c->data;
+}
+
+/**
+ * @brief		unstr_compact_tを読み取り専用のunstr_tとして参照する
+ * @param[in]	c		対象文字列
+ * @param[out]	ref		参照を置く領域
+ * @return		cを指すunstr_t。cまたはrefがNULLならNULL
+ * @public
+ * @par			詳細:
+ * 確保せずにrefの中にcを指すunstr_tを作る。strposやstrcmp等のconst unstr_t *を
+ * 受け取る関数に渡せる。unstr_copyやunstr_sliceに渡した場合は内容を複製する。\n
+ * 書き込む関数やunstr_freeには渡さないこと。cを開放した後は使えない。
+ */
+const unstr_t *unstr_compact_ref(const unstr_compact_t *c, unstr_ref_t *ref)
+{
+	if((c == NULL) || (ref == NULL)){
+		return NULL;
+	}
+	/* heapが0なので部分文字列と同じく自身の領域を持たない文字列として扱われる */
+	ref->str.data = (char *)c->data;
+	ref->str.length = c->length;
+	ref->str.heap = 0;
+	ref->base = NULL;
+	ref->heap = 0;
+	return &(ref->str);
+}
+
+/**
+ * @brief			文字列をコピーする。
+ * @param[in,out]	s1		コピー先
+ * @param[in]		s2		コピー元
+ * @return			コピー結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * s2に空文字列だった場合、s1が空文字列になります。
+ */
+unstr_bool_t unstr_strcpy(unstr_t *s1, const unstr_t *s2)
+{
+	UNSTR_TRACE(UNSTR_TRACE_STRCPY, unstr_strlen(s2));
+	if(!unstr_isset(s2)){
+		return UNSTRING_FALSE;
+	}
+	return unstr_write(s1, s2->data, 0, s2->length);
+}
+
+/**
+ * @brief			unstr_t文字列にchar文字列をコピーする。
+ * @param[in,out]	s1		コピー先
+ * @param[in]		s2		コピー元
+ * @return			コピー結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ */
+unstr_bool_t unstr_strcpy_char(unstr_t *s1, const char *s2)
+{
+	unstr_bool_t ret = UNSTRING_FALSE;
+	unstr_t *str = 0;
+	UNSTR_TRACE(UNSTR_TRACE_STRCPY_CHAR, 0);
+	if(s2 != NULL){
+		str = unstr_init(s2);
+		ret = unstr_strcpy(s1, str);
+		unstr_free(str);
+	}
+	return ret;
+}
+
+/**
+ * @brief			文字列を切り出してコピーする
+ * @param[in,out]	s1		コピー先
+ * @param[in]		s2		コピー元
+ * @param[in]		size	コピーする長さ
+ * @return			コピー結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ */
+unstr_bool_t unstr_substr(unstr_t *s1, const unstr_t *s2, size_t len)
+{
+	UNSTR_TRACE(UNSTR_TRACE_SUBSTR, len);
+	if(!unstr_isset(s1) || unstr_empty(s2)){
+		return UNSTRING_FALSE;
+	}
+	if(s2->length < len){
+		len = s2->length;
+	}
+	return unstr_write(s1, s2->data, 0, len);
+}
+
+/**
+ * @brief		char文字列を切り出してunstr_t文字列に変換する
+ * @param[out]	str		コピー先文字列
+ * @param[in]	c		対象文字列
+ * @param[in]	size	コピーする長さ
+ * @return		変換結果
+ * @return		UNSTRING_TRUE	成功
+ * @return		UNSTRING_FALSE	失敗
+ * @public
+ */
+unstr_bool_t unstr_substr_char(unstr_t *str, const char *c, size_t len)
+{
+	unstr_t *data = 0;
+	unstr_bool_t ret = UNSTRING_FALSE;
+	UNSTR_TRACE(UNSTR_TRACE_SUBSTR_CHAR, len);
+	if(c != NULL){
+		data = unstr_init(c);
+		ret = unstr_substr(str, data, len);
+		unstr_free(data);
+	}
+	return ret;
+}
+
+/**
+ * @brief			文字列を結合する
+ * @param[in,out]	s1		結合先文字列
+ * @param[in]		s2		結合文字列
+ * @return			変換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * s1に変化が無い場合、UNSTRING_FALSEを返します。
+ */
+unstr_bool_t unstr_strcat(unstr_t *s1, const unstr_t *s2)
+{
+	UNSTR_TRACE(UNSTR_TRACE_STRCAT, unstr_strlen(s2));
+	if(!unstr_isset(s1) || unstr_empty(s2)){
+		return UNSTRING_FALSE;
+	}
+	return unstr_write(s1, s2->data, s1->length, s2->length);
+}
+
+/**
+ * @brief			unstr_t文字列にchar文字列を結合する
+ * @param[in,out]	str		結合先文字列
+ * @param[in]		c		結合文字列
+ * @return			結合結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ */
+unstr_bool_t unstr_strcat_char(unstr_t *str, const char *c)
+{
+	unstr_t *data = 0;
+	unstr_bool_t ret = UNSTRING_FALSE;
+	UNSTR_TRACE(UNSTR_TRACE_STRCAT_CHAR, 0);
+	if(c != NULL){
+		data = unstr_init(c);
+		ret = unstr_strcat(str, data);
+		unstr_free(data);
+	}
+	return ret;
+}
+
+/**
+ * @brief		文字列を比較する
+ * @param[in]	s1		比較文字列1
+ * @param[in]	s2		比較文字列2
+ * @return		比較結果
+ * @return		0			同じ
+ * @return		0x100		エラー
+ * @return		上記以外	違う(文字コードの差分)
+ * @public
+ */
+int unstr_strcmp(const unstr_t *s1, const unstr_t *s2)
+{
+	int ret = 0x100;
+	UNSTR_TRACE(UNSTR_TRACE_STRCMP, unstr_strlen(s1));
+	if(unstr_isset(s1) && unstr_isset(s2)){
+		if(s1->length == s2->length){
+			ret = memcmp(s1->data, s2->data, s1->length);
+		}
+	}
+	return ret;
+}
+
+/**
+ * @brief		char文字列とunstr_t文字列を比較する
+ * @param[in]	s1		比較文字列1
+ * @param[in]	s2		比較文字列2
+ * @return		比較結果
+ * @return		0			同じ
+ * @return		0x100		エラー
+ * @return		上記以外	違う(文字コードの差分)
+ * @public
+ */
+int unstr_strcmp_char(const unstr_t *s1, const char *s2)
+{
+	int ret = 0x100;
+	unstr_t *str = 0;
+	UNSTR_TRACE(UNSTR_TRACE_STRCMP_CHAR, unstr_strlen(s1));
+	if(s2 != NULL){
+		str = unstr_init(s2);
+		ret = unstr_strcmp(s1, str);
+		unstr_free(str);
+	}
+	return ret;
+}
+
+/**
+ * @brief		文字列を検索する
+ * @param[in]	s1		比較文字列1
+ * @param[in]	s2		比較文字列2
+ * @return		比較結果
+ * @return		アドレス	発見
+ * @return		NULL		エラー
+ * @public
+ */
+char* unstr_strstr(const unstr_t *s1, const unstr_t *s2)
+{
+	int pos = 0;
+	UNSTR_TRACE(UNSTR_TRACE_STRSTR, unstr_strlen(s1));
+	pos = unstr_strpos(s1, s2);
+	if(pos >= 0){
+		return s1->data + pos;
+	}
+	return NULL;
+}
+
+/**
+ * @brief		unstr_t文字列をchar文字列で検索する
+ * @param[in]	s1		比較文字列1
+ * @param[in]	s2		比較文字列2
+ * @return		比較結果
+ * @return		アドレス	発見
+ * @return		NULL		エラー
+ * @public
+ */
+char* unstr_strstr_char(const unstr_t *s1, const char *s2)
+{
+	char *ret = 0;
+	unstr_t *str = 0;
+	UNSTR_TRACE(UNSTR_TRACE_STRSTR_CHAR, unstr_strlen(s1));
+	if(s2 != NULL){
+		str = unstr_init(s2);
+		ret = unstr_strstr(s1, str);
+		unstr_free(str);
+	}
+	return ret;
+}
+
+/**
+ * @brief		対象文字列を区切り文字で切り、格納先に格納する。
+ * @param[in]	str		対象文字列
+ * @param[in]	delim	区切り文字列
+ * @param[out]	len		配列の長さ
+ * @return		unstr_tの配列
+ * @public
+ */
+unstr_t **unstr_explode(const unstr_t *str, const char *delim, size_t *len)
+{
+	unstr_t *s = 0;
+	unstr_t **ret = 0;
+	size_t index = 0;
+	size_t size = 0;
+	size_t heap = 0;
+	UNSTR_TRACE(UNSTR_TRACE_EXPLODE, unstr_strlen(str));
+	if(unstr_empty(str)
+	|| (delim == NULL)
+	|| (strlen(delim) == 0)
+	|| (len == NULL)){
+		return NULL;
+	}
+	while((s = unstr_strtok(str, delim, &index)) != NULL){
+		if(size >= heap){
+			heap = ((heap << 1) + 8);
+			ret = (unstr_t **)unstr_realloc(ret, heap * sizeof(unstr_t *), size * sizeof(unstr_t *));
+		}
+		ret[size] = s;
+		size++;
+	}
+	*len = size;
+	return ret;
+}
+
+/**
+ * @brief		文字列を区切り文字列で分割し、まとめて開放できる形で返す
+ * @param[in]	str		分割する文字列
+ * @param[in]	delim	区切り文字列
+ * @return		分割した結果。unstr_tokens_freeで開放する
+ * @public
+ * @par			詳細:
+ * 要素はunstr_explodeと同じ。管理情報と要素の構造体を1つの領域に、
+ * 全要素の文字列を1つのバッファに置くので、開放はfree2回で済む。\n
+ * 要素は読み取り専用で、書き換えたり個別にunstr_freeしてはいけない。
+ * unstr_copyやunstr_sliceで取り出した文字列はunstr_tokens_freeの後も使える。
+ */
+unstr_tokens_t *unstr_explode_tokens(const unstr_t *str, const char *delim)
+{
+	unstr_tokens_t *tokens = 0;
+	unstr_tokens_t *p = 0;
+	unstr_token_t *item = 0;
+	unstr_search_t s;
+	char *buffer = 0;
+	size_t dlen = 0;
+	size_t count = 0;
+	size_t size = 0;
+	size_t heap = 0;
+	size_t start = 0;
+	size_t pos = 0;
+	size_t i = 0;
+	UNSTR_TRACE(UNSTR_TRACE_EXPLODE_TOKENS, unstr_strlen(str));
+	if(unstr_empty(str)
+	|| (delim == NULL)
+	|| ((dlen = strlen(delim)) == 0)){
+		return NULL;
+	}
+	heap = str->length + 1;
+	buffer = unstr_buffer_new(&heap);
+	if(buffer == NULL){
+		return NULL;
+	}
+	/* 全体をコピーし、区切り文字列の先頭を'\0'にして各要素の終端にする */
+	memcpy(buffer, str->data, str->length);
+	buffer[str->length] = '\0';
+	unstr_search_init(&s, delim, dlen);
+	while(pos != str->length){
+		pos = unstr_search_exec(&s, buffer, str->length, start);
+		if(pos == UNSTR_NOT_FOUND){
+			pos = str->length;
+		}
+		/* 要素の構造体は管理情報の後ろに並べ、要素数が決まるまで広げていく */
+		if(count >= size){
+			size = (size << 1) + 8;
+			p = (unstr_tokens_t *)unstr_realloc(tokens, sizeof(unstr_tokens_t) + (size * sizeof(unstr_token_t)),
+				(tokens == NULL) ? 0 : sizeof(unstr_tokens_t) + (count * sizeof(unstr_token_t)));
+			if(p == NULL){
+				free(tokens);
+				unstr_buffer_free(buffer, heap);
+				return NULL;
+			}
+			tokens = p;
+		}
+		item = (unstr_token_t *)(tokens + 1) + count;
+#ifdef UNSTRING_ENABLE_COW
+		/* 部分文字列として作るとunstr_copyやunstr_sliceがバッファの参照数を増やせる */
+		item->str.data = buffer + start;
+		item->str.length = pos - start;
+		item->str.heap = 0;
+		item->base = buffer;
+		item->heap = heap;
+#else
+		item->data = buffer + start;
+		item->length = pos - start;
+		item->heap = pos - start + 1;
+#endif
+		buffer[pos] = '\0';
+		start = pos + dlen;
+		count++;
+	}
+	/* 最後に要素の配列を付け足す */
+	p = (unstr_tokens_t *)unstr_realloc(tokens, sizeof(unstr_tokens_t) + (count * (sizeof(unstr_token_t) + sizeof(unstr_t *))),
+		sizeof(unstr_tokens_t) + (count * sizeof(unstr_token_t)));
+	if(p == NULL){
+		free(tokens);
+		unstr_buffer_free(buffer, heap);
+		return NULL;
+	}
+	tokens = p;
+	item = (unstr_token_t *)(tokens + 1);
+	tokens->list = (unstr_t **)(item + count);
+	tokens->len = count;
+	tokens->buffer = buffer;
+	tokens->heap = heap;
+	for(i = 0; i < count; i++){
+		tokens->list[i] = (unstr_t *)&(item[i]);
+	}
+	return tokens;
+}
+
+/**
+ * @brief		unstr_explode_tokensの結果を開放する
+ * @param[in]	tokens	開放する結果
+ * @return		無し
+ * @public
+ */
+void unstr_tokens_free(unstr_tokens_t *tokens)
+{
+	UNSTR_TRACE(UNSTR_TRACE_TOKENS_FREE, 0);
+	if(tokens != NULL){
+		UNSTR_STATS_ADD(free_count, tokens->len);
+		unstr_buffer_free(tokens->buffer, tokens->heap);
+		free(tokens);
+	}
+}
+
+/**
+ * @brief		文字列の配列を区切り文字列で連結する
+ * @param[in]	list	連結する文字列の配列
+ * @param[in]	len		配列の要素数
+ * @param[in]	delim	区切り文字列
+ * @return		連結した文字列
+ * @public
+ * @par			詳細:
+ * unstr_explodeの逆。全体の長さを先に求めて1回だけ確保する。
+ * NULLや無効な要素は空文字列として扱う。lenが0の場合は空文字列を返す。
+ */
+unstr_t *unstr_implode(unstr_t *const *list, size_t len, const char *delim)
+{
+	unstr_t *data = 0;
+	size_t dlen = 0;
+	size_t size = 0;
+	size_t i = 0;
+	char *p = 0;
+	UNSTR_TRACE(UNSTR_TRACE_IMPLODE, 0);
+	if(((list == NULL) && (len != 0)) || (delim == NULL)){
+		return NULL;
+	}
+	dlen = strlen(delim);
+	for(i = 0; i < len; i++){
+		size += unstr_strlen(list[i]);
+	}
+	if(len > 1){
+		size += dlen * (len - 1);
+	}
+	UNSTR_TRACE_BYTES(size);
+	data = unstr_init_memory(size + 2);
+	p = data->data;
+	for(i = 0; i < len; i++){
+		if((i != 0) && (dlen != 0)){
+			memcpy(p, delim, dlen);
+			p += dlen;
+		}
+		if(unstr_isset(list[i]) && (list[i]->length != 0)){
+			memcpy(p, list[i]->data, list[i]->length);
+			p += list[i]->length;
+		}
+	}
+	*p = '\0';
+	data->length = size;
+	return data;
+}
+
+/**
+ * @brief			自動拡張機能付きsprintf。細かいフォーマットには未対応。
+ * @param[in,out]	str		格納先
+ * @param[in]		format	フォーマット
+ * @param[in]		...		可変引数
+ * @return			unstr_t文字列
+ * @public
+ * @par			詳細:
+ * formatが空文字列の場合を許容する
+ */
+unstr_t *unstr_sprintf(unstr_t *str, const char *format, ...)
+{
+	va_list list;
+	unstr_t *unsp = 0;
+	const char *sp = 0;
+	int ip = 0;
+	size_t i = 0;
+	size_t len = 0;
+	char num[UNSTR_INT_DIGITS];
+	UNSTR_TRACE(UNSTR_TRACE_SPRINTF, 0);
+	if(format == NULL){
+		return NULL;
+	}
+	va_start(list, format);
+	if(unstr_isset(str)){
+		unstr_zero(str);
+	} else {
+		unstr_free(str);
+		str = unstr_init_memory(UNSTRING_HEAP_SIZE);
+	}
+	while((sp = strchr(format, '%')) != NULL){
+		i = sp - format;
+		if(i > 0){
+			unsp = unstr_init_memory(i + 2);
+			unstr_substr_char(unsp, format, i);
+			unstr_strcat(str, unsp);
+			unstr_free(unsp);
+			format += i;
+		}
+		if((*(format + 1)) == '\0'){
+			break;
+		}
+		format++;
+		switch(*format){
+		case 's':
+			sp = va_arg(list, char *);
+			unstr_strcat_char(str, sp);
+			break;
+		case '$':
+			unsp = va_arg(list, unstr_t*);
+			unstr_strcat(str, unsp);
+			break;
+		case 'd':
+			/* 数値は作業用の文字列を作らずに直接書き込む */
+			ip = va_arg(list, int);
+			len = unstr_format_int(num + sizeof(num), ip, 10, UNSTR_DIGITS_LOWER);
+			unstr_write(str, num + sizeof(num) - len, str->length, len);
+			break;
+		case 'x':
+			ip = va_arg(list, int);
+			len = unstr_format_int(num + sizeof(num), ip, 16, UNSTR_DIGITS_LOWER);
+			unstr_write(str, num + sizeof(num) - len, str->length, len);
+			break;
+		case 'X':
+			ip = va_arg(list, int);
+			len = unstr_format_int(num + sizeof(num), ip, 16, UNSTR_DIGITS_UPPER);
+			unstr_write(str, num + sizeof(num) - len, str->length, len);
+			break;
+		case '%':
+			unstr_strcat_char(str, "%");
+			break;
+		default:
+			format--;
+			break;
+		}
+		format++;
+	}
+	unstr_strcat_char(str, format);
+	va_end(list);
+	UNSTR_TRACE_BYTES(str->length);
+	return str;
+}
+
+/**
+ * @brief		文字列を反転させた文字列を返す。非破壊。
+ * @param[in]	str		対象文字列
+ * @return		反転した文字列
+ * @public
+ * @par			詳細:
+ * バイト単位で反転する。UTF-8の文字を保つ場合はunstr_utf8_reverseを使う。
+ */
+unstr_t *unstr_reverse(const unstr_t *str)
+{
+	unstr_t *ret = 0;
+	UNSTR_TRACE(UNSTR_TRACE_REVERSE, unstr_strlen(str));
+	if(unstr_empty(str)) return NULL;
+	ret = unstr_init_memory(str->length + 2);
+	unstr_reverse_into(ret, str);
+	return ret;
+}
+
+/**
+ * @brief			文字列をその場で反転させる。破壊的。
+ * @param[in,out]	str		対象文字列
+ * @return			反転結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ */
+unstr_bool_t unstr_reverse_inplace(unstr_t *str)
+{
+	UNSTR_TRACE(UNSTR_TRACE_REVERSE_INPLACE, unstr_strlen(str));
+	if(!unstr_isset(str)){
+		return UNSTRING_FALSE;
+	}
+	UNSTR_DETACH(str, str->length);
+	unstr_reverse_swap(str->data, str->length);
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			反転させた文字列を別の文字列に書き込む
+ * @param[out]		dst		書き込み先文字列
+ * @param[in]		src		対象文字列
+ * @return			反転結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * dstとsrcが同じ場合はunstr_reverse_inplaceと同じ。
+ * dstのバッファが足りる場合は新たに確保しない。
+ */
+unstr_bool_t unstr_reverse_into(unstr_t *dst, const unstr_t *src)
+{
+	UNSTR_TRACE(UNSTR_TRACE_REVERSE_INTO, unstr_strlen(src));
+	if(!unstr_isset(dst) || !unstr_isset(src)){
+		return UNSTRING_FALSE;
+	}
+	if(dst == src){
+		UNSTR_DETACH(dst, dst->length);
+		unstr_reverse_swap(dst->data, dst->length);
+		return UNSTRING_TRUE;
+	}
+	UNSTR_DETACH(dst, 0);
+	if(unstr_check_heap_size(dst, src->length + 1)){
+		unstr_alloc(dst, src->length + 1);
+	}
+	unstr_reverse_copy(dst->data, src->data, src->length);
+	dst->length = src->length;
+	dst->data[dst->length] = '\0';
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		数値から文字列を作成する。
+ * @param[in]	num		対象数値
+ * @param[in]	physics	基数
+ * @return		unstr_t文字列
+ * @public
+ * @par			詳細:
+ * 10進数以外のマイナス値には対応していない。
+ */
+unstr_t *unstr_itoa(int num, size_t physics)
+{
+	unstr_t *str = 0;
+	UNSTR_TRACE(UNSTR_TRACE_ITOA, 0);
+	if((physics < 2) || (physics > 36)){
+		return NULL;
+	}
+	str = unstr_init_memory(UNSTRING_HEAP_SIZE);
+	unstr_itoa_into(str, num, physics);
+	return str;
+}
+
+/**
+ * @brief			数値を文字列にして書き込む
+ * @param[out]		dst		書き込み先文字列
+ * @param[in]		num		対象数値
+ * @param[in]		physics	基数
+ * @return			変換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * unstr_itoaと同じ。dstのバッファが足りる場合は新たに確保しない。
+ */
+unstr_bool_t unstr_itoa_into(unstr_t *dst, int num, size_t physics)
+{
+	char buf[UNSTR_INT_DIGITS];
+	size_t len = 0;
+	UNSTR_TRACE(UNSTR_TRACE_ITOA_INTO, 0);
+	if(!unstr_isset(dst) || (physics < 2) || (physics > 36)){
+		return UNSTRING_FALSE;
+	}
+	len = unstr_format_int(buf + sizeof(buf), num, physics, UNSTR_DIGITS_LOWER);
+	UNSTR_TRACE_BYTES(len);
+	return unstr_write(dst, buf + sizeof(buf) - len, 0, len);
+}
+
+/**
+ * @brief		数値を文字列にする
+ * @param[out]	end		書き込む領域の終端。後ろから書き込む
+ * @param[in]	num		対象数値
+ * @param[in]	physics	基数(2〜36)
+ * @param[in]	digits	各桁に使う文字
+ * @return		書き込んだ長さ
+ * @par			詳細:
+ * 10進数以外のマイナス値はsize_tに変換した値になる。
+ * endの前にUNSTR_INT_DIGITSバイトの領域が必要。
+ */
+static size_t unstr_format_int(char *end, int num, size_t physics, const char *digits)
+{
+	char *p = end;
+	size_t number = (size_t)num;
+	if((num < 0) && (physics == 10)){
+		/* INT_MINでも溢れないように符号無しで反転する */
+		number = (size_t)0 - number;
+	}
+	do {
+		*--p = digits[number % physics];
+		number /= physics;
+	} while(number > 0);
+	if((num < 0) && (physics == 10)){
+		*--p = '-';
+	}
+	return (size_t)(end - p);
+}
+
+/**
+ * @brief		頭の良いsubstr
+ * @param[in]	data	対象文字列
+ * @param[in]	format	切り出すフォーマット
+ * @param[out]	...		領域が確保されたunstr_t型
+ * @return		切り出した文字数
+ * @public
+ *
+ * @par			詳細:
+ * dataからformat通りに文字列を切り出し、unstr_t型に格納する。\n
+ * 対応フォーマットは「$」のみ\n
+ * "abcdefg"から"cd"と"fg"を抜き出したい場合、"ab$e$"と書く\n
+ * 「$$」と書けば「$」を区切り文字に出来る\n
+ * 取得した文字列の数を返す。上記の場合は「2」を返す
+ */
+size_t unstr_sscanf(const unstr_t *data, const char *format, ...)
+{
+	va_list list;
+	size_t count = 0;
+	unstr_sscanf_plan_t *plan = 0;
+	UNSTR_TRACE(UNSTR_TRACE_SSCANF, unstr_strlen(data));
+
+	if(!unstr_isset(data) || (format == NULL)){
+		return 0;
+	}
+	plan = unstr_sscanf_compile(format);
+	if(plan == NULL){
+		return 0;
+	}
+	va_start(list, format);
+	count = unstr_sscanf_vexec(plan, data, list);
+	va_end(list);
+	unstr_sscanf_plan_free(plan);
+	return count;
+}
+
+/**
+ * @brief		unstr_sscanfのフォーマットを解析し、再利用できる形にする
+ * @param[in]	format	unstr_sscanfと同じフォーマット
+ * @return		解析結果。formatに「$」が無い場合はNULL
+ * @public
+ * @par			詳細:
+ * 区切り文字列と検索用の移動量表を作成しておくので、同じフォーマットで
+ * 何度も切り出す場合はunstr_sscanf_execを使う方が速い。\n
+ * 使い終わったらunstr_sscanf_plan_freeで開放する。
+ */
+unstr_sscanf_plan_t *unstr_sscanf_compile(const char *format)
+{
+	unstr_sscanf_plan_t *plan = 0;
+	char *literal = 0;
+	const char *p = 0;
+	const char *p_end = 0;
+	size_t count = 0;
+	size_t len = 0;
+
+	if((format == NULL) || (strchr(format, '$') == NULL)){
+		return NULL;
+	}
+	/* 「$」の数だけ区切り文字列がある */
+	for(p = format; (p = strchr(p, '$')) != NULL; p++){
+		count++;
+	}
+	/* 区切り文字列の実体はフォーマットを複製してplanの後ろに置く */
+	len = strlen(format);
+	plan = (unstr_sscanf_plan_t *)unstr_malloc(sizeof(unstr_sscanf_plan_t) + (sizeof(unstr_search_t) * count) + len + 1);
+	if(plan == NULL){
+		return NULL;
+	}
+	plan->sep = (unstr_search_t *)(plan + 1);
+	plan->count = 0;
+	literal = (char *)(plan->sep + count);
+	memcpy(literal, format, len + 1);
+
+	/* 先頭を探索する */
+	p = strchr(literal, '$');
+	unstr_search_init(&(plan->head), literal, (size_t)(p - literal));
+	while(strchr(p, '$') != NULL){
+		p++;
+		p_end = strchr(p, '$');
+		if(*p == '\0'){
+			/* 末尾の「$」は残り全てを取得する */
+			unstr_search_init(&(plan->sep[plan->count]), NULL, 0);
+		} else {
+			if(p_end == NULL){
+				p_end = p + strlen(p);
+			}
+			if(p_end == p){
+				/* 「$$」は「$」を区切り文字にする */
+				unstr_search_init(&(plan->sep[plan->count]), p, 1);
+			} else {
+				unstr_search_init(&(plan->sep[plan->count]), p, (size_t)(p_end - p));
+			}
+			p = p_end;
+		}
+		plan->count++;
+		if(*p == '\0'){
+			break;
+		}
+	}
+	return plan;
+}
+
+/**
+ * @brief		unstr_sscanf_compileで解析したフォーマットで切り出す
+ * @param[in]	plan	unstr_sscanf_compileの戻り値
+ * @param[in]	data	対象文字列
+ * @param[out]	...		領域が確保されたunstr_t型
+ * @return		切り出した文字数
+ * @public
+ * @par			詳細:
+ * 切り出し方と戻り値はunstr_sscanfと同じ。
+ */
+size_t unstr_sscanf_exec(const unstr_sscanf_plan_t *plan, const unstr_t *data, ...)
+{
+	va_list list;
+	size_t count = 0;
+	UNSTR_TRACE(UNSTR_TRACE_SSCANF, unstr_strlen(data));
+
+	va_start(list, data);
+	count = unstr_sscanf_vexec(plan, data, list);
+	va_end(list);
+	return count;
+}
+
+/**
+ * @brief		unstr_sscanf_compileで解析したフォーマットで切り出す
+ * @param[in]	plan	unstr_sscanf_compileの戻り値
+ * @param[in]	data	対象文字列
+ * @param[in]	list	領域が確保されたunstr_t型の可変引数
+ * @return		切り出した文字数
+ */
+static size_t unstr_sscanf_vexec(const unstr_sscanf_plan_t *plan, const unstr_t *data, va_list list)
+{
+	unstr_view_t view;
+	unstr_t *str = 0;
+	size_t count = 0;
+	size_t i = 0;
+	size_t pos = 0;
+
+	while(unstr_sscanf_next(plan, data, &i, &pos, &view)){
+		str = va_arg(list, unstr_t *);
+		if((view.data != NULL) && unstr_write(str, view.data, 0, view.length)){
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief			切り出す範囲を1つ求める
+ * @param[in]		plan	unstr_sscanf_compileの戻り値
+ * @param[in]		data	対象文字列
+ * @param[in,out]	i		次の区切り文字列の番号。最初は0
+ * @param[in,out]	pos		次の検索開始位置。最初は0
+ * @param[out]		view	切り出す範囲。残りが空の場合はdataをNULLにする
+ * @return			結果
+ * @return			UNSTRING_TRUE	viewを求めた
+ * @return			UNSTRING_FALSE	終了
+ */
+static unstr_bool_t unstr_sscanf_next(const unstr_sscanf_plan_t *plan, const unstr_t *data, size_t *i, size_t *pos, unstr_view_t *view)
+{
+	const unstr_search_t *sep = 0;
+	size_t index = UNSTR_NOT_FOUND;
+
+	if((plan == NULL) || !unstr_isset(data) || (*i >= plan->count)){
+		return UNSTRING_FALSE;
+	}
+	if(*i == 0){
+		/* 先頭が見つからない場合は何も取得しない */
+		*pos = unstr_search_exec(&(plan->head), data->data, data->length, 0);
+		if(*pos == UNSTR_NOT_FOUND){
+			*i = plan->count;
+			return UNSTRING_FALSE;
+		}
+		*pos += plan->head.m;
+	}
+	sep = &(plan->sep[*i]);
+	if(sep->x != NULL){
+		index = unstr_search_exec(sep, data->data, data->length, *pos);
+	}
+	/* 残りが空の場合は取得失敗として扱う */
+	view->data = (*pos < data->length) ? (data->data + *pos) : NULL;
+	if(index == UNSTR_NOT_FOUND){
+		/* 残り全てを取得して終了 */
+		view->length = data->length - *pos;
+		*i = plan->count;
+	} else {
+		view->length = index - *pos;
+		*pos = index + sep->m;
+		(*i)++;
+	}
+	if(view->data == NULL){
+		view->length = 0;
+	}
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		コピーせずに切り出し範囲だけを求めるunstr_sscanf
+ * @param[in]	data	対象文字列
+ * @param[in]	format	unstr_sscanfと同じフォーマット
+ * @param[out]	views	切り出した範囲の格納先
+ * @param[in]	size	viewsの要素数
+ * @return		切り出した文字数
+ * @public
+ * @par			詳細:
+ * viewsはdataの中を指すので、dataを変更・開放するまで有効。\n
+ * 取得できなかった要素はdataをNULL、lengthを0にする。
+ */
+size_t unstr_sscanf_view(const unstr_t *data, const char *format, unstr_view_t *views, size_t size)
+{
+	size_t count = 0;
+	unstr_sscanf_plan_t *plan = 0;
+	UNSTR_TRACE(UNSTR_TRACE_SSCANF, unstr_strlen(data));
+
+	if(views == NULL){
+		return 0;
+	}
+	/* dataが無効でもviewsは空にするので、解析せずにunstr_sscanf_exec_viewへ渡す */
+	if(unstr_isset(data)){
+		plan = unstr_sscanf_compile(format);
+	}
+	count = unstr_sscanf_exec_view(plan, data, views, size);
+	unstr_sscanf_plan_free(plan);
+	return count;
+}
+
+/**
+ * @brief		コピーせずに切り出し範囲だけを求めるunstr_sscanf_exec
+ * @param[in]	plan	unstr_sscanf_compileの戻り値
+ * @param[in]	data	対象文字列
+ * @param[out]	views	切り出した範囲の格納先
+ * @param[in]	size	viewsの要素数
+ * @return		切り出した文字数
+ * @public
+ * @par			詳細:
+ * unstr_sscanf_viewと同じ。
+ */
+size_t unstr_sscanf_exec_view(const unstr_sscanf_plan_t *plan, const unstr_t *data, unstr_view_t *views, size_t size)
+{
+	size_t count = 0;
+	size_t i = 0;
+	size_t n = 0;
+	size_t pos = 0;
+
+	if(views == NULL){
+		return 0;
+	}
+	while((n < size) && unstr_sscanf_next(plan, data, &i, &pos, &views[n])){
+		if(views[n].data != NULL){
+			count++;
+		}
+		n++;
+	}
+	for(; n < size; n++){
+		views[n].data = NULL;
+		views[n].length = 0;
+	}
+	return count;
+}
+
+/**
+ * @brief		unstr_sscanf_compileで確保した領域を開放する
+ * @param[in]	plan	開放する解析結果
+ * @return		無し
+ * @public
+ */
+void unstr_sscanf_plan_free(unstr_sscanf_plan_t *plan)
+{
+	free(plan);
+}
+
+/**
+ * @brief		ファイルを丸ごと読み込む
+ * @param[in]	filename	ファイルパス
+ * @return		読み込んだファイルの中身
+ * @public
+ */
+unstr_t *unstr_file_get_contents(const unstr_t *filename)
+{
+	FILE *fp = 0;
+	unstr_t *str = 0;
+	UNSTR_TRACE(UNSTR_TRACE_FILE_GET_CONTENTS, 0);
+
+	fp = unstr_file_open(filename, "r");
+	if(fp == NULL) return NULL;
+	str = unstr_file_read(NULL, fp);
+	UNSTR_TRACE_BYTES(str->length);
+	/* ファイルポインタをクローズ */
+	fclose(fp);
+	return str;
+}
+
+/**
+ * @brief			ファイルを丸ごと読み込み、文字列に書き込む
+ * @param[out]		dst			書き込み先文字列
+ * @param[in]		filename	ファイルパス
+ * @return			読み込み結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * dstのバッファがファイルサイズより大きい場合は新たに確保しない。
+ */
+unstr_bool_t unstr_file_get_contents_into(unstr_t *dst, const unstr_t *filename)
+{
+	FILE *fp = 0;
+	UNSTR_TRACE(UNSTR_TRACE_FILE_GET_CONTENTS_INTO, 0);
+	if(!unstr_isset(dst)){
+		return UNSTRING_FALSE;
+	}
+	fp = unstr_file_open(filename, "r");
+	if(fp == NULL) return UNSTRING_FALSE;
+	unstr_file_read(dst, fp);
+	UNSTR_TRACE_BYTES(dst->length);
+	fclose(fp);
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			開いたファイルの中身を全て読み込む
+ * @param[in,out]	str		格納先。NULLの場合はファイルサイズに合わせて確保する
+ * @param[in]		fp		ファイルポインタ
+ * @return			格納先
+ */
+static unstr_t *unstr_file_read(unstr_t *str, FILE *fp)
+{
+	long size = 0;
+	size_t getsize = 0;
+	/* ファイルサイズを求める */
+	/* ファイルポインタを最後まで移動 */
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	/* ファイルポインタを先頭に戻す */
+	rewind(fp);
+	if(size < 0){
+		size = 0;
+	}
+
+	/* ファイルサイズ分の領域を確保 */
+	if(str == NULL){
+		str = unstr_init_memory((size_t)size + 1);
+	} else {
+		unstr_zero(str);
+		if(unstr_check_heap_size(str, (size_t)size + 1)){
+			unstr_alloc(str, (size_t)size + 1);
+		}
+	}
+
+	/* 読み込み */
+	getsize = fread(str->data, 1, (size_t)size, fp);
+	str->data[getsize] = '\0';
+	str->length = getsize;
+	return str;
+}
+
+/**
+ * @brief		ファイルに書き出す
+ * @param[in]	filename	ファイルパス
+ * @param[in]	data		書き込む内容
+ * @param[in]	mode		書き込みモード
+ * @return		出力結果
+ * @return		UNSTRING_TRUE	成功
+ * @return		UNSTRING_FALSE	失敗
+ * @public
+ */
+unstr_bool_t unstr_file_put_contents(const unstr_t *filename, const unstr_t *data, const char *mode)
+{
+	FILE *fp = 0;
+	UNSTR_TRACE(UNSTR_TRACE_FILE_PUT_CONTENTS, unstr_strlen(data));
+	if(unstr_empty(data)) return UNSTRING_FALSE;
+	fp = unstr_file_open(filename, mode);
+	if(fp == NULL) return UNSTRING_FALSE;
+	/* ftell(fp); */
+	fwrite(data->data, 1, data->length, fp);
+	fclose(fp);
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		文字列を置換する。非破壊。
+ * @param[in]	data	対象文字列
+ * @param[in]	search	置換対象文字列
+ * @param[in]	replace	置換文字列
+ * @return		対象文字列から置換対象文字列を置換文字列に置換した文字列
+ * @public
+ */
+unstr_t *unstr_replace(const unstr_t *data, const unstr_t *search, const unstr_t *replace)
+{
+	unstr_t *str = 0;
+	unstr_search_t s;
+	UNSTR_TRACE(UNSTR_TRACE_REPLACE, unstr_strlen(data));
+
+	if(unstr_empty(data) || unstr_empty(search) || !unstr_isset(replace)){
+		return NULL;
+	}
+	unstr_search_init(&s, search->data, search->length);
+	str = unstr_init_memory(data->length);
+	unstr_replace_exec(str, data->data, data->length, &s, replace);
+	return str;
+}
+
+/**
+ * @brief			文字列を置換し、別の文字列に書き込む
+ * @param[out]		dst		書き込み先文字列
+ * @param[in]		data	対象文字列
+ * @param[in]		search	置換対象文字列
+ * @param[in]		replace	置換文字列
+ * @return			置換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * 置換のしかたはunstr_replaceと同じ。dstのバッファが足りる場合は新たに確保しない。
+ * dstに他の引数と同じ文字列を渡した場合は、作業用の文字列を経由する。
+ */
+unstr_bool_t unstr_replace_into(unstr_t *dst, const unstr_t *data, const unstr_t *search, const unstr_t *replace)
+{
+	unstr_t *tmp = 0;
+	unstr_search_t s;
+	UNSTR_TRACE(UNSTR_TRACE_REPLACE_INTO, unstr_strlen(data));
+
+	if(!unstr_isset(dst) || unstr_empty(data) || unstr_empty(search) || !unstr_isset(replace)){
+		return UNSTRING_FALSE;
+	}
+	unstr_search_init(&s, search->data, search->length);
+	if((dst == data) || (dst == search) || (dst == replace)){
+		tmp = unstr_init_memory(data->length);
+		unstr_replace_exec(tmp, data->data, data->length, &s, replace);
+		unstr_strcpy(dst, tmp);
+		unstr_free(tmp);
+		return UNSTRING_TRUE;
+	}
+	unstr_zero(dst);
+	unstr_replace_exec(dst, data->data, data->length, &s, replace);
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			置換した結果を文字列の後ろに追加する
+ * @param[in,out]	str		格納先。他の引数と別の文字列であること
+ * @param[in]		data	対象文字列
+ * @param[in]		len		対象文字列の長さ
+ * @param[in]		s		置換対象文字列の移動量表(空でないこと)
+ * @param[in]		replace	置換文字列
+ * @return			無し
+ */
+static void unstr_replace_exec(unstr_t *str, const char *data, size_t len, const unstr_search_t *s, const unstr_t *replace)
+{
+	size_t size = 0;
+	size_t pos = 0;
+	size_t index = 0;
+	/* 部分文字列は'\0'で終わっていないので、長さで区切って検索する */
+	while((index = unstr_search_exec(s, data, len, pos)) != UNSTR_NOT_FOUND){
+		size = index - pos;
+		if(unstr_check_heap_size(str, size + replace->length)){
+			unstr_alloc(str, size + replace->length);
+		}
+		memcpy(&(str->data[str->length]), data + pos, size);
+		str->length += size;
+		memcpy(&(str->data[str->length]), replace->data, replace->length);
+		str->length += replace->length;
+		pos = index + s->m;
+	}
+	if(pos < len){
+		size = len - pos;
+		if(unstr_check_heap_size(str, size)){
+			unstr_alloc(str, size);
+		}
+		memcpy(&(str->data[str->length]), data + pos, size);
+		str->length += size;
+	}
+	str->data[str->length] = '\0';
+}
+
+/**
+ * @brief		文字列を検索し、発見した文字位置を返す
+ * @param[in]	text	対象文字列
+ * @param[in]	search	検索文字列
+ * @return		文字位置
+ * @public
+ */
+int unstr_strpos(const unstr_t *text, const unstr_t *search)
+{
+	size_t pos = 0;
+	unstr_search_t s;
+	UNSTR_TRACE(UNSTR_TRACE_STRPOS, unstr_strlen(text));
+
+	if(unstr_empty(text) || unstr_empty(search)){
+		return -1;
+	}
+	// クイックサーチ
+	unstr_search_init(&s, search->data, search->length);
+	pos = unstr_search_exec(&s, text->data, text->length, 0);
+	if(pos == UNSTR_NOT_FOUND){
+		return -1;
+	}
+	return (int)pos;
+}
+
+/**
+ * @brief		出現数をカウント
+ * @param[in]	text	対象文字列
+ * @param[in]	search	検索文字列
+ * @return		検索文字列の出現数
+ * @public
+ */
+size_t unstr_substr_count(const unstr_t *text, const unstr_t *search)
+{
+	unstr_search_t s;
+	UNSTR_TRACE(UNSTR_TRACE_SUBSTR_COUNT, unstr_strlen(text));
+
+	if(unstr_empty(text) || unstr_empty(search)){
+		return 0;
+	}
+	// クイックサーチ
+	unstr_search_init(&s, search->data, search->length);
+	return unstr_search_count(&s, text->data, text->length);
+}
+
+/**
+ * @brief		出現数をカウント
+ * @param[in]	text	対象文字列
+ * @param[in]	search	検索文字列
+ * @return		検索文字列の出現数
+ * @public
+ */
+size_t unstr_substr_count_char(const unstr_t *text, const char *search)
+{
+	size_t count = 0;
+	unstr_t *str = 0;
+	UNSTR_TRACE(UNSTR_TRACE_SUBSTR_COUNT_CHAR, unstr_strlen(text));
+	if(search != NULL){
+		str = unstr_init(search);
+		count = unstr_substr_count(text, str);
+		unstr_free(str);
+	}
+	return count;
+}
+
+/**
+ * @brief			文字列をトークンで切り分ける
+ * @param[in,out]	str		対象文字列。
+ * @param[in]		delim	トークン(文字列可)
+ * @param[in,out]	index	インデックス値。次回呼び出し時に必要
+ * @return			切り出した文字列
+ * @public
+ *
+ * @par				詳細:
+ * delimで指定された「文字列」でstrを切り分けます。
+ */
+unstr_t *unstr_strtok(const unstr_t *str, const char *delim, size_t *index)
+{
+	unstr_t *data = 0;
+	size_t start = 0;
+	size_t len = 0;
+	UNSTR_TRACE(UNSTR_TRACE_STRTOK, 0);
+	if(!unstr_strtok_next(str, delim, index, &start, &len)){
+		return NULL;
+	}
+	UNSTR_TRACE_BYTES(len);
+	data = unstr_init_memory(len + 2);
+	unstr_write(data, str->data + start, 0, len);
+	return data;
+}
+
+/**
+ * @brief			文字列をトークンで切り分け、別の文字列に書き込む
+ * @param[out]		dst		書き込み先文字列。strとは別の文字列であること
+ * @param[in]		str		対象文字列
+ * @param[in]		delim	トークン(文字列可)
+ * @param[in,out]	index	インデックス値。次回呼び出し時に必要
+ * @return			切り出し結果
+ * @return			UNSTRING_TRUE	切り出した
+ * @return			UNSTRING_FALSE	終了、または引数が無効
+ * @public
+ * @par				詳細:
+ * 切り分け方はunstr_strtokと同じ。dstのバッファが足りる場合は新たに確保しない。
+ */
+unstr_bool_t unstr_strtok_into(unstr_t *dst, const unstr_t *str, const char *delim, size_t *index)
+{
+	size_t start = 0;
+	size_t len = 0;
+	UNSTR_TRACE(UNSTR_TRACE_STRTOK_INTO, 0);
+	if(!unstr_isset(dst) || !unstr_strtok_next(str, delim, index, &start, &len)){
+		return UNSTRING_FALSE;
+	}
+	UNSTR_TRACE_BYTES(len);
+	return unstr_write(dst, str->data + start, 0, len);
+}
+
+/**
+ * @brief			次のトークンの範囲を求める
+ * @param[in]		str		対象文字列
+ * @param[in]		delim	トークン(文字列可)
+ * @param[in,out]	index	インデックス値。次のトークンの先頭に進める
+ * @param[out]		start	トークンの開始位置
+ * @param[out]		len		トークンの長さ
+ * @return			結果
+ * @return			UNSTRING_TRUE	範囲を求めた
+ * @return			UNSTRING_FALSE	終了、または引数が無効
+ */
+static unstr_bool_t unstr_strtok_next(const unstr_t *str, const char *delim, size_t *index, size_t *start, size_t *len)
+{
+	size_t pos = 0;
+	size_t dlen = 0;
+	size_t slen = unstr_strlen(str);
+	unstr_search_t s;
+	if(unstr_empty(str)
+	|| (delim == NULL)
+	|| ((dlen = strlen(delim)) == 0)
+	|| (index == NULL)
+	|| (*index > slen)){
+		return UNSTRING_FALSE;
+	}
+	/* 部分文字列は'\0'で終わっていないので、長さで区切って検索する */
+	unstr_search_init(&s, delim, dlen);
+	pos = unstr_search_exec(&s, str->data, slen, *index);
+	*start = *index;
+	if(pos != UNSTR_NOT_FOUND){
+		*len = pos - (*index);
+		*index += *len + dlen;
+	} else {
+		*len = slen - (*index);
+		*index = slen + 1;
+	}
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		繰り返し文字列を生成する
+ * @param[in]	str		繰り返す文字列
+ * @param[in]	count	繰り返す回数
+ * @return		生成した文字列
+ * @public
+ */
+unstr_t *unstr_repeat(const unstr_t *str, size_t count)
+{
+	unstr_t *data = 0;
+	UNSTR_TRACE(UNSTR_TRACE_REPEAT, unstr_strlen(str) * count);
+	if(unstr_empty(str) || (count == 0) || (count > (((size_t)-1 - 2) / str->length))){
+		return NULL;
+	}
+	data = unstr_init_memory((str->length * count) + 2);
+	unstr_repeat_into(data, str, count);
+	return data;
+}
+
+/**
+ * @brief			繰り返し文字列を生成し、別の文字列に書き込む
+ * @param[out]		dst		書き込み先文字列
+ * @param[in]		str		繰り返す文字列
+ * @param[in]		count	繰り返す回数
+ * @return			生成結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * dstとstrが同じ場合はその場で繰り返す。dstのバッファが足りる場合は新たに確保しない。
+ */
+unstr_bool_t unstr_repeat_into(unstr_t *dst, const unstr_t *str, size_t count)
+{
+	size_t unit = 0;
+	size_t size = 0;
+	size_t filled = 0;
+	char c = 0;
+	UNSTR_TRACE(UNSTR_TRACE_REPEAT_INTO, unstr_strlen(str) * count);
+	if(!unstr_isset(dst) || unstr_empty(str) || (count == 0) || (count > (((size_t)-1 - 2) / str->length))){
+		return UNSTRING_FALSE;
+	}
+	unit = str->length;
+	size = unit * count;
+	c = str->data[0];
+	if(dst == str){
+		/* 先頭の1回分はそのまま使う */
+		UNSTR_DETACH(dst, unit);
+	} else {
+		unstr_zero(dst);
+	}
+	if(unstr_check_heap_size(dst, size + 1)){
+		unstr_alloc(dst, size + 1);
+	}
+	if(unit == 1){
+		memset(dst->data, c, size);
+	} else {
+		if(dst != str){
+			memcpy(dst->data, str->data, unit);
+		}
+		/* 書き込み済みの部分を倍々にコピーする */
+		filled = unit;
+		while(filled <= (size - filled)){
+			memcpy(dst->data + filled, dst->data, filled);
+			filled <<= 1;
+		}
+		memcpy(dst->data + filled, dst->data, size - filled);
+	}
+	dst->data[size] = '\0';
+	dst->length = size;
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		繰り返し文字列を生成する
+ * @param[in]	str		繰り返す文字列
+ * @param[in]	count	繰り返す回数
+ * @return		生成した文字列
+ * @public
+ */
+unstr_t *unstr_repeat_char(const char *str, size_t count)
+{
+	unstr_t *data = 0;
+	unstr_t *ret = 0;
+	UNSTR_TRACE(UNSTR_TRACE_REPEAT_CHAR, 0);
+	if(str != NULL){
+		data = unstr_init(str);
+		ret = unstr_repeat(data, count);
+		unstr_free(data);
+	}
+	return ret;
+}
+
+
+/**
+ * @brief		配列の全ての要素を検索し、発見した文字位置を格納する
+ * @param[in]	list	対象文字列の配列
+ * @param[in]	len		配列の要素数
+ * @param[in]	search	検索文字列
+ * @param[out]	result	文字位置の格納先(len個)。見つからない要素は-1。NULLなら格納しない
+ * @return		検索文字列を含む要素の数
+ * @public
+ * @par			詳細:
+ * unstr_strposを要素毎に呼ぶのと同じ結果になる。移動量表は1回だけ作る。
+ */
+size_t unstr_strpos_batch(unstr_t *const *list, size_t len, const unstr_t *search, int *result)
+{
+	UNSTR_TRACE(UNSTR_TRACE_STRPOS_BATCH, len);
+	if((list == NULL) && (len != 0)){
+		return 0;
+	}
+	return unstr_strpos_each(list, NULL, len, search, result);
+}
+
+/**
+ * @brief		範囲の配列の全ての要素を検索し、発見した文字位置を格納する
+ * @param[in]	views	対象範囲の配列
+ * @param[in]	len		配列の要素数
+ * @param[in]	search	検索文字列
+ * @param[out]	result	文字位置の格納先(len個)。見つからない要素は-1。NULLなら格納しない
+ * @return		検索文字列を含む要素の数
+ * @public
+ */
+size_t unstr_strpos_batch_view(const unstr_view_t *views, size_t len, const unstr_t *search, int *result)
+{
+	UNSTR_TRACE(UNSTR_TRACE_STRPOS_BATCH, len);
+	if((views == NULL) && (len != 0)){
+		return 0;
+	}
+	return unstr_strpos_each(NULL, views, len, search, result);
+}
+
+/**
+ * @brief		配列の要素毎に出現数をカウント
+ * @param[in]	list	対象文字列の配列
+ * @param[in]	len		配列の要素数
+ * @param[in]	search	検索文字列
+ * @param[out]	result	出現数の格納先(len個)。NULLなら格納しない
+ * @return		出現数の合計
+ * @public
+ * @par			詳細:
+ * unstr_substr_countを要素毎に呼ぶのと同じ結果になる。移動量表は1回だけ作る。
+ */
+size_t unstr_substr_count_batch(unstr_t *const *list, size_t len, const unstr_t *search, size_t *result)
+{
+	UNSTR_TRACE(UNSTR_TRACE_SUBSTR_COUNT_BATCH, len);
+	if((list == NULL) && (len != 0)){
+		return 0;
+	}
+	return unstr_substr_count_each(list, NULL, len, search, result);
+}
+
+/**
+ * @brief		範囲の配列の要素毎に出現数をカウント
+ * @param[in]	views	対象範囲の配列
+ * @param[in]	len		配列の要素数
+ * @param[in]	search	検索文字列
+ * @param[out]	result	出現数の格納先(len個)。NULLなら格納しない
+ * @return		出現数の合計
+ * @public
+ */
+size_t unstr_substr_count_batch_view(const unstr_view_t *views, size_t len, const unstr_t *search, size_t *result)
+{
+	UNSTR_TRACE(UNSTR_TRACE_SUBSTR_COUNT_BATCH, len);
+	if((views == NULL) && (len != 0)){
+		return 0;
+	}
+	return unstr_substr_count_each(NULL, views, len, search, result);
+}
+
+/**
+ * @brief		配列の全ての要素を1つの文字列と比較する
+ * @param[in]	list	比較文字列の配列
+ * @param[in]	len		配列の要素数
+ * @param[in]	s2		比較文字列
+ * @param[out]	result	比較結果の格納先(len個)。unstr_strcmpと同じ値。NULLなら格納しない
+ * @return		s2と同じ要素の数
+ * @public
+ * @par			詳細:
+ * 長さと先頭の1バイトで違いが分かる要素はmemcmpを呼ばない。
+ */
+size_t unstr_strcmp_batch(unstr_t *const *list, size_t len, const unstr_t *s2, int *result)
+{
+	UNSTR_TRACE(UNSTR_TRACE_STRCMP_BATCH, len);
+	if((list == NULL) && (len != 0)){
+		return 0;
+	}
+	return unstr_strcmp_each(list, NULL, len, s2, result);
+}
+
+/**
+ * @brief		範囲の配列の全ての要素を1つの文字列と比較する
+ * @param[in]	views	比較範囲の配列。dataがNULLの要素は無効
+ * @param[in]	len		配列の要素数
+ * @param[in]	s2		比較文字列
+ * @param[out]	result	比較結果の格納先(len個)。unstr_strcmpと同じ値。NULLなら格納しない
+ * @return		s2と同じ要素の数
+ * @public
+ */
+size_t unstr_strcmp_batch_view(const unstr_view_t *views, size_t len, const unstr_t *s2, int *result)
+{
+	UNSTR_TRACE(UNSTR_TRACE_STRCMP_BATCH, len);
+	if((views == NULL) && (len != 0)){
+		return 0;
+	}
+	return unstr_strcmp_each(NULL, views, len, s2, result);
+}
+
+/**
+ * @brief			配列の全ての要素を置換する
+ * @param[in,out]	dst		書き込み先の配列(len個)。NULLの要素は新しく確保する
+ * @param[in]		list	対象文字列の配列
+ * @param[in]		len		配列の要素数
+ * @param[in]		search	置換対象文字列
+ * @param[in]		replace	置換文字列
+ * @return			置換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	引数が無効
+ * @public
+ * @par				詳細:
+ * dst[i]にlist[i]を置換した結果を書き込む。空や無効な要素は空文字列になる。
+ * dstとlistに同じ配列を渡すと、その場で置換する。
+ */
+unstr_bool_t unstr_replace_batch(unstr_t **dst, unstr_t *const *list, size_t len, const unstr_t *search, const unstr_t *replace)
+{
+	UNSTR_TRACE(UNSTR_TRACE_REPLACE_BATCH, len);
+	if((list == NULL) && (len != 0)){
+		return UNSTRING_FALSE;
+	}
+	return unstr_replace_each(dst, list, NULL, len, search, replace);
+}
+
+/**
+ * @brief			範囲の配列の全ての要素を置換する
+ * @param[in,out]	dst		書き込み先の配列(len個)。NULLの要素は新しく確保する
+ * @param[in]		views	対象範囲の配列
+ * @param[in]		len		配列の要素数
+ * @param[in]		search	置換対象文字列
+ * @param[in]		replace	置換文字列
+ * @return			置換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	引数が無効
+ * @public
+ * @par				詳細:
+ * 範囲がdstの要素の中を指していてはいけない。
+ */
+unstr_bool_t unstr_replace_batch_view(unstr_t **dst, const unstr_view_t *views, size_t len, const unstr_t *search, const unstr_t *replace)
+{
+	UNSTR_TRACE(UNSTR_TRACE_REPLACE_BATCH, len);
+	if((views == NULL) && (len != 0)){
+		return UNSTRING_FALSE;
+	}
+	return unstr_replace_each(dst, NULL, views, len, search, replace);
+}
+
+/**
+ * @brief		配列の要素の範囲を取り出す
+ * @param[in]	list	文字列の配列。viewsがNULLの場合に使う
+ * @param[in]	views	範囲の配列
+ * @param[in]	i		要素の番号
+ * @param[out]	item	要素の範囲。無効な要素はdataをNULLにする
+ * @return		無し
+ */
+static void unstr_batch_item(unstr_t *const *list, const unstr_view_t *views, size_t i, unstr_view_t *item)
+{
+	if(views != NULL){
+		*item = views[i];
+	} else if(unstr_isset(list[i])){
+		item->data = list[i]->data;
+		item->length = list[i]->length;
+	} else {
+		item->data = NULL;
+		item->length = 0;
+	}
+}
+
+/**
+ * @brief		unstr_strpos_batchとunstr_strpos_batch_viewの本体
+ * @param[in]	list	文字列の配列
+ * @param[in]	views	範囲の配列。NULLでなければlistより優先する
+ * @param[in]	len		配列の要素数
+ * @param[in]	search	検索文字列
+ * @param[out]	result	文字位置の格納先
+ * @return		検索文字列を含む要素の数
+ */
+static size_t unstr_strpos_each(unstr_t *const *list, const unstr_view_t *views, size_t len, const unstr_t *search, int *result)
+{
+	unstr_search_t s;
+	unstr_view_t item;
+	size_t found = 0;
+	size_t pos = 0;
+	size_t i = 0;
+	if(unstr_empty(search)){
+		for(i = 0; (result != NULL) && (i < len); i++){
+			result[i] = -1;
+		}
+		return 0;
+	}
+	unstr_search_init(&s, search->data, search->length);
+	for(i = 0; i < len; i++){
+		unstr_batch_item(list, views, i, &item);
+		pos = UNSTR_NOT_FOUND;
+		if(item.data != NULL){
+			pos = unstr_search_exec(&s, item.data, item.length, 0);
+		}
+		if(pos != UNSTR_NOT_FOUND){
+			found++;
+		}
+		if(result != NULL){
+			result[i] = (pos == UNSTR_NOT_FOUND) ? -1 : (int)pos;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief		unstr_substr_count_batchとunstr_substr_count_batch_viewの本体
+ * @param[in]	list	文字列の配列
+ * @param[in]	views	範囲の配列。NULLでなければlistより優先する
+ * @param[in]	len		配列の要素数
+ * @param[in]	search	検索文字列
+ * @param[out]	result	出現数の格納先
+ * @return		出現数の合計
+ */
+static size_t unstr_substr_count_each(unstr_t *const *list, const unstr_view_t *views, size_t len, const unstr_t *search, size_t *result)
+{
+	unstr_search_t s;
+	unstr_view_t item;
+	size_t total = 0;
+	size_t count = 0;
+	size_t i = 0;
+	if(unstr_empty(search)){
+		for(i = 0; (result != NULL) && (i < len); i++){
+			result[i] = 0;
+		}
+		return 0;
+	}
+	unstr_search_init(&s, search->data, search->length);
+	for(i = 0; i < len; i++){
+		unstr_batch_item(list, views, i, &item);
+		count = (item.data == NULL) ? 0 : unstr_search_count(&s, item.data, item.length);
+		total += count;
+		if(result != NULL){
+			result[i] = count;
+		}
+	}
+	return total;
+}
+
+/**
+ * @brief		unstr_strcmp_batchとunstr_strcmp_batch_viewの本体
+ * @param[in]	list	文字列の配列
+ * @param[in]	views	範囲の配列。NULLでなければlistより優先する
+ * @param[in]	len		配列の要素数
+ * @param[in]	s2		比較文字列
+ * @param[out]	result	比較結果の格納先
+ * @return		s2と同じ要素の数
+ */
+static size_t unstr_strcmp_each(unstr_t *const *list, const unstr_view_t *views, size_t len, const unstr_t *s2, int *result)
+{
+	unstr_view_t item;
+	size_t same = 0;
+	size_t i = 0;
+	int ret = 0;
+	unsigned char first = 0;
+	if(unstr_isset(s2) && (s2->length != 0)){
+		first = (unsigned char)s2->data[0];
+	}
+	for(i = 0; i < len; i++){
+		unstr_batch_item(list, views, i, &item);
+		/* 長さと先頭の1バイトで決まる場合はmemcmpを呼ばない */
+		if((item.data == NULL) || !unstr_isset(s2) || (item.length != s2->length)){
+			ret = 0x100;
+		} else if(item.length == 0){
+			ret = 0;
+		} else if((unsigned char)item.data[0] != first){
+			ret = (int)(unsigned char)item.data[0] - (int)first;
+		} else {
+			ret = memcmp(item.data, s2->data, item.length);
+		}
+		if(ret == 0){
+			same++;
+		}
+		if(result != NULL){
+			result[i] = ret;
+		}
+	}
+	return same;
+}
+
+/**
+ * @brief			unstr_replace_batchとunstr_replace_batch_viewの本体
+ * @param[in,out]	dst		書き込み先の配列
+ * @param[in]		list	文字列の配列
+ * @param[in]		views	範囲の配列。NULLでなければlistより優先する
+ * @param[in]		len		配列の要素数
+ * @param[in]		search	置換対象文字列
+ * @param[in]		replace	置換文字列
+ * @return			置換結果
+ * @par				詳細:
+ * 移動量表と、書き込み先が対象と同じ場合の作業用の文字列は1回だけ作る。
+ */
+static unstr_bool_t unstr_replace_each(unstr_t **dst, unstr_t *const *list, const unstr_view_t *views, size_t len, const unstr_t *search, const unstr_t *replace)
+{
+	unstr_search_t s;
+	unstr_view_t item;
+	unstr_t *tmp = 0;
+	size_t i = 0;
+	if(((dst == NULL) && (len != 0)) || unstr_empty(search) || !unstr_isset(replace)){
+		return UNSTRING_FALSE;
+	}
+	unstr_search_init(&s, search->data, search->length);
+	for(i = 0; i < len; i++){
+		unstr_batch_item(list, views, i, &item);
+		if(item.data == NULL){
+			item.length = 0;
+		}
+		if(!unstr_isset(dst[i])){
+			unstr_free(dst[i]);
+			dst[i] = unstr_init_memory(item.length + 2);
+		} else if(((list != NULL) && (views == NULL) && (dst[i] == list[i])) || (dst[i] == search) || (dst[i] == replace)){
+			/* 対象に書き込む場合は作業用の文字列を経由する */
+			if(tmp == NULL){
+				tmp = unstr_init_memory(item.length + 2);
+			}
+			unstr_zero(tmp);
+			unstr_replace_exec(tmp, item.data, item.length, &s, replace);
+			unstr_strcpy(dst[i], tmp);
+			continue;
+		} else {
+			unstr_zero(dst[i]);
+		}
+		unstr_replace_exec(dst[i], item.data, item.length, &s, replace);
+	}
+	unstr_free(tmp);
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			ASCIIの小文字を大文字に変換する。破壊的。
+ * @param[in,out]	str		対象文字列
+ * @return			変換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ */
+unstr_bool_t unstr_toupper(unstr_t *str)
+{
+	UNSTR_TRACE(UNSTR_TRACE_TOUPPER, unstr_strlen(str));
+	if(!unstr_isset(str)){
+		return UNSTRING_FALSE;
+	}
+	UNSTR_DETACH(str, str->length);
+	unstr_convert_case(str->data, str->length, 'a', -0x20);
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			ASCIIの大文字を小文字に変換する。破壊的。
+ * @param[in,out]	str		対象文字列
+ * @return			変換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ */
+unstr_bool_t unstr_tolower(unstr_t *str)
+{
+	UNSTR_TRACE(UNSTR_TRACE_TOLOWER, unstr_strlen(str));
+	if(!unstr_isset(str)){
+		return UNSTRING_FALSE;
+	}
+	UNSTR_DETACH(str, str->length);
+	unstr_convert_case(str->data, str->length, 'A', 0x20);
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		ASCIIの大文字小文字を区別せずに文字列を比較する
+ * @param[in]	s1		比較文字列1
+ * @param[in]	s2		比較文字列2
+ * @return		比較結果
+ * @return		0			同じ
+ * @return		0x100		エラー
+ * @return		上記以外	違う(小文字にした文字コードの差分)
+ * @public
+ * @par			詳細:
+ * unstr_strcmpと同じく、長さが違う場合は0x100を返す。
+ */
+int unstr_strcasecmp(const unstr_t *s1, const unstr_t *s2)
+{
+	int ret = 0x100;
+	UNSTR_TRACE(UNSTR_TRACE_STRCASECMP, unstr_strlen(s1));
+	if(unstr_isset(s1) && unstr_isset(s2)){
+		if(s1->length == s2->length){
+			ret = unstr_memcasecmp((const unsigned char *)s1->data, (const unsigned char *)s2->data, s1->length);
+		}
+	}
+	return ret;
+}
+
+/**
+ * @brief		ASCIIの大文字小文字を区別せずに検索し、発見した文字位置を返す
+ * @param[in]	text	対象文字列
+ * @param[in]	search	検索文字列
+ * @return		文字位置。見つからない場合は負の値
+ * @public
+ */
+int unstr_stripos(const unstr_t *text, const unstr_t *search)
+{
+	size_t pos = 0;
+	unstr_search_t s;
+	UNSTR_TRACE(UNSTR_TRACE_STRIPOS, unstr_strlen(text));
+
+	if(unstr_empty(text) || unstr_empty(search)){
+		return -1;
+	}
+	unstr_search_init_case(&s, search->data, search->length);
+	pos = unstr_search_exec_case(&s, text->data, text->length, 0);
+	if(pos == UNSTR_NOT_FOUND){
+		return -1;
+	}
+	return (int)pos;
+}
+
+/**
+ * @brief		ASCIIの大文字小文字を区別せずに出現数をカウント
+ * @param[in]	text	対象文字列
+ * @param[in]	search	検索文字列
+ * @return		検索文字列の出現数
+ * @public
+ */
+size_t unstr_substr_icount(const unstr_t *text, const unstr_t *search)
+{
+	size_t count = 0;
+	size_t pos = 0;
+	unstr_search_t s;
+	UNSTR_TRACE(UNSTR_TRACE_SUBSTR_ICOUNT, unstr_strlen(text));
+
+	if(unstr_empty(text) || unstr_empty(search)){
+		return 0;
+	}
+	unstr_search_init_case(&s, search->data, search->length);
+	while((pos = unstr_search_exec_case(&s, text->data, text->length, pos)) != UNSTR_NOT_FOUND){
+		count++;
+		pos++;
+	}
+	return count;
+}
+
+/**
+ * @brief		UTF-8として正しいか調べる
+ * @param[in]	str		対象文字列
+ * @return		結果
+ * @return		UNSTRING_TRUE	正しい(空文字列を含む)
+ * @return		UNSTRING_FALSE	不正なバイトを含む、またはstrが無効
+ * @public
+ * @par			詳細:
+ * 冗長な表現、サロゲート、U+10FFFFを超える値も不正とする。
+ */
+unstr_bool_t unstr_utf8_valid(const unstr_t *str)
+{
+	UNSTR_TRACE(UNSTR_TRACE_UTF8_VALID, unstr_strlen(str));
+	if(!unstr_isset(str)){
+		return UNSTRING_FALSE;
+	}
+	if(unstr_utf8_check((const unsigned char *)str->data, str->length) != UNSTR_NOT_FOUND){
+		return UNSTRING_FALSE;
+	}
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		UTF-8の文字数を返す
+ * @param[in]	str		対象文字列
+ * @return		文字数
+ * @public
+ * @par			詳細:
+ * 不正なバイト列は検査しない。継続バイト以外のバイトを1文字と数える。
+ */
+size_t unstr_utf8_strlen(const unstr_t *str)
+{
+	UNSTR_TRACE(UNSTR_TRACE_UTF8_STRLEN, unstr_strlen(str));
+	if(!unstr_isset(str)){
+		return 0;
+	}
+	return unstr_utf8_count((const unsigned char *)str->data, str->length);
+}
+
+/**
+ * @brief		UTF-8の文字番号をバイト位置に変換する
+ * @param[in]	str		対象文字列
+ * @param[in]	index	文字番号(0から)
+ * @return		バイト位置
+ * @return		UNSTRING_NPOS	indexが文字数を超える、またはstrが無効
+ * @public
+ * @par			詳細:
+ * indexが文字数と同じ場合は文字列の長さを返す。
+ */
+size_t unstr_utf8_offset(const unstr_t *str, size_t index)
+{
+	UNSTR_TRACE(UNSTR_TRACE_UTF8_OFFSET, 0);
+	if(!unstr_isset(str)){
+		return UNSTRING_NPOS;
+	}
+	return unstr_utf8_seek((const unsigned char *)str->data, str->length, index);
+}
+
+/**
+ * @brief			文字単位で切り出す
+ * @param[out]		s1		コピー先文字列
+ * @param[in]		s2		対象文字列
+ * @param[in]		start	開始する文字番号
+ * @param[in]		len		切り出す文字数
+ * @return			切り出し結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * unstr_substrと違い、UTF-8の文字の途中で切らない。
+ * lenが残りの文字数より多い場合は末尾まで切り出す。startが文字数を超える場合は失敗。
+ */
+unstr_bool_t unstr_utf8_substr(unstr_t *s1, const unstr_t *s2, size_t start, size_t len)
+{
+	const unsigned char *p = 0;
+	size_t begin = 0;
+	size_t end = 0;
+	UNSTR_TRACE(UNSTR_TRACE_UTF8_SUBSTR, 0);
+	if(!unstr_isset(s1) || unstr_empty(s2)){
+		return UNSTRING_FALSE;
+	}
+	p = (const unsigned char *)s2->data;
+	begin = unstr_utf8_seek(p, s2->length, start);
+	if(begin == UNSTR_NOT_FOUND){
+		return UNSTRING_FALSE;
+	}
+	end = unstr_utf8_seek(p + begin, s2->length - begin, len);
+	end = (end == UNSTR_NOT_FOUND) ? s2->length : (begin + end);
+	UNSTR_TRACE_BYTES(end);
+	return unstr_write(s1, s2->data + begin, 0, end - begin);
+}
+
+/**
+ * @brief		文字単位で反転させた文字列を返す。非破壊。
+ * @param[in]	str		対象文字列
+ * @return		反転した文字列
+ * @public
+ * @par			詳細:
+ * UTF-8の1文字の中のバイト順は保つ。先頭バイトに続く継続バイトは
+ * 最大3個までを1文字とみなし、単独の継続バイトは1バイトで1文字とする。
+ */
+unstr_t *unstr_utf8_reverse(const unstr_t *str)
+{
+	const unsigned char *p = 0;
+	unstr_t *ret = 0;
+	size_t len = 0;
+	size_t i = 0;
+	size_t n = 0;
+	size_t k = 0;
+	UNSTR_TRACE(UNSTR_TRACE_UTF8_REVERSE, unstr_strlen(str));
+	if(unstr_empty(str)) return NULL;
+	p = (const unsigned char *)str->data;
+	len = str->length;
+	ret = unstr_init_memory(len + 1);
+	while(i < len){
+#if defined(__SSE2__)
+		/* ASCIIだけの16バイトはまとめて反転する */
+		if((p[i] < 0x80)
+		&& ((i + 16) <= len)
+		&& (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i))) == 0)){
+			unstr_reverse_copy(ret->data + len - i - 16, str->data + i, 16);
+			i += 16;
+			continue;
+		}
+#endif
+		n = 1;
+		if(p[i] >= 0xC0){
+			while((n < 4) && ((i + n) < len) && ((p[i + n] & 0xC0) == 0x80)){
+				n++;
+			}
+		}
+		for(k = 0; k < n; k++){
+			ret->data[len - i - n + k] = str->data[i + k];
+		}
+		i += n;
+	}
+	ret->data[len] = '\0';
+	ret->length = len;
+	return ret;
+}
+
+/**
+ * @brief		正規表現をコンパイルする
+ * @param[in]	pattern	正規表現
+ * @return		コンパイルした正規表現。構文が誤っている場合はNULL
+ * @public
+ * @par			詳細:
+ * POSIXの拡張正規表現の主な構文を扱う。後方参照と部分一致の取得は無い。\n
+ * 文字、.(改行を含む任意の1バイト)、[...]、[^...]、[:alpha:]等の文字クラス、
+ * \\d \\w \\s \\D \\W \\S、\\n \\t \\r \\f \\v \\xHH、^ $、( )、|、* + ? {m} {m,} {m,n}\n
+ * 一致は最も左から始まるものの中で最も長いもの(POSIXと同じ)で、バイト単位で比較する。\n
+ * DFAは検索しながら必要な分だけ作り、大きくなり過ぎたら作り直すので、
+ * 1回の検索は対象文字列の長さに比例する時間で終わる。
+ * DFAを書き換えるので、同じunstr_regex_tを複数のスレッドで同時に使ってはいけない。
+ */
+unstr_regex_t *unstr_regex_compile(const char *pattern)
+{
+	unstr_regex_parser_t ps;
+	unstr_regex_t *re = 0;
+	unsigned short classes[UNSTR_REGEX_SYMBOLS];
+	int remap[UNSTR_REGEX_SYMBOLS * 2];
+	size_t len = 0;
+	size_t i = 0;
+	int root = 0;
+	int next = 0;
+	int c = 0;
+	int k = 0;
+
+	if(pattern == NULL){
+		return NULL;
+	}
+	memset(&ps, 0, sizeof(ps));
+	ps.p = (const unsigned char *)pattern;
+	root = unstr_regex_parse_alt(&ps);
+	if(ps.error || (*(ps.p) != '\0')){
+		free(ps.nodes);
+		return NULL;
+	}
+	re = (unstr_regex_t *)unstr_malloc(sizeof(unstr_regex_t));
+	if(re == NULL){
+		free(ps.nodes);
+		return NULL;
+	}
+	memset(re, 0, sizeof(unstr_regex_t));
+	/* 後ろから読むNFAは連結の順番を逆にして作る */
+	re->fwd.match = unstr_regex_add_state(&(re->fwd), UNSTR_REGEX_STATE_MATCH, -1, -1, NULL);
+	re->fwd.start = unstr_regex_emit(&(re->fwd), ps.nodes, root, re->fwd.match, UNSTRING_FALSE);
+	re->rev.match = unstr_regex_add_state(&(re->rev), UNSTR_REGEX_STATE_MATCH, -1, -1, NULL);
+	re->rev.start = unstr_regex_emit(&(re->rev), ps.nodes, root, re->rev.match, UNSTRING_TRUE);
+	if((re->fwd.start < 0) || (re->rev.start < 0)){
+		free(ps.nodes);
+		unstr_regex_free(re);
+		return NULL;
+	}
+	/* どの集合でも区別されない記号を同じ種類にまとめ、遷移表を小さくする。
+	 * 先頭と終端の記号はバイトと扱いが違うので、必ず別の種類にする */
+	re->classes[UNSTR_REGEX_EOT] = 1;
+	re->classes[UNSTR_REGEX_BOT] = 2;
+	re->nclass = 3;
+	for(i = 0; i < ps.count; i++){
+		if(ps.nodes[i].type != UNSTR_REGEX_NODE_SET){
+			continue;
+		}
+		for(k = 0; k < (int)(re->nclass * 2); k++){
+			remap[k] = -1;
+		}
+		next = 0;
+		for(c = 0; c < UNSTR_REGEX_SYMBOLS; c++){
+			k = (re->classes[c] * 2) + (int)UNSTR_REGEX_HAS(ps.nodes[i].set, c);
+			if(remap[k] < 0){
+				remap[k] = next++;
+			}
+			classes[c] = (unsigned short)remap[k];
+		}
+		memcpy(re->classes, classes, sizeof(classes));
+		re->nclass = (size_t)next;
+	}
+	for(c = UNSTR_REGEX_SYMBOLS - 1; c >= 0; c--){
+		re->rep[re->classes[c]] = c;
+	}
+	/* 先頭の固定文字列はクイックサーチで読み飛ばす */
+	re->prefix_data = (char *)unstr_malloc(strlen(pattern) + 1);
+	if(re->prefix_data == NULL){
+		free(ps.nodes);
+		unstr_regex_free(re);
+		return NULL;
+	}
+	unstr_regex_prefix(ps.nodes, root, re->prefix_data, &len);
+	unstr_search_init(&(re->prefix), re->prefix_data, len);
+	free(ps.nodes);
+
+	re->mark_count = (re->fwd.count > re->rev.count) ? re->fwd.count : re->rev.count;
+	re->mark = (unsigned int *)unstr_malloc(re->mark_count * sizeof(unsigned int));
+	re->stack = (int *)unstr_malloc(((re->mark_count * 2) + 2) * sizeof(int));
+	re->key = (int *)unstr_malloc(((re->mark_count * 2) + 2) * sizeof(int));
+	if((re->mark == NULL) || (re->stack == NULL) || (re->key == NULL)){
+		unstr_regex_free(re);
+		return NULL;
+	}
+	memset(re->mark, 0, re->mark_count * sizeof(unsigned int));
+	re->search.nfa = &(re->fwd);
+	re->search.unanchored = UNSTRING_TRUE;
+	re->search.accel = (len != 0) ? UNSTRING_TRUE : UNSTRING_FALSE;
+	re->anchored.nfa = &(re->fwd);
+	re->reverse.nfa = &(re->rev);
+	return re;
+}
+
+/**
+ * @brief		コンパイルした正規表現を開放する
+ * @param[in]	re		開放する正規表現
+ * @return		無し
+ * @public
+ */
+void unstr_regex_free(unstr_regex_t *re)
+{
+	if(re == NULL){
+		return;
+	}
+	free(re->fwd.states);
+	free(re->rev.states);
+	unstr_regex_dfa_free(&(re->search));
+	unstr_regex_dfa_free(&(re->anchored));
+	unstr_regex_dfa_free(&(re->reverse));
+	free(re->prefix_data);
+	free(re->mark);
+	free(re->stack);
+	free(re->key);
+	free(re);
+}
+
+/**
+ * @brief		文字列全体が正規表現に一致するか調べる
+ * @param[in]	re		正規表現
+ * @param[in]	str		対象文字列
+ * @return		結果
+ * @return		UNSTRING_TRUE	一致
+ * @return		UNSTRING_FALSE	不一致、または引数が無効
+ * @public
+ */
+unstr_bool_t unstr_regex_match(unstr_regex_t *re, const unstr_t *str)
+{
+	UNSTR_TRACE(UNSTR_TRACE_REGEX_MATCH, unstr_strlen(str));
+	if((re == NULL) || !unstr_isset(str)){
+		return UNSTRING_FALSE;
+	}
+	/* 先頭から一致する最も長いものが末尾まで届けば全体が一致する */
+	if(unstr_regex_forward(re, &(re->anchored), (const unsigned char *)str->data, str->length, 0) == str->length){
+		return UNSTRING_TRUE;
+	}
+	return UNSTRING_FALSE;
+}
+
+/**
+ * @brief		正規表現に一致する部分を検索する
+ * @param[in]	re		正規表現
+ * @param[in]	str		対象文字列
+ * @param[in]	offset	検索開始位置
+ * @param[out]	match	一致した範囲の格納先。NULLなら格納しない
+ * @return		一致した位置。見つからない場合や引数が無効な場合はUNSTRING_NPOS
+ * @public
+ * @par			詳細:
+ * offsetより前は一致に含めない。^は文字列の先頭にだけ一致するので、offsetが0でなければ一致しない。
+ */
+size_t unstr_regex_search(unstr_regex_t *re, const unstr_t *str, size_t offset, unstr_view_t *match)
+{
+	UNSTR_TRACE(UNSTR_TRACE_REGEX_SEARCH, unstr_strlen(str));
+	if((re == NULL) || !unstr_isset(str) || (offset > str->length)){
+		return UNSTRING_NPOS;
+	}
+	return unstr_regex_exec(re, str, offset, match);
+}
+
+/**
+ * @brief		正規表現に一致する部分を全て検索する
+ * @param[in]	re		正規表現
+ * @param[in]	str		対象文字列
+ * @param[out]	views	一致した範囲の格納先。NULLなら数えるだけ
+ * @param[in]	size	viewsの要素数
+ * @return		一致した数(viewsがあればsize以下)
+ * @public
+ * @par			詳細:
+ * 一致は重ならない。空文字列に一致した場合は次の位置から検索を続ける。
+ */
+size_t unstr_regex_find_all(unstr_regex_t *re, const unstr_t *str, unstr_view_t *views, size_t size)
+{
+	unstr_view_t view;
+	size_t count = 0;
+	size_t pos = 0;
+	UNSTR_TRACE(UNSTR_TRACE_REGEX_FIND_ALL, unstr_strlen(str));
+	if((re == NULL) || !unstr_isset(str)){
+		return 0;
+	}
+	while((pos <= str->length) && ((views == NULL) || (count < size))){
+		pos = unstr_regex_exec(re, str, pos, &view);
+		if(pos == UNSTR_NOT_FOUND){
+			break;
+		}
+		if(views != NULL){
+			views[count] = view;
+		}
+		count++;
+		pos += (view.length != 0) ? view.length : 1;
+	}
+	return count;
+}
+
+/**
+ * @brief		一致する範囲を検索する
+ * @param[in]	re		正規表現
+ * @param[in]	str		対象文字列(有効であること)
+ * @param[in]	offset	検索開始位置(長さ以下であること)
+ * @param[out]	match	一致した範囲の格納先。NULLなら格納しない
+ * @return		一致した位置。見つからない場合はUNSTR_NOT_FOUND
+ * @par			詳細:
+ * 前から読んで最も左から始まる一致の終わりを求め、そこから後ろへ読んで始まりを求める。
+ */
+static size_t unstr_regex_exec(unstr_regex_t *re, const unstr_t *str, size_t offset, unstr_view_t *match)
+{
+	const unsigned char *t = (const unsigned char *)str->data;
+	size_t start = 0;
+	size_t end = 0;
+	end = unstr_regex_forward(re, &(re->search), t, str->length, offset);
+	if(end == UNSTR_NOT_FOUND){
+		return UNSTR_NOT_FOUND;
+	}
+	start = unstr_regex_backward(re, t, str->length, end, offset);
+	if(start == UNSTR_NOT_FOUND){
+		return UNSTR_NOT_FOUND;
+	}
+	if(match != NULL){
+		match->data = str->data + start;
+		match->length = end - start;
+	}
+	return start;
+}
+
+/**
+ * @brief		DFAで前から読み、一致が終わる位置を求める
+ * @param[in]	re		正規表現
+ * @param[in]	dfa		使うDFA(searchかanchored)
+ * @param[in]	t		対象文字列
+ * @param[in]	n		対象文字列の長さ
+ * @param[in]	pos		読み始める位置
+ * @return		最も左から始まる一致の中で最も長いものの終わり。無いか、領域の確保に失敗した場合はUNSTR_NOT_FOUND
+ */
+static size_t unstr_regex_forward(unstr_regex_t *re, unstr_regex_dfa_t *dfa, const unsigned char *t, size_t n, size_t pos)
+{
+	const unsigned short *classes = re->classes;
+	size_t nclass = re->nclass;
+	size_t found = UNSTR_NOT_FOUND;
+	size_t i = pos;
+	int s = unstr_regex_start(re, dfa);
+	int next = 0;
+	if(s < 0){
+		return UNSTR_NOT_FOUND;
+	}
+	if(dfa->states[s].match){
+		found = pos;
+	}
+	if(pos == 0){
+		s = unstr_regex_anchor(re, dfa, s, UNSTR_REGEX_BOT);
+		if(s < 0){
+			return UNSTR_NOT_FOUND;
+		}
+		if(dfa->states[s].match){
+			found = 0;
+		}
+	}
+	while(!dfa->states[s].dead){
+		if(i >= n){
+			s = unstr_regex_anchor(re, dfa, s, UNSTR_REGEX_EOT);
+			if(s < 0){
+				return UNSTR_NOT_FOUND;
+			}
+			if(dfa->states[s].match){
+				found = n;
+			}
+			break;
+		}
+		if(dfa->states[s].idle){
+			/* 途中まで一致しているものが無ければ、次に固定文字列が現れる位置まで飛ばせる */
+			i = unstr_search_exec(&(re->prefix), (const char *)t, n, i);
+			if(i == UNSTR_NOT_FOUND){
+				break;
+			}
+		}
+		next = dfa->trans[((size_t)s * nclass) + classes[t[i]]];
+		if(next < 0){
+			next = unstr_regex_step(re, dfa, s, classes[t[i]]);
+			if(next < 0){
+				return UNSTR_NOT_FOUND;
+			}
+		}
+		s = next;
+		i++;
+		if(dfa->states[s].match){
+			found = i;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief		DFAで一致の終わりから後ろへ読み、一致が始まる位置を求める
+ * @param[in]	re		正規表現
+ * @param[in]	t		対象文字列
+ * @param[in]	n		対象文字列の長さ
+ * @param[in]	end		一致の終わり
+ * @param[in]	pos		これより前は読まない
+ * @return		endで終わる一致の中で最も左の始まり。領域の確保に失敗した場合はUNSTR_NOT_FOUND
+ */
+static size_t unstr_regex_backward(unstr_regex_t *re, const unsigned char *t, size_t n, size_t end, size_t pos)
+{
+	unstr_regex_dfa_t *dfa = &(re->reverse);
+	const unsigned short *classes = re->classes;
+	size_t nclass = re->nclass;
+	size_t found = UNSTR_NOT_FOUND;
+	size_t i = end;
+	int s = unstr_regex_start(re, dfa);
+	int next = 0;
+	if(s < 0){
+		return UNSTR_NOT_FOUND;
+	}
+	if(dfa->states[s].match){
+		found = end;
+	}
+	if(end == n){
+		s = unstr_regex_anchor(re, dfa, s, UNSTR_REGEX_EOT);
+		if(s < 0){
+			return UNSTR_NOT_FOUND;
+		}
+		if(dfa->states[s].match){
+			found = end;
+		}
+	}
+	while(!dfa->states[s].dead && (i > pos)){
+		i--;
+		next = dfa->trans[((size_t)s * nclass) + classes[t[i]]];
+		if(next < 0){
+			next = unstr_regex_step(re, dfa, s, classes[t[i]]);
+			if(next < 0){
+				return UNSTR_NOT_FOUND;
+			}
+		}
+		s = next;
+		if(dfa->states[s].match){
+			found = i;
+		}
+	}
+	if(!dfa->states[s].dead && (i == 0)){
+		s = unstr_regex_anchor(re, dfa, s, UNSTR_REGEX_BOT);
+		if(s < 0){
+			return UNSTR_NOT_FOUND;
+		}
+		if(dfa->states[s].match){
+			found = 0;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief		DFAの開始状態を求める
+ * @param[in]	re		正規表現
+ * @param[in]	dfa		DFA
+ * @return		状態の番号。領域の確保に失敗した場合は-1
+ */
+static int unstr_regex_start(unstr_regex_t *re, unstr_regex_dfa_t *dfa)
+{
+	unstr_bool_t flushed = UNSTRING_FALSE;
+	size_t len = 1;
+	size_t i = 0;
+	unstr_regex_next_gen(re);
+	re->key[0] = 0;
+	unstr_regex_closure(re, dfa->nfa, dfa->nfa->start, &len);
+	qsort(re->key + 1, len - 1, sizeof(int), unstr_regex_compare_int);
+	re->key[len++] = -1;
+	for(i = 1; i < len; i++){
+		if(re->key[i] == dfa->nfa->match){
+			re->key[0] = 1;
+		}
+	}
+	if(dfa->accel && (dfa->init == NULL)){
+		/* 確保できなければ読み飛ばさないだけで、一致の結果は変わらない */
+		dfa->init = (int *)unstr_malloc(len * sizeof(int));
+		if(dfa->init != NULL){
+			memcpy(dfa->init, re->key, len * sizeof(int));
+			dfa->init_len = len;
+		}
+	}
+	return unstr_regex_intern(re, dfa, len, &flushed);
+}
+
+/**
+ * @brief		DFAの遷移先を作る
+ * @param[in]	re		正規表現
+ * @param[in]	dfa		DFA
+ * @param[in]	si		遷移元の状態
+ * @param[in]	cls		読んだ記号の種類
+ * @return		遷移先の状態。領域の確保に失敗した場合は-1
+ * @par			詳細:
+ * NFAの状態を始まりの位置が左のものから順に組に分けて持つ。
+ * 同じNFAの状態が複数の組にある場合は左の組だけに残す。
+ * ある組が一致したらそれより右の組を捨て、新しく一致を始めるのもやめる。
+ * これで最も左から始まるものが、その中で最も長く一致するまで読み進められる。
+ */
+static int unstr_regex_step(unstr_regex_t *re, unstr_regex_dfa_t *dfa, int si, int cls)
+{
+	const unstr_regex_nfa_t *nfa = dfa->nfa;
+	const unstr_regex_state_t *st = nfa->states;
+	const int *src = dfa->keys + dfa->states[si].key;
+	size_t srclen = dfa->states[si].len;
+	int *key = re->key;
+	int sym = re->rep[cls];
+	unstr_bool_t flushed = UNSTRING_FALSE;
+	size_t begin = 1;
+	size_t len = 1;
+	size_t i = 0;
+	int ns = 0;
+	int q = 0;
+	unstr_regex_next_gen(re);
+	key[0] = src[0];
+	for(i = 1; i < srclen; i++){
+		q = src[i];
+		if(q < 0){
+			if(len > begin){
+				qsort(key + begin, len - begin, sizeof(int), unstr_regex_compare_int);
+				key[len++] = -1;
+			}
+			begin = len;
+		} else if((st[q].type == UNSTR_REGEX_STATE_SET) && UNSTR_REGEX_HAS(st[q].set, sym)){
+			unstr_regex_closure(re, nfa, st[q].out, &len);
+		} else if((sym >= 256) && (re->mark[q] != re->gen)){
+			/* 先頭と終端の記号は位置を進めないので、読まないものもそのまま残す */
+			re->mark[q] = re->gen;
+			key[len++] = q;
+		}
+	}
+	/* まだ一致していなければ、次の位置から始まるものを最後の組として加える */
+	if(dfa->unanchored && (key[0] == 0) && (sym < 256)){
+		unstr_regex_closure(re, nfa, nfa->start, &len);
+		if(len > begin){
+			qsort(key + begin, len - begin, sizeof(int), unstr_regex_compare_int);
+			key[len++] = -1;
+		}
+	}
+	for(i = 1; i < len; i++){
+		if(key[i] == nfa->match){
+			while(key[i] >= 0){
+				i++;
+			}
+			len = i + 1;
+			key[0] = 1;
+			break;
+		}
+	}
+	ns = unstr_regex_intern(re, dfa, len, &flushed);
+	if((ns >= 0) && !flushed){
+		dfa->trans[((size_t)si * re->nclass) + cls] = ns;
+	}
+	return ns;
+}
+
+/**
+ * @brief		先頭か終端の記号を、それを待つNFAの状態が無くなるまで読む
+ * @param[in]	re		正規表現
+ * @param[in]	dfa		DFA
+ * @param[in]	s		読む前の状態
+ * @param[in]	sym		UNSTR_REGEX_BOTかUNSTR_REGEX_EOT
+ * @return		読んだ後の状態。領域の確保に失敗した場合は-1
+ * @par			詳細:
+ * ^と$は位置を進めない条件なので、^^や(a$|b)$のように条件を通った先に
+ * また同じ条件があれば、同じ位置でもう一度読む。(^)*のように読んでも
+ * 残り続ける場合があるので、NFAの状態数で打ち切る。
+ * 状態の数が上限に達するとDFAは作り直されて番号が変わるので、
+ * 番号が同じかどうかでは止めずに、待っている状態があるかを調べる。
+ */
+static int unstr_regex_anchor(unstr_regex_t *re, unstr_regex_dfa_t *dfa, int s, int sym)
+{
+	const unstr_regex_state_t *st = dfa->nfa->states;
+	const int *key = 0;
+	unstr_bool_t wait = UNSTRING_TRUE;
+	size_t n = 0;
+	size_t i = 0;
+	int cls = re->classes[sym];
+	int next = 0;
+	for(n = 0; wait && (n <= re->mark_count); n++){
+		next = dfa->trans[((size_t)s * re->nclass) + cls];
+		if(next < 0){
+			next = unstr_regex_step(re, dfa, s, cls);
+			if(next < 0){
+				return -1;
+			}
+		}
+		s = next;
+		key = dfa->keys + dfa->states[s].key;
+		wait = UNSTRING_FALSE;
+		for(i = 1; !wait && (i < dfa->states[s].len); i++){
+			wait = ((key[i] >= 0) && (st[key[i]].type == UNSTR_REGEX_STATE_SET) && UNSTR_REGEX_HAS(st[key[i]].set, sym))
+				? UNSTRING_TRUE : UNSTRING_FALSE;
+		}
+	}
+	return s;
+}
+
+/**
+ * @brief		作業領域のキーと同じDFAの状態を探し、無ければ作る
+ * @param[in]	re		正規表現
+ * @param[in]	dfa		DFA
+ * @param[in]	len		キーの長さ
+ * @param[out]	flushed	状態の数が上限に達して作り直した場合はUNSTRING_TRUE
+ * @return		状態の番号。領域の確保に失敗した場合は-1
+ */
+static int unstr_regex_intern(unstr_regex_t *re, unstr_regex_dfa_t *dfa, size_t len, unstr_bool_t *flushed)
+{
+	const int *key = re->key;
+	unstr_regex_dstate_t *d = 0;
+	unstr_regex_dstate_t *states = 0;
+	int *trans = 0;
+	int *keys = 0;
+	int *hash = 0;
+	size_t mask = 0;
+	size_t size = 0;
+	size_t pos = 0;
+	size_t h = 2166136261u;
+	size_t i = 0;
+	int index = 0;
+	for(i = 0; i < len; i++){
+		h = (h ^ (unsigned int)key[i]) * 16777619u;
+	}
+	if(dfa->hash == NULL){
+		size = 1;
+		while(size < (UNSTRING_REGEX_CACHE_STATES * 2)){
+			size <<= 1;
+		}
+		hash = (int *)unstr_malloc(size * sizeof(int));
+		if(hash == NULL){
+			return -1;
+		}
+		memset(hash, 0, size * sizeof(int));
+		dfa->hash = hash;
+		dfa->hash_size = size;
+	}
+	mask = dfa->hash_size - 1;
+	for(pos = h & mask; (index = dfa->hash[pos]) != 0; pos = (pos + 1) & mask){
+		d = &(dfa->states[index - 1]);
+		if((d->len == len) && (memcmp(dfa->keys + d->key, key, len * sizeof(int)) == 0)){
+			return index - 1;
+		}
+	}
+	if(dfa->count >= UNSTRING_REGEX_CACHE_STATES){
+		/* 全て捨てて作り直す。遷移元も無くなるので、呼び出し元は遷移を記録しない */
+		dfa->count = 0;
+		dfa->keys_len = 0;
+		memset(dfa->hash, 0, dfa->hash_size * sizeof(int));
+		*flushed = UNSTRING_TRUE;
+		pos = h & mask;
+	}
+	if(dfa->count >= dfa->size){
+		size = (dfa->size * 2) + 16;
+		/* 失敗しても元の領域は残るので、sizeを変えずに諦めれば次に作るときにやり直せる */
+		states = (unstr_regex_dstate_t *)unstr_realloc(dfa->states, size * sizeof(unstr_regex_dstate_t), dfa->size * sizeof(unstr_regex_dstate_t));
+		if(states == NULL){
+			return -1;
+		}
+		dfa->states = states;
+		trans = (int *)unstr_realloc(dfa->trans, size * re->nclass * sizeof(int), dfa->size * re->nclass * sizeof(int));
+		if(trans == NULL){
+			return -1;
+		}
+		dfa->trans = trans;
+		dfa->size = size;
+	}
+	if((dfa->keys_len + len) > dfa->keys_size){
+		size = (dfa->keys_size + len) * 2;
+		keys = (int *)unstr_realloc(dfa->keys, size * sizeof(int), dfa->keys_size * sizeof(int));
+		if(keys == NULL){
+			return -1;
+		}
+		dfa->keys = keys;
+		dfa->keys_size = size;
+	}
+	d = &(dfa->states[dfa->count]);
+	d->key = dfa->keys_len;
+	d->len = len;
+	memcpy(dfa->keys + dfa->keys_len, key, len * sizeof(int));
+	dfa->keys_len += len;
+	d->match = 0;
+	for(i = 1; i < len; i++){
+		if(key[i] == dfa->nfa->match){
+			d->match = 1;
+		}
+	}
+	d->dead = (len == 1);
+	d->idle = (dfa->init != NULL) && (dfa->init_len == len) && (memcmp(dfa->init, key, len * sizeof(int)) == 0);
+	for(i = 0; i < re->nclass; i++){
+		dfa->trans[(dfa->count * re->nclass) + i] = -1;
+	}
+	dfa->hash[pos] = (int)dfa->count + 1;
+	return (int)(dfa->count++);
+}
+
+/**
+ * @brief			NFAの状態から何も読まずに進める状態を作業領域のキーに加える
+ * @param[in,out]	re		正規表現
+ * @param[in]		nfa		NFA
+ * @param[in]		s		始めの状態
+ * @param[in,out]	len		キーの長さ
+ * @return			無し
+ * @par				詳細:
+ * 同じ世代で加えた状態は加えない。キーには記号を読む状態と一致の状態だけを入れる。
+ */
+static void unstr_regex_closure(unstr_regex_t *re, const unstr_regex_nfa_t *nfa, int s, size_t *len)
+{
+	size_t top = 0;
+	int q = 0;
+	re->stack[top++] = s;
+	while(top > 0){
+		q = re->stack[--top];
+		if((q < 0) || (re->mark[q] == re->gen)){
+			continue;
+		}
+		re->mark[q] = re->gen;
+		if(nfa->states[q].type == UNSTR_REGEX_STATE_SPLIT){
+			re->stack[top++] = nfa->states[q].out1;
+			re->stack[top++] = nfa->states[q].out;
+		} else {
+			re->key[(*len)++] = q;
+		}
+	}
+}
+
+/**
+ * @brief			closureで加えた状態の印を新しくする
+ * @param[in,out]	re		正規表現
+ * @return			無し
+ */
+static void unstr_regex_next_gen(unstr_regex_t *re)
+{
+	re->gen++;
+	if(re->gen == 0){
+		memset(re->mark, 0, re->mark_count * sizeof(unsigned int));
+		re->gen = 1;
+	}
+}
+
+static int unstr_regex_compare_int(const void *a, const void *b)
+{
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief		DFAを開放する
+ * @param[in]	dfa		開放するDFA
+ * @return		無し
+ */
+static void unstr_regex_dfa_free(unstr_regex_dfa_t *dfa)
+{
+	free(dfa->states);
+	free(dfa->trans);
+	free(dfa->keys);
+	free(dfa->hash);
+	free(dfa->init);
+}
+
+/**
+ * @brief			NFAに状態を加える
+ * @param[in,out]	nfa		NFA
+ * @param[in]		type	状態の種類
+ * @param[in]		out		次の状態
+ * @param[in]		out1	もう1つの次の状態
+ * @param[in]		set		記号の集合。NULLなら空
+ * @return			状態の番号。上限を超えた場合は-1
+ */
+static int unstr_regex_add_state(unstr_regex_nfa_t *nfa, unstr_regex_state_type_t type, int out, int out1, const unsigned int *set)
+{
+	unstr_regex_state_t *p = 0;
+	size_t size = 0;
+	if(nfa->count >= UNSTR_REGEX_MAX_NFA){
+		return -1;
+	}
+	if(nfa->count >= nfa->size){
+		size = (nfa->size * 2) + 16;
+		p = (unstr_regex_state_t *)unstr_realloc(nfa->states, size * sizeof(unstr_regex_state_t), nfa->size * sizeof(unstr_regex_state_t));
+		if(p == NULL){
+			return -1;
+		}
+		nfa->states = p;
+		nfa->size = size;
+	}
+	p = &(nfa->states[nfa->count]);
+	p->type = type;
+	p->out = out;
+	p->out1 = out1;
+	if(set != NULL){
+		memcpy(p->set, set, sizeof(p->set));
+	} else {
+		memset(p->set, 0, sizeof(p->set));
+	}
+	return (int)(nfa->count++);
+}
+
+/**
+ * @brief			構文木からNFAを作る
+ * @param[in,out]	nfa		NFA
+ * @param[in]		nodes	構文木
+ * @param[in]		n		作る節
+ * @param[in]		next	節に一致した後の状態
+ * @param[in]		reverse	後ろから読むNFAを作る
+ * @return			節の最初の状態。状態が多過ぎる場合は-1
+ * @par				詳細:
+ * 後ろから順に作るので、繰り返しは節を何度でも作り直せる。
+ */
+static int unstr_regex_emit(unstr_regex_nfa_t *nfa, const unstr_regex_node_t *nodes, int n, int next, unstr_bool_t reverse)
+{
+	const unstr_regex_node_t *node = &(nodes[n]);
+	int body = 0;
+	int loop = 0;
+	int s = 0;
+	int i = 0;
+	switch(node->type){
+	case UNSTR_REGEX_NODE_SET:
+		return unstr_regex_add_state(nfa, UNSTR_REGEX_STATE_SET, next, -1, node->set);
+	case UNSTR_REGEX_NODE_EMPTY:
+		return next;
+	case UNSTR_REGEX_NODE_CONCAT:
+		if(reverse){
+			s = unstr_regex_emit(nfa, nodes, node->left, next, reverse);
+			return (s < 0) ? -1 : unstr_regex_emit(nfa, nodes, node->right, s, reverse);
+		}
+		s = unstr_regex_emit(nfa, nodes, node->right, next, reverse);
+		return (s < 0) ? -1 : unstr_regex_emit(nfa, nodes, node->left, s, reverse);
+	case UNSTR_REGEX_NODE_ALT:
+		s = unstr_regex_emit(nfa, nodes, node->left, next, reverse);
+		body = unstr_regex_emit(nfa, nodes, node->right, next, reverse);
+		if((s < 0) || (body < 0)){
+			return -1;
+		}
+		return unstr_regex_add_state(nfa, UNSTR_REGEX_STATE_SPLIT, s, body, NULL);
+	case UNSTR_REGEX_NODE_REPEAT:
+		s = next;
+		if(node->max < 0){
+			/* 節の後で分岐に戻る輪を作る */
+			loop = unstr_regex_add_state(nfa, UNSTR_REGEX_STATE_SPLIT, -1, next, NULL);
+			body = (loop < 0) ? -1 : unstr_regex_emit(nfa, nodes, node->left, loop, reverse);
+			if(body < 0){
+				return -1;
+			}
+			nfa->states[loop].out = body;
+			s = loop;
+		} else {
+			/* x{0,2}は(x(x)?)?として作る */
+			for(i = node->min; i < node->max; i++){
+				body = unstr_regex_emit(nfa, nodes, node->left, s, reverse);
+				s = (body < 0) ? -1 : unstr_regex_add_state(nfa, UNSTR_REGEX_STATE_SPLIT, body, next, NULL);
+				if(s < 0){
+					return -1;
+				}
+			}
+		}
+		for(i = 0; (i < node->min) && (s >= 0); i++){
+			s = unstr_regex_emit(nfa, nodes, node->left, s, reverse);
+		}
+		return s;
+	}
+	return -1;
+}
+
+/**
+ * @brief			一致の先頭に必ず現れる固定文字列を取り出す
+ * @param[in]		nodes	構文木
+ * @param[in]		n		調べる節
+ * @param[out]		buf		固定文字列の格納先
+ * @param[in,out]	len		固定文字列の長さ
+ * @return			節全体が固定文字列ならUNSTRING_TRUE
+ */
+static unstr_bool_t unstr_regex_prefix(const unstr_regex_node_t *nodes, int n, char *buf, size_t *len)
+{
+	const unstr_regex_node_t *node = &(nodes[n]);
+	int found = -1;
+	int c = 0;
+	switch(node->type){
+	case UNSTR_REGEX_NODE_SET:
+		for(c = 0; c < UNSTR_REGEX_SYMBOLS; c++){
+			if(UNSTR_REGEX_HAS(node->set, c)){
+				if((found >= 0) || (c >= 256)){
+					return UNSTRING_FALSE;
+				}
+				found = c;
+			}
+		}
+		if(found < 0){
+			return UNSTRING_FALSE;
+		}
+		buf[(*len)++] = (char)found;
+		return UNSTRING_TRUE;
+	case UNSTR_REGEX_NODE_EMPTY:
+		return UNSTRING_TRUE;
+	case UNSTR_REGEX_NODE_CONCAT:
+		if(!unstr_regex_prefix(nodes, node->left, buf, len)){
+			return UNSTRING_FALSE;
+		}
+		return unstr_regex_prefix(nodes, node->right, buf, len);
+	case UNSTR_REGEX_NODE_REPEAT:
+		/* 1回は必ず現れるので、その先頭だけ使う */
+		if(node->min > 0){
+			unstr_regex_prefix(nodes, node->left, buf, len);
+		}
+		return UNSTRING_FALSE;
+	default:
+		return UNSTRING_FALSE;
+	}
+}
+
+/**
+ * @brief			構文木に節を加える
+ * @param[in,out]	ps		構文解析の状態
+ * @param[in]		type	節の種類
+ * @param[in]		left	子の節
+ * @param[in]		right	2つ目の子の節
+ * @return			節の番号。確保に失敗した場合は-1
+ */
+static int unstr_regex_node(unstr_regex_parser_t *ps, unstr_regex_node_type_t type, int left, int right)
+{
+	unstr_regex_node_t *p = 0;
+	size_t size = 0;
+	if(ps->count >= ps->size){
+		size = (ps->size * 2) + 16;
+		p = (unstr_regex_node_t *)unstr_realloc(ps->nodes, size * sizeof(unstr_regex_node_t), ps->size * sizeof(unstr_regex_node_t));
+		if(p == NULL){
+			ps->error = UNSTRING_TRUE;
+			return -1;
+		}
+		ps->nodes = p;
+		ps->size = size;
+	}
+	p = &(ps->nodes[ps->count]);
+	memset(p, 0, sizeof(unstr_regex_node_t));
+	p->type = type;
+	p->left = left;
+	p->right = right;
+	return (int)(ps->count++);
+}
+
+/* alt := concat ('|' concat)* */
+static int unstr_regex_parse_alt(unstr_regex_parser_t *ps)
+{
+	int left = unstr_regex_parse_concat(ps);
+	int right = 0;
+	while(!ps->error && (*(ps->p) == '|')){
+		ps->p++;
+		right = unstr_regex_parse_concat(ps);
+		left = unstr_regex_node(ps, UNSTR_REGEX_NODE_ALT, left, right);
+	}
+	return left;
+}
+
+/* concat := repeat* */
+static int unstr_regex_parse_concat(unstr_regex_parser_t *ps)
+{
+	int left = -1;
+	int right = 0;
+	while(!ps->error && (*(ps->p) != '\0') && (*(ps->p) != '|') && (*(ps->p) != ')')){
+		right = unstr_regex_parse_repeat(ps);
+		left = (left < 0) ? right : unstr_regex_node(ps, UNSTR_REGEX_NODE_CONCAT, left, right);
+	}
+	if(left < 0){
+		left = unstr_regex_node(ps, UNSTR_REGEX_NODE_EMPTY, -1, -1);
+	}
+	return left;
+}
+
+/* repeat := atom ('*' | '+' | '?' | '{m}' | '{m,}' | '{m,n}')* */
+static int unstr_regex_parse_repeat(unstr_regex_parser_t *ps)
+{
+	int atom = unstr_regex_parse_atom(ps);
+	int min = 0;
+	int max = 0;
+	int n = 0;
+	while(!ps->error){
+		switch(*(ps->p)){
+		case '*':
+			min = 0;
+			max = -1;
+			break;
+		case '+':
+			min = 1;
+			max = -1;
+			break;
+		case '?':
+			min = 0;
+			max = 1;
+			break;
+		case '{':
+			ps->p++;
+			if(!unstr_regex_parse_number(ps, &min)){
+				return -1;
+			}
+			max = min;
+			if(*(ps->p) == ','){
+				ps->p++;
+				max = -1;
+				if((*(ps->p) != '}') && !unstr_regex_parse_number(ps, &max)){
+					return -1;
+				}
+			}
+			if((*(ps->p) != '}') || ((max >= 0) && (max < min))){
+				ps->error = UNSTRING_TRUE;
+				return -1;
+			}
+			break;
+		default:
+			return atom;
+		}
+		ps->p++;
+		n = unstr_regex_node(ps, UNSTR_REGEX_NODE_REPEAT, atom, -1);
+		if(n >= 0){
+			ps->nodes[n].min = min;
+			ps->nodes[n].max = max;
+		}
+		atom = n;
+	}
+	return atom;
+}
+
+/* atom := '(' alt ')' | '[' bracket ']' | '.' | '^' | '$' | '\' escape | 文字 */
+static int unstr_regex_parse_atom(unstr_regex_parser_t *ps)
+{
+	int n = 0;
+	int c = 0;
+	switch(*(ps->p)){
+	case '(':
+		if(++(ps->depth) > UNSTR_REGEX_MAX_DEPTH){
+			ps->error = UNSTRING_TRUE;
+			return -1;
+		}
+		ps->p++;
+		n = unstr_regex_parse_alt(ps);
+		if(*(ps->p) != ')'){
+			ps->error = UNSTRING_TRUE;
+			return -1;
+		}
+		ps->p++;
+		ps->depth--;
+		return n;
+	case '*':
+	case '+':
+	case '?':
+	case '{':
+		/* 繰り返す対象が無い */
+		ps->error = UNSTRING_TRUE;
+		return -1;
+	}
+	n = unstr_regex_node(ps, UNSTR_REGEX_NODE_SET, -1, -1);
+	if(n < 0){
+		return -1;
+	}
+	c = *(ps->p++);
+	switch(c){
+	case '[':
+		if(!unstr_regex_parse_bracket(ps, ps->nodes[n].set)){
+			ps->error = UNSTRING_TRUE;
+		}
+		break;
+	case '.':
+		for(c = 0; c < 256; c++){
+			UNSTR_REGEX_ADD(ps->nodes[n].set, c);
+		}
+		break;
+	case '^':
+		UNSTR_REGEX_ADD(ps->nodes[n].set, UNSTR_REGEX_BOT);
+		break;
+	case '$':
+		UNSTR_REGEX_ADD(ps->nodes[n].set, UNSTR_REGEX_EOT);
+		break;
+	case '\\':
+		if(unstr_regex_parse_escape(ps, ps->nodes[n].set) == -2){
+			ps->error = UNSTRING_TRUE;
+		}
+		break;
+	default:
+		UNSTR_REGEX_ADD(ps->nodes[n].set, c);
+		break;
+	}
+	return n;
+}
+
+/**
+ * @brief			[]の中を解析する
+ * @param[in,out]	ps		構文解析の状態。'['の次を指していること
+ * @param[out]		set		記号の集合
+ * @return			構文が正しければUNSTRING_TRUE
+ */
+static unstr_bool_t unstr_regex_parse_bracket(unstr_regex_parser_t *ps, unsigned int *set)
+{
+	unsigned int tmp[UNSTR_REGEX_SET_WORDS];
+	unstr_bool_t negate = UNSTRING_FALSE;
+	unstr_bool_t first = UNSTRING_TRUE;
+	const char *end = 0;
+	int lo = 0;
+	int hi = 0;
+	int c = 0;
+	memset(tmp, 0, sizeof(tmp));
+	if(*(ps->p) == '^'){
+		negate = UNSTRING_TRUE;
+		ps->p++;
+	}
+	/* 先頭の']'は文字として扱う */
+	while(first || (*(ps->p) != ']')){
+		first = UNSTRING_FALSE;
+		if(*(ps->p) == '\0'){
+			return UNSTRING_FALSE;
+		}
+		if((ps->p[0] == '[') && (ps->p[1] == ':')){
+			end = strstr((const char *)ps->p + 2, ":]");
+			if((end == NULL) || !unstr_regex_add_ctype(tmp, (const char *)ps->p + 2, (size_t)(end - ((const char *)ps->p + 2)), UNSTRING_FALSE)){
+				return UNSTRING_FALSE;
+			}
+			ps->p = (const unsigned char *)end + 2;
+			continue;
+		}
+		if(*(ps->p) == '\\'){
+			ps->p++;
+			lo = unstr_regex_parse_escape(ps, tmp);
+			if(lo == -2){
+				return UNSTRING_FALSE;
+			}
+			if(lo == -1){
+				/* \dなどは範囲の端にならない */
+				continue;
+			}
+		} else {
+			lo = *(ps->p++);
+		}
+		hi = lo;
+		if((ps->p[0] == '-') && (ps->p[1] != ']') && (ps->p[1] != '\0')){
+			ps->p++;
+			if(*(ps->p) == '\\'){
+				ps->p++;
+				hi = unstr_regex_parse_escape(ps, tmp);
+			} else {
+				hi = *(ps->p++);
+			}
+			if((hi < 0) || (hi < lo)){
+				return UNSTRING_FALSE;
+			}
+		}
+		for(c = lo; c <= hi; c++){
+			UNSTR_REGEX_ADD(tmp, c);
+		}
+	}
+	ps->p++;
+	for(c = 0; c < 256; c++){
+		if(UNSTR_REGEX_HAS(tmp, c) != (negate ? 1u : 0u)){
+			UNSTR_REGEX_ADD(set, c);
+		}
+	}
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			'\'の次を解析する
+ * @param[in,out]	ps		構文解析の状態。'\'の次を指していること
+ * @param[out]		set		記号の集合。表す文字を加える
+ * @return			1文字を表す場合はその値、\dなど複数の文字を表す場合は-1、誤りは-2
+ */
+static int unstr_regex_parse_escape(unstr_regex_parser_t *ps, unsigned int *set)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *p = 0;
+	int c = *(ps->p);
+	int v = 0;
+	int i = 0;
+	if(c == '\0'){
+		return -2;
+	}
+	ps->p++;
+	switch(c){
+	case 'd':
+	case 'D':
+		unstr_regex_add_ctype(set, "digit", 5, ((c == 'D') ? UNSTRING_TRUE : UNSTRING_FALSE));
+		return -1;
+	case 'w':
+	case 'W':
+		unstr_regex_add_ctype(set, "word", 4, ((c == 'W') ? UNSTRING_TRUE : UNSTRING_FALSE));
+		return -1;
+	case 's':
+	case 'S':
+		unstr_regex_add_ctype(set, "space", 5, ((c == 'S') ? UNSTRING_TRUE : UNSTRING_FALSE));
+		return -1;
+	case 'n':
+		c = '\n';
+		break;
+	case 't':
+		c = '\t';
+		break;
+	case 'r':
+		c = '\r';
+		break;
+	case 'f':
+		c = '\f';
+		break;
+	case 'v':
+		c = '\v';
+		break;
+	case 'x':
+		for(i = 0; i < 2; i++){
+			p = (*(ps->p) != '\0') ? strchr(hex, UNSTR_FOLD(*(ps->p))) : NULL;
+			if(p == NULL){
+				return -2;
+			}
+			v = (v << 4) | (int)(p - hex);
+			ps->p++;
+		}
+		c = v;
+		break;
+	}
+	UNSTR_REGEX_ADD(set, c);
+	return c;
+}
+
+/**
+ * @brief			文字クラスを記号の集合に加える
+ * @param[out]		set		記号の集合
+ * @param[in]		name	クラス名(alpha, digitなど。wordは英数字と'_')
+ * @param[in]		len		クラス名の長さ
+ * @param[in]		negate	クラスに含まれない文字を加える
+ * @return			知らないクラス名ならUNSTRING_FALSE
+ * @par				詳細:
+ * ASCIIだけを対象にし、0x80以上はどのクラスにも含まない。
+ */
+static unstr_bool_t unstr_regex_add_ctype(unsigned int *set, const char *name, size_t len, unstr_bool_t negate)
+{
+	static const char *names[] = {
+		"alpha", "digit", "alnum", "upper", "lower", "space",
+		"blank", "punct", "print", "graph", "cntrl", "xdigit", "word"
+	};
+	size_t k = 0;
+	int c = 0;
+	int in = 0;
+	for(k = 0; k < (sizeof(names) / sizeof(names[0])); k++){
+		if((strlen(names[k]) == len) && (strncmp(names[k], name, len) == 0)){
+			break;
+		}
+	}
+	if(k >= (sizeof(names) / sizeof(names[0]))){
+		return UNSTRING_FALSE;
+	}
+	for(c = 0; c < 256; c++){
+		in = 0;
+		if(c < 0x80){
+			switch(k){
+			case 0: in = isalpha(c); break;
+			case 1: in = isdigit(c); break;
+			case 2: in = isalnum(c); break;
+			case 3: in = isupper(c); break;
+			case 4: in = islower(c); break;
+			case 5: in = isspace(c); break;
+			case 6: in = ((c == ' ') || (c == '\t')); break;
+			case 7: in = ispunct(c); break;
+			case 8: in = isprint(c); break;
+			case 9: in = isgraph(c); break;
+			case 10: in = iscntrl(c); break;
+			case 11: in = isxdigit(c); break;
+			default: in = (isalnum(c) || (c == '_')); break;
+			}
+		}
+		if((in != 0) != (negate != UNSTRING_FALSE)){
+			UNSTR_REGEX_ADD(set, c);
+		}
+	}
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			{m,n}の数を読む
+ * @param[in,out]	ps		構文解析の状態
+ * @param[out]		num		読んだ数
+ * @return			数字が無いか大き過ぎる場合はUNSTRING_FALSE
+ */
+static unstr_bool_t unstr_regex_parse_number(unstr_regex_parser_t *ps, int *num)
+{
+	int n = 0;
+	if((*(ps->p) < '0') || (*(ps->p) > '9')){
+		ps->error = UNSTRING_TRUE;
+		return UNSTRING_FALSE;
+	}
+	while((*(ps->p) >= '0') && (*(ps->p) <= '9')){
+		n = (n * 10) + (*(ps->p) - '0');
+		if(n > UNSTR_REGEX_MAX_REPEAT){
+			ps->error = UNSTRING_TRUE;
+			return UNSTRING_FALSE;
+		}
+		ps->p++;
+	}
+	*num = n;
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			バイト列を16進数の文字列に変換する
+ * @param[out]		dst		書き込み先文字列
+ * @param[in]		src		対象文字列(バイナリ可)
+ * @return			変換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * 1バイトを小文字の16進数2文字にする。dstの長さはsrcのちょうど2倍になる。
+ * SSE2が使える場合は16バイトずつ変換する。
+ */
+unstr_bool_t unstr_bin2hex(unstr_t *dst, const unstr_t *src)
+{
+	UNSTR_TRACE(UNSTR_TRACE_BIN2HEX, unstr_strlen(src));
+	if(!unstr_isset(dst) || !unstr_isset(src)){
+		return UNSTRING_FALSE;
+	}
+	if(src->length > (((size_t)-1 - 1) / 2)){
+		return UNSTRING_FALSE;
+	}
+	return unstr_codec_into(dst, src, src->length * 2, unstr_hex_encode);
+}
+
+/**
+ * @brief			16進数の文字列をバイト列に戻す
+ * @param[out]		dst		書き込み先文字列
+ * @param[in]		src		16進数の文字列
+ * @return			変換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * 大文字と小文字のどちらも受け付ける。長さが奇数、または16進数以外の文字を
+ * 含む場合は失敗し、dstは空文字列になる。
+ * SSE2が使える場合は32文字ずつ検査と変換を行う。
+ */
+unstr_bool_t unstr_hex2bin(unstr_t *dst, const unstr_t *src)
+{
+	UNSTR_TRACE(UNSTR_TRACE_HEX2BIN, unstr_strlen(src));
+	if(!unstr_isset(dst) || !unstr_isset(src)){
+		return UNSTRING_FALSE;
+	}
+	return unstr_codec_into(dst, src, src->length / 2, unstr_hex_decode);
+}
+
+/**
+ * @brief			バイト列をBASE64の文字列に変換する
+ * @param[out]		dst		書き込み先文字列
+ * @param[in]		src		対象文字列(バイナリ可)
+ * @return			変換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * RFC 4648の標準の文字を使い、末尾を'='で埋める。改行は入れない。
+ * SSE2が使える場合は12バイトずつ16文字に変換する。
+ */
+unstr_bool_t unstr_base64_encode(unstr_t *dst, const unstr_t *src)
+{
+	UNSTR_TRACE(UNSTR_TRACE_BASE64_ENCODE, unstr_strlen(src));
+	if(!unstr_isset(dst) || !unstr_isset(src)){
+		return UNSTRING_FALSE;
+	}
+	if(src->length > ((((size_t)-1 - 1) / 4) * 3 - 2)){
+		return UNSTRING_FALSE;
+	}
+	return unstr_codec_into(dst, src, ((src->length + 2) / 3) * 4, unstr_base64_encode_exec);
+}
+
+/**
+ * @brief			BASE64の文字列をバイト列に戻す
+ * @param[out]		dst		書き込み先文字列
+ * @param[in]		src		BASE64の文字列
+ * @return			変換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	失敗
+ * @public
+ * @par				詳細:
+ * 長さが4の倍数で、'='が末尾にだけある文字列を受け付ける。
+ * 改行や空白を含む場合や不正な文字がある場合は失敗し、dstは空文字列になる。
+ * SSE2が使える場合は16文字ずつ検査と変換を行う。
+ */
+unstr_bool_t unstr_base64_decode(unstr_t *dst, const unstr_t *src)
+{
+	size_t size = 0;
+	UNSTR_TRACE(UNSTR_TRACE_BASE64_DECODE, unstr_strlen(src));
+	if(!unstr_isset(dst) || !unstr_isset(src)){
+		return UNSTRING_FALSE;
+	}
+	/* 長さが4の倍数でなければ変換処理で失敗させる */
+	if(((src->length % 4) == 0) && (src->length > 0)){
+		size = (src->length / 4) * 3;
+		size -= (src->data[src->length - 1] == '=') ? 1 : 0;
+		size -= (src->data[src->length - 2] == '=') ? 1 : 0;
+	}
+	return unstr_codec_into(dst, src, size, unstr_base64_decode_exec);
+}
+
+/**
+ * @brief			変換処理の結果をdstに書き込む
+ * @param[out]		dst		書き込み先文字列
+ * @param[in]		src		対象文字列
+ * @param[in]		size	変換後の長さの上限
+ * @param[in]		func	変換処理
+ * @return			変換結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	不正な入力
+ * @par				詳細:
+ * 先に求めた長さで一度だけ確保する。失敗した場合、dstは空文字列になる。
+ * dstとsrcが同じ場合は作業用の文字列に変換してから書き戻す。
+ */
+static unstr_bool_t unstr_codec_into(unstr_t *dst, const unstr_t *src, size_t size, unstr_codec_func_t func)
+{
+	unstr_t *tmp = 0;
+	unstr_bool_t ret = UNSTRING_FALSE;
+	size_t len = 0;
+	if(dst == src){
+		tmp = unstr_init_memory(size + 1);
+		ret = unstr_codec_into(tmp, src, size, func);
+		unstr_strcpy(dst, tmp);
+		unstr_free(tmp);
+		return ret;
+	}
+	UNSTR_DETACH(dst, 0);
+	if(unstr_check_heap_size(dst, size + 1)){
+		unstr_alloc(dst, size + 1);
+	}
+	len = func(dst->data, (const unsigned char *)src->data, src->length);
+	ret = UNSTRING_TRUE;
+	if(len == UNSTR_NOT_FOUND){
+		len = 0;
+		ret = UNSTRING_FALSE;
+	}
+	dst->length = len;
+	dst->data[len] = '\0';
+	return ret;
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief		0から15の値を16進数の文字にする
+ * @param[in]	v		各バイトが0から15の値
+ * @return		各バイトを'0'から'9'と'a'から'f'にした値
+ */
+static __m128i unstr_hex_chars(__m128i v)
+{
+	const __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+	return _mm_add_epi8(_mm_add_epi8(v, _mm_set1_epi8('0')), alpha);
+}
+
+/**
+ * @brief		16進数の文字を値に戻す
+ * @param[in]	v		対象の16文字
+ * @return		各バイトを0から15にした値。16進数でない文字は0xFFになる
+ * @par			詳細:
+ * 0x80以上のバイトは符号付きの比較で負になるので、どの範囲にも入らない。
+ */
+static __m128i unstr_hex_values(__m128i v)
+{
+	const __m128i minus = _mm_set1_epi8(-1);
+	const __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	const __m128i a = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	const __m128i is_d = _mm_and_si128(_mm_cmpgt_epi8(d, minus), _mm_cmplt_epi8(d, _mm_set1_epi8(10)));
+	const __m128i is_a = _mm_and_si128(_mm_cmpgt_epi8(a, minus), _mm_cmplt_epi8(a, _mm_set1_epi8(6)));
+	__m128i ret = _mm_or_si128(_mm_and_si128(is_d, d), _mm_and_si128(is_a, _mm_add_epi8(a, _mm_set1_epi8(10))));
+	return _mm_or_si128(ret, _mm_andnot_si128(_mm_or_si128(is_d, is_a), minus));
+}
+
+/**
+ * @brief		0から63の値をBASE64の文字にする
+ * @param[in]	v		各バイトが0から63の値
+ * @return		各バイトをBASE64の文字にした値
+ * @par			詳細:
+ * 値の範囲毎に文字との差が決まっているので、範囲の境目を越える毎に差を足す。
+ */
+static __m128i unstr_base64_chars(__m128i v)
+{
+	__m128i diff = _mm_set1_epi8('A');
+	diff = _mm_add_epi8(diff, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(25)), _mm_set1_epi8(('a' - 26) - 'A')));
+	diff = _mm_add_epi8(diff, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(51)), _mm_set1_epi8(('0' - 52) - ('a' - 26))));
+	diff = _mm_add_epi8(diff, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(61)), _mm_set1_epi8(('+' - 62) - ('0' - 52))));
+	diff = _mm_add_epi8(diff, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(62)), _mm_set1_epi8(('/' - 63) - ('+' - 62))));
+	return _mm_add_epi8(v, diff);
+}
+
+/**
+ * @brief		BASE64の文字を値に戻す
+ * @param[in]	v		対象の16文字
+ * @return		各バイトを0から63にした値。BASE64でない文字は0xFFになる
+ */
+static __m128i unstr_base64_values(__m128i v)
+{
+	const __m128i minus = _mm_set1_epi8(-1);
+	const __m128i u = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+	const __m128i l = _mm_sub_epi8(v, _mm_set1_epi8('a'));
+	const __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	const __m128i is_u = _mm_and_si128(_mm_cmpgt_epi8(u, minus), _mm_cmplt_epi8(u, _mm_set1_epi8(26)));
+	const __m128i is_l = _mm_and_si128(_mm_cmpgt_epi8(l, minus), _mm_cmplt_epi8(l, _mm_set1_epi8(26)));
+	const __m128i is_d = _mm_and_si128(_mm_cmpgt_epi8(d, minus), _mm_cmplt_epi8(d, _mm_set1_epi8(10)));
+	const __m128i is_p = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));
+	const __m128i is_s = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+	__m128i ret = _mm_and_si128(is_u, u);
+	ret = _mm_or_si128(ret, _mm_and_si128(is_l, _mm_add_epi8(l, _mm_set1_epi8(26))));
+	ret = _mm_or_si128(ret, _mm_and_si128(is_d, _mm_add_epi8(d, _mm_set1_epi8(52))));
+	ret = _mm_or_si128(ret, _mm_and_si128(is_p, _mm_set1_epi8(62)));
+	ret = _mm_or_si128(ret, _mm_and_si128(is_s, _mm_set1_epi8(63)));
+	return _mm_or_si128(ret, _mm_andnot_si128(_mm_or_si128(_mm_or_si128(is_u, is_l), _mm_or_si128(_mm_or_si128(is_d, is_p), is_s)), minus));
+}
+#endif
+
+/**
+ * @brief		16進数の1文字を値に戻す
+ * @param[in]	c		対象文字
+ * @return		0から15の値。16進数でなければ-1
+ */
+static int unstr_hex_value(unsigned char c)
+{
+	if((unsigned char)(c - '0') < 10u){
+		return c - '0';
+	}
+	c |= 0x20;
+	if((unsigned char)(c - 'a') < 6u){
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+/**
+ * @brief		BASE64の1文字を値に戻す
+ * @param[in]	c		対象文字
+ * @return		0から63の値。BASE64でなければ-1
+ */
+static int unstr_base64_value(unsigned char c)
+{
+	if((unsigned char)(c - 'A') < 26u){
+		return c - 'A';
+	} else if((unsigned char)(c - 'a') < 26u){
+		return c - 'a' + 26;
+	} else if((unsigned char)(c - '0') < 10u){
+		return c - '0' + 52;
+	} else if(c == '+'){
+		return 62;
+	} else if(c == '/'){
+		return 63;
+	}
+	return -1;
+}
+
+/**
+ * @brief		バイト列を16進数にする
+ * @param[out]	dst		書き込み先(len * 2バイト)
+ * @param[in]	src		対象領域
+ * @param[in]	len		対象領域の長さ
+ * @return		書き込んだ長さ
+ */
+static size_t unstr_hex_encode(char *dst, const unsigned char *src, size_t len)
+{
+	const char *digits = UNSTR_DIGITS_LOWER;
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	__m128i v;
+	__m128i hi;
+	__m128i lo;
+	for(; (i + 16) <= len; i += 16){
+		v = _mm_loadu_si128((const __m128i *)(src + i));
+		hi = unstr_hex_chars(_mm_and_si128(_mm_srli_epi16(v, 4), mask));
+		lo = unstr_hex_chars(_mm_and_si128(v, mask));
+		/* 上位4bitの文字を先にして交互に並べる */
+		_mm_storeu_si128((__m128i *)(dst + (i * 2)), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(dst + (i * 2) + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+#endif
+	for(; i < len; i++){
+		dst[i * 2] = digits[src[i] >> 4];
+		dst[(i * 2) + 1] = digits[src[i] & 0x0f];
+	}
+	return len * 2;
+}
+
+/**
+ * @brief		16進数をバイト列に戻す
+ * @param[out]	dst		書き込み先(len / 2バイト)
+ * @param[in]	src		対象領域
+ * @param[in]	len		対象領域の長さ
+ * @return		書き込んだ長さ。不正な入力ならUNSTR_NOT_FOUND
+ */
+static size_t unstr_hex_decode(char *dst, const unsigned char *src, size_t len)
+{
+	size_t i = 0;
+	int hi = 0;
+	int lo = 0;
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	__m128i a;
+	__m128i b;
+#endif
+	if((len % 2) != 0){
+		return UNSTR_NOT_FOUND;
+	}
+#if defined(__SSE2__)
+	for(; (i + 32) <= len; i += 32){
+		a = unstr_hex_values(_mm_loadu_si128((const __m128i *)(src + i)));
+		b = unstr_hex_values(_mm_loadu_si128((const __m128i *)(src + i + 16)));
+		if(_mm_movemask_epi8(_mm_or_si128(a, b)) != 0){
+			return UNSTR_NOT_FOUND;
+		}
+		/* 16bitの下位に上位4bit、上位に下位4bitが入っているので1バイトにまとめる */
+		a = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(a, mask), 4), _mm_srli_epi16(a, 8));
+		b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b, mask), 4), _mm_srli_epi16(b, 8));
+		_mm_storeu_si128((__m128i *)(dst + (i / 2)), _mm_packus_epi16(a, b));
+	}
+#endif
+	for(; i < len; i += 2){
+		hi = unstr_hex_value(src[i]);
+		lo = unstr_hex_value(src[i + 1]);
+		if((hi < 0) || (lo < 0)){
+			return UNSTR_NOT_FOUND;
+		}
+		dst[i / 2] = (char)((hi << 4) | lo);
+	}
+	return len / 2;
+}
+
+/**
+ * @brief		バイト列をBASE64にする
+ * @param[out]	dst		書き込み先(((len + 2) / 3) * 4バイト)
+ * @param[in]	src		対象領域
+ * @param[in]	len		対象領域の長さ
+ * @return		書き込んだ長さ
+ * @par			詳細:
+ * SIMDでは3バイトを32bitに並べ、乗算のシフトで6bitずつ4バイトに分ける。
+ * SSSE3が使える場合は並べ替えにpshufbを使う。
+ */
+static size_t unstr_base64_encode_exec(char *dst, const unsigned char *src, size_t len)
+{
+	const char *table = UNSTR_BASE64_CHARS;
+	size_t i = 0;
+	size_t o = 0;
+	unsigned long w = 0;
+#if defined(__SSE2__)
+	__m128i v;
+	__m128i t;
+#if defined(__SSSE3__)
+	const __m128i order = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	for(; (i + 16) <= len; i += 12, o += 16){
+		v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), order);
+#else
+	const unsigned char *p = 0;
+	int lane[4];
+	size_t k = 0;
+	for(; (i + 12) <= len; i += 12, o += 16){
+		/* 各32bitにb1,b0,b2,b1の順で並べる */
+		for(k = 0; k < 4; k++){
+			p = src + i + (k * 3);
+			lane[k] = (int)((unsigned int)p[1] | ((unsigned int)p[0] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[1] << 24));
+		}
+		v = _mm_setr_epi32(lane[0], lane[1], lane[2], lane[3]);
+#endif
+		/* 1番目と3番目の6bitは上位16bitへの乗算で、2番目と4番目は下位への乗算で取り出す */
+		t = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+		v = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+		_mm_storeu_si128((__m128i *)(dst + o), unstr_base64_chars(_mm_or_si128(t, v)));
+	}
+#endif
+	for(; (i + 3) <= len; i += 3, o += 4){
+		w = ((unsigned long)src[i] << 16) | ((unsigned long)src[i + 1] << 8) | src[i + 2];
+		dst[o] = table[(w >> 18) & 0x3f];
+		dst[o + 1] = table[(w >> 12) & 0x3f];
+		dst[o + 2] = table[(w >> 6) & 0x3f];
+		dst[o + 3] = table[w & 0x3f];
+	}
+	if(i < len){
+		w = (unsigned long)src[i] << 16;
+		if((i + 1) < len){
+			w |= (unsigned long)src[i + 1] << 8;
+		}
+		dst[o] = table[(w >> 18) & 0x3f];
+		dst[o + 1] = table[(w >> 12) & 0x3f];
+		dst[o + 2] = ((i + 1) < len) ? table[(w >> 6) & 0x3f] : '=';
+		dst[o + 3] = '=';
+		o += 4;
+	}
+	return o;
+}
+
+/**
+ * @brief		BASE64をバイト列に戻す
+ * @param[out]	dst		書き込み先((len / 4) * 3バイトから'='の数を引いた長さ)
+ * @param[in]	src		対象領域
+ * @param[in]	len		対象領域の長さ
+ * @return		書き込んだ長さ。不正な入力ならUNSTR_NOT_FOUND
+ * @par			詳細:
+ * '='を含みうる最後の4文字は1文字ずつ処理する。
+ */
+static size_t unstr_base64_decode_exec(char *dst, const unsigned char *src, size_t len)
+{
+	size_t i = 0;
+	size_t o = 0;
+	size_t k = 0;
+	int c[4];
+	unsigned long w = 0;
+#if defined(__SSE2__)
+	__m128i v;
+#if defined(__SSSE3__)
+	int lane = 0;
+#endif
+#endif
+	if((len % 4) != 0){
+		return UNSTR_NOT_FOUND;
+	}
+	if(len == 0){
+		return 0;
+	}
+#if defined(__SSE2__)
+	for(; (i + 16) < len; i += 16, o += 12){
+		v = unstr_base64_values(_mm_loadu_si128((const __m128i *)(src + i)));
+		if(_mm_movemask_epi8(v) != 0){
+			return UNSTR_NOT_FOUND;
+		}
+		/* 6bitを16bit毎に12bit、32bit毎に24bitにまとめる */
+		v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00ff)), 6), _mm_srli_epi16(v, 8));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+#if defined(__SSSE3__)
+		v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		_mm_storel_epi64((__m128i *)(dst + o), v);
+		lane = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+		memcpy(dst + o + 8, &lane, 4);
+#else
+		/* 32bit毎に3バイトを逆順にし、64bit毎に6バイトに詰める */
+		v = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xff)), 16),
+			_mm_and_si128(v, _mm_set1_epi32(0xff00))), _mm_and_si128(_mm_srli_epi32(v, 16), _mm_set1_epi32(0xff)));
+		v = _mm_or_si128(_mm_and_si128(v, _mm_set_epi32(0, 0xffffff, 0, 0xffffff)),
+			_mm_srli_epi64(_mm_and_si128(v, _mm_set_epi32(0xffffff, 0, 0xffffff, 0)), 8));
+		/* 後ろに最後の4文字分の1バイトと終端があるので、8バイト書いても溢れない */
+		_mm_storel_epi64((__m128i *)(dst + o), v);
+		_mm_storel_epi64((__m128i *)(dst + o + 6), _mm_srli_si128(v, 8));
+#endif
+	}
+#endif
+	for(; i < len; i += 4){
+		for(k = 0; k < 4; k++){
+			c[k] = unstr_base64_value(src[i + k]);
+		}
+		if((c[0] < 0) || (c[1] < 0)){
+			return UNSTR_NOT_FOUND;
+		}
+		if((c[2] < 0) || (c[3] < 0)){
+			/* '='は最後の4文字の末尾にだけ置ける */
+			if(((i + 4) != len) || (src[i + 3] != '=') || ((c[2] < 0) && (src[i + 2] != '='))){
+				return UNSTR_NOT_FOUND;
+			}
+			dst[o++] = (char)((c[0] << 2) | (c[1] >> 4));
+			if(c[2] >= 0){
+				dst[o++] = (char)(((c[1] & 0x0f) << 4) | (c[2] >> 2));
+			}
+			break;
+		}
+		w = ((unsigned long)c[0] << 18) | ((unsigned long)c[1] << 12) | ((unsigned long)c[2] << 6) | (unsigned long)c[3];
+		dst[o] = (char)(w >> 16);
+		dst[o + 1] = (char)(w >> 8);
+		dst[o + 2] = (char)w;
+		o += 3;
+	}
+	return o;
+}
+
+/**
+ * @brief		文字列から接尾辞配列の索引を作る
+ * @param[in]	text	対象文字列(バイナリ可)
+ * @return		作成した索引。長さがINT_MAX以上の場合や確保に失敗した場合はNULL
+ * @public
+ * @par			詳細:
+ * SA-ISで接尾辞配列を、Kasaiの方法でLCP配列を線形時間で作る。
+ * 索引はtextを複製して持つので、作成後にtextを変更・開放してもよい。\n
+ * 全体をファイルと同じ並びの1つの領域に置くので、unstr_index_saveでそのまま書き出せる。
+ * 必要な領域は文字列長のおよそ9倍で、作成中は更に15倍程度を一時的に使う。
+ */
+unstr_index_t *unstr_index_init(const unstr_t *text)
+{
+	unstr_index_t *idx = 0;
+	unstr_index_header_t *head = 0;
+	char *block = 0;
+	int *s = 0;
+	size_t offset[UNSTR_INDEX_SECTIONS];
+	size_t size = 0;
+	size_t i = 0;
+	unstr_bool_t ok = UNSTRING_FALSE;
+	UNSTR_TRACE(UNSTR_TRACE_INDEX_INIT, unstr_strlen(text));
+	if(!unstr_isset(text) || (text->length >= (size_t)INT_MAX)){
+		return NULL;
+	}
+	size = unstr_index_layout(text->length, offset);
+	block = (char *)unstr_malloc(size);
+	idx = (unstr_index_t *)unstr_malloc(sizeof(unstr_index_t));
+	s = (int *)unstr_malloc((text->length + 1) * sizeof(int));
+	if((block == NULL) || (idx == NULL) || (s == NULL)){
+		free(block);
+		free(idx);
+		free(s);
+		return NULL;
+	}
+	head = (unstr_index_header_t *)block;
+	memset(head, 0, sizeof(unstr_index_header_t));
+	memcpy(head->magic, UNSTR_INDEX_MAGIC, sizeof(head->magic));
+	head->order = UNSTR_INDEX_ORDER;
+	head->word = UNSTR_INDEX_WORD;
+	head->length = text->length;
+	head->size = size;
+	memcpy(block + offset[0], text->data, text->length);
+	block[offset[0] + text->length] = '\0';
+	unstr_index_attach(idx, block, size);
+	for(i = 0; i < text->length; i++){
+		s[i] = (unsigned char)text->data[i];
+	}
+	if(unstr_sais(s, (int *)idx->sa, (int)text->length, 255)
+	&& unstr_index_lcp(idx, s)){
+		unstr_index_build_table(idx, idx->sa, (int *)idx->sa_table);
+		unstr_index_build_table(idx, idx->lcp, (int *)idx->lcp_table);
+		ok = UNSTRING_TRUE;
+	}
+	free(s);
+	if(!ok){
+		free(block);
+		free(idx);
+		return NULL;
+	}
+	return idx;
+}
+
+/**
+ * @brief		索引を開放する
+ * @param[in]	idx		開放する索引
+ * @return		無し
+ * @public
+ * @par			詳細:
+ * unstr_index_loadでmmapした場合は対応を解除する。
+ */
+void unstr_index_free(unstr_index_t *idx)
+{
+	if(idx == NULL){
+		return;
+	}
+	if(idx->mapped){
+#ifdef UNSTR_INDEX_MMAP
+		munmap(idx->block, idx->size);
+#endif
+	} else {
+		free(idx->block);
+	}
+	free(idx);
+}
+
+/**
+ * @brief		索引を使って出現回数を数える
+ * @param[in]	idx		索引
+ * @param[in]	search	検索文字列
+ * @return		出現回数。重なる出現も数える
+ * @public
+ * @par			詳細:
+ * 接尾辞配列の二分探索で最初の一致を求め、LCP配列の区間最小値で一致の範囲の終わりを
+ * 求める。検索文字列長をm、文字列長をnとしてO(m log n)。
+ */
+size_t unstr_index_count(const unstr_index_t *idx, const unstr_t *search)
+{
+	size_t begin = 0;
+	size_t end = 0;
+	UNSTR_TRACE(UNSTR_TRACE_INDEX_COUNT, unstr_strlen(search));
+	if((idx == NULL) || unstr_empty(search)){
+		return 0;
+	}
+	begin = unstr_index_range(idx, search, &end);
+	return end - begin;
+}
+
+/**
+ * @brief		索引を使って最初に現れる位置を求める
+ * @param[in]	idx		索引
+ * @param[in]	search	検索文字列
+ * @return		最も前の出現位置。見つからない場合はUNSTRING_NPOS
+ * @public
+ * @par			詳細:
+ * 一致する範囲の接尾辞配列の最小値を、ブロック毎の最小値のスパーステーブルで求める。
+ * O(m log n)。
+ */
+size_t unstr_index_first(const unstr_index_t *idx, const unstr_t *search)
+{
+	size_t begin = 0;
+	size_t end = 0;
+	UNSTR_TRACE(UNSTR_TRACE_INDEX_FIRST, unstr_strlen(search));
+	if((idx == NULL) || unstr_empty(search)){
+		return UNSTRING_NPOS;
+	}
+	begin = unstr_index_range(idx, search, &end);
+	if(begin == end){
+		return UNSTRING_NPOS;
+	}
+	return (size_t)unstr_index_min(idx, idx->sa, idx->sa_table, begin, end);
+}
+
+/**
+ * @brief		索引を使って全ての出現位置を求める
+ * @param[in]	idx			索引
+ * @param[in]	search		検索文字列
+ * @param[out]	positions	出現位置の格納先。NULLの場合は数えるだけ
+ * @param[in]	size		positionsの要素数
+ * @return		出現回数。sizeより多い場合も全ての数を返す
+ * @public
+ * @par			詳細:
+ * 位置は昇順に並べる。sizeが足りない場合は前から順にsize個を格納する。
+ * O(m log n + k log k)。kは出現回数。
+ */
+size_t unstr_index_all(const unstr_index_t *idx, const unstr_t *search, size_t *positions, size_t size)
+{
+	size_t begin = 0;
+	size_t end = 0;
+	size_t *all = 0;
+	size_t i = 0;
+	UNSTR_TRACE(UNSTR_TRACE_INDEX_ALL, unstr_strlen(search));
+	if((idx == NULL) || unstr_empty(search)){
+		return 0;
+	}
+	begin = unstr_index_range(idx, search, &end);
+	if((positions == NULL) || (size == 0) || (begin == end)){
+		return end - begin;
+	}
+	/* 足りない場合は全てを並べてから前の方だけを返す */
+	all = ((end - begin) <= size) ? positions : (size_t *)unstr_malloc((end - begin) * sizeof(size_t));
+	if(all == NULL){
+		return 0;
+	}
+	for(i = begin; i < end; i++){
+		all[i - begin] = (size_t)idx->sa[i];
+	}
+	qsort(all, end - begin, sizeof(size_t), unstr_index_compare_size);
+	if(all != positions){
+		memcpy(positions, all, size * sizeof(size_t));
+		free(all);
+	}
+	return end - begin;
+}
+
+/**
+ * @brief		索引をファイルに書き出す
+ * @param[in]	idx			索引
+ * @param[in]	filename	ファイルパス
+ * @return		出力結果
+ * @return		UNSTRING_TRUE	成功
+ * @return		UNSTRING_FALSE	失敗
+ * @public
+ * @par			詳細:
+ * メモリ上と同じ並びで書き出す。intとsize_tの大きさとバイト順が同じ環境でだけ読み込める。
+ */
+unstr_bool_t unstr_index_save(const unstr_index_t *idx, const unstr_t *filename)
+{
+	FILE *fp = 0;
+	size_t len = 0;
+	UNSTR_TRACE(UNSTR_TRACE_INDEX_SAVE, (idx == NULL) ? 0 : idx->size);
+	if(idx == NULL){
+		return UNSTRING_FALSE;
+	}
+	fp = unstr_file_open(filename, "wb");
+	if(fp == NULL){
+		return UNSTRING_FALSE;
+	}
+	len = fwrite(idx->block, 1, idx->size, fp);
+	if(fclose(fp) != 0){
+		return UNSTRING_FALSE;
+	}
+	return (len == idx->size) ? UNSTRING_TRUE : UNSTRING_FALSE;
+}
+
+/**
+ * @brief		unstr_index_saveで書き出した索引を読み込む
+ * @param[in]	filename	ファイルパス
+ * @return		読み込んだ索引。形式が違う場合はNULL
+ * @public
+ * @par			詳細:
+ * POSIX環境ではファイルをmmapし、同じファイルを使うプロセス間でページキャッシュを
+ * 共有する。それ以外の環境ではファイル全体を読み込む。\n
+ * 読み込み時に見出しと、各配列の値が本文の範囲内にあるかを検査するので、
+ * 壊れたファイルでも範囲外は読まない。値の並びまでは検査しないため、
+ * unstr_index_saveの出力でないファイルでは検索結果は正しくならない。
+ */
+unstr_index_t *unstr_index_load(const unstr_t *filename)
+{
+	unstr_index_t *idx = 0;
+	FILE *fp = 0;
+	char *block = 0;
+	size_t size = 0;
+	unstr_bool_t mapped = UNSTRING_FALSE;
+#ifdef UNSTR_INDEX_MMAP
+	struct stat st;
+#else
+	long end = 0;
+#endif
+	UNSTR_TRACE(UNSTR_TRACE_INDEX_LOAD, 0);
+	fp = unstr_file_open(filename, "rb");
+	if(fp == NULL){
+		return NULL;
+	}
+#ifdef UNSTR_INDEX_MMAP
+	if((fstat(fileno(fp), &st) == 0) && (st.st_size > 0)){
+		size = (size_t)st.st_size;
+		block = (char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+		if(block == MAP_FAILED){
+			block = NULL;
+		}
+		mapped = UNSTRING_TRUE;
+	}
+#else
+	fseek(fp, 0, SEEK_END);
+	end = ftell(fp);
+	rewind(fp);
+	if(end > 0){
+		size = (size_t)end;
+		block = unstr_malloc(size);
+		if((block != NULL) && (fread(block, 1, size, fp) != size)){
+			free(block);
+			block = NULL;
+		}
+	}
+#endif
+	fclose(fp);
+	if(block == NULL){
+		return NULL;
+	}
+	UNSTR_TRACE_BYTES(size);
+	idx = (unstr_index_t *)unstr_malloc(sizeof(unstr_index_t));
+	if((idx != NULL) && unstr_index_attach(idx, block, size)){
+		idx->mapped = mapped;
+		return idx;
+	}
+	free(idx);
+#ifdef UNSTR_INDEX_MMAP
+	munmap(block, size);
+#else
+	free(block);
+#endif
+	return NULL;
+}
+
+/**
+ * @brief		索引の各領域の位置を求める
+ * @param[in]	length	文字列長
+ * @param[out]	offset	各領域の先頭位置の格納先(UNSTR_INDEX_SECTIONS個)。NULLなら求めない
+ * @return		全体の大きさ
+ * @par			詳細:
+ * 見出し、文字列と終端、接尾辞配列、LCP配列、2つのスパーステーブルの順に、
+ * それぞれ8バイト境界に揃えて並べる。
+ */
+static size_t unstr_index_layout(size_t length, size_t *offset)
+{
+	size_t sizes[UNSTR_INDEX_SECTIONS];
+	size_t blocks = (length + UNSTR_INDEX_BLOCK - 1) / UNSTR_INDEX_BLOCK;
+	size_t table = blocks * unstr_index_levels(blocks) * sizeof(int);
+	size_t pos = UNSTR_INDEX_ALIGN(sizeof(unstr_index_header_t));
+	size_t i = 0;
+	sizes[0] = length + 1;
+	sizes[1] = length * sizeof(int);
+	sizes[2] = length * sizeof(int);
+	sizes[3] = table;
+	sizes[4] = table;
+	for(i = 0; i < UNSTR_INDEX_SECTIONS; i++){
+		if(offset != NULL){
+			offset[i] = pos;
+		}
+		pos += UNSTR_INDEX_ALIGN(sizes[i]);
+	}
+	return pos;
+}
+
+/**
+ * @brief			索引の領域を検査し、各配列の位置を設定する
+ * @param[out]		idx		設定する索引
+ * @param[in]		block	索引全体の領域
+ * @param[in]		size	blockの大きさ
+ * @return			検査結果
+ * @return			UNSTRING_TRUE	成功
+ * @return			UNSTRING_FALSE	壊れているか、この環境の形式と違う
+ */
+static unstr_bool_t unstr_index_attach(unstr_index_t *idx, char *block, size_t size)
+{
+	const unstr_index_header_t *head = (const unstr_index_header_t *)block;
+	size_t offset[UNSTR_INDEX_SECTIONS];
+	idx->block = block;
+	idx->size = size;
+	idx->mapped = UNSTRING_FALSE;
+	if((size < sizeof(unstr_index_header_t))
+	|| (memcmp(head->magic, UNSTR_INDEX_MAGIC, sizeof(head->magic)) != 0)
+	|| (head->order != UNSTR_INDEX_ORDER)
+	|| (head->word != UNSTR_INDEX_WORD)
+	|| (head->length >= (size_t)INT_MAX)
+	|| (head->size != size)
+	|| (unstr_index_layout(head->length, offset) != size)
+	|| (block[offset[0] + head->length] != '\0')){
+		return UNSTRING_FALSE;
+	}
+	idx->length = head->length;
+	idx->blocks = (head->length + UNSTR_INDEX_BLOCK - 1) / UNSTR_INDEX_BLOCK;
+	idx->text = block + offset[0];
+	idx->sa = (const int *)(block + offset[1]);
+	idx->lcp = (const int *)(block + offset[2]);
+	idx->sa_table = (const int *)(block + offset[3]);
+	idx->lcp_table = (const int *)(block + offset[4]);
+	/* 接尾辞配列の値は本文の位置として使うので、壊れたファイルで範囲外を読まないようにする */
+	return (unstr_index_check(idx->sa, idx->length, idx->length)
+		&& unstr_index_check(idx->lcp, idx->length, idx->length)
+		&& unstr_index_check(idx->sa_table, idx->blocks * unstr_index_levels(idx->blocks), idx->length)
+		&& unstr_index_check(idx->lcp_table, idx->blocks * unstr_index_levels(idx->blocks), idx->length))
+		? UNSTRING_TRUE : UNSTRING_FALSE;
+}
+
+/**
+ * @brief		配列の全ての値が0以上upper未満か調べる
+ * @param[in]	arr		対象の配列
+ * @param[in]	n		arrの要素数
+ * @param[in]	upper	値の上限(この値は含まない)
+ * @return		検査結果
+ * @return		UNSTRING_TRUE	全て範囲内
+ * @return		UNSTRING_FALSE	範囲外の値がある
+ */
+static unstr_bool_t unstr_index_check(const int *arr, size_t n, size_t upper)
+{
+	size_t i = 0;
+	for(i = 0; i < n; i++){
+		if((arr[i] < 0) || ((size_t)arr[i] >= upper)){
+			return UNSTRING_FALSE;
+		}
+	}
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief		2を底とする対数の切り捨てを求める
+ * @param[in]	x		対象(1以上)
+ * @return		log2(x)の整数部分
+ */
+static size_t unstr_index_log2(size_t x)
+{
+	size_t k = 0;
+	while((x >> (k + 1)) != 0){
+		k++;
+	}
+	return k;
+}
+
+/**
+ * @brief		スパーステーブルの段数を求める
+ * @param[in]	blocks	ブロック数
+ * @return		段数
+ */
+static size_t unstr_index_levels(size_t blocks)
+{
+	return (blocks == 0) ? 0 : (unstr_index_log2(blocks) + 1);
+}
+
+/**
+ * @brief		SA-ISで接尾辞配列を作る
+ * @param[in]	s		対象の列。各要素は0からupperまで
+ * @param[out]	sa		接尾辞配列の格納先(n個)
+ * @param[in]	n		sの長さ
+ * @param[in]	upper	sの要素の最大値
+ * @return		作成結果
+ * @return		UNSTRING_TRUE	成功
+ * @return		UNSTRING_FALSE	確保に失敗
+ * @par			詳細:
+ * LMS部分文字列を誘導ソートで並べ、同じものに同じ番号を付けた列を再帰的に処理して
+ * LMS接尾辞の順序を確定し、もう一度誘導ソートする。終端記号は使わない。
+ */
+static unstr_bool_t unstr_sais(const int *s, int *sa, int n, int upper)
+{
+	unsigned char *ls = 0;
+	int *sum_l = 0;
+	int *sum_s = 0;
+	int *lms_map = 0;
+	int *lms = 0;
+	int *rec_s = 0;
+	int *rec_sa = 0;
+	int m = 0;
+	int i = 0;
+	int k = 0;
+	int l = 0;
+	int r = 0;
+	int end_l = 0;
+	int end_r = 0;
+	int rec_upper = 0;
+	unstr_bool_t same = UNSTRING_FALSE;
+	unstr_bool_t ret = UNSTRING_FALSE;
+	if(n <= 2){
+		if(n >= 1){
+			sa[0] = ((n == 2) && (s[0] >= s[1])) ? 1 : 0;
+		}
+		if(n == 2){
+			sa[1] = 1 - sa[0];
+		}
+		return UNSTRING_TRUE;
+	}
+	ls = (unsigned char *)unstr_malloc((size_t)n);
+	sum_l = (int *)unstr_malloc(((size_t)upper + 2) * sizeof(int));
+	sum_s = (int *)unstr_malloc(((size_t)upper + 2) * sizeof(int));
+	lms_map = (int *)unstr_malloc(((size_t)n + 1) * sizeof(int));
+	lms = (int *)unstr_malloc(((size_t)n / 2 + 1) * sizeof(int));
+	if((ls == NULL) || (sum_l == NULL) || (sum_s == NULL) || (lms_map == NULL) || (lms == NULL)){
+		goto done;
+	}
+	/* 後ろの接尾辞より小さいものをS型(1)、大きいものをL型(0)にする */
+	ls[n - 1] = 0;
+	for(i = n - 2; i >= 0; i--){
+		ls[i] = (s[i] == s[i + 1]) ? ls[i + 1] : (unsigned char)(s[i] < s[i + 1]);
+	}
+	/* 文字毎のL型とS型の書き込み開始位置 */
+	memset(sum_l, 0, ((size_t)upper + 2) * sizeof(int));
+	memset(sum_s, 0, ((size_t)upper + 2) * sizeof(int));
+	for(i = 0; i < n; i++){
+		if(!ls[i]){
+			sum_s[s[i]]++;
+		} else {
+			sum_l[s[i] + 1]++;
+		}
+	}
+	for(i = 0; i <= upper; i++){
+		sum_s[i] += sum_l[i];
+		if(i < upper){
+			sum_l[i + 1] += sum_s[i];
+		}
+	}
+	for(i = 0; i <= n; i++){
+		lms_map[i] = -1;
+	}
+	for(i = 1; i < n; i++){
+		if(!ls[i - 1] && ls[i]){
+			lms_map[i] = m;
+			lms[m++] = i;
+		}
+	}
+	if(!unstr_sais_induce(s, sa, n, upper, ls, sum_l, sum_s, lms, m)){
+		goto done;
+	}
+	if(m > 0){
+		/* 並んだ順にLMS部分文字列を取り出し、等しいものに同じ番号を付ける */
+		rec_s = (int *)unstr_malloc((size_t)m * sizeof(int));
+		rec_sa = (int *)unstr_malloc((size_t)m * sizeof(int));
+		if((rec_s == NULL) || (rec_sa == NULL)){
+			goto done;
+		}
+		for(i = 0, k = 0; i < n; i++){
+			if(lms_map[sa[i]] != -1){
+				rec_sa[k++] = sa[i];
+			}
+		}
+		rec_s[lms_map[rec_sa[0]]] = 0;
+		for(i = 1; i < m; i++){
+			l = rec_sa[i - 1];
+			r = rec_sa[i];
+			end_l = ((lms_map[l] + 1) < m) ? lms[lms_map[l] + 1] : n;
+			end_r = ((lms_map[r] + 1) < m) ? lms[lms_map[r] + 1] : n;
+			same = UNSTRING_TRUE;
+			if((end_l - l) != (end_r - r)){
+				same = UNSTRING_FALSE;
+			} else {
+				while((l < end_l) && (s[l] == s[r])){
+					l++;
+					r++;
+				}
+				if((l == n) || (s[l] != s[r])){
+					same = UNSTRING_FALSE;
+				}
+			}
+			if(!same){
+				rec_upper++;
+			}
+			rec_s[lms_map[rec_sa[i]]] = rec_upper;
+		}
+		if(!unstr_sais(rec_s, rec_sa, m, rec_upper)){
+			goto done;
+		}
+		for(i = 0; i < m; i++){
+			rec_sa[i] = lms[rec_sa[i]];
+		}
+		if(!unstr_sais_induce(s, sa, n, upper, ls, sum_l, sum_s, rec_sa, m)){
+			goto done;
+		}
+	}
+	ret = UNSTRING_TRUE;
+done:
+	free(ls);
+	free(sum_l);
+	free(sum_s);
+	free(lms_map);
+	free(lms);
+	free(rec_s);
+	free(rec_sa);
+	return ret;
+}
+
+/**
+ * @brief		LMS接尾辞の並びから誘導ソートで接尾辞配列を作る
+ * @param[in]	s		対象の列
+ * @param[out]	sa		接尾辞配列の格納先
+ * @param[in]	n		sの長さ
+ * @param[in]	upper	sの要素の最大値
+ * @param[in]	ls		各接尾辞の型(S型なら1)
+ * @param[in]	sum_l	文字毎のL型の書き込み開始位置
+ * @param[in]	sum_s	文字毎のS型の書き込み開始位置
+ * @param[in]	lms		LMS接尾辞の開始位置の並び
+ * @param[in]	m		lmsの要素数
+ * @return		作成結果
+ * @return		UNSTRING_TRUE	成功
+ * @return		UNSTRING_FALSE	確保に失敗
+ */
+static unstr_bool_t unstr_sais_induce(const int *s, int *sa, int n, int upper, const unsigned char *ls, const int *sum_l, const int *sum_s, const int *lms, int m)
+{
+	int *buf = (int *)unstr_malloc(((size_t)upper + 2) * sizeof(int));
+	int i = 0;
+	int v = 0;
+	if(buf == NULL){
+		return UNSTRING_FALSE;
+	}
+	for(i = 0; i < n; i++){
+		sa[i] = -1;
+	}
+	memcpy(buf, sum_s, ((size_t)upper + 1) * sizeof(int));
+	for(i = 0; i < m; i++){
+		if(lms[i] != n){
+			sa[buf[s[lms[i]]]++] = lms[i];
+		}
+	}
+	/* L型を前から、S型を後ろから詰める */
+	memcpy(buf, sum_l, ((size_t)upper + 1) * sizeof(int));
+	sa[buf[s[n - 1]]++] = n - 1;
+	for(i = 0; i < n; i++){
+		v = sa[i];
+		if((v >= 1) && !ls[v - 1]){
+			sa[buf[s[v - 1]]++] = v - 1;
+		}
+	}
+	memcpy(buf, sum_l, ((size_t)upper + 1) * sizeof(int));
+	for(i = n - 1; i >= 0; i--){
+		v = sa[i];
+		if((v >= 1) && ls[v - 1]){
+			sa[--buf[s[v - 1] + 1]] = v - 1;
+		}
+	}
+	free(buf);
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			KasaiらのアルゴリズムでLCP配列を作る
+ * @param[in,out]	idx		接尾辞配列を作った索引
+ * @param[in]		s		作業領域(文字列長+1個)。内容は壊す
+ * @return			作成結果
+ * @return			UNSTRING_TRUE	成功
+ * @par				詳細:
+ * lcp[i]はsa[i - 1]とsa[i]の接尾辞の共通接頭辞の長さ。lcp[0]は0。
+ * 文字列の前から順に、1つ前の位置の値から高々1しか減らないことを使う。
+ */
+static unstr_bool_t unstr_index_lcp(unstr_index_t *idx, int *s)
+{
+	int *rank = s;
+	int *lcp = (int *)idx->lcp;
+	const unsigned char *t = (const unsigned char *)idx->text;
+	size_t n = idx->length;
+	size_t i = 0;
+	size_t j = 0;
+	size_t h = 0;
+	for(i = 0; i < n; i++){
+		rank[idx->sa[i]] = (int)i;
+	}
+	if(n > 0){
+		lcp[0] = 0;
+	}
+	for(i = 0; i < n; i++){
+		if(rank[i] == 0){
+			h = 0;
+			continue;
+		}
+		j = (size_t)idx->sa[rank[i] - 1];
+		while(((i + h) < n) && ((j + h) < n) && (t[i + h] == t[j + h])){
+			h++;
+		}
+		lcp[rank[i]] = (int)h;
+		if(h > 0){
+			h--;
+		}
+	}
+	return UNSTRING_TRUE;
+}
+
+/**
+ * @brief			区間最小値を求めるためのスパーステーブルを作る
+ * @param[in]		idx		索引
+ * @param[in]		arr		対象の配列(文字列長の個数)
+ * @param[out]		table	格納先
+ * @return			無し
+ * @par				詳細:
+ * UNSTR_INDEX_BLOCK個毎の最小値を求め、その2^k個分の最小値をk段目に置く。
+ */
+static void unstr_index_build_table(const unstr_index_t *idx, const int *arr, int *table)
+{
+	size_t nb = idx->blocks;
+	size_t levels = unstr_index_levels(nb);
+	size_t b = 0;
+	size_t i = 0;
+	size_t k = 0;
+	size_t end = 0;
+	int v = 0;
+	for(b = 0; b < nb; b++){
+		end = ((b + 1) * UNSTR_INDEX_BLOCK < idx->length) ? ((b + 1) * UNSTR_INDEX_BLOCK) : idx->length;
+		v = arr[b * UNSTR_INDEX_BLOCK];
+		for(i = b * UNSTR_INDEX_BLOCK; i < end; i++){
+			v = (arr[i] < v) ? arr[i] : v;
+		}
+		table[b] = v;
+	}
+	for(k = 1; k < levels; k++){
+		for(b = 0; b < nb; b++){
+			v = table[((k - 1) * nb) + b];
+			if((b + ((size_t)1 << (k - 1))) < nb){
+				i = ((k - 1) * nb) + b + ((size_t)1 << (k - 1));
+				v = (table[i] < v) ? table[i] : v;
+			}
+			table[(k * nb) + b] = v;
+		}
+	}
+}
+
+/**
+ * @brief		配列の区間[begin, end)の最小値を求める
+ * @param[in]	idx		索引
+ * @param[in]	arr		対象の配列
+ * @param[in]	table	arrのスパーステーブル
+ * @param[in]	begin	区間の先頭
+ * @param[in]	end		区間の終わり(beginより大きいこと)
+ * @return		最小値
+ * @par			詳細:
+ * 両端の半端なブロックは直接調べ、間のブロックは重なる2つの段の値で求める。
  */
-unstr_t *unstr_itoa(int num, size_t physics)
+static int unstr_index_min(const unstr_index_t *idx, const int *arr, const int *table, size_t begin, size_t end)
 {
-	int value = 0;
-	int c = 0;
-	unstr_bool_t flag = UNSTRING_FALSE;
-	size_t number = 0;
-	unstr_t *str = 0;
-	unstr_t *ret = 0;
-	if((physics < 2) || (physics > 36)){
-		return NULL;
-	}
-	str = unstr_init_memory(UNSTRING_HEAP_SIZE);
-	if(num == 0){
-		str->data[str->length++] = '0';
-	} else if(num < 0){
-		if(physics == 10){
-			num *= -1;
-		}
-		flag = UNSTRING_TRUE;
-	}
-	number = num;
-	while(number > 0){
-		value = number % physics;
-		number = number / physics;
-		if(value >= 10){
-			c = (value - 10) + 'a';
-		} else {
-			c = value + '0';
-		}
-		if(unstr_check_heap_size(str, 1)){
-			unstr_alloc(str, 1);
+	size_t bl = begin / UNSTR_INDEX_BLOCK;
+	size_t br = (end - 1) / UNSTR_INDEX_BLOCK;
+	size_t i = 0;
+	size_t k = 0;
+	int v = arr[begin];
+	if(bl == br){
+		for(i = begin; i < end; i++){
+			v = (arr[i] < v) ? arr[i] : v;
 		}
-		str->data[str->length++] = c;
+		return v;
 	}
-	if(physics == 10 && flag){
-		if(unstr_check_heap_size(str, 1)){
-			unstr_alloc(str, 1);
-		}
-		str->data[str->length++] = '-';
+	for(i = begin; i < ((bl + 1) * UNSTR_INDEX_BLOCK); i++){
+		v = (arr[i] < v) ? arr[i] : v;
 	}
-	str->data[str->length] = '\0';
-	ret = unstr_reverse(str);
-	unstr_free(str);
-	return ret;
+	for(i = br * UNSTR_INDEX_BLOCK; i < end; i++){
+		v = (arr[i] < v) ? arr[i] : v;
+	}
+	if((bl + 1) < br){
+		k = unstr_index_log2(br - bl - 1);
+		i = (k * idx->blocks) + bl + 1;
+		v = (table[i] < v) ? table[i] : v;
+		i = (k * idx->blocks) + br - ((size_t)1 << k);
+		v = (table[i] < v) ? table[i] : v;
+	}
+	return v;
 }
 
 /**
- * @brief		頭の良いsubstr
- * @param[in]	data	対象文字列
- * @param[in]	format	切り出すフォーマット
- * @param[out]	...		領域が確保されたunstr_t型
- * @return		切り出した文字数
- * @public
- *
+ * @brief		検索文字列で始まる接尾辞の範囲を求める
+ * @param[in]	idx		索引
+ * @param[in]	search	検索文字列
+ * @param[out]	end		範囲の終わりの格納先
+ * @return		範囲の先頭。一致しない場合は*endと同じ値
  * @par			詳細:
- * dataからformat通りに文字列を切り出し、unstr_t型に格納する。\n
- * 対応フォーマットは「$」のみ\n
- * "abcdefg"から"cd"と"fg"を抜き出したい場合、"ab$e$"と書く\n
- * 「$$」と書けば「$」を区切り文字に出来る\n
- * 取得した文字列の数を返す。上記の場合は「2」を返す
+ * 二分探索の両端と一致した長さを覚えておき、短い方の長さまでは比べずに飛ばす。
+ * 範囲の終わりは、LCPの区間最小値が検索文字列長を下回る最初の位置を二分探索で求める。
  */
-size_t unstr_sscanf(const unstr_t *data, const char *format, ...)
+static size_t unstr_index_range(const unstr_index_t *idx, const unstr_t *search, size_t *end)
 {
-	va_list list;
-	size_t count = 0;
-	size_t steady = 0;
-	unstr_t *str = 0;
-	unstr_t *search = 0;
-	char *tmp = 0;
-	char *index = 0;
-	char *format_end = 0;
-
-	if(!unstr_isset(data) || (format == NULL)){
-		return 0;
+	const unsigned char *t = (const unsigned char *)idx->text;
+	const unsigned char *p = (const unsigned char *)search->data;
+	size_t m = search->length;
+	size_t begin = 0;
+	size_t lo = 0;
+	size_t hi = idx->length;
+	size_t l = 0;
+	size_t r = 0;
+	size_t mid = 0;
+	size_t pos = 0;
+	size_t limit = 0;
+	size_t k = 0;
+	while(lo < hi){
+		mid = lo + ((hi - lo) / 2);
+		pos = (size_t)idx->sa[mid];
+		limit = ((idx->length - pos) < m) ? (idx->length - pos) : m;
+		k = (l < r) ? l : r;
+		while((k < limit) && (t[pos + k] == p[k])){
+			k++;
+		}
+		if((k < m) && ((k == limit) || (t[pos + k] < p[k]))){
+			lo = mid + 1;
+			l = k;
+		} else {
+			hi = mid;
+			r = k;
+		}
 	}
-	tmp = data->data;
-	/* 先頭を探索する */
-	format_end = strchr(format, '$');
-	if(format_end == NULL) return 0;
-	search = unstr_init_memory(UNSTRING_HEAP_SIZE);
-	unstr_substr_char(search, format, format_end - format);
-	va_start(list, format);
-	format += format_end - format;
-	/* search->dataが長さ0の文字列の場合、tmpを返す */
-	index = strstr(tmp, search->data);
-	if(index == NULL){
-		tmp += strlen(tmp);
-		format += strlen(format);
-	} else {
-		tmp = index + search->length;
+	*end = lo;
+	if((lo == idx->length)
+	|| ((idx->length - (size_t)idx->sa[lo]) < m)
+	|| (memcmp(t + idx->sa[lo], p, m) != 0)){
+		return lo;
 	}
-	while((format_end = strchr(format, '$')) != NULL){
-		format++;
-		/* 検索文字列を構築 */
-		format_end = strchr(format, '$');
-		if(*format == '\0'){
-			steady = strlen(tmp);
-			format += strlen(format);
+	begin = lo;
+	lo = begin + 1;
+	hi = idx->length;
+	while(lo < hi){
+		mid = lo + ((hi - lo) / 2);
+		if((size_t)unstr_index_min(idx, idx->lcp, idx->lcp_table, begin + 1, mid + 1) >= m){
+			lo = mid + 1;
 		} else {
-			if(format_end == NULL){
-				format_end = (char *)format + strlen(format);
-			}
-			unstr_substr_char(search, format, format_end - format);
-			if(unstr_strlen(search) == 0){
-				unstr_strcat_char(search, "$");
-			}
-			/* 検索 */
-			index = strstr(tmp, search->data);
-			if(index == NULL){
-				steady = strlen(tmp);
-				format += strlen(format);
-			} else {
-				/* 差分を数値化 */
-				steady = (size_t)(index - tmp);
-				format += format_end - format;
-			}
-		}
-		str = va_arg(list, unstr_t *);
-		if(unstr_substr_char(str, tmp, steady) == UNSTRING_TRUE){
-			count++;
+			hi = mid;
 		}
-		/* ポインタを進める */
-		tmp += steady + search->length;
 	}
-	va_end(list);
-	unstr_free(search);
-	return count;
+	*end = lo;
+	return begin;
 }
 
 /**
- * @brief		ファイルを丸ごと読み込む
- * @param[in]	filename	ファイルパス
- * @return		読み込んだファイルの中身
- * @public
+ * @brief		size_tを昇順に並べるための比較関数
+ * @param[in]	a		比較対象
+ * @param[in]	b		比較対象
+ * @return		aが小さければ負、等しければ0、大きければ正
  */
-unstr_t *unstr_file_get_contents(const unstr_t *filename)
+static int unstr_index_compare_size(const void *a, const void *b)
 {
-	FILE *fp = fopen(filename->data, "r");
-	unstr_t *str = 0;
-	long size = 0;
-	size_t getsize = 0;
-
-	if(fp == NULL) return NULL;
-	/* ファイルサイズを求める */
-	/* ファイルポインタを最後まで移動 */
-	fseek(fp, 0, SEEK_END);
-	size = ftell(fp);
-	/* ファイルポインタを先頭に戻す */
-	rewind(fp);
-
-	/* ファイルサイズ分の領域を確保 */
-	str = unstr_init_memory((size_t)size + 1);
-
-	/* 読み込み */
-	getsize = fread(str->data, 1, (size_t)size, fp);
-	str->data[getsize] = '\0';
-	str->length = getsize;
-
-	/* ファイルポインタをクローズ */
-	fclose(fp);
-	return str;
+	size_t x = *(const size_t *)a;
+	size_t y = *(const size_t *)b;
+	return (x > y) - (x < y);
 }
 
 /**
- * @brief		ファイルに書き出す
- * @param[in]	filename	ファイルパス
- * @param[in]	data		書き込む内容
- * @param[in]	mode		書き込みモード
- * @return		出力結果
+ * @brief		呼び出したスレッドのメモリ統計を取得する
+ * @param[out]	stats	格納先
+ * @return		取得結果
  * @return		UNSTRING_TRUE	成功
- * @return		UNSTRING_FALSE	失敗
+ * @return		UNSTRING_FALSE	統計が無効、またはstatsがNULL
  * @public
+ * @par			詳細:
+ * UNSTRING_ENABLE_STATSを定義せずにビルドした場合、statsを0で埋めて
+ * UNSTRING_FALSEを返す。
  */
-unstr_bool_t unstr_file_put_contents(const unstr_t *filename, const unstr_t *data, const char *mode)
+unstr_bool_t unstr_stats_snapshot(unstr_stats_t *stats)
 {
-	FILE *fp = 0;
-	if(unstr_empty(data)) return UNSTRING_FALSE;
-	fp = fopen(filename->data, mode);
-	if(fp == NULL) return UNSTRING_FALSE;
-	/* ftell(fp); */
-	fwrite(data->data, 1, data->length, fp);
-	fclose(fp);
+	if(stats == NULL){
+		return UNSTRING_FALSE;
+	}
+#ifdef UNSTRING_ENABLE_STATS
+	*stats = unstr_stats_local;
 	return UNSTRING_TRUE;
+#else
+	memset(stats, 0, sizeof(unstr_stats_t));
+	return UNSTRING_FALSE;
+#endif
 }
 
 /**
- * @brief		文字列を置換する。非破壊。
- * @param[in]	data	対象文字列
- * @param[in]	search	置換対象文字列
- * @param[in]	replace	置換文字列
- * @return		対象文字列から置換対象文字列を置換文字列に置換した文字列
+ * @brief			メモリ統計を合算する
+ * @param[in,out]	dst		合算先
+ * @param[in]		src		合算する統計
+ * @return			無し
  * @public
+ * @par				詳細:
+ * heap_peakはスレッド毎の最大値の和になるので、全体の最大値の上限として扱う。
  */
-unstr_t *unstr_replace(const unstr_t *data, const unstr_t *search, const unstr_t *replace)
+void unstr_stats_merge(unstr_stats_t *dst, const unstr_stats_t *src)
 {
-	unstr_t *str = 0;
-	size_t size = 0;
-	char *pt = 0;
-	char *index = 0;
-
-	if(unstr_empty(data) || unstr_empty(search) || !unstr_isset(replace)){
-		return NULL;
-	}
-	pt = data->data;
-	str = unstr_init_memory(data->length);
-	while((index = strstr(pt, search->data)) != NULL){
-		size = (size_t)(index - pt);
-		if(unstr_check_heap_size(str, size + replace->length)){
-			unstr_alloc(str, size + replace->length);
-		}
-		memcpy(&(str->data[str->length]), pt, size);
-		str->length += size;
-		memcpy(&(str->data[str->length]), replace->data, replace->length);
-		str->length += replace->length;
-		pt = index + search->length;
-	}
-	if(*pt != '\0'){
-		size = strlen(pt);
-		if(unstr_check_heap_size(str, size)){
-			unstr_alloc(str, size);
-		}
-		memcpy(&(str->data[str->length]), pt, size);
-		str->length += size;
+	if((dst == NULL) || (src == NULL)){
+		return;
 	}
-	str->data[str->length] = '\0';
-	return str;
+	dst->alloc_count += src->alloc_count;
+	dst->realloc_count += src->realloc_count;
+	dst->free_count += src->free_count;
+	dst->heap_live += src->heap_live;
+	dst->heap_peak += src->heap_peak;
+	dst->freed_heap += src->freed_heap;
+	dst->freed_length += src->freed_length;
+	dst->cache_hit += src->cache_hit;
 }
 
 /**
- * @brief		文字列を検索し、発見した文字位置を返す
- * @param[in]	text	対象文字列
- * @param[in]	search	検索文字列
- * @return		文字位置
+ * @brief		呼び出したスレッドのメモリ統計を0に戻す
+ * @return		無し
  * @public
  */
-int unstr_strpos(const unstr_t *text, const unstr_t *search)
+void unstr_stats_reset(void)
 {
-	unsigned char *x = 0;
-	size_t m = 0;
-	unsigned char *y = 0;
-	size_t n = 0;
-	size_t i = 0;
-	size_t table[256] = {0};
-
-	if(unstr_empty(text) || unstr_empty(search)){
-		return -1;
-	}
-	x = (unsigned char *)search->data;
-	m = unstr_strlen(search);
-	y = (unsigned char *)text->data;
-	n = unstr_strlen(text);
-
-	// クイックサーチ
-	for(i = 0; i < 256; i++){
-		table[i] = m + 1;
-	}
-	for(i = 0; i < m; i++){
-		table[x[i]] = m - i;
-	}
-
-	for(i = 0; i <= n - m;){
-		if(memcmp(x, y + i, m) == 0){
-			return (int)i;
-		}
-		i += table[y[i + m]];
-	}
-	return -1;
+#ifdef UNSTRING_ENABLE_STATS
+	memset(&unstr_stats_local, 0, sizeof(unstr_stats_t));
+#endif
 }
 
 /**
- * @brief		出現数をカウント
- * @param[in]	text	対象文字列
- * @param[in]	search	検索文字列
- * @return		検索文字列の出現数
+ * @brief		呼び出したスレッドが再利用のために保持している領域を全て開放する
+ * @return		開放した領域の数
  * @public
+ * @par			詳細:
+ * UNSTRING_ENABLE_CACHEを定義してビルドした場合、保持している領域は
+ * スレッドが終了しても開放されないので、各スレッドは終了前に必ず呼び出すこと。
+ * 保持するのは2048バイト未満の領域だけで、1種類当たりUNSTRING_CACHE_DEPTH個まで。
+ * 定義せずにビルドした場合は何もせず0を返す。
  */
-size_t unstr_substr_count(const unstr_t *text, const unstr_t *search)
+size_t unstr_cache_release(void)
 {
-	unsigned char *x = 0;
-	size_t m = 0;
-	unsigned char *y = 0;
-	size_t n = 0;
 	size_t count = 0;
-	size_t i = 0;
-	size_t table[256] = {0};
-
-	if(unstr_empty(text) || unstr_empty(search)){
-		return 0;
-	}
-	x = (unsigned char *)search->data;
-	m = unstr_strlen(search);
-	y = (unsigned char *)text->data;
-	n = unstr_strlen(text);
-
-	// クイックサーチ
-	for(i = 0; i < 256; i++){
-		table[i] = m + 1;
-	}
-	for(i = 0; i < m; i++){
-		table[x[i]] = m - i;
+#ifdef UNSTRING_ENABLE_CACHE
+	size_t c = 0;
+	while(unstr_cache_local.header_count != 0){
+		free(unstr_cache_local.header[--unstr_cache_local.header_count]);
+		count++;
 	}
-
-	for(i = 0; i <= n - m;){
-		if(memcmp(x, y + i, m) == 0){
+	for(c = 0; c < UNSTRING_CACHE_CLASSES; c++){
+		while(unstr_cache_local.buffer_count[c] != 0){
+			free(unstr_cache_local.buffer[c][--unstr_cache_local.buffer_count[c]]);
 			count++;
 		}
-		i += table[y[i + m]];
 	}
+#endif
 	return count;
 }
 
 /**
- * @brief		出現数をカウント
- * @param[in]	text	対象文字列
- * @param[in]	search	検索文字列
- * @return		検索文字列の出現数
+ * @brief		呼び出したスレッドの関数毎の計測結果を取得する
+ * @param[out]	stats	格納先。UNSTR_TRACE_MAX個の配列
+ * @return		取得結果
+ * @return		UNSTRING_TRUE	成功
+ * @return		UNSTRING_FALSE	計測が無効、またはstatsがNULL
  * @public
+ * @par			詳細:
+ * UNSTRING_ENABLE_TRACEを定義せずにビルドした場合、statsを0で埋めて
+ * UNSTRING_FALSEを返す。
  */
-size_t unstr_substr_count_char(const unstr_t *text, const char *search)
+unstr_bool_t unstr_trace_snapshot(unstr_trace_stat_t *stats)
 {
-	size_t count = 0;
-	unstr_t *str = 0;
-	if(search != NULL){
-		str = unstr_init(search);
-		count = unstr_substr_count(text, str);
-		unstr_free(str);
+	if(stats == NULL){
+		return UNSTRING_FALSE;
 	}
-	return count;
+#ifdef UNSTRING_ENABLE_TRACE
+	memcpy(stats, unstr_trace_local, sizeof(unstr_trace_local));
+	return UNSTRING_TRUE;
+#else
+	memset(stats, 0, sizeof(unstr_trace_stat_t) * UNSTR_TRACE_MAX);
+	return UNSTRING_FALSE;
+#endif
 }
 
 /**
- * @brief			文字列をトークンで切り分ける
- * @param[in,out]	str		対象文字列。
- * @param[in]		delim	トークン(文字列可)
- * @param[in,out]	index	インデックス値。次回呼び出し時に必要
- * @return			切り出した文字列
+ * @brief		呼び出したスレッドの計測結果を0に戻す
+ * @return		無し
  * @public
- *
- * @par				詳細:
- * delimで指定された「文字列」でstrを切り分けます。
  */
-unstr_t *unstr_strtok(const unstr_t *str, const char *delim, size_t *index)
+void unstr_trace_reset(void)
 {
-	unstr_t *data = 0;
-	char *p = 0;
-	char *ptr = 0;
-	size_t len = 0;
-	size_t slen = unstr_strlen(str);
-	if(unstr_empty(str)
-	|| (delim == NULL)
-	|| (strlen(delim) == 0)
-	|| (index == NULL)
-	|| (*index > slen)){
+#ifdef UNSTRING_ENABLE_TRACE
+	memset(unstr_trace_local, 0, sizeof(unstr_trace_local));
+#endif
+}
+
+/**
+ * @brief		関数呼び出し毎に呼ばれるフックを設定する
+ * @param[in]	hook	フック。NULLで解除
+ * @param[in]	arg		フックに渡す引数
+ * @return		無し
+ * @public
+ * @par			詳細:
+ * フックはスレッド毎に設定する。フックの中で呼んだ関数は計測されない。
+ */
+void unstr_trace_set_hook(unstr_trace_hook_t hook, void *arg)
+{
+#ifdef UNSTRING_ENABLE_TRACE
+	unstr_trace_hook = hook;
+	unstr_trace_hook_arg = arg;
+#else
+	(void)hook;
+	(void)arg;
+#endif
+}
+
+/**
+ * @brief		計測対象の関数名を返す
+ * @param[in]	id		計測対象
+ * @return		関数名。範囲外の場合はNULL
+ * @public
+ */
+const char *unstr_trace_name(unstr_trace_id_t id)
+{
+	static const char *names[UNSTR_TRACE_MAX] = {
+		"unstr_alloc",
+		"unstr_init",
+		"unstr_init_memory",
+		"unstr_free_func",
+		"unstr_delete",
+		"unstr_write",
+		"unstr_copy",
+		"unstr_strcpy",
+		"unstr_strcpy_char",
+		"unstr_substr",
+		"unstr_substr_char",
+		"unstr_strcat",
+		"unstr_strcat_char",
+		"unstr_strcmp",
+		"unstr_strcmp_char",
+		"unstr_strstr",
+		"unstr_strstr_char",
+		"unstr_explode",
+		"unstr_sprintf",
+		"unstr_sscanf",
+		"unstr_reverse",
+		"unstr_itoa",
+		"unstr_file_get_contents",
+		"unstr_file_put_contents",
+		"unstr_replace",
+		"unstr_strpos",
+		"unstr_substr_count",
+		"unstr_substr_count_char",
+		"unstr_strtok",
+		"unstr_repeat",
+		"unstr_repeat_char",
+		"unstr_toupper",
+		"unstr_tolower",
+		"unstr_strcasecmp",
+		"unstr_stripos",
+		"unstr_substr_icount",
+		"unstr_utf8_valid",
+		"unstr_utf8_strlen",
+		"unstr_utf8_offset",
+		"unstr_utf8_substr",
+		"unstr_utf8_reverse",
+		"unstr_reverse_inplace",
+		"unstr_reverse_into",
+		"unstr_implode",
+		"unstr_slice",
+		"unstr_replace_into",
+		"unstr_itoa_into",
+		"unstr_repeat_into",
+		"unstr_strtok_into",
+		"unstr_file_get_contents_into",
+		"unstr_strpos_batch",
+		"unstr_substr_count_batch",
+		"unstr_strcmp_batch",
+		"unstr_replace_batch",
+		"unstr_delete_array",
+		"unstr_explode_tokens",
+		"unstr_tokens_free",
+		"unstr_regex_match",
+		"unstr_regex_search",
+		"unstr_regex_find_all",
+		"unstr_bin2hex",
+		"unstr_hex2bin",
+		"unstr_base64_encode",
+		"unstr_base64_decode",
+		"unstr_compact_init",
+		"unstr_compact_free",
+		"unstr_index_init",
+		"unstr_index_count",
+		"unstr_index_first",
+		"unstr_index_all",
+		"unstr_index_save",
+		"unstr_index_load"
+	};
+	if(((int)id < 0) || (id >= UNSTR_TRACE_MAX)){
 		return NULL;
 	}
-	data = unstr_init_memory(UNSTRING_HEAP_SIZE);
-	ptr = str->data + (*index);
-	p = strstr(ptr, delim);
-	if(p != NULL){
-		len = (size_t)(p - ptr);
-		unstr_substr_char(data, ptr, len);
-		*index += len + strlen(delim);
-	} else {
-		unstr_substr_char(data, ptr, slen - (*index));
-		*index = slen + 1;
+	return names[id];
+}
+
+/**
+ * @brief		ヒストグラムの区間の下限を求める
+ * @param[in]	i		ヒストグラムの位置
+ * @return		処理時間(ns)
+ */
+static unsigned long long unstr_trace_floor(size_t i)
+{
+	size_t e = 0;
+	if(i < 16){
+		return i;
 	}
-	return data;
+	e = 4 + ((i - 16) >> UNSTRING_TRACE_SUB_BITS);
+	return (unsigned long long)((1 << UNSTRING_TRACE_SUB_BITS) + ((i - 16) & ((1 << UNSTRING_TRACE_SUB_BITS) - 1)))
+		<< (e - UNSTRING_TRACE_SUB_BITS);
 }
 
 /**
- * @brief		繰り返し文字列を生成する
- * @param[in]	str		繰り返す文字列
- * @param[in]	count	繰り返す回数
- * @return		生成した文字列
+ * @brief		ヒストグラムから百分位の処理時間を求める
+ * @param[in]	stat	計測結果
+ * @param[in]	percent	百分位(0〜100)
+ * @return		処理時間(ns)。該当区間の下限を返す
  * @public
  */
-unstr_t *unstr_repeat(const unstr_t *str, size_t count)
+unsigned long long unstr_trace_percentile(const unstr_trace_stat_t *stat, double percent)
 {
-	unstr_t *data = 0;
 	size_t i = 0;
-	if(unstr_empty(str) || (count == 0)){
-		return NULL;
+	size_t sum = 0;
+	size_t target = 0;
+	if((stat == NULL) || (stat->calls == 0)){
+		return 0;
 	}
-	data = unstr_init_memory((unstr_strlen(str) * count) + 2);
-	for(i = 0; i < count; i++){
-		unstr_strcat(data, str);
+	target = (size_t)(((double)stat->calls * percent) / 100.0);
+	if(target >= stat->calls){
+		target = stat->calls - 1;
 	}
-	return data;
+	for(i = 0; i < (UNSTRING_TRACE_BUCKETS - 1); i++){
+		sum += stat->histogram[i];
+		if(sum > target){
+			break;
+		}
+	}
+	return unstr_trace_floor(i);
 }
 
 /**
- * @brief		繰り返し文字列を生成する
- * @param[in]	str		繰り返す文字列
- * @param[in]	count	繰り返す回数
- * @return		生成した文字列
+ * @brief			呼び出したスレッドの計測結果をJSONで書き出す
+ * @param[in,out]	str		格納先。NULLの場合は新しく確保する
+ * @return			JSON文字列
  * @public
+ * @par				詳細:
+ * {"unstr_replace":{"calls":1,"bytes":10,"nsec":100,"p50":96,"p99":96,
+ * "histogram":[[96,1]]},...}の形式で、呼ばれた関数のみ出力する。
+ * histogramは[区間の下限(ns), 回数]の組で、0回の区間は省略する。\n
+ * 作業領域を確保できなかった場合はstrを変更せずに返す。
  */
-unstr_t *unstr_repeat_char(const char *str, size_t count)
+unstr_t *unstr_trace_json(unstr_t *str)
 {
-	unstr_t *data = 0;
-	unstr_t *ret = 0;
-	if(str != NULL){
-		data = unstr_init(str);
-		ret = unstr_repeat(data, count);
-		unstr_free(data);
+	unstr_trace_stat_t *stats = 0;
+	size_t i = 0;
+	size_t j = 0;
+	const char *sep = "";
+	const char *bucket_sep = "";
+	char tmp[128];
+#ifdef UNSTRING_ENABLE_TRACE
+	unstr_bool_t busy = unstr_trace_busy;
+	unstr_trace_busy = UNSTRING_TRUE;
+#endif
+	stats = (unstr_trace_stat_t *)malloc(sizeof(unstr_trace_stat_t) * UNSTR_TRACE_MAX);
+	if(stats == NULL){
+		/* 書き出せないので格納先はそのまま返す */
+#ifdef UNSTRING_ENABLE_TRACE
+		unstr_trace_busy = busy;
+#endif
+		return str;
 	}
-	return ret;
+	unstr_trace_snapshot(stats);
+	str = unstr_sprintf(str, "{");
+	for(i = 0; i < UNSTR_TRACE_MAX; i++){
+		if(stats[i].calls == 0){
+			continue;
+		}
+		snprintf(tmp, sizeof(tmp), "%s\"%s\":{\"calls\":%zu,\"bytes\":%zu,\"nsec\":%llu,",
+			sep, unstr_trace_name((unstr_trace_id_t)i), stats[i].calls, stats[i].bytes, stats[i].nsec);
+		unstr_strcat_char(str, tmp);
+		snprintf(tmp, sizeof(tmp), "\"p50\":%llu,\"p99\":%llu,\"histogram\":[",
+			unstr_trace_percentile(&stats[i], 50.0), unstr_trace_percentile(&stats[i], 99.0));
+		unstr_strcat_char(str, tmp);
+		bucket_sep = "";
+		for(j = 0; j < UNSTRING_TRACE_BUCKETS; j++){
+			if(stats[i].histogram[j] == 0){
+				continue;
+			}
+			snprintf(tmp, sizeof(tmp), "%s[%llu,%zu]", bucket_sep, unstr_trace_floor(j), stats[i].histogram[j]);
+			unstr_strcat_char(str, tmp);
+			bucket_sep = ",";
+		}
+		unstr_strcat_char(str, "]}");
+		sep = ",";
+	}
+	unstr_strcat_char(str, "}");
+	free(stats);
+#ifdef UNSTRING_ENABLE_TRACE
+	unstr_trace_busy = busy;
+#endif
+	return str;
 }
-
@@ -6,8 +6,13 @@
 
 #include <stdlib.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define UNSTRING_HEAP_SIZE			(0x20)
 #define UNSTRING_MEMORY_STAMP		(0x55)	/* ascii:[U] bin:01010101 */
+#define UNSTRING_NPOS				((size_t)-1)
 #define unstr_free(str)				\
 	do { unstr_free_func(str); (str) = NULL; } while(0)
 
@@ -22,40 +27,273 @@ typedef struct unstr_st {
 	size_t heap;
 } unstr_t;
 
-extern unstr_t *unstr_alloc(unstr_t *str, size_t size);
-extern unstr_t *unstr_init(const char *str);
-extern unstr_t *unstr_init_memory(size_t size);
-extern void unstr_free_func(unstr_t *str);
-extern void unstr_delete(size_t size, ...);
-extern void unstr_zero(unstr_t *str);
-extern unstr_bool_t unstr_isset(const unstr_t *str);
-extern unstr_bool_t unstr_empty(const unstr_t *str);
-extern unstr_bool_t unstr_write(unstr_t *us, const char *bin, size_t offset, size_t len);
-extern size_t unstr_strlen(const unstr_t *str);
-extern unstr_t *unstr_copy(const unstr_t *str);
-extern unstr_bool_t unstr_strcpy(unstr_t *s1, const unstr_t *s2);
-extern unstr_bool_t unstr_strcpy_char(unstr_t *s1, const char *s2);
-extern unstr_bool_t unstr_substr(unstr_t *s1, const unstr_t *s2, size_t len);
-extern unstr_bool_t unstr_substr_char(unstr_t *data, const char *c, size_t len);
-extern unstr_bool_t unstr_strcat(unstr_t *s1, const unstr_t *s2);
-extern unstr_bool_t unstr_strcat_char(unstr_t *str, const char *c);
-extern int unstr_strcmp(const unstr_t *s1, const unstr_t *s2);
-extern int unstr_strcmp_char(const unstr_t *s1, const char *s2);
-extern char *unstr_strstr(const unstr_t *s1, const unstr_t *s2);
-extern char *unstr_strstr_char(const unstr_t *s1, const char *s2);
-extern unstr_t **unstr_explode(const unstr_t *str, const char *tmp, size_t *len);
-extern unstr_t *unstr_sprintf(unstr_t *str, const char *format, ...);
-extern size_t unstr_sscanf(const unstr_t *data, const char *format, ...);
-extern unstr_t *unstr_reverse(const unstr_t *str);
-extern unstr_t *unstr_itoa(int num, size_t physics);
-extern unstr_t *unstr_file_get_contents(const unstr_t *filename);
-extern unstr_bool_t unstr_file_put_contents(const unstr_t *filename, const unstr_t *data, const char *mode);
-extern unstr_t *unstr_replace(const unstr_t *data, const unstr_t *search, const unstr_t *replace);
-extern int unstr_strpos(const unstr_t *text, const unstr_t *search);
-extern size_t unstr_substr_count(const unstr_t *text, const unstr_t *search);
-extern size_t unstr_substr_count_char(const unstr_t *text, const char *search);
-extern unstr_t *unstr_strtok(const unstr_t *str, const char *delim, size_t *index);
-extern unstr_t *unstr_repeat(const unstr_t *str, size_t count);
-extern unstr_t *unstr_repeat_char(const char *str, size_t count);
+/*
+ * UNSTRING_ENABLE_STATSを定義してビルドした場合のみ集計される。
+ * 集計はスレッド毎に行うので、全体の値はunstr_stats_mergeで合算する。
+ */
+typedef struct unstr_stats_st {
+	size_t alloc_count;		/* 新規確保の回数 */
+	size_t realloc_count;	/* 再確保の回数 */
+	size_t free_count;		/* 開放した文字列の数 */
+	long heap_live;			/* 確保中のバッファ量(別スレッドで開放すると負になり得る) */
+	long heap_peak;			/* heap_liveの最大値 */
+	size_t freed_heap;		/* 開放した文字列のバッファ量の合計 */
+	size_t freed_length;	/* 開放した文字列の長さの合計 */
+	size_t cache_hit;		/* alloc_countの内、開放済みの領域を再利用した回数 */
+} unstr_stats_t;
+
+/*
+ * UNSTRING_ENABLE_TRACEを定義してビルドした場合のみ計測される関数の一覧。
+ * 処理量がほぼ一定のunstr_isset等は計測しない。
+ */
+typedef enum {
+	UNSTR_TRACE_ALLOC = 0,
+	UNSTR_TRACE_INIT,
+	UNSTR_TRACE_INIT_MEMORY,
+	UNSTR_TRACE_FREE_FUNC,
+	UNSTR_TRACE_DELETE,
+	UNSTR_TRACE_WRITE,
+	UNSTR_TRACE_COPY,
+	UNSTR_TRACE_STRCPY,
+	UNSTR_TRACE_STRCPY_CHAR,
+	UNSTR_TRACE_SUBSTR,
+	UNSTR_TRACE_SUBSTR_CHAR,
+	UNSTR_TRACE_STRCAT,
+	UNSTR_TRACE_STRCAT_CHAR,
+	UNSTR_TRACE_STRCMP,
+	UNSTR_TRACE_STRCMP_CHAR,
+	UNSTR_TRACE_STRSTR,
+	UNSTR_TRACE_STRSTR_CHAR,
+	UNSTR_TRACE_EXPLODE,
+	UNSTR_TRACE_SPRINTF,
+	UNSTR_TRACE_SSCANF,
+	UNSTR_TRACE_REVERSE,
+	UNSTR_TRACE_ITOA,
+	UNSTR_TRACE_FILE_GET_CONTENTS,
+	UNSTR_TRACE_FILE_PUT_CONTENTS,
+	UNSTR_TRACE_REPLACE,
+	UNSTR_TRACE_STRPOS,
+	UNSTR_TRACE_SUBSTR_COUNT,
+	UNSTR_TRACE_SUBSTR_COUNT_CHAR,
+	UNSTR_TRACE_STRTOK,
+	UNSTR_TRACE_REPEAT,
+	UNSTR_TRACE_REPEAT_CHAR,
+	UNSTR_TRACE_TOUPPER,
+	UNSTR_TRACE_TOLOWER,
+	UNSTR_TRACE_STRCASECMP,
+	UNSTR_TRACE_STRIPOS,
+	UNSTR_TRACE_SUBSTR_ICOUNT,
+	UNSTR_TRACE_UTF8_VALID,
+	UNSTR_TRACE_UTF8_STRLEN,
+	UNSTR_TRACE_UTF8_OFFSET,
+	UNSTR_TRACE_UTF8_SUBSTR,
+	UNSTR_TRACE_UTF8_REVERSE,
+	UNSTR_TRACE_REVERSE_INPLACE,
+	UNSTR_TRACE_REVERSE_INTO,
+	UNSTR_TRACE_IMPLODE,
+	UNSTR_TRACE_SLICE,
+	UNSTR_TRACE_REPLACE_INTO,
+	UNSTR_TRACE_ITOA_INTO,
+	UNSTR_TRACE_REPEAT_INTO,
+	UNSTR_TRACE_STRTOK_INTO,
+	UNSTR_TRACE_FILE_GET_CONTENTS_INTO,
+	UNSTR_TRACE_STRPOS_BATCH,
+	UNSTR_TRACE_SUBSTR_COUNT_BATCH,
+	UNSTR_TRACE_STRCMP_BATCH,
+	UNSTR_TRACE_REPLACE_BATCH,
+	UNSTR_TRACE_DELETE_ARRAY,
+	UNSTR_TRACE_EXPLODE_TOKENS,
+	UNSTR_TRACE_TOKENS_FREE,
+	UNSTR_TRACE_REGEX_MATCH,
+	UNSTR_TRACE_REGEX_SEARCH,
+	UNSTR_TRACE_REGEX_FIND_ALL,
+	UNSTR_TRACE_BIN2HEX,
+	UNSTR_TRACE_HEX2BIN,
+	UNSTR_TRACE_BASE64_ENCODE,
+	UNSTR_TRACE_BASE64_DECODE,
+	UNSTR_TRACE_COMPACT_INIT,
+	UNSTR_TRACE_COMPACT_FREE,
+	UNSTR_TRACE_INDEX_INIT,
+	UNSTR_TRACE_INDEX_COUNT,
+	UNSTR_TRACE_INDEX_FIRST,
+	UNSTR_TRACE_INDEX_ALL,
+	UNSTR_TRACE_INDEX_SAVE,
+	UNSTR_TRACE_INDEX_LOAD,
+	UNSTR_TRACE_MAX
+} unstr_trace_id_t;
+
+/* 16ns未満は1ns刻み、それ以上は2の冪毎に8分割する(相対誤差12.5%) */
+#define UNSTRING_TRACE_SUB_BITS		(3)
+#define UNSTRING_TRACE_MAX_EXP		(40)
+#define UNSTRING_TRACE_BUCKETS		(16 + ((UNSTRING_TRACE_MAX_EXP - 4) << UNSTRING_TRACE_SUB_BITS))
+
+typedef struct unstr_trace_stat_st {
+	size_t calls;			/* 呼び出し回数 */
+	size_t bytes;			/* 処理したバイト数 */
+	unsigned long long nsec;	/* 処理時間の合計 */
+	size_t histogram[UNSTRING_TRACE_BUCKETS];
+} unstr_trace_stat_t;
+
+/* 他の文字列の一部を指す読み取り専用の範囲。元の文字列が有効な間だけ使える */
+typedef struct unstr_view_st {
+	const char *data;
+	size_t length;
+} unstr_view_t;
+
+/* unstr_explode_tokensの結果。listとlenは読み取り専用、bufferとheapは内部用 */
+typedef struct unstr_tokens_st {
+	unstr_t **list;			/* 分割した要素の配列 */
+	size_t len;				/* 要素数 */
+	char *buffer;			/* 全要素の文字列 */
+	size_t heap;			/* bufferのサイズ */
+} unstr_tokens_t;
+
+/*
+ * 短い文字列を大量に保持するための読み取り専用の文字列。
+ * 4バイトの長さと内容を1つの領域に置く。中身は内部用。
+ */
+typedef struct unstr_compact_st unstr_compact_t;
+
+/* unstr_compact_refの参照を置く領域。strだけを読み取り専用で使う */
+typedef struct unstr_ref_st {
+	unstr_t str;
+	char *base;				/* 内部用。部分文字列と同じ並びにする */
+	size_t heap;			/* 内部用 */
+} unstr_ref_t;
+
+typedef struct unstr_sscanf_plan_st unstr_sscanf_plan_t;
+typedef struct unstr_regex_st unstr_regex_t;
+typedef struct unstr_index_st unstr_index_t;
+
+typedef void (*unstr_trace_hook_t)(unstr_trace_id_t id, size_t bytes, unsigned long long nsec, void *arg);
+
+/*
+ * UNSTRING_HEADER_ONLYを定義してからincludeすると、unstring.cを取り込んで
+ * 全ての関数をstatic inlineとして定義する。ライブラリをリンクせずに使え、
+ * unstr_strlen等の小さな関数も呼び出し側に展開される。
+ * unstring.cをunstring.hと同じ場所に置くこと(installすると一緒に置かれる)。
+ * C++からunstring.hppと一緒に使うこともできる。
+ * 統計・計測・キャッシュはincludeした翻訳単位毎に別々になる。
+ */
+#if !defined(UNSTRING_HEADER_ONLY)
+#define UNSTRING_API				extern
+#elif defined(__GNUC__)
+#define UNSTRING_API				static __inline__
+#elif defined(_MSC_VER)
+#define UNSTRING_API				static __inline
+#else
+#define UNSTRING_API				static
+#endif
+
+UNSTRING_API unstr_t *unstr_alloc(unstr_t *str, size_t size);
+UNSTRING_API unstr_t *unstr_init(const char *str);
+UNSTRING_API unstr_t *unstr_init_memory(size_t size);
+UNSTRING_API void unstr_free_func(unstr_t *str);
+UNSTRING_API void unstr_delete(size_t size, ...);
+UNSTRING_API void unstr_delete_array(unstr_t **list, size_t len);
+UNSTRING_API void unstr_zero(unstr_t *str);
+UNSTRING_API unstr_bool_t unstr_isset(const unstr_t *str);
+UNSTRING_API unstr_bool_t unstr_empty(const unstr_t *str);
+UNSTRING_API unstr_bool_t unstr_write(unstr_t *us, const char *bin, size_t offset, size_t len);
+UNSTRING_API size_t unstr_strlen(const unstr_t *str);
+UNSTRING_API unstr_t *unstr_copy(const unstr_t *str);
+UNSTRING_API unstr_bool_t unstr_detach(unstr_t *str);
+UNSTRING_API unstr_t *unstr_slice(const unstr_t *str, size_t start, size_t len);
+UNSTRING_API unstr_compact_t *unstr_compact_init(const unstr_t *str);
+UNSTRING_API void unstr_compact_free(unstr_compact_t *c);
+UNSTRING_API size_t unstr_compact_strlen(const unstr_compact_t *c);
+UNSTRING_API const char *unstr_compact_data(const unstr_compact_t *c);
+UNSTRING_API const unstr_t *unstr_compact_ref(const unstr_compact_t *c, unstr_ref_t *ref);
+UNSTRING_API unstr_bool_t unstr_strcpy(unstr_t *s1, const unstr_t *s2);
+UNSTRING_API unstr_bool_t unstr_strcpy_char(unstr_t *s1, const char *s2);
+UNSTRING_API unstr_bool_t unstr_substr(unstr_t *s1, const unstr_t *s2, size_t len);
+UNSTRING_API unstr_bool_t unstr_substr_char(unstr_t *data, const char *c, size_t len);
+UNSTRING_API unstr_bool_t unstr_strcat(unstr_t *s1, const unstr_t *s2);
+UNSTRING_API unstr_bool_t unstr_strcat_char(unstr_t *str, const char *c);
+UNSTRING_API int unstr_strcmp(const unstr_t *s1, const unstr_t *s2);
+UNSTRING_API int unstr_strcmp_char(const unstr_t *s1, const char *s2);
+UNSTRING_API char *unstr_strstr(const unstr_t *s1, const unstr_t *s2);
+UNSTRING_API char *unstr_strstr_char(const unstr_t *s1, const char *s2);
+UNSTRING_API unstr_t **unstr_explode(const unstr_t *str, const char *tmp, size_t *len);
+UNSTRING_API unstr_tokens_t *unstr_explode_tokens(const unstr_t *str, const char *delim);
+UNSTRING_API void unstr_tokens_free(unstr_tokens_t *tokens);
+UNSTRING_API unstr_t *unstr_implode(unstr_t *const *list, size_t len, const char *delim);
+UNSTRING_API unstr_t *unstr_sprintf(unstr_t *str, const char *format, ...);
+UNSTRING_API size_t unstr_sscanf(const unstr_t *data, const char *format, ...);
+UNSTRING_API unstr_sscanf_plan_t *unstr_sscanf_compile(const char *format);
+UNSTRING_API size_t unstr_sscanf_exec(const unstr_sscanf_plan_t *plan, const unstr_t *data, ...);
+UNSTRING_API void unstr_sscanf_plan_free(unstr_sscanf_plan_t *plan);
+UNSTRING_API size_t unstr_sscanf_view(const unstr_t *data, const char *format, unstr_view_t *views, size_t size);
+UNSTRING_API size_t unstr_sscanf_exec_view(const unstr_sscanf_plan_t *plan, const unstr_t *data, unstr_view_t *views, size_t size);
+UNSTRING_API unstr_t *unstr_reverse(const unstr_t *str);
+UNSTRING_API unstr_bool_t unstr_reverse_inplace(unstr_t *str);
+UNSTRING_API unstr_bool_t unstr_reverse_into(unstr_t *dst, const unstr_t *src);
+UNSTRING_API unstr_t *unstr_itoa(int num, size_t physics);
+UNSTRING_API unstr_bool_t unstr_itoa_into(unstr_t *dst, int num, size_t physics);
+UNSTRING_API unstr_t *unstr_file_get_contents(const unstr_t *filename);
+UNSTRING_API unstr_bool_t unstr_file_get_contents_into(unstr_t *dst, const unstr_t *filename);
+UNSTRING_API unstr_bool_t unstr_file_put_contents(const unstr_t *filename, const unstr_t *data, const char *mode);
+UNSTRING_API unstr_t *unstr_replace(const unstr_t *data, const unstr_t *search, const unstr_t *replace);
+UNSTRING_API unstr_bool_t unstr_replace_into(unstr_t *dst, const unstr_t *data, const unstr_t *search, const unstr_t *replace);
+UNSTRING_API int unstr_strpos(const unstr_t *text, const unstr_t *search);
+UNSTRING_API size_t unstr_substr_count(const unstr_t *text, const unstr_t *search);
+UNSTRING_API size_t unstr_substr_count_char(const unstr_t *text, const char *search);
+UNSTRING_API unstr_t *unstr_strtok(const unstr_t *str, const char *delim, size_t *index);
+UNSTRING_API unstr_bool_t unstr_strtok_into(unstr_t *dst, const unstr_t *str, const char *delim, size_t *index);
+UNSTRING_API unstr_t *unstr_repeat(const unstr_t *str, size_t count);
+UNSTRING_API unstr_bool_t unstr_repeat_into(unstr_t *dst, const unstr_t *str, size_t count);
+UNSTRING_API size_t unstr_strpos_batch(unstr_t *const *list, size_t len, const unstr_t *search, int *result);
+UNSTRING_API size_t unstr_strpos_batch_view(const unstr_view_t *views, size_t len, const unstr_t *search, int *result);
+UNSTRING_API size_t unstr_substr_count_batch(unstr_t *const *list, size_t len, const unstr_t *search, size_t *result);
+UNSTRING_API size_t unstr_substr_count_batch_view(const unstr_view_t *views, size_t len, const unstr_t *search, size_t *result);
+UNSTRING_API size_t unstr_strcmp_batch(unstr_t *const *list, size_t len, const unstr_t *s2, int *result);
+UNSTRING_API size_t unstr_strcmp_batch_view(const unstr_view_t *views, size_t len, const unstr_t *s2, int *result);
+UNSTRING_API unstr_bool_t unstr_replace_batch(unstr_t **dst, unstr_t *const *list, size_t len, const unstr_t *search, const unstr_t *replace);
+UNSTRING_API unstr_bool_t unstr_replace_batch_view(unstr_t **dst, const unstr_view_t *views, size_t len, const unstr_t *search, const unstr_t *replace);
+UNSTRING_API unstr_t *unstr_repeat_char(const char *str, size_t count);
+UNSTRING_API unstr_bool_t unstr_toupper(unstr_t *str);
+UNSTRING_API unstr_bool_t unstr_tolower(unstr_t *str);
+UNSTRING_API int unstr_strcasecmp(const unstr_t *s1, const unstr_t *s2);
+UNSTRING_API int unstr_stripos(const unstr_t *text, const unstr_t *search);
+UNSTRING_API size_t unstr_substr_icount(const unstr_t *text, const unstr_t *search);
+UNSTRING_API unstr_bool_t unstr_utf8_valid(const unstr_t *str);
+UNSTRING_API size_t unstr_utf8_strlen(const unstr_t *str);
+UNSTRING_API size_t unstr_utf8_offset(const unstr_t *str, size_t index);
+UNSTRING_API unstr_bool_t unstr_utf8_substr(unstr_t *s1, const unstr_t *s2, size_t start, size_t len);
+UNSTRING_API unstr_t *unstr_utf8_reverse(const unstr_t *str);
+UNSTRING_API unstr_regex_t *unstr_regex_compile(const char *pattern);
+UNSTRING_API void unstr_regex_free(unstr_regex_t *re);
+UNSTRING_API unstr_bool_t unstr_regex_match(unstr_regex_t *re, const unstr_t *str);
+UNSTRING_API size_t unstr_regex_search(unstr_regex_t *re, const unstr_t *str, size_t offset, unstr_view_t *match);
+UNSTRING_API size_t unstr_regex_find_all(unstr_regex_t *re, const unstr_t *str, unstr_view_t *views, size_t size);
+UNSTRING_API unstr_bool_t unstr_bin2hex(unstr_t *dst, const unstr_t *src);
+UNSTRING_API unstr_bool_t unstr_hex2bin(unstr_t *dst, const unstr_t *src);
+UNSTRING_API unstr_bool_t unstr_base64_encode(unstr_t *dst, const unstr_t *src);
+UNSTRING_API unstr_bool_t unstr_base64_decode(unstr_t *dst, const unstr_t *src);
+UNSTRING_API unstr_index_t *unstr_index_init(const unstr_t *text);
+UNSTRING_API void unstr_index_free(unstr_index_t *idx);
+UNSTRING_API size_t unstr_index_count(const unstr_index_t *idx, const unstr_t *search);
+UNSTRING_API size_t unstr_index_first(const unstr_index_t *idx, const unstr_t *search);
+UNSTRING_API size_t unstr_index_all(const unstr_index_t *idx, const unstr_t *search, size_t *positions, size_t size);
+UNSTRING_API unstr_bool_t unstr_index_save(const unstr_index_t *idx, const unstr_t *filename);
+UNSTRING_API unstr_index_t *unstr_index_load(const unstr_t *filename);
+UNSTRING_API unstr_bool_t unstr_stats_snapshot(unstr_stats_t *stats);
+UNSTRING_API void unstr_stats_merge(unstr_stats_t *dst, const unstr_stats_t *src);
+UNSTRING_API void unstr_stats_reset(void);
+UNSTRING_API size_t unstr_cache_release(void);
+UNSTRING_API unstr_bool_t unstr_trace_snapshot(unstr_trace_stat_t *stats);
+UNSTRING_API void unstr_trace_reset(void);
+UNSTRING_API void unstr_trace_set_hook(unstr_trace_hook_t hook, void *arg);
+UNSTRING_API const char *unstr_trace_name(unstr_trace_id_t id);
+UNSTRING_API unsigned long long unstr_trace_percentile(const unstr_trace_stat_t *stat, double percent);
+UNSTRING_API unstr_t *unstr_trace_json(unstr_t *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef UNSTRING_HEADER_ONLY
+#include "unstring.c"
+#endif
 
 #endif /* UNSTRING_H_INCLUDE */
@@ -0,0 +1,943 @@
+/*
+ * unstring.hpp
+ *
+ * unstr_tを所有するC++用のクラス。C++17以降で使う。
+ */
+#ifndef UNSTRING_HPP_INCLUDE
+#define UNSTRING_HPP_INCLUDE
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "unstring.h"
+
+namespace unstr {
+
+namespace detail {
+
+/**
+ * @brief		string_viewを指す読み取り専用のunstr_tを作る
+ * @param[out]	r		参照を置く領域。戻り値を使い終わるまで保つこと
+ * @param[in]	sv		対象
+ * @return		読み取り専用の関数に渡せる文字列
+ * @par			詳細:
+ * unstr_compact_refと同じく、バッファを持たない部分文字列の形にする。
+ * 確保もコピーもしないので、*_char関数のunstr_initによる一時文字列が要らない。
+ */
+inline const unstr_t *ref(unstr_ref_t &r, std::string_view sv) noexcept
+{
+	r.str.data = const_cast<char *>((sv.data() == nullptr) ? "" : sv.data());
+	r.str.length = sv.size();
+	r.str.heap = 0;
+	r.base = nullptr;
+	r.heap = 0;
+	return &(r.str);
+}
+
+/* unstr_tの内容を指すstring_view。NULLは空にする */
+inline std::string_view view(const unstr_t *str) noexcept
+{
+	return unstr_isset(str) ? std::string_view(str->data, str->length) : std::string_view();
+}
+
+/* 立っている最下位のビットの位置 */
+inline unsigned int lowest_bit(unsigned int bits) noexcept
+{
+#if defined(__GNUC__)
+	return static_cast<unsigned int>(__builtin_ctz(bits));
+#else
+	unsigned int i = 0;
+	while((bits & 1u) == 0){
+		bits >>= 1;
+		i++;
+	}
+	return i;
+#endif
+}
+
+} // namespace detail
+
+/*
+ * 検索文字列をコンパイル時に固定した検索器。移動量表はコンパイル時に作る。
+ * 検索文字列の長さで処理を選ぶ。
+ *   1バイト       memchr(数える場合はunstr_substr_countのSIMD処理)
+ *   2,4,8バイト   先頭と末尾のバイトで候補を絞り、整数1回の比較で確かめる
+ *   その他        先頭と末尾のバイトで候補を絞り、memcmpで確かめる
+ * 候補の絞り込みはSSE2が使える場合は16箇所ずつ行い、
+ * 使えない場合と末尾の残りはmemchrかクイックサーチで探す。
+ */
+template<std::size_t M>
+class static_searcher {
+public:
+	static_assert(M > 0, "unstr::static_searcher: needle must not be empty");
+	static constexpr std::size_t npos = UNSTRING_NPOS;
+
+	constexpr explicit static_searcher(const char (&needle)[M + 1]) noexcept
+	{
+		for(std::size_t i = 0; i < 256; i++){
+			table_[i] = M + 1;
+		}
+		for(std::size_t i = 0; i < M; i++){
+			needle_[i] = needle[i];
+			table_[static_cast<unsigned char>(needle[i])] = M - i;
+		}
+	}
+
+	constexpr std::string_view needle() const noexcept
+	{
+		return std::string_view(needle_, M);
+	}
+
+	/* クイックサーチの移動量 */
+	constexpr std::size_t shift(unsigned char c) const noexcept
+	{
+		return table_[c];
+	}
+
+	/**
+	 * @brief		検索する
+	 * @param[in]	text	対象文字列
+	 * @param[in]	pos		検索開始位置
+	 * @return		発見した位置。見つからない場合はnpos
+	 */
+	std::size_t find(std::string_view text, std::size_t pos = 0) const noexcept
+	{
+		const char *p = nullptr;
+		if((pos > text.size()) || (M > (text.size() - pos))){
+			return npos;
+		}
+		p = scan(text.data() + pos, text.data() + text.size());
+		return (p == nullptr) ? npos : static_cast<std::size_t>(p - text.data());
+	}
+
+	std::size_t find(const unstr_t *text, std::size_t pos = 0) const noexcept
+	{
+		return find(detail::view(text), pos);
+	}
+
+	/* 重なって出現したものも数える */
+	std::size_t count(std::string_view text) const noexcept
+	{
+		const char *p = text.data();
+		const char *end = text.data() + text.size();
+		std::size_t n = 0;
+		if constexpr (M == 1){
+			unstr_ref_t t;
+			unstr_ref_t s;
+			return unstr_substr_count(detail::ref(t, text), detail::ref(s, needle()));
+		}
+		if(text.size() < M){
+			return 0;
+		}
+		while((p = scan(p, end)) != nullptr){
+			n++;
+			p++;
+		}
+		return n;
+	}
+
+	std::size_t count(const unstr_t *text) const noexcept
+	{
+		return count(detail::view(text));
+	}
+
+private:
+	static constexpr bool word = ((M == 2) || (M == 4) || (M == 8));
+	using word_t = std::conditional_t<(M == 2), std::uint16_t, std::conditional_t<(M == 4), std::uint32_t, std::uint64_t>>;
+
+	/* pの位置から検索文字列が始まっているか */
+	bool match(const char *p) const noexcept
+	{
+		if constexpr (word){
+			word_t a = 0;
+			word_t b = 0;
+			std::memcpy(&a, p, M);
+			std::memcpy(&b, needle_, M);
+			return a == b;
+		} else {
+			return std::memcmp(p, needle_, M) == 0;
+		}
+	}
+
+	/**
+	 * @brief		[p, end)から検索文字列が最初に現れる位置を探す
+	 * @param[in]	p		検索開始位置
+	 * @param[in]	end		対象の終端
+	 * @return		発見した位置。見つからない場合はnullptr
+	 */
+	const char *scan(const char *p, const char *end) const noexcept
+	{
+		if(static_cast<std::size_t>(end - p) < M){
+			return nullptr;
+		}
+		if constexpr (M == 1){
+			return static_cast<const char *>(std::memchr(p, needle_[0], static_cast<std::size_t>(end - p)));
+		} else {
+#if defined(__SSE2__)
+			const __m128i first = _mm_set1_epi8(needle_[0]);
+			const __m128i last = _mm_set1_epi8(needle_[M - 1]);
+			unsigned int mask = 0;
+			unsigned int i = 0;
+			/* 16箇所の開始位置について、先頭と末尾のバイトが一致するものだけを確かめる */
+			while(static_cast<std::size_t>(end - p) >= (M + 15)){
+				mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_and_si128(
+					_mm_cmpeq_epi8(first, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p))),
+					_mm_cmpeq_epi8(last, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + M - 1)))
+				)));
+				while(mask != 0){
+					i = detail::lowest_bit(mask);
+					if(match(p + i)){
+						return p + i;
+					}
+					mask &= mask - 1;
+				}
+				p += 16;
+			}
+#endif
+			if constexpr (word){
+				const char *stop = end - M;
+				while(p <= stop){
+					p = static_cast<const char *>(std::memchr(p, needle_[0], static_cast<std::size_t>(stop - p) + 1));
+					if(p == nullptr){
+						return nullptr;
+					}
+					if(match(p)){
+						return p;
+					}
+					p++;
+				}
+			} else {
+				while(static_cast<std::size_t>(end - p) >= M){
+					if(match(p)){
+						return p;
+					}
+					if(static_cast<std::size_t>(end - p) == M){
+						break;
+					}
+					p += table_[static_cast<unsigned char>(p[M])];
+				}
+			}
+			return nullptr;
+		}
+	}
+
+	char needle_[M] = {};
+	std::size_t table_[256] = {};
+};
+
+/* 文字列リテラルから検索器を作る。constexprで受ければ移動量表はコンパイル時に作られる */
+template<std::size_t N>
+constexpr static_searcher<N - 1> make_searcher(const char (&needle)[N]) noexcept
+{
+	return static_searcher<N - 1>(needle);
+}
+
+#if defined(__cpp_nontype_template_args) && (__cpp_nontype_template_args >= 201911L)
+/* テンプレート引数に渡すための文字列リテラル */
+template<std::size_t N>
+struct fixed_string {
+	char data[N] = {};
+
+	constexpr fixed_string(const char (&s)[N]) noexcept
+	{
+		for(std::size_t i = 0; i < N; i++){
+			data[i] = s[i];
+		}
+	}
+};
+
+/*
+ * unstr::searcher<"needle">::find(text)のように使う(C++20)。
+ * 検索器はテンプレート引数毎に1つだけ静的に置かれる。
+ */
+template<fixed_string S>
+struct searcher {
+	static constexpr static_searcher<sizeof(S.data) - 1> value{S.data};
+
+	static std::size_t find(std::string_view text, std::size_t pos = 0) noexcept
+	{
+		return value.find(text, pos);
+	}
+
+	static std::size_t find(const unstr_t *text, std::size_t pos = 0) noexcept
+	{
+		return value.find(text, pos);
+	}
+
+	static std::size_t count(std::string_view text) noexcept
+	{
+		return value.count(text);
+	}
+
+	static std::size_t count(const unstr_t *text) noexcept
+	{
+		return value.count(text);
+	}
+};
+#endif
+
+namespace detail {
+
+/* 64bitの値をかき混ぜる(splitmix64の最終段) */
+constexpr std::uint64_t mix(std::uint64_t x) noexcept
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/* キーワードと照合する語の両方に使うハッシュ。コンパイル時にも実行時にも同じ値になる */
+constexpr std::uint64_t keyword_hash(std::string_view s, std::uint64_t seed) noexcept
+{
+	std::uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+	for(std::size_t i = 0; i < s.size(); i++){
+		h = (h ^ static_cast<unsigned char>(s[i])) * 0x100000001b3ULL;
+	}
+	return mix(h ^ s.size());
+}
+
+/* n以上の2の累乗の2倍。空きを半分残して調整値を見つけやすくする */
+constexpr std::size_t keyword_slots(std::size_t n) noexcept
+{
+	std::size_t size = 2;
+	while(size < n){
+		size <<= 1;
+	}
+	return size << 1;
+}
+
+} // namespace detail
+
+/*
+ * 固定したキーワードの集合から、コンパイル時に完全ハッシュを作る。
+ * 語のハッシュでバケツを選び、バケツ毎の調整値とハッシュからスロットを決める
+ * (hash and displace)。調整値は大きいバケツから順に、全員が空きスロットに
+ * 入るものを探す。照合はハッシュ1回と比較1回で、一時文字列を作らない。
+ * 同じキーワードが2つある場合はコンパイルエラーになる。
+ */
+template<std::size_t N, std::size_t Size>
+class keyword_set {
+public:
+	static_assert((N > 0) && (N < 65535), "unstr::keyword_set: too many keywords");
+	static constexpr std::size_t npos = UNSTRING_NPOS;
+
+	template<std::size_t... K>
+	constexpr explicit keyword_set(const char (&... words)[K])
+	{
+		std::size_t i = 0;
+		std::size_t offset = 0;
+		((add(i, offset, std::string_view(words, K - 1))), ...);
+		build();
+	}
+
+	constexpr std::size_t size() const noexcept
+	{
+		return N;
+	}
+
+	/* index番目のキーワード */
+	constexpr std::string_view operator[](std::size_t index) const noexcept
+	{
+		return std::string_view(pool_ + offset_[index], length_[index]);
+	}
+
+	/**
+	 * @brief		キーワードを探す
+	 * @param[in]	word	照合する語
+	 * @return		キーワードの番号(make_keywordsに渡した順)。キーワードでない場合はnpos
+	 */
+	constexpr std::size_t find(std::string_view word) const noexcept
+	{
+		std::uint64_t h = detail::keyword_hash(word, seed_);
+		std::size_t i = slot_[slot(h, pilot_[bucket(h)])];
+		if((i == 0) || ((*this)[i - 1] != word)){
+			return npos;
+		}
+		return i - 1;
+	}
+
+	std::size_t find(const unstr_t *word) const noexcept
+	{
+		return find(detail::view(word));
+	}
+
+private:
+	static constexpr std::size_t buckets = (N / 2) + 1;
+	static constexpr std::size_t slots = detail::keyword_slots(N);
+	static constexpr std::uint32_t max_pilot = 1u << 16;
+
+	static constexpr std::size_t bucket(std::uint64_t h) noexcept
+	{
+		return static_cast<std::size_t>((h >> 32) % buckets);
+	}
+
+	static constexpr std::size_t slot(std::uint64_t h, std::uint32_t pilot) noexcept
+	{
+		return static_cast<std::size_t>(detail::mix(h + (pilot * 0x9e3779b97f4a7c15ULL)) & (slots - 1));
+	}
+
+	constexpr void add(std::size_t &i, std::size_t &offset, std::string_view word)
+	{
+		for(std::size_t j = 0; j < word.size(); j++){
+			pool_[offset + j] = word[j];
+		}
+		offset_[i] = static_cast<std::uint32_t>(offset);
+		length_[i] = static_cast<std::uint32_t>(word.size());
+		offset += word.size() + 1;
+		i++;
+	}
+
+	/* 全てのキーワードが入るまでハッシュの種を変えて作り直す */
+	constexpr void build()
+	{
+		for(std::uint64_t seed = 0; seed < 64; seed++){
+			if(place(seed)){
+				seed_ = seed;
+				return;
+			}
+		}
+		throw std::logic_error("unstr::keyword_set: cannot build perfect hash");
+	}
+
+	/**
+	 * @brief		種seedで全てのキーワードをスロットに置く
+	 * @param[in]	seed	ハッシュの種
+	 * @retval		true	成功
+	 * @retval		false	調整値が見つからないバケツがあった
+	 */
+	constexpr bool place(std::uint64_t seed)
+	{
+		std::uint64_t hash[N] = {};
+		std::size_t count[buckets] = {};
+		std::size_t start[buckets + 1] = {};
+		std::size_t order[N] = {};
+		std::size_t max = 0;
+		std::size_t i = 0;
+		std::size_t b = 0;
+		for(i = 0; i < slots; i++){
+			slot_[i] = 0;
+		}
+		/* バケツ毎にキーワードを並べる */
+		for(i = 0; i < N; i++){
+			hash[i] = detail::keyword_hash((*this)[i], seed);
+			count[bucket(hash[i])]++;
+		}
+		for(b = 0; b < buckets; b++){
+			start[b + 1] = start[b] + count[b];
+			max = (count[b] > max) ? count[b] : max;
+		}
+		for(i = 0; i < N; i++){
+			b = bucket(hash[i]);
+			order[start[b + 1] - count[b]] = i;
+			count[b]--;
+		}
+		for(std::size_t n = max; n > 0; n--){
+			for(b = 0; b < buckets; b++){
+				if(((start[b + 1] - start[b]) == n) && !place_bucket(b, hash, order + start[b], n)){
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	constexpr bool place_bucket(std::size_t b, const std::uint64_t *hash, const std::size_t *keys, std::size_t n)
+	{
+		std::size_t used[N] = {};
+		bool ok = false;
+		for(std::size_t j = 0; j < n; j++){
+			for(std::size_t k = 0; k < j; k++){
+				if(hash[keys[j]] != hash[keys[k]]){
+					continue;
+				}
+				if((*this)[keys[j]] == (*this)[keys[k]]){
+					throw std::logic_error("unstr::keyword_set: duplicate keyword");
+				}
+				/* ハッシュが完全に一致した場合は種を変える */
+				return false;
+			}
+		}
+		for(std::uint32_t pilot = 0; pilot < max_pilot; pilot++){
+			ok = true;
+			for(std::size_t j = 0; ok && (j < n); j++){
+				used[j] = slot(hash[keys[j]], pilot);
+				ok = (slot_[used[j]] == 0);
+				for(std::size_t k = 0; ok && (k < j); k++){
+					ok = (used[j] != used[k]);
+				}
+			}
+			if(ok){
+				for(std::size_t j = 0; j < n; j++){
+					slot_[used[j]] = static_cast<std::uint16_t>(keys[j] + 1);
+				}
+				pilot_[b] = pilot;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	char pool_[Size] = {};
+	std::uint32_t offset_[N] = {};
+	std::uint32_t length_[N] = {};
+	std::uint64_t seed_ = 0;
+	std::uint32_t pilot_[buckets] = {};
+	std::uint16_t slot_[slots] = {};
+};
+
+/**
+ * @brief		キーワードの集合を作る
+ * @param[in]	words	キーワードの文字列リテラル
+ * @return		完全ハッシュを持つ集合。constexprで受ければコンパイル時に作られる
+ */
+template<std::size_t... K>
+constexpr keyword_set<sizeof...(K), (K + ...)> make_keywords(const char (&... words)[K])
+{
+	return keyword_set<sizeof...(K), (K + ...)>(words...);
+}
+
+namespace detail {
+
+/* 連結式の葉。連結するまで文字列の位置と長さだけを持つ */
+struct piece {
+	std::string_view sv;
+
+	std::size_t size() const noexcept
+	{
+		return sv.size();
+	}
+
+	char *copy(char *p) const noexcept
+	{
+		if(!sv.empty()){
+			std::memcpy(p, sv.data(), sv.size());
+		}
+		return p + sv.size();
+	}
+
+	bool overlaps(const char *begin, const char *end) const noexcept
+	{
+		return !sv.empty() && (sv.data() < end) && (begin < (sv.data() + sv.size()));
+	}
+};
+
+} // namespace detail
+
+/*
+ * a + b + cのような連結を遅延させる式。stringへの代入や追加で評価され、
+ * 全体の長さを先に求めて1度だけ確保し、各部分を直接コピーする。
+ * 部分の文字列を参照するだけなので、式をautoで受けて後から評価しないこと。
+ */
+template<class L, class R>
+class concat {
+public:
+	constexpr concat(const L &l, const R &r) noexcept : l_(l), r_(r) {}
+
+	std::size_t size() const noexcept
+	{
+		return l_.size() + r_.size();
+	}
+
+	/* pから書き込み、書き終わった次の位置を返す */
+	char *copy(char *p) const noexcept
+	{
+		return r_.copy(l_.copy(p));
+	}
+
+	/* [begin, end)を参照している部分があるか */
+	bool overlaps(const char *begin, const char *end) const noexcept
+	{
+		return l_.overlaps(begin, end) || r_.overlaps(begin, end);
+	}
+
+private:
+	L l_;
+	R r_;
+};
+
+/*
+ * unstr_tを1つ所有し、破棄する時にunstr_freeで開放する。
+ * ムーブは所有しているunstr_tを移すだけで、コピーはunstr_copyを使う
+ * (UNSTRING_ENABLE_COWを定義した場合はバッファを共有する)。
+ * C APIとはadoptで所有権を受け取り、releaseで渡す。getで借りたものは開放しない。
+ * 確保に失敗した場合はstd::bad_allocを投げる。
+ */
+class string {
+public:
+	static constexpr std::size_t npos = UNSTRING_NPOS;
+
+	string() noexcept = default;
+
+	explicit string(std::string_view sv)
+	{
+		assign(sv);
+	}
+
+	string(const string &other)
+	{
+		if(other.str_ != nullptr){
+			str_ = unstr_copy(other.str_);
+			if(str_ == nullptr){
+				throw std::bad_alloc();
+			}
+		}
+	}
+
+	string(string &&other) noexcept : str_(other.str_)
+	{
+		other.str_ = nullptr;
+	}
+
+	/* 連結式を評価する。確保は1度だけ */
+	template<class L, class R>
+	string(const concat<L, R> &expr)
+	{
+		write(expr, 0);
+	}
+
+	~string()
+	{
+		unstr_free_func(str_);
+	}
+
+	string &operator=(const string &other)
+	{
+		if(this != &other){
+			string tmp(other);
+			swap(tmp);
+		}
+		return *this;
+	}
+
+	string &operator=(string &&other) noexcept
+	{
+		if(this != &other){
+			unstr_free_func(str_);
+			str_ = other.str_;
+			other.str_ = nullptr;
+		}
+		return *this;
+	}
+
+	string &operator=(std::string_view sv)
+	{
+		return assign(sv);
+	}
+
+	template<class L, class R>
+	string &operator=(const concat<L, R> &expr)
+	{
+		return write(expr, 0);
+	}
+
+	/**
+	 * @brief		C APIで作った文字列の所有権を受け取る
+	 * @param[in]	str		unstr_init等で確保した文字列。以後は開放しないこと
+	 * @return		strを所有するstring
+	 */
+	static string adopt(unstr_t *str) noexcept
+	{
+		string ret;
+		ret.str_ = str;
+		return ret;
+	}
+
+	/**
+	 * @brief		所有権を手放す
+	 * @return		所有していた文字列。呼び出し側がunstr_freeで開放する
+	 */
+	unstr_t *release() noexcept
+	{
+		unstr_t *str = str_;
+		str_ = nullptr;
+		return str;
+	}
+
+	/* C APIに渡すための文字列。空のstringではNULL */
+	unstr_t *get() noexcept
+	{
+		return str_;
+	}
+
+	const unstr_t *get() const noexcept
+	{
+		return str_;
+	}
+
+	/* 部分文字列(unstr_slice)は'\0'で終わっていないので、長さと組で使う */
+	const char *data() const noexcept
+	{
+		return unstr_isset(str_) ? str_->data : "";
+	}
+
+	std::size_t size() const noexcept
+	{
+		return unstr_strlen(str_);
+	}
+
+	bool empty() const noexcept
+	{
+		return unstr_empty(str_) != UNSTRING_FALSE;
+	}
+
+	std::string_view view() const noexcept
+	{
+		return std::string_view(data(), size());
+	}
+
+	operator std::string_view() const noexcept
+	{
+		return view();
+	}
+
+	string &assign(std::string_view sv)
+	{
+		return write(sv, 0);
+	}
+
+	string &append(std::string_view sv)
+	{
+		return write(sv, size());
+	}
+
+	string &operator+=(std::string_view sv)
+	{
+		return append(sv);
+	}
+
+	/* 一時文字列を作らずに連結式を末尾に書き込む */
+	template<class L, class R>
+	string &append(const concat<L, R> &expr)
+	{
+		return write(expr, size());
+	}
+
+	template<class L, class R>
+	string &operator+=(const concat<L, R> &expr)
+	{
+		return append(expr);
+	}
+
+	void clear() noexcept
+	{
+		unstr_zero(str_);
+	}
+
+	void swap(string &other) noexcept
+	{
+		unstr_t *tmp = str_;
+		str_ = other.str_;
+		other.str_ = tmp;
+	}
+
+	/**
+	 * @brief		文字列を検索する
+	 * @param[in]	sv		検索文字列
+	 * @param[in]	pos		検索開始位置
+	 * @return		発見した位置。見つからない場合と検索文字列が空の場合はnpos
+	 */
+	std::size_t find(std::string_view sv, std::size_t pos = 0) const noexcept
+	{
+		unstr_ref_t text;
+		unstr_ref_t search;
+		int ret = 0;
+		if(pos > size()){
+			return npos;
+		}
+		ret = unstr_strpos(detail::ref(text, view().substr(pos)), detail::ref(search, sv));
+		return (ret < 0) ? npos : (pos + static_cast<std::size_t>(ret));
+	}
+
+	/* 重なって出現したものも数える。検索文字列が空の場合は0 */
+	std::size_t count(std::string_view sv) const noexcept
+	{
+		unstr_ref_t search;
+		return unstr_substr_count(str_, detail::ref(search, sv));
+	}
+
+	int compare(std::string_view sv) const noexcept
+	{
+		return view().compare(sv);
+	}
+
+	/**
+	 * @brief		部分文字列を返す
+	 * @param[in]	pos		開始位置
+	 * @param[in]	len		長さ。残りより長い場合は末尾まで
+	 * @return		部分文字列。UNSTRING_ENABLE_COWを定義した場合はバッファを共有する
+	 */
+	string substr(std::size_t pos, std::size_t len = npos) const
+	{
+		unstr_t *str = nullptr;
+		if(pos > size()){
+			throw std::out_of_range("unstr::string::substr");
+		}
+		if(str_ == nullptr){
+			return string();
+		}
+		str = unstr_slice(str_, pos, len);
+		if(str == nullptr){
+			throw std::bad_alloc();
+		}
+		return adopt(str);
+	}
+
+	/* 全ての出現を置換した文字列を返す。検索文字列が空の場合はそのままコピーする */
+	string replace(std::string_view search, std::string_view to) const
+	{
+		unstr_ref_t s;
+		unstr_ref_t r;
+		unstr_t *str = nullptr;
+		if(empty() || search.empty()){
+			return *this;
+		}
+		str = unstr_replace(str_, detail::ref(s, search), detail::ref(r, to));
+		if(str == nullptr){
+			throw std::bad_alloc();
+		}
+		return adopt(str);
+	}
+
+	friend bool operator==(const string &a, const string &b) noexcept
+	{
+		return a.view() == b.view();
+	}
+
+	friend bool operator==(const string &a, std::string_view b) noexcept
+	{
+		return a.view() == b;
+	}
+
+	friend bool operator==(std::string_view a, const string &b) noexcept
+	{
+		return a == b.view();
+	}
+
+	friend bool operator!=(const string &a, const string &b) noexcept
+	{
+		return !(a == b);
+	}
+
+	friend bool operator!=(const string &a, std::string_view b) noexcept
+	{
+		return !(a == b);
+	}
+
+	friend bool operator!=(std::string_view a, const string &b) noexcept
+	{
+		return !(a == b);
+	}
+
+private:
+	/**
+	 * @brief		offsetの位置にsvを書き込み、そこまでの長さにする
+	 * @param[in]	sv		書き込む内容。自身を指していてもよい
+	 * @param[in]	offset	書き込む位置
+	 * @return		自身
+	 */
+	string &write(std::string_view sv, std::size_t offset)
+	{
+		if(str_ == nullptr){
+			str_ = unstr_init_memory(sv.size() + 1);
+			if(str_ == nullptr){
+				throw std::bad_alloc();
+			}
+		}
+		if(!unstr_write(str_, (sv.data() == nullptr) ? "" : sv.data(), offset, sv.size())){
+			throw std::bad_alloc();
+		}
+		return *this;
+	}
+
+	/**
+	 * @brief		offsetの位置に連結式の結果を書き込み、そこまでの長さにする
+	 * @param[in]	expr	連結式
+	 * @param[in]	offset	書き込む位置
+	 * @return		自身
+	 * @par			詳細:
+	 * 式が自身のバッファを参照している場合は、拡張や上書きで壊れないように
+	 * 一時文字列に評価してから書き込む。
+	 */
+	template<class L, class R>
+	string &write(const concat<L, R> &expr, std::size_t offset)
+	{
+		std::size_t len = expr.size();
+		if(str_ == nullptr){
+			str_ = unstr_init_memory(len + 1);
+			if(str_ == nullptr){
+				throw std::bad_alloc();
+			}
+		} else if(expr.overlaps(data(), data() + size())){
+			string tmp(expr);
+			return write(tmp.view(), offset);
+		} else if(!unstr_write(str_, "", offset, 0)){
+			/* 共有しているバッファや部分文字列を自身のバッファにする */
+			throw std::bad_alloc();
+		}
+		if((offset + len + 1) > str_->heap){
+			unstr_alloc(str_, len + 1);
+		}
+		expr.copy(str_->data + offset);
+		str_->length = offset + len;
+		str_->data[str_->length] = '\0';
+		return *this;
+	}
+
+	unstr_t *str_ = nullptr;
+};
+
+inline void swap(string &a, string &b) noexcept
+{
+	a.swap(b);
+}
+
+namespace detail {
+
+template<class T>
+struct is_concat : std::false_type {};
+
+template<class L, class R>
+struct is_concat<concat<L, R>> : std::true_type {};
+
+/* 連結式の部分になれる型 */
+template<class T>
+inline constexpr bool is_operand = is_concat<T>::value || std::is_convertible_v<const T &, std::string_view>;
+
+/* 片方がunstr::stringか連結式の場合だけ遅延させる。std::string同士等には関与しない */
+template<class A, class B>
+inline constexpr bool is_concat_operands = is_operand<A> && is_operand<B>
+	&& (is_concat<A>::value || is_concat<B>::value || std::is_same_v<A, string> || std::is_same_v<B, string>);
+
+template<class T>
+auto leaf(const T &x) noexcept
+{
+	if constexpr (is_concat<T>::value){
+		return x;
+	} else {
+		return piece{std::string_view(x)};
+	}
+}
+
+} // namespace detail
+
+template<class A, class B, std::enable_if_t<detail::is_concat_operands<A, B>, int> = 0>
+auto operator+(const A &a, const B &b) noexcept
+{
+	using L = decltype(detail::leaf(a));
+	using R = decltype(detail::leaf(b));
+	return concat<L, R>(detail::leaf(a), detail::leaf(b));
+}
+
+} // namespace unstr
+
+#endif /* UNSTRING_HPP_INCLUDE */
@@ -0,0 +1,1208 @@
+/*
+ * unstring_bench.c
+ *
+ * unstring.hの公開関数のスループットとレイテンシを計測する。
+ * 結果はCSV(既定)またはJSON Linesで標準出力に書き出す。
+ *
+ * 使い方:
+ *   bench_unstring [-json] [-max サイズ] [-time 秒] [-filter 関数名]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <regex.h>
+
+#include "unstring.h"
+
+#define BENCH_MIN_SIZE			((size_t)8)
+#define BENCH_DEFAULT_MAX_SIZE	((size_t)16 * 1024 * 1024)
+#define BENCH_LIMIT_SIZE		((size_t)1024 * 1024 * 1024)
+#define BENCH_DEFAULT_TIME		(0.05)
+#define BENCH_ROUNDS			(5)
+#define BENCH_UNIT_SIZE			(8)
+#define BENCH_PIECE_SIZE		(64)
+#define BENCH_TMP_FILE			"bench_unstring.tmp"
+
+typedef enum {
+	BENCH_KIND_FIXED = 0,	/* 文字列長に依存しない */
+	BENCH_KIND_SIZE,		/* 文字列長のみ変化させる */
+	BENCH_KIND_SEARCH		/* 文字列長×検索文字列長×ヒット率 */
+} bench_kind_t;
+
+typedef struct bench_st {
+	unstr_t *text;			/* 対象文字列 */
+	unstr_t *needle;		/* 検索文字列 */
+	unstr_t *replace;		/* 置換文字列 */
+	unstr_t *unit;			/* 繰り返し単位 */
+	unstr_t *work;			/* 作業領域 */
+	unstr_t *kana;			/* ひらがなとASCIIを混ぜたUTF-8文字列 */
+	unstr_t *hex;			/* textを16進数にしたもの */
+	unstr_t *base64;		/* textをBASE64にしたもの */
+	unstr_t *coded;			/* 16進数とBASE64の変換先 */
+	unstr_t **pieces;		/* textをBENCH_PIECE_SIZE毎に分けたもの */
+	size_t piece_count;
+	unstr_t **outs;			/* piecesの置換結果(piece_count個) */
+	int *positions;			/* piecesの検索結果(piece_count個) */
+	size_t *counts;			/* piecesの出現数(piece_count個) */
+	unstr_t *filename;		/* 一時ファイル名 */
+	char *buf;				/* libc用の作業領域 */
+	char *format;			/* unstr_sscanf用フォーマット */
+	unstr_sscanf_plan_t *plan;	/* formatを解析したもの */
+	unstr_regex_t *regex;	/* needleの後に小文字が続く正規表現 */
+	regex_t posix;			/* regexと同じものをlibcでコンパイルしたもの */
+	unstr_index_t *index;	/* textの索引(使うケースで初めて作る) */
+	size_t size;
+	size_t needle_len;
+	double hit_rate;
+	size_t sink;			/* 最適化で計測対象が消えないようにする */
+} bench_t;
+
+typedef void (*bench_func_t)(bench_t *b);
+
+typedef struct bench_case_st {
+	const char *name;
+	const char *impl;
+	bench_kind_t kind;
+	bench_func_t func;
+	size_t max_size;		/* 計測する最大長。0なら無制限 */
+} bench_case_t;
+
+typedef struct bench_option_st {
+	unstr_bool_t json;
+	size_t max_size;
+	double min_time;
+	const char *filter;
+} bench_option_t;
+
+static unsigned long g_seed = 88172645463325252UL;
+
+static unsigned long bench_rand(void);
+static double bench_now(void);
+static void bench_fill(bench_t *b, size_t size, size_t needle_len, double hit_rate);
+static void bench_clear(bench_t *b);
+static void bench_run(const bench_case_t *c, bench_t *b, const bench_option_t *opt);
+static int bench_compare_double(const void *a, const void *b);
+
+/*================================================================*/
+/* 長さに依存しない関数 */
+
+static void bench_unstr_isset(bench_t *b)
+{
+	b->sink += unstr_isset(b->text);
+}
+
+static void bench_unstr_empty(bench_t *b)
+{
+	b->sink += unstr_empty(b->text);
+}
+
+static void bench_unstr_strlen(bench_t *b)
+{
+	b->sink += unstr_strlen(b->text);
+}
+
+static void bench_libc_strlen(bench_t *b)
+{
+	b->sink += strlen(b->text->data);
+}
+
+static void bench_unstr_zero(bench_t *b)
+{
+	unstr_zero(b->work);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_itoa(bench_t *b)
+{
+	unstr_t *str = unstr_itoa((int)(b->sink & 0x7fffffff) + 1234567, 10);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_unstr_itoa_into(bench_t *b)
+{
+	unstr_itoa_into(b->work, (int)(b->sink & 0x7fffffff) + 1234567, 10);
+	b->sink += b->work->length;
+}
+
+static void bench_libc_snprintf_d(bench_t *b)
+{
+	char tmp[32];
+	b->sink += snprintf(tmp, sizeof(tmp), "%d", (int)(b->sink & 0x7fffffff) + 1234567);
+}
+
+static void bench_unstr_sprintf(bench_t *b)
+{
+	b->work = unstr_sprintf(b->work, "%s:%d:%x:%X", "unstring", 1234567, 0xbeef, 0xcafe);
+	b->sink += b->work->length;
+}
+
+static void bench_libc_snprintf(bench_t *b)
+{
+	char tmp[64];
+	b->sink += snprintf(tmp, sizeof(tmp), "%s:%d:%x:%X", "unstring", 1234567, 0xbeef, 0xcafe);
+}
+
+/*================================================================*/
+/* 長さに依存する関数 */
+
+static void bench_unstr_alloc(bench_t *b)
+{
+	unstr_t *str = unstr_alloc(NULL, b->size);
+	b->sink += str->heap;
+	unstr_free(str);
+}
+
+static void bench_unstr_init_memory(bench_t *b)
+{
+	unstr_t *str = unstr_init_memory(b->size);
+	b->sink += str->heap;
+	unstr_free(str);
+}
+
+static void bench_libc_malloc(bench_t *b)
+{
+	char *p = malloc(b->size);
+	b->sink += (p != NULL);
+	free(p);
+}
+
+static void bench_unstr_delete(bench_t *b)
+{
+	unstr_t *s1 = unstr_init_memory(b->size);
+	unstr_t *s2 = unstr_init_memory(b->size);
+	b->sink += s1->heap + s2->heap;
+	unstr_delete(2, s1, s2);
+}
+
+static void bench_unstr_init(bench_t *b)
+{
+	unstr_t *str = unstr_init(b->text->data);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_libc_strdup(bench_t *b)
+{
+	char *p = strdup(b->text->data);
+	b->sink += (p != NULL);
+	free(p);
+}
+
+static void bench_unstr_copy(bench_t *b)
+{
+	unstr_t *str = unstr_copy(b->text);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_libc_malloc_memcpy(bench_t *b)
+{
+	char *p = malloc(b->size + 1);
+	memcpy(p, b->text->data, b->size + 1);
+	b->sink += (size_t)p[0];
+	free(p);
+}
+
+static void bench_unstr_slice(bench_t *b)
+{
+	unstr_t *str = unstr_slice(b->text, 1, b->size - 1);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_unstr_substr_copy(bench_t *b)
+{
+	unstr_t *str = unstr_init_memory(b->size + 1);
+	unstr_write(str, b->text->data + 1, 0, b->size - 1);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_unstr_compact_init(bench_t *b)
+{
+	size_t i = 0;
+	unstr_compact_t *c = 0;
+	for(i = 0; i < b->piece_count; i++){
+		c = unstr_compact_init(b->pieces[i]);
+		b->sink += unstr_compact_strlen(c);
+		unstr_compact_free(c);
+	}
+}
+
+static void bench_unstr_copy_pieces(bench_t *b)
+{
+	size_t i = 0;
+	unstr_t *str = 0;
+	for(i = 0; i < b->piece_count; i++){
+		str = unstr_copy(b->pieces[i]);
+		b->sink += str->length;
+		unstr_free(str);
+	}
+}
+
+static void bench_unstr_write(bench_t *b)
+{
+	unstr_write(b->work, b->text->data, 0, b->text->length);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_strcpy(bench_t *b)
+{
+	unstr_strcpy(b->work, b->text);
+	b->sink += b->work->length;
+}
+
+static void bench_libc_memcpy(bench_t *b)
+{
+	memcpy(b->buf, b->text->data, b->size + 1);
+	b->sink += (size_t)b->buf[0];
+}
+
+static void bench_unstr_strcpy_char(bench_t *b)
+{
+	unstr_strcpy_char(b->work, b->text->data);
+	b->sink += b->work->length;
+}
+
+static void bench_libc_strcpy(bench_t *b)
+{
+	strcpy(b->buf, b->text->data);
+	b->sink += (size_t)b->buf[0];
+}
+
+static void bench_unstr_substr(bench_t *b)
+{
+	unstr_substr(b->work, b->text, b->size / 2);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_substr_char(bench_t *b)
+{
+	unstr_substr_char(b->work, b->text->data, b->size / 2);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_strcat(bench_t *b)
+{
+	unstr_zero(b->work);
+	unstr_strcat(b->work, b->text);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_strcat_char(bench_t *b)
+{
+	unstr_zero(b->work);
+	unstr_strcat_char(b->work, b->text->data);
+	b->sink += b->work->length;
+}
+
+static void bench_libc_strcat(bench_t *b)
+{
+	b->buf[0] = '\0';
+	strcat(b->buf, b->text->data);
+	b->sink += (size_t)b->buf[0];
+}
+
+static void bench_unstr_strcmp(bench_t *b)
+{
+	b->sink += (size_t)unstr_strcmp(b->text, b->work);
+}
+
+static void bench_libc_memcmp(bench_t *b)
+{
+	b->sink += (size_t)memcmp(b->text->data, b->buf, b->size);
+}
+
+static void bench_unstr_strcmp_char(bench_t *b)
+{
+	b->sink += (size_t)unstr_strcmp_char(b->text, b->buf);
+}
+
+static void bench_libc_strcmp(bench_t *b)
+{
+	b->sink += (size_t)strcmp(b->text->data, b->buf);
+}
+
+static void bench_unstr_sprintf_unstr(bench_t *b)
+{
+	b->work = unstr_sprintf(b->work, "[%$]", b->text);
+	b->sink += b->work->length;
+}
+
+static void bench_libc_snprintf_s(bench_t *b)
+{
+	b->sink += snprintf(b->buf, b->size + 1, "[%s]", b->text->data);
+}
+
+static void bench_unstr_reverse(bench_t *b)
+{
+	unstr_t *str = unstr_reverse(b->text);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_unstr_reverse_inplace(bench_t *b)
+{
+	unstr_reverse_inplace(b->work);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_reverse_into(bench_t *b)
+{
+	unstr_reverse_into(b->work, b->text);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_utf8_valid(bench_t *b)
+{
+	b->sink += unstr_utf8_valid(b->text);
+}
+
+static void bench_unstr_utf8_valid_kana(bench_t *b)
+{
+	b->sink += unstr_utf8_valid(b->kana);
+}
+
+static void bench_unstr_utf8_strlen(bench_t *b)
+{
+	b->sink += unstr_utf8_strlen(b->kana);
+}
+
+static void bench_unstr_utf8_offset(bench_t *b)
+{
+	b->sink += unstr_utf8_offset(b->kana, b->size / 4);
+}
+
+static void bench_unstr_utf8_reverse(bench_t *b)
+{
+	unstr_t *str = unstr_utf8_reverse(b->kana);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_unstr_bin2hex(bench_t *b)
+{
+	unstr_bin2hex(b->coded, b->text);
+	b->sink += b->coded->length;
+}
+
+static void bench_libc_snprintf_x(bench_t *b)
+{
+	size_t i = 0;
+	for(i = 0; i < b->size; i++){
+		snprintf(b->coded->data + (i * 2), 3, "%02x", (unsigned char)b->text->data[i]);
+	}
+	b->sink += (unsigned char)b->coded->data[0];
+}
+
+static void bench_unstr_hex2bin(bench_t *b)
+{
+	unstr_hex2bin(b->coded, b->hex);
+	b->sink += b->coded->length;
+}
+
+static void bench_libc_strtoul_x(bench_t *b)
+{
+	char tmp[3] = {0};
+	size_t i = 0;
+	for(i = 0; i < b->size; i++){
+		memcpy(tmp, b->hex->data + (i * 2), 2);
+		b->buf[i] = (char)strtoul(tmp, NULL, 16);
+	}
+	b->sink += (unsigned char)b->buf[0];
+}
+
+static void bench_unstr_base64_encode(bench_t *b)
+{
+	unstr_base64_encode(b->coded, b->text);
+	b->sink += b->coded->length;
+}
+
+static void bench_unstr_base64_decode(bench_t *b)
+{
+	unstr_base64_decode(b->coded, b->base64);
+	b->sink += b->coded->length;
+}
+
+static void bench_unstr_repeat(bench_t *b)
+{
+	unstr_t *str = unstr_repeat(b->unit, b->size / BENCH_UNIT_SIZE);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_unstr_repeat_into(bench_t *b)
+{
+	unstr_repeat_into(b->work, b->unit, b->size / BENCH_UNIT_SIZE);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_repeat_char(bench_t *b)
+{
+	unstr_t *str = unstr_repeat_char("u", b->size);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_libc_memset(bench_t *b)
+{
+	memset(b->buf, 'u', b->size);
+	b->sink += (size_t)b->buf[0];
+}
+
+static void bench_unstr_file_put_contents(bench_t *b)
+{
+	b->sink += unstr_file_put_contents(b->filename, b->text, "w");
+}
+
+static void bench_libc_fwrite(bench_t *b)
+{
+	FILE *fp = fopen(b->filename->data, "w");
+	if(fp != NULL){
+		b->sink += fwrite(b->text->data, 1, b->text->length, fp);
+		fclose(fp);
+	}
+}
+
+static void bench_unstr_file_get_contents(bench_t *b)
+{
+	unstr_t *str = unstr_file_get_contents(b->filename);
+	b->sink += unstr_strlen(str);
+	unstr_free(str);
+}
+
+static void bench_unstr_file_get_contents_into(bench_t *b)
+{
+	unstr_file_get_contents_into(b->work, b->filename);
+	b->sink += b->work->length;
+}
+
+static void bench_libc_fread(bench_t *b)
+{
+	FILE *fp = fopen(b->filename->data, "r");
+	if(fp != NULL){
+		b->sink += fread(b->buf, 1, b->size, fp);
+		fclose(fp);
+	}
+}
+
+/*================================================================*/
+/* 検索系の関数 */
+
+static void bench_unstr_strpos(bench_t *b)
+{
+	b->sink += (size_t)unstr_strpos(b->text, b->needle);
+}
+
+static void bench_libc_memmem(bench_t *b)
+{
+	b->sink += (size_t)memmem(b->text->data, b->text->length, b->needle->data, b->needle->length);
+}
+
+static void bench_unstr_strstr(bench_t *b)
+{
+	b->sink += (size_t)unstr_strstr(b->text, b->needle);
+}
+
+static void bench_unstr_strstr_char(bench_t *b)
+{
+	b->sink += (size_t)unstr_strstr_char(b->text, b->needle->data);
+}
+
+static void bench_libc_strstr(bench_t *b)
+{
+	b->sink += (size_t)strstr(b->text->data, b->needle->data);
+}
+
+static void bench_unstr_substr_count(bench_t *b)
+{
+	b->sink += unstr_substr_count(b->text, b->needle);
+}
+
+static void bench_unstr_substr_count_char(bench_t *b)
+{
+	b->sink += unstr_substr_count_char(b->text, b->needle->data);
+}
+
+static void bench_libc_memmem_count(bench_t *b)
+{
+	const char *p = b->text->data;
+	const char *end = p + b->text->length;
+	size_t m = b->needle->length;
+	while((p = memmem(p, (size_t)(end - p), b->needle->data, m)) != NULL){
+		b->sink++;
+		p++;
+	}
+}
+
+static void bench_unstr_replace(bench_t *b)
+{
+	unstr_t *str = unstr_replace(b->text, b->needle, b->replace);
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_unstr_replace_into(bench_t *b)
+{
+	unstr_replace_into(b->work, b->text, b->needle, b->replace);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_strpos_batch(bench_t *b)
+{
+	b->sink += unstr_strpos_batch(b->pieces, b->piece_count, b->needle, b->positions);
+}
+
+/* 要素毎にunstr_strposを呼ぶ */
+static void bench_loop_strpos(bench_t *b)
+{
+	size_t i = 0;
+	for(i = 0; i < b->piece_count; i++){
+		b->positions[i] = unstr_strpos(b->pieces[i], b->needle);
+		b->sink += (b->positions[i] >= 0);
+	}
+}
+
+static void bench_unstr_substr_count_batch(bench_t *b)
+{
+	b->sink += unstr_substr_count_batch(b->pieces, b->piece_count, b->needle, b->counts);
+}
+
+static void bench_loop_substr_count(bench_t *b)
+{
+	size_t i = 0;
+	for(i = 0; i < b->piece_count; i++){
+		b->counts[i] = unstr_substr_count(b->pieces[i], b->needle);
+		b->sink += b->counts[i];
+	}
+}
+
+static void bench_unstr_strcmp_batch(bench_t *b)
+{
+	b->sink += unstr_strcmp_batch(b->pieces, b->piece_count, b->needle, b->positions);
+}
+
+static void bench_loop_strcmp(bench_t *b)
+{
+	size_t i = 0;
+	for(i = 0; i < b->piece_count; i++){
+		b->positions[i] = unstr_strcmp(b->pieces[i], b->needle);
+		b->sink += (b->positions[i] == 0);
+	}
+}
+
+static void bench_unstr_replace_batch(bench_t *b)
+{
+	unstr_replace_batch(b->outs, b->pieces, b->piece_count, b->needle, b->replace);
+	b->sink += b->outs[0]->length;
+}
+
+static void bench_loop_replace_into(bench_t *b)
+{
+	size_t i = 0;
+	for(i = 0; i < b->piece_count; i++){
+		unstr_replace_into(b->outs[i], b->pieces[i], b->needle, b->replace);
+	}
+	b->sink += b->outs[0]->length;
+}
+
+static void bench_unstr_explode(bench_t *b)
+{
+	size_t i = 0;
+	size_t len = 0;
+	unstr_t **list = unstr_explode(b->text, b->needle->data, &len);
+	for(i = 0; i < len; i++){
+		unstr_free(list[i]);
+	}
+	free(list);
+	b->sink += len;
+}
+
+static void bench_unstr_explode_tokens(bench_t *b)
+{
+	unstr_tokens_t *tokens = unstr_explode_tokens(b->text, b->needle->data);
+	b->sink += tokens->len;
+	unstr_tokens_free(tokens);
+}
+
+static void bench_unstr_regex_search(bench_t *b)
+{
+	b->sink += (size_t)unstr_regex_search(b->regex, b->text, 0, NULL);
+}
+
+static void bench_libc_regexec(bench_t *b)
+{
+	regmatch_t m;
+	if(regexec(&(b->posix), b->text->data, 1, &m, 0) == 0){
+		b->sink += (size_t)m.rm_so;
+	}
+}
+
+static void bench_unstr_regex_find_all(bench_t *b)
+{
+	b->sink += unstr_regex_find_all(b->regex, b->text, NULL, 0);
+}
+
+static void bench_libc_regexec_all(bench_t *b)
+{
+	regmatch_t m;
+	const char *p = b->text->data;
+	int flags = 0;
+	while(regexec(&(b->posix), p, 1, &m, flags) == 0){
+		b->sink++;
+		p += (m.rm_eo > m.rm_so) ? m.rm_eo : (m.rm_so + 1);
+		if(*p == '\0'){
+			break;
+		}
+		flags = REG_NOTBOL;
+	}
+}
+
+static void bench_unstr_index_init(bench_t *b)
+{
+	unstr_index_t *idx = unstr_index_init(b->text);
+	b->sink += (size_t)idx;
+	unstr_index_free(idx);
+}
+
+static void bench_unstr_index_count(bench_t *b)
+{
+	if(b->index == NULL){
+		b->index = unstr_index_init(b->text);
+	}
+	b->sink += unstr_index_count(b->index, b->needle);
+}
+
+static void bench_unstr_index_first(bench_t *b)
+{
+	if(b->index == NULL){
+		b->index = unstr_index_init(b->text);
+	}
+	b->sink += unstr_index_first(b->index, b->needle);
+}
+
+static void bench_unstr_implode(bench_t *b)
+{
+	unstr_t *str = unstr_implode(b->pieces, b->piece_count, ",");
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+/* 今までの方法(unstr_strcatを繰り返す)で連結する */
+static void bench_strcat_implode(bench_t *b)
+{
+	size_t i = 0;
+	unstr_t *str = unstr_init_memory(BENCH_PIECE_SIZE);
+	for(i = 0; i < b->piece_count; i++){
+		if(i != 0){
+			unstr_strcat_char(str, ",");
+		}
+		unstr_strcat(str, b->pieces[i]);
+	}
+	b->sink += str->length;
+	unstr_free(str);
+}
+
+static void bench_unstr_strtok(bench_t *b)
+{
+	size_t index = 0;
+	unstr_t *str = 0;
+	while((str = unstr_strtok(b->text, b->needle->data, &index)) != NULL){
+		b->sink += str->length;
+		unstr_free(str);
+	}
+}
+
+static void bench_unstr_strtok_into(bench_t *b)
+{
+	size_t index = 0;
+	while(unstr_strtok_into(b->work, b->text, b->needle->data, &index)){
+		b->sink += b->work->length;
+	}
+}
+
+static void bench_libc_strtok_r(bench_t *b)
+{
+	char *save = 0;
+	char *p = 0;
+	memcpy(b->buf, b->text->data, b->size + 1);
+	for(p = strtok_r(b->buf, b->needle->data, &save); p != NULL; p = strtok_r(NULL, b->needle->data, &save)){
+		b->sink++;
+	}
+}
+
+static void bench_unstr_sscanf(bench_t *b)
+{
+	b->sink += unstr_sscanf(b->text, b->format, b->work, b->work);
+}
+
+static void bench_unstr_sscanf_exec(bench_t *b)
+{
+	b->sink += unstr_sscanf_exec(b->plan, b->text, b->work, b->work);
+}
+
+static void bench_unstr_sscanf_exec_view(bench_t *b)
+{
+	unstr_view_t views[2];
+	b->sink += unstr_sscanf_exec_view(b->plan, b->text, views, 2);
+	b->sink += views[0].length;
+}
+
+static void bench_unstr_toupper(bench_t *b)
+{
+	unstr_toupper(b->work);
+	unstr_tolower(b->work);
+	b->sink += b->work->length;
+}
+
+static void bench_unstr_strcasecmp(bench_t *b)
+{
+	b->sink += (size_t)unstr_strcasecmp(b->text, b->work);
+}
+
+static void bench_libc_strcasecmp(bench_t *b)
+{
+	b->sink += (size_t)strcasecmp(b->text->data, b->buf);
+}
+
+static void bench_unstr_stripos(bench_t *b)
+{
+	b->sink += (size_t)unstr_stripos(b->text, b->needle);
+}
+
+/* 大文字小文字を区別しない検索を今までの方法(コピーして小文字化)で行う */
+static void bench_copy_tolower_strpos(bench_t *b)
+{
+	unstr_t *text = unstr_copy(b->text);
+	unstr_t *needle = unstr_copy(b->needle);
+	unstr_tolower(text);
+	unstr_tolower(needle);
+	b->sink += (size_t)unstr_strpos(text, needle);
+	unstr_delete(2, text, needle);
+}
+
+static void bench_unstr_substr_icount(bench_t *b)
+{
+	b->sink += unstr_substr_icount(b->text, b->needle);
+}
+
+static const bench_case_t g_cases[] = {
+	{"unstr_isset",					"unstring",	BENCH_KIND_FIXED,	bench_unstr_isset, 0},
+	{"unstr_empty",					"unstring",	BENCH_KIND_FIXED,	bench_unstr_empty, 0},
+	{"unstr_zero",					"unstring",	BENCH_KIND_FIXED,	bench_unstr_zero, 0},
+	{"unstr_itoa",					"unstring",	BENCH_KIND_FIXED,	bench_unstr_itoa, 0},
+	{"unstr_itoa_into",				"unstring",	BENCH_KIND_FIXED,	bench_unstr_itoa_into, 0},
+	{"unstr_itoa",					"libc",		BENCH_KIND_FIXED,	bench_libc_snprintf_d, 0},
+	{"unstr_sprintf",				"unstring",	BENCH_KIND_FIXED,	bench_unstr_sprintf, 0},
+	{"unstr_sprintf",				"libc",		BENCH_KIND_FIXED,	bench_libc_snprintf, 0},
+	{"unstr_strlen",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_strlen, 0},
+	{"unstr_strlen",				"libc",		BENCH_KIND_SIZE,	bench_libc_strlen, 0},
+	{"unstr_alloc",					"unstring",	BENCH_KIND_SIZE,	bench_unstr_alloc, 0},
+	{"unstr_alloc",					"libc",		BENCH_KIND_SIZE,	bench_libc_malloc, 0},
+	{"unstr_init_memory",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_init_memory, 0},
+	{"unstr_init_memory",			"libc",		BENCH_KIND_SIZE,	bench_libc_malloc, 0},
+	{"unstr_delete",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_delete, 0},
+	{"unstr_init",					"unstring",	BENCH_KIND_SIZE,	bench_unstr_init, 0},
+	{"unstr_init",					"libc",		BENCH_KIND_SIZE,	bench_libc_strdup, 0},
+	{"unstr_copy",					"unstring",	BENCH_KIND_SIZE,	bench_unstr_copy, 0},
+	{"unstr_copy",					"libc",		BENCH_KIND_SIZE,	bench_libc_malloc_memcpy, 0},
+	{"unstr_slice",					"unstring",	BENCH_KIND_SIZE,	bench_unstr_slice, 0},
+	{"unstr_slice",					"substr",	BENCH_KIND_SIZE,	bench_unstr_substr_copy, 0},
+	{"unstr_compact_init",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_compact_init, 0},
+	{"unstr_compact_init",			"copy",		BENCH_KIND_SIZE,	bench_unstr_copy_pieces, 0},
+	{"unstr_write",					"unstring",	BENCH_KIND_SIZE,	bench_unstr_write, 0},
+	{"unstr_write",					"libc",		BENCH_KIND_SIZE,	bench_libc_memcpy, 0},
+	{"unstr_strcpy",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_strcpy, 0},
+	{"unstr_strcpy",				"libc",		BENCH_KIND_SIZE,	bench_libc_memcpy, 0},
+	{"unstr_strcpy_char",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_strcpy_char, 0},
+	{"unstr_strcpy_char",			"libc",		BENCH_KIND_SIZE,	bench_libc_strcpy, 0},
+	{"unstr_substr",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_substr, 0},
+	{"unstr_substr_char",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_substr_char, 0},
+	{"unstr_strcat",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_strcat, 0},
+	{"unstr_strcat",				"libc",		BENCH_KIND_SIZE,	bench_libc_strcat, 0},
+	{"unstr_strcat_char",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_strcat_char, 0},
+	{"unstr_strcmp",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_strcmp, 0},
+	{"unstr_strcmp",				"libc",		BENCH_KIND_SIZE,	bench_libc_memcmp, 0},
+	{"unstr_strcmp_char",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_strcmp_char, 0},
+	{"unstr_strcmp_char",			"libc",		BENCH_KIND_SIZE,	bench_libc_strcmp, 0},
+	{"unstr_sprintf($)",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_sprintf_unstr, 0},
+	{"unstr_sprintf($)",			"libc",		BENCH_KIND_SIZE,	bench_libc_snprintf_s, 0},
+	{"unstr_toupper+tolower",		"unstring",	BENCH_KIND_SIZE,	bench_unstr_toupper, 0},
+	{"unstr_strcasecmp",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_strcasecmp, 0},
+	{"unstr_strcasecmp",			"libc",		BENCH_KIND_SIZE,	bench_libc_strcasecmp, 0},
+	{"unstr_reverse",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_reverse, 0},
+	{"unstr_reverse_inplace",		"unstring",	BENCH_KIND_SIZE,	bench_unstr_reverse_inplace, 0},
+	{"unstr_reverse_into",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_reverse_into, 0},
+	{"unstr_utf8_valid(ascii)",		"unstring",	BENCH_KIND_SIZE,	bench_unstr_utf8_valid, 0},
+	{"unstr_utf8_valid(kana)",		"unstring",	BENCH_KIND_SIZE,	bench_unstr_utf8_valid_kana, 0},
+	{"unstr_utf8_strlen",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_utf8_strlen, 0},
+	{"unstr_utf8_offset",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_utf8_offset, 0},
+	{"unstr_utf8_reverse",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_utf8_reverse, 0},
+	{"unstr_bin2hex",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_bin2hex, 0},
+	{"unstr_bin2hex",				"libc",		BENCH_KIND_SIZE,	bench_libc_snprintf_x, 0},
+	{"unstr_hex2bin",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_hex2bin, 0},
+	{"unstr_hex2bin",				"libc",		BENCH_KIND_SIZE,	bench_libc_strtoul_x, 0},
+	{"unstr_base64_encode",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_base64_encode, 0},
+	{"unstr_base64_decode",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_base64_decode, 0},
+	{"unstr_repeat",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_repeat, 0},
+	{"unstr_repeat_into",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_repeat_into, 0},
+	{"unstr_repeat_char",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_repeat_char, 0},
+	{"unstr_repeat_char",			"libc",		BENCH_KIND_SIZE,	bench_libc_memset, 0},
+	{"unstr_implode",				"unstring",	BENCH_KIND_SIZE,	bench_unstr_implode, 0},
+	{"unstr_implode",				"strcat",	BENCH_KIND_SIZE,	bench_strcat_implode, 0},
+	{"unstr_file_put_contents",		"unstring",	BENCH_KIND_SIZE,	bench_unstr_file_put_contents, 0},
+	{"unstr_file_put_contents",		"libc",		BENCH_KIND_SIZE,	bench_libc_fwrite, 0},
+	{"unstr_file_get_contents",		"unstring",	BENCH_KIND_SIZE,	bench_unstr_file_get_contents, 0},
+	{"unstr_file_get_contents_into",	"unstring",	BENCH_KIND_SIZE,	bench_unstr_file_get_contents_into, 0},
+	{"unstr_file_get_contents",		"libc",		BENCH_KIND_SIZE,	bench_libc_fread, 0},
+	{"unstr_strpos",				"unstring",	BENCH_KIND_SEARCH,	bench_unstr_strpos, 0},
+	{"unstr_strpos",				"libc",		BENCH_KIND_SEARCH,	bench_libc_memmem, 0},
+	{"unstr_strstr",				"unstring",	BENCH_KIND_SEARCH,	bench_unstr_strstr, 0},
+	{"unstr_strstr",				"libc",		BENCH_KIND_SEARCH,	bench_libc_strstr, 0},
+	{"unstr_strstr_char",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_strstr_char, 0},
+	{"unstr_substr_count",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_substr_count, 0},
+	{"unstr_substr_count",			"libc",		BENCH_KIND_SEARCH,	bench_libc_memmem_count, 0},
+	{"unstr_substr_count_char",		"unstring",	BENCH_KIND_SEARCH,	bench_unstr_substr_count_char, 0},
+	{"unstr_stripos",				"unstring",	BENCH_KIND_SEARCH,	bench_unstr_stripos, 0},
+	{"unstr_stripos",				"copy",		BENCH_KIND_SEARCH,	bench_copy_tolower_strpos, 0},
+	{"unstr_substr_icount",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_substr_icount, 0},
+	{"unstr_replace",				"unstring",	BENCH_KIND_SEARCH,	bench_unstr_replace, 0},
+	{"unstr_replace_into",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_replace_into, 0},
+	{"unstr_strpos_batch",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_strpos_batch, 0},
+	{"unstr_strpos_batch",			"loop",		BENCH_KIND_SEARCH,	bench_loop_strpos, 0},
+	{"unstr_substr_count_batch",	"unstring",	BENCH_KIND_SEARCH,	bench_unstr_substr_count_batch, 0},
+	{"unstr_substr_count_batch",	"loop",		BENCH_KIND_SEARCH,	bench_loop_substr_count, 0},
+	{"unstr_strcmp_batch",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_strcmp_batch, 0},
+	{"unstr_strcmp_batch",			"loop",		BENCH_KIND_SEARCH,	bench_loop_strcmp, 0},
+	{"unstr_replace_batch",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_replace_batch, 0},
+	{"unstr_replace_batch",			"loop",		BENCH_KIND_SEARCH,	bench_loop_replace_into, 0},
+	{"unstr_explode",				"unstring",	BENCH_KIND_SEARCH,	bench_unstr_explode, 0},
+	{"unstr_explode",				"tokens",	BENCH_KIND_SEARCH,	bench_unstr_explode_tokens, 0},
+	{"unstr_regex_search",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_regex_search, 0},
+	{"unstr_regex_search",			"libc",		BENCH_KIND_SEARCH,	bench_libc_regexec, 1024 * 1024},
+	{"unstr_regex_find_all",		"unstring",	BENCH_KIND_SEARCH,	bench_unstr_regex_find_all, 0},
+	{"unstr_regex_find_all",		"libc",		BENCH_KIND_SEARCH,	bench_libc_regexec_all, 1024 * 1024},
+	{"unstr_index_init",			"unstring",	BENCH_KIND_SIZE,	bench_unstr_index_init, 0},
+	{"unstr_index_count",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_index_count, 0},
+	{"unstr_index_count",			"scan",		BENCH_KIND_SEARCH,	bench_unstr_substr_count, 0},
+	{"unstr_index_first",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_index_first, 0},
+	{"unstr_index_first",			"scan",		BENCH_KIND_SEARCH,	bench_unstr_strpos, 0},
+	{"unstr_strtok",				"unstring",	BENCH_KIND_SEARCH,	bench_unstr_strtok, 0},
+	{"unstr_strtok_into",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_strtok_into, 0},
+	{"unstr_strtok",				"libc",		BENCH_KIND_SEARCH,	bench_libc_strtok_r, 0},
+	{"unstr_sscanf",				"unstring",	BENCH_KIND_SEARCH,	bench_unstr_sscanf, 0},
+	{"unstr_sscanf_exec",			"unstring",	BENCH_KIND_SEARCH,	bench_unstr_sscanf_exec, 0},
+	{"unstr_sscanf_exec_view",		"unstring",	BENCH_KIND_SEARCH,	bench_unstr_sscanf_exec_view, 0},
+	{NULL, NULL, BENCH_KIND_FIXED, NULL, 0}
+};
+
+static const size_t g_needle_lens[] = {1, 4, 16, 64};
+static const double g_hit_rates[] = {0.0, 0.001, 0.1};
+
+int main(int argc, char *argv[])
+{
+	bench_option_t opt = {UNSTRING_FALSE, BENCH_DEFAULT_MAX_SIZE, BENCH_DEFAULT_TIME, NULL};
+	bench_t b;
+	const bench_case_t *c = 0;
+	size_t size = 0;
+	size_t i = 0;
+	size_t j = 0;
+	int k = 0;
+
+	for(k = 1; k < argc; k++){
+		if(strcmp(argv[k], "-json") == 0){
+			opt.json = UNSTRING_TRUE;
+		} else if((strcmp(argv[k], "-max") == 0) && (k + 1 < argc)){
+			opt.max_size = strtoul(argv[++k], NULL, 10);
+		} else if((strcmp(argv[k], "-time") == 0) && (k + 1 < argc)){
+			opt.min_time = strtod(argv[++k], NULL);
+		} else if((strcmp(argv[k], "-filter") == 0) && (k + 1 < argc)){
+			opt.filter = argv[++k];
+		} else {
+			fprintf(stderr, "usage: %s [-json] [-max size] [-time sec] [-filter name]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(opt.max_size > BENCH_LIMIT_SIZE){
+		opt.max_size = BENCH_LIMIT_SIZE;
+	}
+	memset(&b, 0, sizeof(b));
+	b.filename = unstr_init(BENCH_TMP_FILE);
+	b.replace = unstr_init("x");
+	b.unit = unstr_repeat_char("u", BENCH_UNIT_SIZE);
+
+	if(!opt.json){
+		printf("function,impl,size,needle,hit_rate,iterations,ns_min,ns_median,mb_per_s\n");
+	}
+	/* 長さに依存しない関数 */
+	bench_fill(&b, BENCH_MIN_SIZE, 1, 0.0);
+	for(c = g_cases; c->name != NULL; c++){
+		if(c->kind == BENCH_KIND_FIXED){
+			bench_run(c, &b, &opt);
+		}
+	}
+	bench_clear(&b);
+	/* 8Bから8倍ずつ増やす */
+	for(size = BENCH_MIN_SIZE; size <= opt.max_size; size *= 8){
+		bench_fill(&b, size, 1, 0.0);
+		unstr_file_put_contents(b.filename, b.text, "w");
+		for(c = g_cases; c->name != NULL; c++){
+			if(c->kind == BENCH_KIND_SIZE){
+				bench_run(c, &b, &opt);
+			}
+		}
+		bench_clear(&b);
+		for(i = 0; i < sizeof(g_needle_lens) / sizeof(g_needle_lens[0]); i++){
+			if(g_needle_lens[i] > size) continue;
+			for(j = 0; j < sizeof(g_hit_rates) / sizeof(g_hit_rates[0]); j++){
+				bench_fill(&b, size, g_needle_lens[i], g_hit_rates[j]);
+				for(c = g_cases; c->name != NULL; c++){
+					if(c->kind == BENCH_KIND_SEARCH){
+						bench_run(c, &b, &opt);
+					}
+				}
+				bench_clear(&b);
+			}
+		}
+		/* オーバーフロー対策 */
+		if(size > (BENCH_LIMIT_SIZE / 8)) break;
+	}
+	remove(BENCH_TMP_FILE);
+	fprintf(stderr, "sink:%lu\n", (unsigned long)b.sink);
+	unstr_delete(3, b.filename, b.replace, b.unit);
+	return 0;
+}
+
+/**
+ * @brief		xorshiftによる擬似乱数。計測結果を再現できるよう種は固定。
+ * @return		乱数
+ */
+static unsigned long bench_rand(void)
+{
+	g_seed ^= (g_seed << 13);
+	g_seed ^= (g_seed >> 7);
+	g_seed ^= (g_seed << 17);
+	return g_seed;
+}
+
+/**
+ * @brief		単調増加する時刻を秒で返す
+ * @return		時刻
+ */
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/**
+ * @brief		計測用の文字列を作成する
+ * @param[out]	b			計測環境
+ * @param[in]	size		対象文字列の長さ
+ * @param[in]	needle_len	検索文字列の長さ
+ * @param[in]	hit_rate	検索文字列を埋め込む確率(needle_len毎)
+ * @return		無し
+ *
+ * @par			詳細:
+ * 対象文字列は小文字、検索文字列は大文字で作るので、
+ * 埋め込んだ箇所以外では一致しない。
+ */
+static void bench_fill(bench_t *b, size_t size, size_t needle_len, double hit_rate)
+{
+	size_t i = 0;
+	unsigned long threshold = (unsigned long)(hit_rate * 1000000.0);
+	char *pattern = NULL;
+
+	b->size = size;
+	b->needle_len = needle_len;
+	b->hit_rate = hit_rate;
+	b->text = unstr_init_memory(size + 1);
+	b->needle = unstr_init_memory(needle_len + 1);
+	b->work = unstr_init_memory(size + 2);
+	b->buf = malloc(size + 1);
+	for(i = 0; i < needle_len; i++){
+		b->needle->data[i] = (char)('A' + (bench_rand() % 26));
+	}
+	b->needle->data[needle_len] = '\0';
+	b->needle->length = needle_len;
+	for(i = 0; i < size; i++){
+		b->text->data[i] = (char)('a' + (bench_rand() % 26));
+	}
+	for(i = 0; (i + needle_len) <= size; i += needle_len){
+		if((bench_rand() % 1000000) < threshold){
+			memcpy(&(b->text->data[i]), b->needle->data, needle_len);
+		}
+	}
+	b->text->data[size] = '\0';
+	b->text->length = size;
+	/* 比較用に同じ内容を用意する */
+	unstr_strcpy(b->work, b->text);
+	memcpy(b->buf, b->text->data, size + 1);
+	b->format = malloc(needle_len + 3);
+	b->format[0] = '$';
+	memcpy(&(b->format[1]), b->needle->data, needle_len);
+	b->format[needle_len + 1] = '$';
+	b->format[needle_len + 2] = '\0';
+	b->plan = unstr_sscanf_compile(b->format);
+	/* needleは英大文字だけなのでそのまま正規表現に使える */
+	pattern = malloc(needle_len + 6);
+	memcpy(pattern, b->needle->data, needle_len);
+	memcpy(&(pattern[needle_len]), "[a-z]", 6);
+	b->regex = unstr_regex_compile(pattern);
+	regcomp(&(b->posix), pattern, REG_EXTENDED);
+	free(pattern);
+	/* 8文字に1文字をASCIIにし、残りはひらがな(3バイト)にする */
+	b->kana = unstr_init_memory(size + 1);
+	i = 0;
+	while(i < size){
+		if(((bench_rand() % 8) == 0) || ((size - i) < 3)){
+			b->kana->data[i++] = (char)('a' + (bench_rand() % 26));
+		} else {
+			b->kana->data[i++] = (char)0xe3;
+			b->kana->data[i++] = (char)0x81;
+			b->kana->data[i++] = (char)(0x81 + (bench_rand() % 63));
+		}
+	}
+	b->kana->data[size] = '\0';
+	b->kana->length = size;
+	b->hex = unstr_init_memory(1);
+	unstr_bin2hex(b->hex, b->text);
+	b->base64 = unstr_init_memory(1);
+	unstr_base64_encode(b->base64, b->text);
+	b->coded = unstr_init_memory((size * 2) + 2);
+	b->piece_count = (size + BENCH_PIECE_SIZE - 1) / BENCH_PIECE_SIZE;
+	b->pieces = malloc(b->piece_count * sizeof(unstr_t *));
+	b->outs = malloc(b->piece_count * sizeof(unstr_t *));
+	b->positions = malloc(b->piece_count * sizeof(int));
+	b->counts = malloc(b->piece_count * sizeof(size_t));
+	for(i = 0; i < b->piece_count; i++){
+		b->outs[i] = unstr_init_memory(BENCH_PIECE_SIZE + 2);
+		b->pieces[i] = unstr_init_memory(BENCH_PIECE_SIZE + 2);
+		unstr_write(b->pieces[i], b->text->data + (i * BENCH_PIECE_SIZE), 0,
+			((size - (i * BENCH_PIECE_SIZE)) < BENCH_PIECE_SIZE) ? (size - (i * BENCH_PIECE_SIZE)) : BENCH_PIECE_SIZE);
+	}
+}
+
+/**
+ * @brief		計測用の文字列を開放する
+ * @param[in]	b	計測環境
+ * @return		無し
+ */
+static void bench_clear(bench_t *b)
+{
+	size_t i = 0;
+	unstr_delete(7, b->text, b->needle, b->work, b->kana, b->hex, b->base64, b->coded);
+	b->text = NULL;
+	b->needle = NULL;
+	b->work = NULL;
+	b->kana = NULL;
+	b->hex = NULL;
+	b->base64 = NULL;
+	b->coded = NULL;
+	for(i = 0; i < b->piece_count; i++){
+		unstr_free(b->pieces[i]);
+		unstr_free(b->outs[i]);
+	}
+	free(b->pieces);
+	b->pieces = NULL;
+	free(b->outs);
+	b->outs = NULL;
+	free(b->positions);
+	b->positions = NULL;
+	free(b->counts);
+	b->counts = NULL;
+	b->piece_count = 0;
+	free(b->buf);
+	b->buf = NULL;
+	free(b->format);
+	b->format = NULL;
+	unstr_sscanf_plan_free(b->plan);
+	b->plan = NULL;
+	unstr_regex_free(b->regex);
+	b->regex = NULL;
+	regfree(&(b->posix));
+	unstr_index_free(b->index);
+	b->index = NULL;
+}
+
+static int bench_compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief		1ケースを計測して結果を出力する
+ * @param[in]	c		計測ケース
+ * @param[in]	b		計測環境
+ * @param[in]	opt		オプション
+ * @return		無し
+ *
+ * @par			詳細:
+ * min_timeを超えるまで反復回数を倍にして調整し、
+ * その回数でBENCH_ROUNDS回計測した1回あたりの最小値と中央値を出す。
+ */
+static void bench_run(const bench_case_t *c, bench_t *b, const bench_option_t *opt)
+{
+	double ns[BENCH_ROUNDS];
+	double start = 0;
+	double elapsed = 0;
+	double mbps = 0;
+	size_t iterations = 1;
+	size_t i = 0;
+	size_t r = 0;
+	size_t size = (c->kind == BENCH_KIND_FIXED) ? 0 : b->size;
+	size_t needle = (c->kind == BENCH_KIND_SEARCH) ? b->needle_len : 0;
+	double hit_rate = (c->kind == BENCH_KIND_SEARCH) ? b->hit_rate : 0.0;
+
+	if((opt->filter != NULL) && (strstr(c->name, opt->filter) == NULL)){
+		return;
+	}
+	if((c->max_size > 0) && (b->size > c->max_size)){
+		return;
+	}
+	for(;;){
+		start = bench_now();
+		for(i = 0; i < iterations; i++){
+			c->func(b);
+		}
+		elapsed = bench_now() - start;
+		if((elapsed >= (opt->min_time / BENCH_ROUNDS)) || (iterations >= ((size_t)1 << 30))){
+			break;
+		}
+		iterations <<= 1;
+	}
+	for(r = 0; r < BENCH_ROUNDS; r++){
+		start = bench_now();
+		for(i = 0; i < iterations; i++){
+			c->func(b);
+		}
+		ns[r] = ((bench_now() - start) * 1e9) / (double)iterations;
+	}
+	qsort(ns, BENCH_ROUNDS, sizeof(double), bench_compare_double);
+	if((size > 0) && (ns[BENCH_ROUNDS / 2] > 0)){
+		mbps = ((double)size / (1024.0 * 1024.0)) / (ns[BENCH_ROUNDS / 2] / 1e9);
+	}
+	if(opt->json){
+		printf(
+			"{\"function\":\"%s\",\"impl\":\"%s\",\"size\":%lu,\"needle\":%lu,"
+			"\"hit_rate\":%g,\"iterations\":%lu,\"ns_min\":%.1f,\"ns_median\":%.1f,"
+			"\"mb_per_s\":%.1f}\n",
+			c->name, c->impl, (unsigned long)size, (unsigned long)needle,
+			hit_rate, (unsigned long)iterations, ns[0], ns[BENCH_ROUNDS / 2], mbps
+		);
+	} else {
+		printf(
+			"%s,%s,%lu,%lu,%g,%lu,%.1f,%.1f,%.1f\n",
+			c->name, c->impl, (unsigned long)size, (unsigned long)needle,
+			hit_rate, (unsigned long)iterations, ns[0], ns[BENCH_ROUNDS / 2], mbps
+		);
+	}
+	fflush(stdout);
+}
@@ -39,12 +39,17 @@ static void test_unstr_alloc(void);
 static void test_unstr_free(void);
 //static void test_unstr_free_func(void);
 static void test_unstr_delete(void);
+static void test_unstr_delete_array(void);
 static void test_unstr_zero(void);
 static void test_unstr_isset(void);
 static void test_unstr_empty(void);
 static void test_unstr_strlen(void);
 static void test_unstr_write(void);
 static void test_unstr_copy(void);
+static void test_unstr_detach(void);
+static void test_unstr_slice(void);
+static void test_unstr_compact_init(void);
+static void test_unstr_compact_ref(void);
 static void test_unstr_strcpy(void);
 static void test_unstr_strcpy_char(void);
 static void test_unstr_substr(void);
@@ -56,19 +61,55 @@ static void test_unstr_strcmp_char(void);
 static void test_unstr_strstr(void);
 static void test_unstr_strstr_char(void);
 static void test_unstr_explode(void);
+static void test_unstr_explode_tokens(void);
+static void test_unstr_implode(void);
 static void test_unstr_sprintf(void);
 static void test_unstr_sscanf(void);
+static void test_unstr_sscanf_exec(void);
+static void test_unstr_sscanf_view(void);
 static void test_unstr_reverse(void);
+static void test_unstr_reverse_inplace(void);
+static void test_unstr_reverse_into(void);
 static void test_unstr_itoa(void);
+static void test_unstr_itoa_into(void);
 //static void test_unstr_file_get_contents(void);
 //static void test_unstr_file_put_contents(void);
 static void test_unstr_replace(void);
+static void test_unstr_replace_into(void);
 static void test_unstr_strpos(void);
 static void test_unstr_substr_count(void);
 static void test_unstr_substr_count_char(void);
 static void test_unstr_strtok(void);
+static void test_unstr_strtok_into(void);
 static void test_unstr_repeat(void);
+static void test_unstr_repeat_into(void);
+static void test_unstr_strpos_batch(void);
+static void test_unstr_substr_count_batch(void);
+static void test_unstr_strcmp_batch(void);
+static void test_unstr_replace_batch(void);
 static void test_unstr_repeat_char(void);
+static void test_unstr_toupper(void);
+static void test_unstr_strcasecmp(void);
+static void test_unstr_stripos(void);
+static void test_unstr_substr_icount(void);
+static void test_unstr_utf8_valid(void);
+static void test_unstr_utf8_strlen(void);
+static void test_unstr_utf8_offset(void);
+static void test_unstr_utf8_substr(void);
+static void test_unstr_utf8_reverse(void);
+static void test_unstr_regex_compile(void);
+static void test_unstr_regex_match(void);
+static void test_unstr_regex_search(void);
+static void test_unstr_regex_find_all(void);
+static void test_unstr_bin2hex(void);
+static void test_unstr_hex2bin(void);
+static void test_unstr_base64_encode(void);
+static void test_unstr_base64_decode(void);
+static void test_unstr_index_init(void);
+static void test_unstr_index_save(void);
+static void test_unstr_stats(void);
+static void test_unstr_cache(void);
+static void test_unstr_trace(void);
 
 
 int main(int argc, char *argv[])
@@ -80,12 +121,17 @@ int main(int argc, char *argv[])
 		test(unstr_free);
 		//test(unstr_free_func);
 		test(unstr_delete);
+		test(unstr_delete_array);
 		test(unstr_zero);
 		test(unstr_isset);
 		test(unstr_empty);
 		test(unstr_strlen);
 		test(unstr_write);
 		test(unstr_copy);
+		test(unstr_detach);
+		test(unstr_slice);
+		test(unstr_compact_init);
+		test(unstr_compact_ref);
 		test(unstr_strcpy);
 		test(unstr_strcpy_char);
 		test(unstr_substr);
@@ -97,19 +143,55 @@ int main(int argc, char *argv[])
 		test(unstr_strstr);
 		test(unstr_strstr_char);
 		test(unstr_explode);
+		test(unstr_explode_tokens);
+		test(unstr_implode);
 		test(unstr_sprintf);
 		test(unstr_sscanf);
+		test(unstr_sscanf_exec);
+		test(unstr_sscanf_view);
 		test(unstr_reverse);
+		test(unstr_reverse_inplace);
+		test(unstr_reverse_into);
 		test(unstr_itoa);
+		test(unstr_itoa_into);
 		//test(unstr_file_get_contents);
 		//test(unstr_file_put_contents);
 		test(unstr_replace);
+		test(unstr_replace_into);
 		test(unstr_strpos);
 		test(unstr_substr_count);
 		test(unstr_substr_count_char);
 		test(unstr_strtok);
+		test(unstr_strtok_into);
 		test(unstr_repeat);
+		test(unstr_repeat_into);
+		test(unstr_strpos_batch);
+		test(unstr_substr_count_batch);
+		test(unstr_strcmp_batch);
+		test(unstr_replace_batch);
 		test(unstr_repeat_char);
+		test(unstr_toupper);
+		test(unstr_strcasecmp);
+		test(unstr_stripos);
+		test(unstr_substr_icount);
+		test(unstr_utf8_valid);
+		test(unstr_utf8_strlen);
+		test(unstr_utf8_offset);
+		test(unstr_utf8_substr);
+		test(unstr_utf8_reverse);
+		test(unstr_regex_compile);
+		test(unstr_regex_match);
+		test(unstr_regex_search);
+		test(unstr_regex_find_all);
+		test(unstr_bin2hex);
+		test(unstr_hex2bin);
+		test(unstr_base64_encode);
+		test(unstr_base64_decode);
+		test(unstr_index_init);
+		test(unstr_index_save);
+		test(unstr_stats);
+		test(unstr_cache);
+		test(unstr_trace);
 	} else {
 		printf("NG\n");
 	}
@@ -260,6 +342,26 @@ static void test_unstr_delete(void)
 	unstr_delete(3, str[0], str[1], str[2]);
 }
 
+static void test_unstr_delete_array(void)
+{
+	size_t len = 0;
+	unstr_t *str = unstr_init("1 2 3");
+	unstr_t **list = unstr_explode(str, " ", &len);
+	unstr_t *part[3] = {0};
+
+	unstr_delete_array(NULL, 3);
+	check_int(len, 3);
+	unstr_delete_array(list, len);
+	check_null(list[0]);
+	check_null(list[2]);
+	free(list);
+	/* NULLの要素は飛ばす */
+	part[1] = unstr_init_memory(100);
+	unstr_delete_array(part, 3);
+	check_null(part[1]);
+	unstr_free(str);
+}
+
 static void test_unstr_zero(void)
 {
 	unstr_t *str = unstr_init("unkokkokussakusa");
@@ -333,6 +435,199 @@ static void test_unstr_copy(void)
 	unstr_delete(2, str, tmp);
 }
 
+static void test_unstr_detach(void)
+{
+	unstr_t *str = unstr_init("unkokkokussakusa");
+	unstr_t *a = unstr_copy(str);
+	unstr_t *b = unstr_copy(str);
+	unstr_t *c = unstr_copy(str);
+	unstr_t *d = unstr_copy(str);
+	unstr_t *e = unstr_copy(str);
+#ifdef UNSTRING_ENABLE_COW
+	check_assert(a->data == str->data);
+#endif
+	check_assert(unstr_detach(NULL) == UNSTRING_FALSE);
+	/* どこに書き込んでも他のコピーは変わらない */
+	unstr_strcat_char(a, "!");
+	unstr_toupper(b);
+	unstr_zero(c);
+	unstr_reverse_inplace(d);
+	check_assert(unstr_detach(e) == UNSTRING_TRUE);
+	e->data[0] = 'U';
+	check_unstr_char(str, "unkokkokussakusa");
+	check_unstr_char(a, "unkokkokussakusa!");
+	check_unstr_char(b, "UNKOKKOKUSSAKUSA");
+	check_unstr_char(c, "");
+	check_unstr_char(d, "asukassukokkoknu");
+	check_unstr_char(e, "Unkokkokussakusa");
+	unstr_delete(5, a, b, c, d, e);
+
+	/* 元の文字列を先に開放しても共有先は残る */
+	a = unstr_copy(str);
+	unstr_free(str);
+	check_unstr_char(a, "unkokkokussakusa");
+	unstr_strcpy(a, a);
+	check_unstr_char(a, "unkokkokussakusa");
+	/* 共有しているバッファの一部を自身に書き込む */
+	b = unstr_copy(a);
+	check_assert(unstr_write(a, a->data + 4, 0, 8) == UNSTRING_TRUE);
+	check_unstr_char(a, "kkokussa");
+	check_unstr_char(b, "unkokkokussakusa");
+	unstr_free(b);
+	unstr_free(a);
+}
+
+static void test_unstr_slice(void)
+{
+	unstr_t *str = unstr_init("unko,kokko,kussa,kusa");
+	unstr_t *tmp = unstr_init_memory(1);
+	unstr_t *a = 0;
+	unstr_t *b = 0;
+	unstr_t *c = 0;
+	unstr_t **list = 0;
+	size_t len = 0;
+	size_t i = 0;
+	check_null(unstr_slice(NULL, 0, 1));
+	check_null(unstr_slice(str, 22, 1));
+
+	a = unstr_slice(str, 5, 5);
+	b = unstr_slice(str, 11, 100);
+#ifdef UNSTRING_ENABLE_COW
+	check_assert(a->data == str->data + 5);
+#endif
+	check_unstr_char(a, "kokko");
+	check_unstr_char(b, "kussa,kusa");
+	/* 読み取り専用の関数は終端の無い部分文字列でも長さの範囲だけを見る */
+	check_int(unstr_strpos(b, a), -1);
+	check_int(unstr_substr_count_char(a, "k"), 3);
+	check_int(unstr_strcmp_char(b, "kussa,kusa"), 0);
+	unstr_strcpy_char(tmp, "kusa");
+	check_assert(unstr_strstr(b, tmp) == b->data + 6);
+	c = unstr_replace(b, a, tmp);
+	check_unstr_char(c, "kussa,kusa");
+	unstr_free(c);
+	c = unstr_slice(b, 0, 3);
+	check_assert(unstr_strcpy(tmp, c) == UNSTRING_TRUE);
+	check_unstr_char(tmp, "kus");
+	unstr_free(c);
+	c = unstr_replace(str, a, tmp);
+	check_unstr_char(c, "unko,kus,kussa,kusa");
+	unstr_free(c);
+	list = unstr_explode(b, ",", &len);
+	check_int(len, 2);
+	check_unstr_char(list[0], "kussa");
+	check_unstr_char(list[1], "kusa");
+	for(i = 0; i < len; i++){
+		unstr_free(list[i]);
+	}
+	free(list);
+
+	/* 部分文字列の部分文字列とコピー */
+	c = unstr_slice(b, 6, 2);
+	check_unstr_char(c, "ku");
+	unstr_free(c);
+	c = unstr_copy(a);
+	check_unstr_char(c, "kokko");
+	unstr_free(c);
+
+	/* 元の文字列を変更・開放しても部分文字列は変わらない */
+	unstr_toupper(str);
+	check_unstr_char(str, "UNKO,KOKKO,KUSSA,KUSA");
+	check_unstr_char(a, "kokko");
+	unstr_free(str);
+	check_unstr_char(b, "kussa,kusa");
+
+	/* 書き込むと自身のバッファにコピーされる */
+	unstr_strcat_char(a, "!");
+	check_unstr_char(a, "kokko!");
+	check_int(a->data[a->length], '\0');
+	unstr_toupper(b);
+	check_unstr_char(b, "KUSSA,KUSA");
+	c = unstr_slice(b, 6, 4);
+	unstr_free(b);
+	unstr_strcpy(c, c);
+	check_unstr_char(c, "KUSA");
+	check_assert(unstr_detach(c) == UNSTRING_TRUE);
+	check_int(c->data[c->length], '\0');
+	unstr_delete(3, a, c, tmp);
+}
+
+static void test_unstr_compact_init(void)
+{
+	unstr_t *str = unstr_init("unkokusai");
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_compact_t *c = 0;
+	check_assert(unstr_compact_init(NULL) == NULL);
+	check_int(unstr_compact_strlen(NULL), 0);
+	check_assert(unstr_compact_data(NULL) == NULL);
+	unstr_compact_free(NULL);
+
+	c = unstr_compact_init(str);
+	/* 元の文字列とは別の領域に複製する */
+	unstr_toupper(str);
+	check_int(unstr_compact_strlen(c), 9);
+	check_char(unstr_compact_data(c), "unkokusai");
+	unstr_compact_free(c);
+
+	unstr_write(str, "un\0ko", 0, 5);
+	c = unstr_compact_init(str);
+	check_int(unstr_compact_strlen(c), 5);
+	check_assert(memcmp(unstr_compact_data(c), "un\0ko", 6) == 0);
+	unstr_compact_free(c);
+
+	c = unstr_compact_init(emp);
+	check_int(unstr_compact_strlen(c), 0);
+	check_char(unstr_compact_data(c), "");
+	unstr_compact_free(c);
+	unstr_delete(2, str, emp);
+}
+
+static void test_unstr_compact_ref(void)
+{
+	unstr_t *str = unstr_init("unko,kokko,kusa");
+	unstr_t *tmp = unstr_init("kokko");
+	unstr_t *ret = 0;
+	unstr_t **list = 0;
+	unstr_compact_t *c = unstr_compact_init(str);
+	unstr_ref_t ref;
+	const unstr_t *r = 0;
+	size_t len = 0;
+	size_t i = 0;
+	check_assert(unstr_compact_ref(NULL, &ref) == NULL);
+	check_assert(unstr_compact_ref(c, NULL) == NULL);
+
+	/* 読み取り専用の関数にそのまま渡せる */
+	r = unstr_compact_ref(c, &ref);
+	check_assert(r->data == unstr_compact_data(c));
+	check_unstr(r, str);
+	check_int(unstr_strpos(r, tmp), 5);
+	check_int(unstr_substr_count_char(r, "k"), 5);
+	check_int(unstr_strcmp(r, str), 0);
+	check_assert(unstr_utf8_valid(r) == UNSTRING_TRUE);
+	check_assert(unstr_strcpy(tmp, r) == UNSTRING_TRUE);
+	check_unstr(tmp, str);
+	list = unstr_explode(r, ",", &len);
+	check_int(len, 3);
+	check_unstr_char(list[2], "kusa");
+	for(i = 0; i < len; i++){
+		unstr_free(list[i]);
+	}
+	free(list);
+
+	/* コピーと部分文字列は内容を複製するので、元を開放しても使える */
+	ret = unstr_copy(r);
+	check_unstr(ret, str);
+	check_assert(ret->data != r->data);
+	unstr_free(tmp);
+	tmp = unstr_slice(r, 5, 5);
+	unstr_compact_free(c);
+	check_unstr_char(ret, "unko,kokko,kusa");
+	check_unstr_char(tmp, "kokko");
+	unstr_strcat_char(ret, "!");
+	check_unstr_char(ret, "unko,kokko,kusa!");
+	unstr_delete(3, str, tmp, ret);
+}
+
 static void test_unstr_strcpy(void)
 {
 	unstr_t *tmp = unstr_init_memory(1);
@@ -588,6 +883,83 @@ static void test_unstr_explode(void)
 	free(ret);
 }
 
+static void test_unstr_explode_tokens(void)
+{
+	size_t i = 0;
+	unstr_t *str = unstr_init("1, 2, 3, 4, 5, 6, 7, 8, 9, 0, ");
+	char *ans[11] = {"1", "2", "3", "4", "5", "6", "7", "8", "9", "0", ""};
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_t *copy = 0;
+	unstr_t *ret = 0;
+	unstr_tokens_t *tokens = 0;
+	check_null(unstr_explode_tokens(NULL, ", "));
+	check_null(unstr_explode_tokens(emp, ", "));
+	check_null(unstr_explode_tokens(str, NULL));
+	check_null(unstr_explode_tokens(str, ""));
+	unstr_tokens_free(NULL);
+
+	tokens = unstr_explode_tokens(str, ", ");
+	check_int(tokens->len, 11);
+	for(i = 0; i < tokens->len; i++){
+		check_unstr_char(tokens->list[i], ans[i]);
+	}
+	ret = unstr_implode(tokens->list, tokens->len, ", ");
+	check_unstr(ret, str);
+	/* 取り出した文字列は開放後も使える */
+	copy = unstr_copy(tokens->list[8]);
+	unstr_tokens_free(tokens);
+	check_unstr_char(copy, "9");
+	unstr_strcat_char(copy, "9");
+	check_unstr_char(copy, "99");
+
+	/* 区切り文字列が無い場合は全体が1つの要素になる */
+	tokens = unstr_explode_tokens(str, "|");
+	check_int(tokens->len, 1);
+	check_unstr(tokens->list[0], str);
+	unstr_tokens_free(tokens);
+
+	unstr_delete(4, str, emp, copy, ret);
+}
+
+static void test_unstr_implode(void)
+{
+	size_t i = 0;
+	size_t len = 0;
+	unstr_t *str = unstr_init("1 2 3 4 5 6 7 8 9 0 ");
+	unstr_t **list = unstr_explode(str, " ", &len);
+	unstr_t *ret = 0;
+	unstr_t *part[3] = {0, 0, 0};
+	check_null(unstr_implode(NULL, 1, ","));
+	check_null(unstr_implode(list, len, NULL));
+
+	/* unstr_explodeの結果を戻す */
+	ret = unstr_implode(list, len, " ");
+	check_unstr(ret, str);
+	unstr_free(ret);
+	ret = unstr_implode(list, len, ", ");
+	check_unstr_char(ret, "1, 2, 3, 4, 5, 6, 7, 8, 9, 0, ");
+	unstr_free(ret);
+	ret = unstr_implode(list, 3, "");
+	check_unstr_char(ret, "123");
+	unstr_free(ret);
+	ret = unstr_implode(list, 0, ",");
+	check_unstr_char(ret, "");
+	unstr_free(ret);
+
+	/* NULLの要素は空文字列 */
+	part[0] = list[0];
+	part[2] = list[2];
+	ret = unstr_implode(part, 3, "-");
+	check_unstr_char(ret, "1--3");
+	unstr_free(ret);
+
+	for(i = 0; i < len; i++){
+		unstr_free(list[i]);
+	}
+	free(list);
+	unstr_free(str);
+}
+
 static void test_unstr_sprintf(void)
 {
 	unstr_t *tmp = 0;
@@ -679,6 +1051,103 @@ static void test_unstr_sscanf(void)
 	unstr_delete(8, source1, source2, source3, source4, source5, p1, p2, p3);
 }
 
+static void test_unstr_sscanf_exec(void)
+{
+	size_t ret = 0;
+	size_t i = 0;
+	unstr_sscanf_plan_t *plan = 0;
+	unstr_t *source1 = unstr_init("unko<>hoge<>fuga");
+	unstr_t *source2 = unstr_init("head:unko<>hoge<>");
+	unstr_t *source3 = unstr_init("unko$hoge$fuga");
+	unstr_t *p1 = unstr_init_memory(1);
+	unstr_t *p2 = unstr_init_memory(1);
+	unstr_t *p3 = unstr_init_memory(1);
+
+	check_null(unstr_sscanf_compile(NULL));
+	check_null(unstr_sscanf_compile("unko<>"));
+	check_int(unstr_sscanf_exec(NULL, source1, p1), 0);
+
+	plan = unstr_sscanf_compile("$<>$<>$");
+	check_int(unstr_sscanf_exec(plan, NULL, p1), 0);
+	/* 同じplanを何度でも使える */
+	for(i = 0; i < 3; i++){
+		ret = unstr_sscanf_exec(plan, source1, p1, p2, p3);
+		check_int(ret, 3);
+		check_unstr_char(p1, "unko");
+		check_unstr_char(p2, "hoge");
+		check_unstr_char(p3, "fuga");
+	}
+	unstr_sscanf_plan_free(plan);
+
+	/* 先頭の読み飛ばしと、空の残りは取得失敗 */
+	plan = unstr_sscanf_compile("head:$<>$<>$");
+	unstr_strcpy_char(p3, "untouched");
+	ret = unstr_sscanf_exec(plan, source2, p1, p2, p3);
+	check_int(ret, 2);
+	check_unstr_char(p1, "unko");
+	check_unstr_char(p2, "hoge");
+	check_unstr_char(p3, "untouched");
+	check_int(unstr_sscanf_exec(plan, source1, p1, p2, p3), 0);
+	unstr_sscanf_plan_free(plan);
+
+	plan = unstr_sscanf_compile("$$$$$$");
+	ret = unstr_sscanf_exec(plan, source3, p1, p2, p3);
+	check_int(ret, 3);
+	check_unstr_char(p1, "unko");
+	check_unstr_char(p2, "hoge");
+	check_unstr_char(p3, "fuga");
+	unstr_sscanf_plan_free(plan);
+
+	unstr_delete(6, source1, source2, source3, p1, p2, p3);
+}
+
+static void test_unstr_sscanf_view(void)
+{
+	size_t ret = 0;
+	unstr_view_t views[4];
+	unstr_sscanf_plan_t *plan = 0;
+	unstr_t *source1 = unstr_init("unko<>hoge<>fuga");
+	unstr_t *source2 = unstr_init("unko<><>fuga<>");
+
+	/* 取得できなかった場合も前の結果を残さない */
+	views[0].data = "unko";
+	views[0].length = 4;
+	check_int(unstr_sscanf_view(NULL, "$<>$", views, 4), 0);
+	check_null((void *)views[0].data);
+	check_int(views[0].length, 0);
+	views[0].data = "unko";
+	check_int(unstr_sscanf_view(source1, NULL, views, 4), 0);
+	check_null((void *)views[0].data);
+	check_int(unstr_sscanf_view(source1, "$<>$", NULL, 4), 0);
+
+	ret = unstr_sscanf_view(source1, "$<>$<>$", views, 4);
+	check_int(ret, 3);
+	check_assert(views[0].data == source1->data);
+	check_int(views[0].length, 4);
+	check_assert(views[1].data == source1->data + 6);
+	check_int(views[1].length, 4);
+	check_assert(memcmp(views[2].data, "fuga", views[2].length) == 0);
+	check_null((void *)views[3].data);
+
+	/* 要素数で打ち切る */
+	ret = unstr_sscanf_view(source1, "$<>$<>$", views, 1);
+	check_int(ret, 1);
+	check_int(views[0].length, 4);
+
+	plan = unstr_sscanf_compile("$<>$<>$<>$");
+	ret = unstr_sscanf_exec_view(plan, source2, views, 4);
+	check_int(ret, 3);
+	check_int(views[0].length, 4);
+	check_assert(views[1].data != NULL);
+	check_int(views[1].length, 0);
+	check_assert(memcmp(views[2].data, "fuga", views[2].length) == 0);
+	/* 残りが空 */
+	check_null((void *)views[3].data);
+	unstr_sscanf_plan_free(plan);
+
+	unstr_delete(2, source1, source2);
+}
+
 static void test_unstr_reverse(void)
 {
 	unstr_t *ret = 0;
@@ -711,6 +1180,37 @@ static void test_unstr_reverse(void)
 	unstr_delete(5, source1, source2, ret, emp, tmp);
 }
 
+static void test_unstr_reverse_inplace(void)
+{
+	/* 両端の16バイトずつと中央の残りを通るように33バイトにする */
+	unstr_t *str = unstr_init("0123456789abcdefghijklmnopqrstuvw");
+	check_assert(unstr_reverse_inplace(NULL) == UNSTRING_FALSE);
+	check_assert(unstr_reverse_inplace(str) == UNSTRING_TRUE);
+	check_unstr_char(str, "wvutsrqponmlkjihgfedcba9876543210");
+	unstr_strcpy_char(str, "ab");
+	check_assert(unstr_reverse_inplace(str) == UNSTRING_TRUE);
+	check_unstr_char(str, "ba");
+	unstr_zero(str);
+	check_assert(unstr_reverse_inplace(str) == UNSTRING_TRUE);
+	check_unstr_char(str, "");
+	unstr_free(str);
+}
+
+static void test_unstr_reverse_into(void)
+{
+	unstr_t *str = unstr_init("0123456789abcdefghijklmnopqrstuvw");
+	unstr_t *data = unstr_init_memory(4);
+	check_assert(unstr_reverse_into(NULL, str) == UNSTRING_FALSE);
+	check_assert(unstr_reverse_into(data, NULL) == UNSTRING_FALSE);
+	check_assert(unstr_reverse_into(data, str) == UNSTRING_TRUE);
+	check_unstr_char(data, "wvutsrqponmlkjihgfedcba9876543210");
+	check_unstr_char(str, "0123456789abcdefghijklmnopqrstuvw");
+	/* 同じ文字列を渡した場合はその場で反転 */
+	check_assert(unstr_reverse_into(str, str) == UNSTRING_TRUE);
+	check_unstr(str, data);
+	unstr_delete(2, str, data);
+}
+
 static void test_unstr_itoa(void)
 {
 	unstr_t *ret = 0;
@@ -742,6 +1242,25 @@ static void test_unstr_itoa(void)
 	unstr_free(ret);
 }
 
+static void test_unstr_itoa_into(void)
+{
+	unstr_t *str = unstr_init("unkokkokussakusa");
+	check_assert(unstr_itoa_into(NULL, 1, 10) == UNSTRING_FALSE);
+	check_assert(unstr_itoa_into(str, 1, 1) == UNSTRING_FALSE);
+	check_assert(unstr_itoa_into(str, 1, 37) == UNSTRING_FALSE);
+	check_unstr_char(str, "unkokkokussakusa");
+
+	check_assert(unstr_itoa_into(str, 0, 10) == UNSTRING_TRUE);
+	check_unstr_char(str, "0");
+	check_assert(unstr_itoa_into(str, 1234567890, 2) == UNSTRING_TRUE);
+	check_unstr_char(str, "1001001100101100000001011010010");
+	check_assert(unstr_itoa_into(str, -2147483647 - 1, 10) == UNSTRING_TRUE);
+	check_unstr_char(str, "-2147483648");
+	check_assert(unstr_itoa_into(str, 1234567890, 36) == UNSTRING_TRUE);
+	check_unstr_char(str, "kf12oi");
+	unstr_free(str);
+}
+
 static void test_unstr_replace(void)
 {
 	unstr_t *ret = 0;
@@ -811,9 +1330,43 @@ static void test_unstr_strpos(void)
 	unstr_strcpy_char(search, "aaa");
 	check_assert(unstr_strpos(text, search) < 0);
 
+	/* 1バイトの検索文字列 */
+	unstr_strcpy_char(search, "9");
+	check_int(unstr_strpos(text, search), 9);
+	unstr_strcpy_char(search, "a");
+	check_assert(unstr_strpos(text, search) < 0);
+	unstr_write(text, "01\0\xff", 0, 4);
+	unstr_write(search, "\xff", 0, 1);
+	check_int(unstr_strpos(text, search), 3);
+
 	unstr_delete(3, emp, text, search);
 }
 
+static void test_unstr_replace_into(void)
+{
+	unstr_t *dst = unstr_init_memory(1);
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_t *data = unstr_init("unkokkokokkokokkokokekokko");
+	unstr_t *search = unstr_init("ko");
+	unstr_t *replace = unstr_init("unko");
+
+	check_assert(unstr_replace_into(NULL, data, search, replace) == UNSTRING_FALSE);
+	check_assert(unstr_replace_into(dst, emp, search, replace) == UNSTRING_FALSE);
+	check_assert(unstr_replace_into(dst, data, emp, replace) == UNSTRING_FALSE);
+	check_assert(unstr_replace_into(dst, data, search, NULL) == UNSTRING_FALSE);
+
+	check_assert(unstr_replace_into(dst, data, search, emp) == UNSTRING_TRUE);
+	check_unstr_char(dst, "unkkkkek");
+	/* 前の内容は残らない */
+	check_assert(unstr_replace_into(dst, data, search, replace) == UNSTRING_TRUE);
+	check_unstr_char(dst, "ununkokunkounkokunkounkokunkounkokeunkokunko");
+	/* 対象文字列に書き込む */
+	check_assert(unstr_replace_into(data, data, search, replace) == UNSTRING_TRUE);
+	check_unstr(data, dst);
+
+	unstr_delete(5, dst, emp, data, search, replace);
+}
+
 static void test_unstr_substr_count(void)
 {
 	unstr_t *emp = unstr_init_memory(1);
@@ -831,6 +1384,16 @@ static void test_unstr_substr_count(void)
 	unstr_strcpy_char(search, "ko");
 	check_int(unstr_substr_count(text, search), 9);
 
+	/* 1バイトの検索文字列。16バイト単位とその余りの両方で数える */
+	unstr_strcpy_char(search, "k");
+	check_int(unstr_substr_count(text, search), 14);
+	unstr_free(text);
+	text = unstr_repeat_char("unko\n\xe3\x81\x86", 1000);
+	unstr_strcat_char(text, "\n");
+	check_int(unstr_substr_count_char(text, "\n"), 1001);
+	check_int(unstr_substr_count_char(text, "\x81"), 1000);
+	check_int(unstr_substr_count_char(text, "z"), 0);
+
 	unstr_delete(3, emp, text, search);
 }
 
@@ -887,6 +1450,28 @@ static void test_unstr_strtok(void)
 	unstr_delete(3, ret, emp, text);
 }
 
+static void test_unstr_strtok_into(void)
+{
+	size_t index = 0;
+	size_t i = 0;
+	unstr_t *dst = unstr_init_memory(1);
+	unstr_t *text = unstr_init("1<>2<>3<>4<>5<>6<>7<>8<>9<>0<>");
+	char *ans[11] = {"1", "2", "3", "4", "5", "6", "7", "8", "9", "0", ""};
+
+	check_assert(unstr_strtok_into(NULL, text, "<>", &index) == UNSTRING_FALSE);
+	check_assert(unstr_strtok_into(dst, NULL, "<>", &index) == UNSTRING_FALSE);
+	check_assert(unstr_strtok_into(dst, text, "", &index) == UNSTRING_FALSE);
+	check_assert(unstr_strtok_into(dst, text, "<>", NULL) == UNSTRING_FALSE);
+
+	while(unstr_strtok_into(dst, text, "<>", &index)){
+		check_unstr_char(dst, ans[i]);
+		i++;
+	}
+	check_int(i, 11);
+
+	unstr_delete(2, dst, text);
+}
+
 static void test_unstr_repeat(void)
 {
 	unstr_t *ret = 0;
@@ -906,10 +1491,196 @@ static void test_unstr_repeat(void)
 	ret = unstr_repeat(str, 5);
 	check_unstr_char(ret, "unkounkounkounkounko");
 	unstr_free(ret);
+	ret = unstr_repeat(str, 1);
+	check_unstr_char(ret, "unko");
+	unstr_free(ret);
+	ret = unstr_repeat(str, (size_t)-1);
+	check_null(ret);
+
+	unstr_strcpy_char(str, "u");
+	ret = unstr_repeat(str, 7);
+	check_unstr_char(ret, "uuuuuuu");
+	unstr_free(ret);
 
 	unstr_delete(3, ret, emp, str);
 }
 
+static void test_unstr_repeat_into(void)
+{
+	unstr_t *dst = unstr_init("unkokkokussakusa");
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_t *str = unstr_init("unko");
+
+	check_assert(unstr_repeat_into(NULL, str, 2) == UNSTRING_FALSE);
+	check_assert(unstr_repeat_into(dst, emp, 2) == UNSTRING_FALSE);
+	check_assert(unstr_repeat_into(dst, str, 0) == UNSTRING_FALSE);
+	check_assert(unstr_repeat_into(dst, str, (size_t)-1) == UNSTRING_FALSE);
+	check_unstr_char(dst, "unkokkokussakusa");
+
+	check_assert(unstr_repeat_into(dst, str, 3) == UNSTRING_TRUE);
+	check_unstr_char(dst, "unkounkounko");
+	check_assert(unstr_repeat_into(dst, str, 1) == UNSTRING_TRUE);
+	check_unstr_char(dst, "unko");
+	/* その場で繰り返す */
+	check_assert(unstr_repeat_into(str, str, 5) == UNSTRING_TRUE);
+	check_unstr_char(str, "unkounkounkounkounko");
+	unstr_strcpy_char(str, "u");
+	check_assert(unstr_repeat_into(str, str, 7) == UNSTRING_TRUE);
+	check_unstr_char(str, "uuuuuuu");
+
+	unstr_delete(3, dst, emp, str);
+}
+
+static void test_unstr_strpos_batch(void)
+{
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_t *search = unstr_init("ko");
+	unstr_t *list[4];
+	unstr_view_t views[3];
+	int result[4];
+
+	list[0] = unstr_init("unko");
+	list[1] = unstr_init("unun");
+	list[2] = NULL;
+	list[3] = unstr_init("kokko");
+	check_int(unstr_strpos_batch(NULL, 4, search, result), 0);
+	check_int(unstr_strpos_batch(list, 4, emp, result), 0);
+	check_int(result[0], -1);
+	check_int(result[3], -1);
+
+	check_int(unstr_strpos_batch(list, 4, search, result), 2);
+	check_int(result[0], 2);
+	check_int(result[1], -1);
+	check_int(result[2], -1);
+	check_int(result[3], 0);
+	check_int(unstr_strpos_batch(list, 4, search, NULL), 2);
+
+	/* 範囲の外は検索しない */
+	views[0].data = list[3]->data + 1;
+	views[0].length = 4;
+	views[1].data = list[0]->data;
+	views[1].length = 3;
+	views[2].data = NULL;
+	views[2].length = 0;
+	check_int(unstr_strpos_batch_view(views, 3, search, result), 1);
+	check_int(result[0], 2);
+	check_int(result[1], -1);
+	check_int(result[2], -1);
+
+	unstr_delete(5, emp, search, list[0], list[1], list[3]);
+}
+
+static void test_unstr_substr_count_batch(void)
+{
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_t *search = unstr_init("ko");
+	unstr_t *list[3];
+	unstr_view_t views[2];
+	size_t result[3];
+
+	list[0] = unstr_init("unkokkokokkokokkokokekokko");
+	list[1] = NULL;
+	list[2] = unstr_init("kokko");
+	check_int(unstr_substr_count_batch(NULL, 3, search, result), 0);
+	check_int(unstr_substr_count_batch(list, 3, emp, result), 0);
+	check_int(result[0], 0);
+
+	check_int(unstr_substr_count_batch(list, 3, search, result), 11);
+	check_int(result[0], 9);
+	check_int(result[1], 0);
+	check_int(result[2], 2);
+
+	views[0].data = list[2]->data;
+	views[0].length = 4;
+	views[1].data = list[0]->data;
+	views[1].length = 0;
+	check_int(unstr_substr_count_batch_view(views, 2, search, result), 1);
+	check_int(result[0], 1);
+	check_int(result[1], 0);
+
+	unstr_delete(4, emp, search, list[0], list[2]);
+}
+
+static void test_unstr_strcmp_batch(void)
+{
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_t *s2 = unstr_init("unko");
+	unstr_t *list[5];
+	unstr_view_t views[3];
+	int result[5];
+
+	list[0] = unstr_init("unko");
+	list[1] = unstr_init("unk");
+	list[2] = unstr_init("anko");
+	list[3] = unstr_init("unkp");
+	list[4] = NULL;
+	check_int(unstr_strcmp_batch(NULL, 5, s2, result), 0);
+	check_int(unstr_strcmp_batch(list, 5, NULL, result), 0);
+	check_int(result[0], 0x100);
+
+	check_int(unstr_strcmp_batch(list, 5, s2, result), 1);
+	check_int(result[0], 0);
+	check_int(result[1], 0x100);
+	check_assert(result[2] < 0);
+	check_assert(result[3] > 0);
+	check_int(result[4], 0x100);
+
+	views[0].data = list[0]->data;
+	views[0].length = 4;
+	views[1].data = list[0]->data;
+	views[1].length = 0;
+	views[2].data = NULL;
+	views[2].length = 0;
+	check_int(unstr_strcmp_batch_view(views, 3, emp, result), 1);
+	check_int(result[0], 0x100);
+	check_int(result[1], 0);
+	check_int(result[2], 0x100);
+
+	unstr_delete(6, emp, s2, list[0], list[1], list[2], list[3]);
+}
+
+static void test_unstr_replace_batch(void)
+{
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_t *search = unstr_init("ko");
+	unstr_t *replace = unstr_init("unko");
+	unstr_t *list[3];
+	unstr_t *dst[3];
+	unstr_view_t views[2];
+
+	list[0] = unstr_init("unkokko");
+	list[1] = unstr_init_memory(1);
+	list[2] = unstr_init("kunko");
+	dst[0] = NULL;
+	dst[1] = unstr_init("unkokkokussakusa");
+	dst[2] = NULL;
+	check_assert(unstr_replace_batch(NULL, list, 3, search, replace) == UNSTRING_FALSE);
+	check_assert(unstr_replace_batch(dst, NULL, 3, search, replace) == UNSTRING_FALSE);
+	check_assert(unstr_replace_batch(dst, list, 3, emp, replace) == UNSTRING_FALSE);
+	check_assert(unstr_replace_batch(dst, list, 3, search, NULL) == UNSTRING_FALSE);
+
+	check_assert(unstr_replace_batch(dst, list, 3, search, replace) == UNSTRING_TRUE);
+	check_unstr_char(dst[0], "ununkokunko");
+	check_unstr_char(dst[1], "");
+	check_unstr_char(dst[2], "kununko");
+
+	/* その場で置換する */
+	check_assert(unstr_replace_batch(list, list, 3, search, emp) == UNSTRING_TRUE);
+	check_unstr_char(list[0], "unk");
+	check_unstr_char(list[1], "");
+	check_unstr_char(list[2], "kun");
+
+	views[0].data = dst[0]->data + 2;
+	views[0].length = 4;
+	views[1].data = NULL;
+	views[1].length = 0;
+	check_assert(unstr_replace_batch_view(list, views, 2, search, emp) == UNSTRING_TRUE);
+	check_unstr_char(list[0], "un");
+	check_unstr_char(list[1], "");
+
+	unstr_delete(9, emp, search, replace, list[0], list[1], list[2], dst[0], dst[1], dst[2]);
+}
+
 static void test_unstr_repeat_char(void)
 {
 	unstr_t *ret = 0;
@@ -932,3 +1703,670 @@ static void test_unstr_repeat_char(void)
 	unstr_free(ret);
 }
 
+
+static void test_unstr_toupper(void)
+{
+	unstr_t *str = unstr_init("unko-UNKO-0123456789-abcdefghijklmnopqrstuvwxyz-\xe3\x81\x82z");
+	check_assert(unstr_toupper(NULL) == UNSTRING_FALSE);
+	check_assert(unstr_toupper(str) == UNSTRING_TRUE);
+	check_unstr_char(str, "UNKO-UNKO-0123456789-ABCDEFGHIJKLMNOPQRSTUVWXYZ-\xe3\x81\x82Z");
+	check_assert(unstr_tolower(NULL) == UNSTRING_FALSE);
+	check_assert(unstr_tolower(str) == UNSTRING_TRUE);
+	check_unstr_char(str, "unko-unko-0123456789-abcdefghijklmnopqrstuvwxyz-\xe3\x81\x82z");
+	unstr_free(str);
+}
+
+static void test_unstr_strcasecmp(void)
+{
+	unstr_t *str = unstr_init("Content-Length");
+	unstr_t *ans = unstr_init("content-LENGTH");
+	unstr_t *ans_fail = unstr_init("content-lengti");
+	unstr_t *emp = unstr_init_memory(1);
+	check_assert(unstr_strcasecmp(NULL, str) == 0x100);
+	check_assert(unstr_strcasecmp(str, NULL) == 0x100);
+	check_assert(unstr_strcasecmp(str, emp) == 0x100);
+
+	check_assert(unstr_strcasecmp(str, ans) == 0);
+	check_assert(unstr_strcasecmp(str, ans_fail) < 0);
+	check_assert(unstr_strcasecmp(ans_fail, str) > 0);
+
+	unstr_delete(4, str, ans, ans_fail, emp);
+}
+
+static void test_unstr_stripos(void)
+{
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_t *text = unstr_init("Host: example.com\r\nContent-Type: text/html");
+	unstr_t *search = unstr_init("content-type");
+
+	check_assert(unstr_stripos(NULL, search) < 0);
+	check_assert(unstr_stripos(emp, search) < 0);
+	check_assert(unstr_stripos(text, NULL) < 0);
+	check_assert(unstr_stripos(text, emp) < 0);
+
+	check_int(unstr_stripos(text, search), 19);
+	unstr_strcpy_char(search, "HOST");
+	check_int(unstr_stripos(text, search), 0);
+	unstr_strcpy_char(search, "TEXT/HTMLX");
+	check_assert(unstr_stripos(text, search) < 0);
+
+	unstr_delete(3, emp, text, search);
+}
+
+static void test_unstr_substr_icount(void)
+{
+	unstr_t *emp = unstr_init_memory(1);
+	unstr_t *text = unstr_init("unKokkoKOkokkOkokkokokekokko");
+	unstr_t *search = unstr_init("Ko");
+
+	check_int(unstr_substr_icount(NULL, search), 0);
+	check_int(unstr_substr_icount(emp, search), 0);
+	check_int(unstr_substr_icount(text, NULL), 0);
+	check_int(unstr_substr_icount(text, emp), 0);
+	check_int(unstr_substr_icount(text, search), 10);
+
+	unstr_delete(3, emp, text, search);
+}
+
+static void test_unstr_utf8_valid(void)
+{
+	/* 「あいうえお」とASCIIを混ぜて16バイトを超える長さにする */
+	unstr_t *str = unstr_init("0123456789abcdef\xe3\x81\x82\xe3\x81\x84\xe3\x81\x86\xe3\x81\x88\xe3\x81\x8a-\xf0\x9f\x8d\xa3-\xc3\xa9");
+	unstr_t *bad = unstr_init_memory(8);
+	check_assert(unstr_utf8_valid(NULL) == UNSTRING_FALSE);
+	check_assert(unstr_utf8_valid(str) == UNSTRING_TRUE);
+	unstr_zero(str);
+	check_assert(unstr_utf8_valid(str) == UNSTRING_TRUE);
+	/* 途中で切れた文字 */
+	unstr_strcpy_char(bad, "0123456789abcdef\xe3\x81");
+	check_assert(unstr_utf8_valid(bad) == UNSTRING_FALSE);
+	/* 単独の継続バイト */
+	unstr_strcpy_char(bad, "a\x80");
+	check_assert(unstr_utf8_valid(bad) == UNSTRING_FALSE);
+	/* 冗長な表現 */
+	unstr_strcpy_char(bad, "\xc0\xaf");
+	check_assert(unstr_utf8_valid(bad) == UNSTRING_FALSE);
+	unstr_strcpy_char(bad, "\xe0\x80\xaf");
+	check_assert(unstr_utf8_valid(bad) == UNSTRING_FALSE);
+	/* サロゲート */
+	unstr_strcpy_char(bad, "\xed\xa0\x80");
+	check_assert(unstr_utf8_valid(bad) == UNSTRING_FALSE);
+	/* U+10FFFFを超える */
+	unstr_strcpy_char(bad, "\xf4\x90\x80\x80");
+	check_assert(unstr_utf8_valid(bad) == UNSTRING_FALSE);
+	unstr_strcpy_char(bad, "\xf4\x8f\xbf\xbf");
+	check_assert(unstr_utf8_valid(bad) == UNSTRING_TRUE);
+	unstr_delete(2, str, bad);
+}
+
+static void test_unstr_utf8_strlen(void)
+{
+	unstr_t *str = unstr_init("\xe3\x81\x82\xe3\x81\x84\xe3\x81\x86\xe3\x81\x88\xe3\x81\x8a\xe3\x81\x8b\xe3\x81\x8d-unko");
+	check_int(unstr_utf8_strlen(NULL), 0);
+	check_int(unstr_utf8_strlen(str), 12);
+	unstr_strcpy_char(str, "unko");
+	check_int(unstr_utf8_strlen(str), 4);
+	unstr_zero(str);
+	check_int(unstr_utf8_strlen(str), 0);
+	unstr_free(str);
+}
+
+static void test_unstr_utf8_offset(void)
+{
+	unstr_t *str = unstr_init("\xe3\x81\x82\xe3\x81\x84\xe3\x81\x86\xe3\x81\x88\xe3\x81\x8a\xe3\x81\x8b\xe3\x81\x8d-unko");
+	check_assert(unstr_utf8_offset(NULL, 0) == UNSTRING_NPOS);
+	check_int(unstr_utf8_offset(str, 0), 0);
+	check_int(unstr_utf8_offset(str, 1), 3);
+	check_int(unstr_utf8_offset(str, 6), 18);
+	check_int(unstr_utf8_offset(str, 7), 21);
+	check_int(unstr_utf8_offset(str, 12), 26);
+	check_assert(unstr_utf8_offset(str, 13) == UNSTRING_NPOS);
+	unstr_free(str);
+}
+
+static void test_unstr_utf8_substr(void)
+{
+	unstr_t *str = unstr_init("\xe3\x81\x82\xe3\x81\x84\xe3\x81\x86\xe3\x81\x88\xe3\x81\x8a\xe3\x81\x8b\xe3\x81\x8d-unko");
+	unstr_t *data = unstr_init_memory(8);
+	check_assert(unstr_utf8_substr(NULL, str, 0, 1) == UNSTRING_FALSE);
+	check_assert(unstr_utf8_substr(data, NULL, 0, 1) == UNSTRING_FALSE);
+	check_assert(unstr_utf8_substr(data, str, 1, 2) == UNSTRING_TRUE);
+	check_unstr_char(data, "\xe3\x81\x84\xe3\x81\x86");
+	check_assert(unstr_utf8_substr(data, str, 6, 100) == UNSTRING_TRUE);
+	check_unstr_char(data, "\xe3\x81\x8d-unko");
+	check_assert(unstr_utf8_substr(data, str, 12, 1) == UNSTRING_TRUE);
+	check_unstr_char(data, "");
+	check_assert(unstr_utf8_substr(data, str, 13, 1) == UNSTRING_FALSE);
+	unstr_delete(2, str, data);
+}
+
+static void test_unstr_utf8_reverse(void)
+{
+	unstr_t *str = unstr_init("0123456789abcdef\xe3\x81\x82\xe3\x81\x84-\xf0\x9f\x8d\xa3");
+	unstr_t *data = 0;
+	check_null(unstr_utf8_reverse(NULL));
+	data = unstr_utf8_reverse(str);
+	check_unstr_char(data, "\xf0\x9f\x8d\xa3-\xe3\x81\x84\xe3\x81\x82" "fedcba9876543210");
+	unstr_free(data);
+	/* 単独の継続バイトは1バイトずつ */
+	unstr_strcpy_char(str, "a\x80\x81");
+	data = unstr_utf8_reverse(str);
+	check_unstr_char(data, "\x81\x80" "a");
+	unstr_delete(2, str, data);
+}
+
+static void test_unstr_regex_compile(void)
+{
+	const char *bad[] = {"(", "a)", "*a", "a|+", "[a", "[b-a]", "[[:unko:]]", "a{2,1}", "a{1001}", "a{", "\\", "\\x6"};
+	size_t i = 0;
+	unstr_regex_t *re = 0;
+	check_null(unstr_regex_compile(NULL));
+	for(i = 0; i < (sizeof(bad) / sizeof(bad[0])); i++){
+		check_null(unstr_regex_compile(bad[i]));
+	}
+	re = unstr_regex_compile("");
+	check_assert(re != NULL);
+	unstr_regex_free(re);
+	re = unstr_regex_compile("(a|b)*[]x-]{2,}[^[:digit:]]\\d+\\.$");
+	check_assert(re != NULL);
+	unstr_regex_free(re);
+	unstr_regex_free(NULL);
+}
+
+static void test_unstr_regex_match(void)
+{
+	unstr_regex_t *re = unstr_regex_compile("[a-z]+(-[a-z]+)*@[a-z]+\\.(com|jp)");
+	unstr_t *str = unstr_init("unko-kusa@unko.jp");
+	unstr_t *emp = unstr_init_memory(1);
+
+	check_assert(unstr_regex_match(NULL, str) == UNSTRING_FALSE);
+	check_assert(unstr_regex_match(re, NULL) == UNSTRING_FALSE);
+	check_assert(unstr_regex_match(re, str) == UNSTRING_TRUE);
+	check_assert(unstr_regex_match(re, emp) == UNSTRING_FALSE);
+	/* 全体が一致しなければならない */
+	unstr_strcpy_char(str, "unko@unko.jpn");
+	check_assert(unstr_regex_match(re, str) == UNSTRING_FALSE);
+	unstr_strcpy_char(str, "-unko@unko.com");
+	check_assert(unstr_regex_match(re, str) == UNSTRING_FALSE);
+	unstr_regex_free(re);
+
+	re = unstr_regex_compile("(ab)*");
+	check_assert(unstr_regex_match(re, emp) == UNSTRING_TRUE);
+	unstr_strcpy_char(str, "ababab");
+	check_assert(unstr_regex_match(re, str) == UNSTRING_TRUE);
+	unstr_strcpy_char(str, "ababa");
+	check_assert(unstr_regex_match(re, str) == UNSTRING_FALSE);
+	unstr_regex_free(re);
+
+	/* ^と$は幅を持たないので続けて書いても一致する */
+	re = unstr_regex_compile("^^a");
+	unstr_strcpy_char(str, "a");
+	check_assert(unstr_regex_match(re, str) == UNSTRING_TRUE);
+	unstr_regex_free(re);
+	re = unstr_regex_compile("a$$");
+	check_assert(unstr_regex_match(re, str) == UNSTRING_TRUE);
+	unstr_regex_free(re);
+	re = unstr_regex_compile("(a$|b)$");
+	check_assert(unstr_regex_match(re, str) == UNSTRING_TRUE);
+	unstr_regex_free(re);
+	re = unstr_regex_compile("^(^a|b)");
+	unstr_strcpy_char(str, "ab");
+	check_assert(unstr_regex_match(re, str) == UNSTRING_FALSE);
+	unstr_strcpy_char(str, "a");
+	check_assert(unstr_regex_match(re, str) == UNSTRING_TRUE);
+	unstr_regex_free(re);
+	re = unstr_regex_compile("x?$$");
+	check_assert(unstr_regex_match(re, emp) == UNSTRING_TRUE);
+	unstr_regex_free(re);
+
+	unstr_delete(2, str, emp);
+}
+
+static void test_unstr_regex_search(void)
+{
+	unstr_regex_t *re = unstr_regex_compile("ko+");
+	unstr_t *str = unstr_init("unkokkoookussakusa");
+	unstr_view_t view;
+
+	check_int(unstr_regex_search(NULL, str, 0, &view), -1);
+	check_int(unstr_regex_search(re, NULL, 0, &view), -1);
+	check_int(unstr_regex_search(re, str, 100, &view), -1);
+
+	check_int(unstr_regex_search(re, str, 0, &view), 2);
+	check_int(view.length, 2);
+	check_assert(view.data == str->data + 2);
+	check_int(unstr_regex_search(re, str, 3, &view), 5);
+	check_int(view.length, 4);
+	check_int(unstr_regex_search(re, str, 9, NULL), -1);
+	unstr_regex_free(re);
+
+	/* 最も左から始まるものの中で最も長いもの */
+	re = unstr_regex_compile("a|ab|abc|bcd");
+	unstr_strcpy_char(str, "xabcd");
+	check_int(unstr_regex_search(re, str, 0, &view), 1);
+	check_int(view.length, 3);
+	unstr_regex_free(re);
+
+	/* ^と$は文字列の先頭と末尾にだけ一致する */
+	re = unstr_regex_compile("^un|sa$");
+	unstr_strcpy_char(str, "unkokusa");
+	check_int(unstr_regex_search(re, str, 0, &view), 0);
+	check_int(unstr_regex_search(re, str, 1, &view), 6);
+	check_int(view.length, 2);
+	unstr_regex_free(re);
+
+	/* 同じ位置で続く^や$も読む */
+	re = unstr_regex_compile("$$");
+	unstr_zero(str);
+	check_int(unstr_regex_search(re, str, 0, &view), 0);
+	check_int(view.length, 0);
+	unstr_strcpy_char(str, "unko");
+	check_int(unstr_regex_search(re, str, 0, &view), 4);
+	unstr_regex_free(re);
+	re = unstr_regex_compile("^^");
+	unstr_zero(str);
+	check_int(unstr_regex_search(re, str, 0, &view), 0);
+	unstr_regex_free(re);
+	re = unstr_regex_compile("x?$$");
+	unstr_strcpy_char(str, "unkox");
+	check_int(unstr_regex_search(re, str, 0, &view), 4);
+	check_int(view.length, 1);
+	unstr_regex_free(re);
+	re = unstr_regex_compile("(a$|b)$");
+	unstr_strcpy_char(str, "a");
+	check_int(unstr_regex_search(re, str, 0, &view), 0);
+	check_int(view.length, 1);
+	unstr_regex_free(re);
+	re = unstr_regex_compile("^(^a|b)");
+	unstr_strcpy_char(str, "ab");
+	check_int(unstr_regex_search(re, str, 0, &view), 0);
+	check_int(view.length, 1);
+	unstr_regex_free(re);
+
+	re = unstr_regex_compile("[[:upper:]]\\w*");
+	unstr_strcpy_char(str, "unko Kusa_2 sa");
+	check_int(unstr_regex_search(re, str, 0, &view), 5);
+	check_int(view.length, 6);
+	unstr_regex_free(re);
+
+	unstr_free(str);
+}
+
+static void test_unstr_regex_find_all(void)
+{
+	unstr_regex_t *re = unstr_regex_compile("[0-9]+");
+	unstr_t *str = unstr_init("a1b22c333d");
+	unstr_view_t views[4];
+
+	check_int(unstr_regex_find_all(NULL, str, views, 4), 0);
+	check_int(unstr_regex_find_all(re, NULL, views, 4), 0);
+	check_int(unstr_regex_find_all(re, str, NULL, 0), 3);
+	check_int(unstr_regex_find_all(re, str, views, 2), 2);
+	check_int(unstr_regex_find_all(re, str, views, 4), 3);
+	check_assert((views[0].data == str->data + 1) && (views[0].length == 1));
+	check_assert((views[1].data == str->data + 3) && (views[1].length == 2));
+	check_assert((views[2].data == str->data + 6) && (views[2].length == 3));
+	unstr_regex_free(re);
+
+	/* 空文字列に一致したら1文字進める */
+	re = unstr_regex_compile("b*");
+	unstr_strcpy_char(str, "abba");
+	check_int(unstr_regex_find_all(re, str, views, 4), 4);
+	check_assert((views[0].data == str->data) && (views[0].length == 0));
+	check_assert((views[1].data == str->data + 1) && (views[1].length == 2));
+	check_assert((views[2].data == str->data + 3) && (views[2].length == 0));
+	check_assert((views[3].data == str->data + 4) && (views[3].length == 0));
+	unstr_regex_free(re);
+
+	unstr_free(str);
+}
+
+static void test_unstr_bin2hex(void)
+{
+	unstr_t *str = unstr_init_memory(1);
+	unstr_t *data = unstr_init_memory(1);
+	unstr_write(str, "\x00\x01\x7f\x80\xab\xff unko 0123456789", 0, 22);
+	check_assert(unstr_bin2hex(NULL, str) == UNSTRING_FALSE);
+	check_assert(unstr_bin2hex(data, NULL) == UNSTRING_FALSE);
+	check_assert(unstr_bin2hex(data, str) == UNSTRING_TRUE);
+	check_unstr_char(data, "00017f80abff20756e6b6f2030313233343536373839");
+	check_int(data->length, 44);
+	/* 同じ文字列を渡した場合 */
+	unstr_strcpy_char(str, "ab");
+	check_assert(unstr_bin2hex(str, str) == UNSTRING_TRUE);
+	check_unstr_char(str, "6162");
+	unstr_zero(str);
+	check_assert(unstr_bin2hex(data, str) == UNSTRING_TRUE);
+	check_unstr_char(data, "");
+	unstr_delete(2, str, data);
+}
+
+static void test_unstr_hex2bin(void)
+{
+	unstr_t *str = unstr_init("00017F80abFF20756e6b6f2030313233343536373839");
+	unstr_t *data = unstr_init_memory(1);
+	check_assert(unstr_hex2bin(NULL, str) == UNSTRING_FALSE);
+	check_assert(unstr_hex2bin(data, NULL) == UNSTRING_FALSE);
+	check_assert(unstr_hex2bin(data, str) == UNSTRING_TRUE);
+	check_int(data->length, 22);
+	check_assert(memcmp(data->data, "\x00\x01\x7f\x80\xab\xff unko 0123456789", 22) == 0);
+	/* 不正な入力は失敗し、空文字列になる */
+	unstr_strcpy_char(str, "0123456789abcdef0123456789abcdef0g");
+	check_assert(unstr_hex2bin(data, str) == UNSTRING_FALSE);
+	check_unstr_char(data, "");
+	unstr_strcpy_char(str, "0123456789abcdef0123456789abcdeg01");
+	check_assert(unstr_hex2bin(data, str) == UNSTRING_FALSE);
+	unstr_strcpy_char(str, "abc");
+	check_assert(unstr_hex2bin(data, str) == UNSTRING_FALSE);
+	unstr_strcpy_char(str, "7a");
+	check_assert(unstr_hex2bin(str, str) == UNSTRING_TRUE);
+	check_unstr_char(str, "z");
+	unstr_delete(2, str, data);
+}
+
+static void test_unstr_base64_encode(void)
+{
+	unstr_t *str = unstr_init("unko");
+	unstr_t *data = unstr_init_memory(1);
+	check_assert(unstr_base64_encode(NULL, str) == UNSTRING_FALSE);
+	check_assert(unstr_base64_encode(data, NULL) == UNSTRING_FALSE);
+	check_assert(unstr_base64_encode(data, str) == UNSTRING_TRUE);
+	check_unstr_char(data, "dW5rbw==");
+	unstr_strcpy_char(str, "unk");
+	unstr_base64_encode(data, str);
+	check_unstr_char(data, "dW5r");
+	unstr_strcpy_char(str, "unkou");
+	unstr_base64_encode(data, str);
+	check_unstr_char(data, "dW5rb3U=");
+	unstr_write(str, "\xfb\xff\xbf unkokusaiunkokusaiunko", 0, 26);
+	unstr_base64_encode(data, str);
+	check_unstr_char(data, "+/+/IHVua29rdXNhaXVua29rdXNhaXVua28=");
+	check_assert(unstr_base64_encode(str, str) == UNSTRING_TRUE);
+	check_unstr(str, data);
+	unstr_delete(2, str, data);
+}
+
+static void test_unstr_base64_decode(void)
+{
+	unstr_t *str = unstr_init("+/+/IHVua29rdXNhaXVua29rdXNhaXVua28=");
+	unstr_t *data = unstr_init_memory(1);
+	const char *bad[] = {"dW5rbw=", "dW5rb===", "dW=rbw==", "dW5r\nbw==", "dW5rbw==dW5r", "dW5r-w==", "dW5rdW5rdW5rdW5r*W5rdW5r"};
+	size_t i = 0;
+	check_assert(unstr_base64_decode(NULL, str) == UNSTRING_FALSE);
+	check_assert(unstr_base64_decode(data, NULL) == UNSTRING_FALSE);
+	check_assert(unstr_base64_decode(data, str) == UNSTRING_TRUE);
+	check_int(data->length, 26);
+	check_assert(memcmp(data->data, "\xfb\xff\xbf unkokusaiunkokusaiunko", 26) == 0);
+	unstr_strcpy_char(str, "dW5rb3U=");
+	check_assert(unstr_base64_decode(data, str) == UNSTRING_TRUE);
+	check_unstr_char(data, "unkou");
+	/* 不正な入力は失敗し、空文字列になる */
+	for(i = 0; i < (sizeof(bad) / sizeof(bad[0])); i++){
+		unstr_strcpy_char(str, bad[i]);
+		check_assert(unstr_base64_decode(data, str) == UNSTRING_FALSE);
+		check_unstr_char(data, "");
+	}
+	unstr_strcpy_char(str, "dW5rbw==");
+	check_assert(unstr_base64_decode(str, str) == UNSTRING_TRUE);
+	check_unstr_char(str, "unko");
+	unstr_delete(2, str, data);
+}
+
+static void test_unstr_index_init(void)
+{
+	unstr_t *str = unstr_init("unkokkokussakusaunkounkokko");
+	unstr_t *tmp = unstr_init("");
+	unstr_index_t *idx = 0;
+	const char *words[] = {"unko", "kko", "k", "kusa", "unkokkokussakusaunkounkokko", "unkoo", "z", "kokkokusa"};
+	size_t pos[8];
+	size_t i = 0;
+	check_assert(unstr_index_init(NULL) == NULL);
+	idx = unstr_index_init(tmp);
+	check_assert(idx != NULL);
+	check_int(unstr_index_count(idx, str), 0);
+	check_assert(unstr_index_first(idx, str) == UNSTRING_NPOS);
+	unstr_index_free(idx);
+
+	idx = unstr_index_init(str);
+	check_int(unstr_index_count(NULL, str), 0);
+	check_int(unstr_index_count(idx, NULL), 0);
+	check_int(unstr_index_count(idx, tmp), 0);
+	check_assert(unstr_index_first(idx, tmp) == UNSTRING_NPOS);
+	/* 索引を使わない関数と同じ結果になる */
+	for(i = 0; i < (sizeof(words) / sizeof(words[0])); i++){
+		unstr_strcpy_char(tmp, words[i]);
+		check_int(unstr_index_count(idx, tmp), unstr_substr_count(str, tmp));
+		check_int(unstr_index_first(idx, tmp), unstr_strpos(str, tmp));
+	}
+	/* 出現位置は昇順で返す */
+	unstr_strcpy_char(tmp, "ko");
+	check_int(unstr_index_all(idx, tmp, NULL, 0), 5);
+	check_int(unstr_index_all(idx, tmp, pos, 8), 5);
+	check_int(pos[0], 2);
+	check_int(pos[1], 5);
+	check_int(pos[2], 18);
+	check_int(pos[3], 22);
+	check_int(pos[4], 25);
+	/* 格納先が足りない場合は先頭から詰められるだけ詰める */
+	check_int(unstr_index_all(idx, tmp, pos, 2), 5);
+	check_int(pos[0], 2);
+	check_int(pos[1], 5);
+	/* 作成後に元の文字列を変更しても影響しない */
+	unstr_strcpy_char(str, "zzz");
+	check_int(unstr_index_count(idx, tmp), 5);
+	unstr_index_free(idx);
+	unstr_index_free(NULL);
+	unstr_delete(2, str, tmp);
+}
+
+static void test_unstr_index_save(void)
+{
+	unstr_t *str = unstr_init_memory(1);
+	unstr_t *file = unstr_init("unstring_test_index.tmp");
+	unstr_t *tmp = unstr_init("abra");
+	unstr_index_t *idx = 0;
+	unstr_index_t *load = 0;
+	FILE *fp = 0;
+	size_t i = 0;
+	unstr_write(str, "abracadabra\0abracadabra", 0, 23);
+	idx = unstr_index_init(str);
+	check_assert(unstr_index_save(NULL, file) == UNSTRING_FALSE);
+	check_assert(unstr_index_save(idx, NULL) == UNSTRING_FALSE);
+	check_assert(unstr_index_save(idx, file) == UNSTRING_TRUE);
+	check_assert(unstr_index_load(NULL) == NULL);
+	load = unstr_index_load(file);
+	check_assert(load != NULL);
+	check_int(unstr_index_count(load, tmp), 4);
+	check_int(unstr_index_first(load, tmp), 0);
+	unstr_write(tmp, "a\0a", 0, 3);
+	check_int(unstr_index_count(load, tmp), 1);
+	check_int(unstr_index_first(load, tmp), 10);
+	unstr_index_free(load);
+
+	/* 接尾辞配列の値が範囲外のファイルは読み込まない */
+	fp = fopen(file->data, "r+b");
+	fseek(fp, -64, SEEK_END);
+	for(i = 0; i < 64; i++){
+		fputc(0xff, fp);
+	}
+	fclose(fp);
+	check_assert(unstr_index_load(file) == NULL);
+
+	/* 壊れたファイルは読み込まない */
+	fp = fopen(file->data, "wb");
+	fwrite("UNSTRIDX", 1, 8, fp);
+	fclose(fp);
+	check_assert(unstr_index_load(file) == NULL);
+	remove(file->data);
+	check_assert(unstr_index_load(file) == NULL);
+	unstr_index_free(idx);
+	unstr_delete(3, str, file, tmp);
+}
+
+static void test_unstr_stats(void)
+{
+	unstr_stats_t before;
+	unstr_stats_t after;
+	unstr_stats_t total;
+	unstr_t *str = 0;
+	unstr_t *tmp = 0;
+	size_t heap = 0;
+	size_t index = 0;
+	size_t i = 0;
+
+	check_assert(unstr_stats_snapshot(NULL) == UNSTRING_FALSE);
+	if(unstr_stats_snapshot(&before) == UNSTRING_FALSE){
+		/* 統計無効時は0で埋められる */
+		check_int(before.alloc_count, 0);
+		check_int(before.heap_live, 0);
+		return;
+	}
+	str = unstr_init("unkokkokussakusa");
+	unstr_strcat_char(str, "unkokkokussakusaunkokkokussakusa");
+	unstr_stats_snapshot(&after);
+	check_assert(after.alloc_count >= before.alloc_count + 2);
+	check_assert(after.realloc_count > before.realloc_count);
+	check_assert(after.heap_live >= before.heap_live + (long)str->heap);
+	check_assert(after.heap_peak >= after.heap_live);
+
+	before = after;
+	heap = str->heap;
+	unstr_free(str);
+	unstr_stats_snapshot(&after);
+	check_int(after.free_count, before.free_count + 1);
+	check_int(after.heap_live, before.heap_live - (long)heap);
+	check_assert(after.freed_heap > after.freed_length);
+
+	/* 書き込み先を使い回すと、足りるようになった後は確保しない */
+	str = unstr_init("unko,kokko,kussa");
+	tmp = unstr_init_memory(1);
+	for(i = 0; i < 3; i++){
+		if(i == 2){
+			unstr_stats_snapshot(&before);
+		}
+		unstr_itoa_into(tmp, 1234567890, 10);
+		unstr_repeat_into(tmp, str, 3);
+		unstr_reverse_into(tmp, str);
+		unstr_strcpy(tmp, str);
+		index = 0;
+		while(unstr_strtok_into(tmp, str, ",", &index));
+	}
+	unstr_stats_snapshot(&after);
+	check_int(after.alloc_count + after.realloc_count, before.alloc_count + before.realloc_count);
+	unstr_delete(2, str, tmp);
+
+	memset(&total, 0, sizeof(total));
+	unstr_stats_merge(&total, &before);
+	unstr_stats_merge(&total, &after);
+	check_int(total.free_count, before.free_count + after.free_count);
+
+	unstr_stats_reset();
+	unstr_stats_snapshot(&after);
+	check_int(after.alloc_count, 0);
+}
+
+static void test_trace_hook(unstr_trace_id_t id, size_t bytes, unsigned long long nsec, void *arg)
+{
+	size_t *count = arg;
+	unstr_t *str = 0;
+	(void)bytes;
+	(void)nsec;
+	if(id == UNSTR_TRACE_REPLACE){
+		(*count)++;
+	}
+	/* フックの中で呼んだ関数は計測されない */
+	str = unstr_init("unko");
+	unstr_free(str);
+}
+
+static void test_unstr_cache(void)
+{
+	unstr_t *str = 0;
+	unstr_t *data = 0;
+	unstr_t *header = 0;
+	char *buffer = 0;
+	/* 前のテストで開放した領域を空にしておく */
+	unstr_cache_release();
+	str = unstr_init("unko");
+	header = str;
+	buffer = str->data;
+	unstr_free(str);
+	/* 同じ大きさなら直前に開放した領域が使われる */
+	str = unstr_init("kuso");
+	data = unstr_init("unkokkokussakusaunkokkokussakusa");
+#ifdef UNSTRING_ENABLE_CACHE
+	check_assert(str == header);
+	check_assert(str->data == buffer);
+	check_assert(unstr_cache_release() == 0);
+#else
+	(void)header;
+	(void)buffer;
+#endif
+	check_unstr_char(str, "kuso");
+	check_unstr_char(data, "unkokkokussakusaunkokkokussakusa");
+	unstr_strcat(str, data);
+	check_unstr_char(str, "kusounkokkokussakusaunkokkokussakusa");
+	unstr_delete(2, str, data);
+#ifdef UNSTRING_ENABLE_CACHE
+	check_assert(unstr_cache_release() >= 4);
+#endif
+	check_int(unstr_cache_release(), 0);
+	/* 大きな領域は保持せずに開放する */
+	str = unstr_init_memory(1 << 20);
+	unstr_free(str);
+#ifdef UNSTRING_ENABLE_CACHE
+	check_int(unstr_cache_release(), 1);
+#endif
+	check_int(unstr_cache_release(), 0);
+}
+
+static void test_unstr_trace(void)
+{
+	unstr_trace_stat_t stats[UNSTR_TRACE_MAX];
+	unstr_trace_stat_t stat;
+	unstr_t *data = unstr_init("unkokkokokkokokkokokekokko");
+	unstr_t *search = unstr_init("ko");
+	unstr_t *replace = unstr_init("unko");
+	unstr_t *ret = 0;
+	unstr_t *json = 0;
+	size_t count = 0;
+
+	check_assert(unstr_trace_snapshot(NULL) == UNSTRING_FALSE);
+	check_char(unstr_trace_name(UNSTR_TRACE_REPLACE), "unstr_replace");
+	check_char(unstr_trace_name(UNSTR_TRACE_REPEAT_CHAR), "unstr_repeat_char");
+	check_null((void *)unstr_trace_name(UNSTR_TRACE_MAX));
+
+	memset(&stat, 0, sizeof(stat));
+	check_assert(unstr_trace_percentile(&stat, 50.0) == 0);
+	stat.calls = 4;
+	stat.histogram[3] = 1;
+	stat.histogram[16] = 2;
+	stat.histogram[17] = 1;
+	check_assert(unstr_trace_percentile(&stat, 0.0) == 3);
+	check_assert(unstr_trace_percentile(&stat, 50.0) == 16);
+	check_assert(unstr_trace_percentile(&stat, 100.0) == 18);
+
+	if(unstr_trace_snapshot(stats) == UNSTRING_FALSE){
+		/* 計測無効時は0で埋められる */
+		check_int(stats[UNSTR_TRACE_REPLACE].calls, 0);
+		unstr_delete(3, data, search, replace);
+		return;
+	}
+	unstr_trace_reset();
+	unstr_trace_set_hook(test_trace_hook, &count);
+	ret = unstr_replace(data, search, replace);
+	unstr_trace_set_hook(NULL, NULL);
+	check_int(count, 1);
+	unstr_trace_snapshot(stats);
+	check_int(stats[UNSTR_TRACE_REPLACE].calls, 1);
+	check_int(stats[UNSTR_TRACE_REPLACE].bytes, unstr_strlen(data));
+	check_int(stats[UNSTR_TRACE_INIT].calls, 0);
+
+	json = unstr_trace_json(NULL);
+	unstr_trace_snapshot(stats);
+	check_int(stats[UNSTR_TRACE_SPRINTF].calls, 0);
+	check_int(stats[UNSTR_TRACE_STRCAT_CHAR].calls, 0);
+	check_assert(unstr_strstr_char(json, "\"unstr_replace\":{\"calls\":1,") != NULL);
+
+	unstr_delete(5, data, search, replace, ret, json);
+}
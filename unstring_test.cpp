@@ -0,0 +1,448 @@
+#include "unstring.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#define check_macro(fname, ...)	\
+	do {						\
+		if(fname(__VA_ARGS__)){	\
+			std::printf("file:%s\nline:%u\nfunc:%s\n", __FILE__, __LINE__, __func__);	\
+			throw 1;			\
+			/* NOTREACHED */	\
+		}						\
+	} while(0)
+
+#define check_int(a, b)			check_macro(check_int_func, a, b)
+#define check_view(a, b)		check_macro(check_view_func, a, b)
+#define check_assert(a)			check_macro(check_assert_func, a)
+
+#define test(name)				test_box(test_##name, #name)
+
+typedef void (*FP)(void);
+
+static int check_int_func(long a, long b);
+static int check_view_func(std::string_view s1, std::string_view s2);
+static int check_assert_func(bool flag);
+
+static void test_box(FP test_func, const char *func_name);
+
+static void test_string_init(void);
+static void test_string_move(void);
+static void test_string_copy(void);
+static void test_string_adopt(void);
+static void test_string_append(void);
+static void test_string_find(void);
+static void test_string_substr(void);
+static void test_string_replace(void);
+static void test_searcher(void);
+static void test_searcher_template(void);
+static void test_string_concat(void);
+static void test_string_concat_alias(void);
+static void test_keyword_set(void);
+
+
+int main(void)
+{
+	try {
+		test(string_init);
+		test(string_move);
+		test(string_copy);
+		test(string_adopt);
+		test(string_append);
+		test(string_find);
+		test(string_substr);
+		test(string_replace);
+		test(searcher);
+		test(searcher_template);
+		test(string_concat);
+		test(string_concat_alias);
+		test(keyword_set);
+	} catch(...) {
+		std::printf("NG\n");
+	}
+	return 0;
+}
+
+static void test_box(FP test_func, const char *func_name)
+{
+	std::printf("test %s", func_name);
+	(*test_func)();
+	std::printf(" OK\n");
+}
+
+static int check_int_func(long a, long b)
+{
+	if(a != b){
+		std::printf("\n数値が一致しませんでした %ld != %ld\n", a, b);
+		return -1;
+	}
+	return 0;
+}
+
+static int check_view_func(std::string_view s1, std::string_view s2)
+{
+	if(s1 != s2){
+		std::printf(
+			"\n文字列が一致しませんでした\n"
+			"\t'%.*s' != '%.*s'\n",
+			static_cast<int>(s1.size()), s1.data(), static_cast<int>(s2.size()), s2.data()
+		);
+		return -1;
+	}
+	return 0;
+}
+
+static int check_assert_func(bool flag)
+{
+	if(!flag){
+		std::printf("\nassert失敗\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void test_string_init(void)
+{
+	unstr::string emp;
+	unstr::string str("unko");
+	std::string text("kusa");
+	unstr::string tmp(text);
+	std::string_view sv = str;
+	check_assert(emp.get() == nullptr);
+	check_assert(emp.empty());
+	check_int(emp.size(), 0);
+	check_view(emp, "");
+	check_view(str, "unko");
+	check_int(str.size(), 4);
+	check_assert(!str.empty());
+	check_assert(sv.data() == str.get()->data);
+	check_view(tmp, "kusa");
+	/* 途中に'\0'があっても長さで扱う */
+	tmp = std::string_view("un\0ko", 5);
+	check_int(tmp.size(), 5);
+	check_assert(std::memcmp(tmp.data(), "un\0ko", 5) == 0);
+	tmp.clear();
+	check_assert(tmp.empty());
+	check_assert(tmp.get() != nullptr);
+}
+
+static void test_string_move(void)
+{
+	unstr::string str("unko");
+	unstr::string tmp("kusa");
+	unstr_t *p = str.get();
+	/* ムーブはunstr_tごと移し、バッファをコピーしない */
+	unstr::string dst(std::move(str));
+	check_assert(dst.get() == p);
+	check_assert(str.get() == nullptr);
+	check_assert(str.empty());
+	tmp = std::move(dst);
+	check_assert(tmp.get() == p);
+	check_assert(dst.get() == nullptr);
+	check_view(tmp, "unko");
+	/* ムーブ元は空の文字列として使い続けられる */
+	str = "kokko";
+	check_view(str, "kokko");
+	swap(str, tmp);
+	check_view(str, "unko");
+	check_view(tmp, "kokko");
+}
+
+static void test_string_copy(void)
+{
+	unstr::string str("unko");
+	unstr::string emp;
+	unstr::string tmp(str);
+	unstr::string nul(emp);
+	check_view(tmp, "unko");
+	check_assert(tmp.get() != str.get());
+	check_assert(nul.get() == nullptr);
+	/* コピーへの書き込みは元に影響しない */
+	tmp += "kusa";
+	check_view(tmp, "unkokusa");
+	check_view(str, "unko");
+	str = tmp;
+	check_view(str, "unkokusa");
+	str = str;
+	check_view(str, "unkokusa");
+	check_assert(str == tmp);
+	check_assert(str == "unkokusa");
+	check_assert("unkokusa" == str);
+	check_assert(str != "unko");
+}
+
+static void test_string_adopt(void)
+{
+	unstr::string str = unstr::string::adopt(unstr_init("unko"));
+	unstr_t *p = 0;
+	check_view(str, "unko");
+	/* getで借りてC APIで書き換える */
+	check_assert(unstr_strcat_char(str.get(), "kusa") == UNSTRING_TRUE);
+	check_view(str, "unkokusa");
+	check_int(unstr_substr_count_char(str.get(), "k"), 2);
+	/* 手放した文字列はC APIで開放する */
+	p = str.release();
+	check_assert(str.get() == nullptr);
+	check_assert(unstr_strcmp_char(p, "unkokusa") == 0);
+	unstr_free(p);
+}
+
+static void test_string_append(void)
+{
+	unstr::string str;
+	std::string_view sv("unkokusaunko");
+	str.append(sv.substr(0, 4));
+	check_view(str, "unko");
+	str += sv.substr(4, 4);
+	check_view(str, "unkokusa");
+	check_assert(str.data()[str.size()] == '\0');
+	/* 自身の一部を追加する */
+	str.append(std::string_view(str).substr(0, 4));
+	check_view(str, "unkokusaunko");
+	str.assign(std::string_view(str).substr(4, 4));
+	check_view(str, "kusa");
+	str.append("");
+	check_view(str, "kusa");
+}
+
+static void test_string_find(void)
+{
+	unstr::string str("unkokkokussakusa");
+	unstr_stats_t before;
+	unstr_stats_t after;
+	std::string_view text("kusa,kokko");
+	check_int(str.find("kusa"), 12);
+	check_int(str.find(text.substr(5, 3)), 2);
+	check_int(str.find("k", 3), 4);
+	check_int(str.find("ko", 5), 5);
+	check_assert(str.find("kusak") == unstr::string::npos);
+	check_assert(str.find("ko", 100) == unstr::string::npos);
+	check_assert(str.find("") == unstr::string::npos);
+	check_int(str.count("k"), 5);
+	check_int(str.count(text.substr(0, 2)), 2);
+	check_int(str.count(""), 0);
+	check_assert(str.compare("unkokkokussakusa") == 0);
+	check_assert(str.compare("z") < 0);
+	/* string_viewは一時文字列を作らずにそのまま渡す */
+	if(unstr_stats_snapshot(&before)){
+		str.find(text.substr(0, 4));
+		str.count(text.substr(5, 5));
+		unstr_stats_snapshot(&after);
+		check_int(after.alloc_count, before.alloc_count);
+	}
+}
+
+static void test_string_substr(void)
+{
+	unstr::string str("unkokkokussakusa");
+	unstr::string tmp = str.substr(4, 4);
+	bool thrown = false;
+	check_view(tmp, "kkok");
+	check_view(str.substr(12), "kusa");
+	check_view(str.substr(16), "");
+	try {
+		str.substr(17);
+	} catch(const std::out_of_range &) {
+		thrown = true;
+	}
+	check_assert(thrown);
+	/* 元を変更・破棄しても部分文字列は変わらない */
+	str = "zzz";
+	check_view(tmp, "kkok");
+	tmp += "!";
+	check_view(tmp, "kkok!");
+}
+
+static void test_string_replace(void)
+{
+	unstr::string str("unkokkokussakusa");
+	unstr::string emp;
+	check_view(str.replace("kusa", "unko"), "unkokkokussaunko");
+	check_view(str.replace("k", ""), "unooussausa");
+	check_view(str.replace("", "unko"), "unkokkokussakusa");
+	check_view(str, "unkokkokussakusa");
+	check_view(emp.replace("k", "unko"), "");
+}
+
+/* string_view::findの結果と全位置で比べる */
+template<std::size_t M>
+static void check_searcher(const unstr::static_searcher<M> &s, std::string_view text)
+{
+	std::size_t pos = 0;
+	std::size_t n = 0;
+	std::size_t i = 0;
+	for(i = 0; i <= text.size() + 1; i++){
+		check_assert(s.find(text, i) == text.find(s.needle(), i));
+	}
+	while((pos = text.find(s.needle(), pos)) != std::string_view::npos){
+		n++;
+		pos++;
+	}
+	check_int(s.count(text), n);
+}
+
+static void test_searcher(void)
+{
+	static constexpr auto s1 = unstr::make_searcher("k");
+	static constexpr auto s2 = unstr::make_searcher("ko");
+	static constexpr auto s3 = unstr::make_searcher("kok");
+	static constexpr auto s4 = unstr::make_searcher("kusa");
+	static constexpr auto s5 = unstr::make_searcher("unkok");
+	static constexpr auto s8 = unstr::make_searcher("kusaunko");
+	static constexpr auto s9 = unstr::make_searcher("kokkokuss");
+	static constexpr auto s17 = unstr::make_searcher("unkokkokussakusak");
+	std::string text;
+	unstr_t *str = unstr_init("unkokkokussakusa");
+	/* 移動量表はコンパイル時に作られる */
+	static_assert(s4.shift('k') == 4);
+	static_assert(s4.shift('a') == 1);
+	static_assert(s4.shift('z') == 5);
+	static_assert(s1.needle() == "k");
+	/* SIMDの16バイト単位の境界と末尾の残りをまたぐように並べる */
+	while(text.size() < 200){
+		text += "unkokkokussakusa";
+		text += text.size() % 3 ? "kusaunko" : "k";
+	}
+	check_searcher(s1, text);
+	check_searcher(s2, text);
+	check_searcher(s3, text);
+	check_searcher(s4, text);
+	check_searcher(s5, text);
+	check_searcher(s8, text);
+	check_searcher(s9, text);
+	check_searcher(s17, text);
+	check_searcher(s4, "");
+	check_searcher(s4, "kus");
+	check_searcher(s17, std::string_view(text).substr(0, 17));
+	/* '\0'を含んでも長さで扱う */
+	text.assign(40, '\0');
+	text += "kusa";
+	check_searcher(s4, text);
+	check_int(s4.find(text), 40);
+	/* unstr_tとunstr::stringから検索する */
+	check_int(s4.find(str), 12);
+	check_int(s2.count(str), 2);
+	check_assert(s17.find(str) == unstr::static_searcher<17>::npos);
+	check_assert(s4.find(static_cast<const unstr_t *>(nullptr)) == unstr::static_searcher<4>::npos);
+	check_int(s1.count(static_cast<const unstr_t *>(nullptr)), 0);
+	check_int(s9.find(unstr::string("unkokkokussakusa")), 2);
+	unstr_free(str);
+}
+
+static void test_searcher_template(void)
+{
+#if defined(__cpp_nontype_template_args) && (__cpp_nontype_template_args >= 201911L)
+	unstr_t *str = unstr_init("unkokkokussakusa");
+	static_assert(unstr::searcher<"kusa">::value.shift('u') == 3);
+	check_int(unstr::searcher<"kusa">::find("unkokkokussakusa"), 12);
+	check_int(unstr::searcher<"kok">::find(str), 2);
+	check_int(unstr::searcher<"kok">::find(str, 3), 5);
+	check_int(unstr::searcher<"k">::count(str), 5);
+	check_int(unstr::searcher<"kok">::count("kokokok"), 3);
+	check_assert(unstr::searcher<"kusak">::find(str) == unstr::static_searcher<5>::npos);
+	unstr_free(str);
+#endif
+}
+
+static void test_string_concat(void)
+{
+	unstr::string a("unko");
+	unstr::string b("kusa");
+	unstr::string emp;
+	std::string text("kokko");
+	unstr::string str = a + b + "," + text + std::string_view("!?", 1) + emp;
+	unstr_stats_t before;
+	unstr_stats_t after;
+	unstr_stats_t base;
+	check_view(str, "unkokusa,kokko!");
+	check_assert(str.data()[str.size()] == '\0');
+	/* 括弧で組んだ式同士も連結できる */
+	str = (a + b) + (emp + b + a);
+	check_view(str, "unkokusakusaunko");
+	str += "," + a + (b + "!");
+	check_view(str, "unkokusakusaunko,unkokusa!");
+	emp += a + b;
+	check_view(emp, "unkokusa");
+	str = emp + "";
+	check_view(str, "unkokusa");
+	/* 評価時の確保は1度だけで、再確保はしない */
+	if(unstr_stats_snapshot(&base)){
+		unstr_free_func(unstr_init_memory(10));
+		unstr_stats_snapshot(&before);
+		{
+			unstr::string tmp = a + b + a + b + a + b + a + b;
+			check_view(tmp, "unkokusaunkokusaunkokusaunkokusa");
+		}
+		unstr_stats_snapshot(&after);
+		check_int(after.alloc_count - before.alloc_count, before.alloc_count - base.alloc_count);
+		check_int(after.realloc_count, before.realloc_count);
+		/* 容量が足りない追加でも拡張は1度だけ */
+		unstr_stats_snapshot(&before);
+		str += a + b + a + b + a + b + a + b + a + b + a + b;
+		unstr_stats_snapshot(&after);
+		check_assert((after.alloc_count + after.realloc_count) - (before.alloc_count + before.realloc_count) <= 1);
+		check_int(str.size(), 8 + 48);
+	}
+}
+
+static void test_string_concat_alias(void)
+{
+	unstr::string str("unko");
+	unstr::string sub;
+	/* 自身を参照する式は拡張や上書きで壊れない */
+	str += str + "," + str;
+	check_view(str, "unkounko,unko");
+	str = "[" + str + "]";
+	check_view(str, "[unkounko,unko]");
+	str = std::string_view(str).substr(1, 4) + str;
+	check_view(str, "unko[unkounko,unko]");
+	/* 部分文字列(UNSTRING_ENABLE_COWではバッファを共有する)への連結 */
+	sub = str.substr(5, 8);
+	sub += sub + str;
+	check_view(sub, "unkounkounkounkounko[unkounko,unko]");
+	check_view(str, "unko[unkounko,unko]");
+	str = unstr::string("kusa").substr(1, 2);
+	str += str + str;
+	check_view(str, "ususus");
+}
+
+static void test_keyword_set(void)
+{
+	static constexpr auto keywords = unstr::make_keywords(
+		"auto", "break", "case", "char", "const", "continue", "default", "do",
+		"double", "else", "enum", "extern", "float", "for", "goto", "if",
+		"inline", "int", "long", "register", "restrict", "return", "short", "signed",
+		"sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void",
+		"volatile", "while", "_Bool", "_Complex", "_Imaginary", ""
+	);
+	static constexpr auto one = unstr::make_keywords("unko");
+	unstr_t *text = unstr_init("static int unko void return sizeof long");
+	unstr_t *token = nullptr;
+	std::size_t n = 0;
+	std::size_t i = 0;
+	/* 照合もコンパイル時にできる */
+	static_assert(keywords.find("while") == 33);
+	static_assert(keywords.find("whil") == keywords.npos);
+	check_int(keywords.size(), 38);
+	for(i = 0; i < keywords.size(); i++){
+		check_int(keywords.find(keywords[i]), i);
+		check_assert(keywords.find(std::string(keywords[i]) + "x") == keywords.npos);
+	}
+	check_view(keywords[9], "else");
+	check_int(keywords.find(""), 37);
+	check_assert(keywords.find("Auto") == keywords.npos);
+	check_assert(keywords.find(std::string_view("if\0", 3)) == keywords.npos);
+	check_int(one.find("unko"), 0);
+	check_assert(one.find("kusa") == one.npos);
+	/* unstr_strtokで切り出した語を照合する */
+	while((token = unstr_strtok(text, " ", &n)) != nullptr){
+		if(keywords.find(token) != keywords.npos){
+			i++;
+		}
+		unstr_free(token);
+	}
+	check_int(i, 38 + 6);
+	check_assert(keywords.find(static_cast<const unstr_t *>(nullptr)) == 37);
+	unstr_free(text);
+}